@@ -0,0 +1,193 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include <sksExceptionMacro.h>
+#include <sksDotDetection.h>
+#include <opencv2/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+
+/**
+* \brief Reads a rows x cols matrix of whitespace separated numbers.
+*/
+cv::Mat LoadMatrix(const std::string& fileName, const int rows, const int cols)
+{
+  std::ifstream file(fileName.c_str());
+  cv::Mat matrix(rows, cols, CV_64FC1);
+  for (int r = 0; r < rows; r++)
+  {
+    for (int c = 0; c < cols; c++)
+    {
+      file >> matrix.at<double>(r, c);
+    }
+  }
+  if (!file)
+  {
+    sksExceptionThrow() << "Failed to read " << rows << "x" << cols << " matrix from " << fileName;
+  }
+  return matrix;
+}
+
+
+/**
+* \brief The 25 x 18 grid of dots, at 5mm spacing, in Testing/Data/calib-ucl-circles.
+*/
+cv::Mat CreateGridPoints()
+{
+  cv::Mat gridPoints = cv::Mat::zeros(18 * 25, 6, CV_64FC1);
+  int counter = 0;
+  for (int y = 0; y < 18; y++)
+  {
+    for (int x = 0; x < 25; x++)
+    {
+      gridPoints.at<double>(counter, 0) = counter;
+      gridPoints.at<double>(counter, 1) = (x + 1) * 50;
+      gridPoints.at<double>(counter, 2) = (y + 1) * 50;
+      gridPoints.at<double>(counter, 3) = x * 5;
+      gridPoints.at<double>(counter, 4) = y * 5;
+      counter++;
+    }
+  }
+  return gridPoints;
+}
+
+
+/**
+* \brief Times one detector on one image, returning seconds per image.
+*/
+double Benchmark(sks::DotDetector& detector,
+                 const cv::Mat& image,
+                 const int numberOfIterations,
+                 cv::Mat& points)
+{
+  // The first call allocates, so is not timed.
+  detector.detect(image, points);
+
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfIterations; i++)
+  {
+    detector.detect(image, points);
+  }
+  double seconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+  return seconds / numberOfIterations;
+}
+
+
+/**
+ * \brief Compares speed, and agreement, of two-pass and single-pass sks::DotDetector, on images of dots.
+ */
+int main(int argc, char** argv)
+{
+  int returnStatus = EXIT_FAILURE;
+
+  if (argc < 5)
+  {
+    std::cerr << "Usage: sksDotDetectionBenchmark intrinsics.txt distortion.txt iterations image.png [image.png ...]" << std::endl;
+    return returnStatus;
+  }
+
+  try
+  {
+    cv::Mat intrinsicMatrix = LoadMatrix(argv[1], 3, 3);
+    cv::Mat distortionCoefficients = LoadMatrix(argv[2], 1, 5);
+    int numberOfIterations = std::max(1, atoi(argv[3]));
+    cv::Mat gridPoints = CreateGridPoints();
+    cv::Mat referencePoints = (cv::Mat_<int>(4, 1) << 133, 141, 308, 316);
+
+    sks::DotDetectorParameters singlePassParameters;
+    singlePassParameters.isSinglePass = true;
+
+    double totalTwoPassSeconds = 0;
+    double totalSinglePassSeconds = 0;
+
+    for (int a = 4; a < argc; a++)
+    {
+      cv::Mat image = cv::imread(argv[a]);
+      if (image.empty())
+      {
+        sksExceptionThrow() << "Failed to read " << argv[a];
+      }
+      cv::Mat greyscaleImage;
+      cv::cvtColor(image, greyscaleImage, cv::COLOR_BGR2GRAY);
+
+      sks::DotDetector twoPass(intrinsicMatrix, distortionCoefficients, gridPoints, referencePoints,
+                               greyscaleImage.cols, greyscaleImage.rows);
+      sks::DotDetector singlePass(intrinsicMatrix, distortionCoefficients, gridPoints, referencePoints,
+                                  greyscaleImage.cols, greyscaleImage.rows, singlePassParameters);
+
+      cv::Mat twoPassPoints;
+      cv::Mat singlePassPoints;
+      double twoPassSeconds = Benchmark(twoPass, greyscaleImage, numberOfIterations, twoPassPoints);
+      double singlePassSeconds = Benchmark(singlePass, greyscaleImage, numberOfIterations, singlePassPoints);
+      totalTwoPassSeconds += twoPassSeconds;
+      totalSinglePassSeconds += singlePassSeconds;
+
+      // Agreement, on dots both modes labelled with the same grid point.
+      std::map<int, cv::Point2d> twoPassById;
+      for (int i = 0; i < twoPassPoints.rows; i++)
+      {
+        twoPassById[static_cast<int>(twoPassPoints.at<double>(i, 0))]
+          = cv::Point2d(twoPassPoints.at<double>(i, 1), twoPassPoints.at<double>(i, 2));
+      }
+      int numberInCommon = 0;
+      double maximumDistance = 0;
+      for (int i = 0; i < singlePassPoints.rows; i++)
+      {
+        std::map<int, cv::Point2d>::const_iterator iter
+          = twoPassById.find(static_cast<int>(singlePassPoints.at<double>(i, 0)));
+        if (iter != twoPassById.end())
+        {
+          cv::Point2d difference = iter->second
+            - cv::Point2d(singlePassPoints.at<double>(i, 1), singlePassPoints.at<double>(i, 2));
+          maximumDistance = std::max(maximumDistance, std::sqrt(difference.dot(difference)));
+          numberInCommon++;
+        }
+      }
+
+      std::cout << argv[a]
+                << ": two-pass dots=" << twoPassPoints.rows
+                << ", ms=" << twoPassSeconds * 1000
+                << ", single-pass dots=" << singlePassPoints.rows
+                << ", ms=" << singlePassSeconds * 1000
+                << ", speed up=" << twoPassSeconds / singlePassSeconds
+                << ", common ids=" << numberInCommon
+                << ", max distance=" << maximumDistance
+                << std::endl;
+    }
+
+    std::cout << "Overall: two-pass ms/image=" << totalTwoPassSeconds * 1000 / (argc - 4)
+              << ", single-pass ms/image=" << totalSinglePassSeconds * 1000 / (argc - 4)
+              << ", speed up=" << totalTwoPassSeconds / totalSinglePassSeconds
+              << std::endl;
+
+    returnStatus = EXIT_SUCCESS;
+  }
+  catch (sks::Exception& e)
+  {
+    std::cerr << "Caught sks::Exception: " << e.GetDescription() << std::endl;
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Caught std::exception: " << e.what() << std::endl;
+  }
+
+  return returnStatus;
+}
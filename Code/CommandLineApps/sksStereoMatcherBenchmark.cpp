@@ -0,0 +1,133 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include <sksExceptionMacro.h>
+#include <sksStereoMatcher.h>
+#include <opencv2/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+
+/**
+* \brief Reads a rows x cols matrix of whitespace separated numbers.
+*/
+cv::Mat LoadMatrix(const std::string& fileName, const int rows, const int cols)
+{
+  std::ifstream file(fileName.c_str());
+  cv::Mat matrix(rows, cols, CV_64FC1);
+  for (int r = 0; r < rows; r++)
+  {
+    for (int c = 0; c < cols; c++)
+    {
+      file >> matrix.at<double>(r, c);
+    }
+  }
+  if (!file)
+  {
+    sksExceptionThrow() << "Failed to read " << rows << "x" << cols << " matrix from " << fileName;
+  }
+  return matrix;
+}
+
+
+/**
+* \brief Times one matcher, and prints throughput and density.
+*/
+void Benchmark(const std::string& name,
+               sks::StereoMatcher& matcher,
+               const cv::Mat& leftImage,
+               const cv::Mat& rightImage,
+               const int numberOfIterations)
+{
+  cv::Mat matchedPoints;
+
+  // The first call allocates, so is not timed.
+  matcher.matchPoints(leftImage, rightImage, matchedPoints);
+
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfIterations; i++)
+  {
+    matcher.matchPoints(leftImage, rightImage, matchedPoints);
+  }
+  double seconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+  double secondsPerFrame = seconds / numberOfIterations;
+
+  std::cout << name
+            << ": matches=" << matchedPoints.rows
+            << ", density=" << static_cast<double>(matchedPoints.rows) / leftImage.total()
+            << ", ms/frame=" << secondsPerFrame * 1000
+            << ", fps=" << 1.0 / secondsPerFrame
+            << ", matches/s=" << matchedPoints.rows / secondsPerFrame
+            << std::endl;
+}
+
+
+/**
+ * \brief Compares throughput and density of each sks::StereoMatcher, on one pair of undistorted images.
+ */
+int main(int argc, char** argv)
+{
+  int returnStatus = EXIT_FAILURE;
+
+  if (argc < 6)
+  {
+    std::cerr << "Usage: sksStereoMatcherBenchmark left.png right.png left.intrinsic.txt right.intrinsic.txt l2r.4x4 [iterations]" << std::endl;
+    return returnStatus;
+  }
+
+  try
+  {
+    cv::Mat leftImage = cv::imread(argv[1]);
+    cv::Mat rightImage = cv::imread(argv[2]);
+    cv::Mat leftCameraMatrix = LoadMatrix(argv[3], 3, 3);
+    cv::Mat rightCameraMatrix = LoadMatrix(argv[4], 3, 3);
+    cv::Mat leftToRight = LoadMatrix(argv[5], 4, 4);
+    int numberOfIterations = argc > 6 ? std::max(1, atoi(argv[6])) : 10;
+
+    sks::StereoRig rig(leftCameraMatrix,
+                       rightCameraMatrix,
+                       leftToRight(cv::Rect(0, 0, 3, 3)).clone(),
+                       leftToRight(cv::Rect(3, 0, 1, 3)).clone());
+
+    std::cout << "Images=" << leftImage.cols << "x" << leftImage.rows
+              << ", iterations=" << numberOfIterations << std::endl;
+
+    sks::StoyanovStereoMatcher stoyanov;
+    Benchmark("Stoyanov", stoyanov, leftImage, rightImage, numberOfIterations);
+
+    sks::RectifiedStereoMatcher blockMatching(rig, leftImage.cols, leftImage.rows, false);
+    Benchmark("StereoBM", blockMatching, leftImage, rightImage, numberOfIterations);
+
+    sks::RectifiedStereoMatcher semiGlobal(rig, leftImage.cols, leftImage.rows, true);
+    Benchmark("StereoSGBM", semiGlobal, leftImage, rightImage, numberOfIterations);
+
+    sks::FeatureStereoMatcher features;
+    Benchmark("ORB", features, leftImage, rightImage, numberOfIterations);
+
+    returnStatus = EXIT_SUCCESS;
+  }
+  catch (sks::Exception& e)
+  {
+    std::cerr << "Caught sks::Exception: " << e.GetDescription() << std::endl;
+  }
+  catch (std::exception& e)
+  {
+    std::cerr << "Caught std::exception: " << e.what() << std::endl;
+  }
+
+  return returnStatus;
+}
@@ -0,0 +1,347 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksAdaptiveThreshold.h"
+#include "sksBuffers.h"
+#include "sksExceptionMacro.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <algorithm>
+#include <limits>
+#include <vector>
+
+namespace sks
+{
+
+//-----------------------------------------------------------------------------
+void InternalValidateThresholdInputs(const cv::Mat& image, const int windowSize)
+{
+  if (image.empty())
+  {
+    sksExceptionThrow() << "Image is empty.";
+  }
+  if (image.type() != CV_8UC1)
+  {
+    sksExceptionThrow() << "Image should be CV_8UC1, not type " << image.type();
+  }
+  if (windowSize < 3 || windowSize % 2 == 0)
+  {
+    sksExceptionThrow() << "Window size should be odd and > 1, not " << windowSize;
+  }
+
+  // Largest values are 2 * 511 * area in the comparison, and 255 * windowSize * rows in the column sums.
+  double area = static_cast<double>(windowSize) * windowSize;
+  double maximumColumnSum = 255.0 * windowSize * (image.rows + windowSize);
+  if (1022.0 * area > std::numeric_limits<int>::max()
+      || maximumColumnSum > std::numeric_limits<int>::max())
+  {
+    sksExceptionThrow() << "Window size " << windowSize << " is too big for 32 bit sums, on "
+                        << image.cols << "x" << image.rows << " images.";
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Sums each pixel's window along the row, with replicated borders, in O(cols) whatever the radius.
+*/
+void InternalBoxSumRow(const unsigned char* row, const int cols, const int radius, int* sums)
+{
+  int sum = 0;
+  for (int k = -radius; k <= radius; k++)
+  {
+    sum += row[std::min(std::max(k, 0), cols - 1)];
+  }
+  sums[0] = sum;
+
+  for (int c = 1; c < cols; c++)
+  {
+    sum += row[std::min(c + radius, cols - 1)] - row[std::max(c - radius - 1, 0)];
+    sums[c] = sum;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief One row of cv::GaussianBlur(image, blurred, cv::Size(5, 5), 0), using its fixed point arithmetic.
+*
+* The kernel is [1 4 6 4 1] / 16 in each direction, so all sums fit in 16 bits,
+* and the result is rounded half up, as OpenCV does for 8 bit images. Borders
+* are reflected, as cv::BORDER_REFLECT_101, the cv::GaussianBlur default.
+*
+* \param columnSums per thread buffer, of cols + 4
+*/
+void InternalGaussianBlurRow(const cv::Mat& image, const int row, unsigned short* columnSums, unsigned char* blurred)
+{
+  const int cols = image.cols;
+  const unsigned char* p0 = image.ptr<unsigned char>(cv::borderInterpolate(row - 2, image.rows, cv::BORDER_REFLECT_101));
+  const unsigned char* p1 = image.ptr<unsigned char>(cv::borderInterpolate(row - 1, image.rows, cv::BORDER_REFLECT_101));
+  const unsigned char* p2 = image.ptr<unsigned char>(row);
+  const unsigned char* p3 = image.ptr<unsigned char>(cv::borderInterpolate(row + 1, image.rows, cv::BORDER_REFLECT_101));
+  const unsigned char* p4 = image.ptr<unsigned char>(cv::borderInterpolate(row + 2, image.rows, cv::BORDER_REFLECT_101));
+
+  // Two spare values either side, for the horizontal border.
+  unsigned short* v = columnSums + 2;
+  int c = 0;
+
+#if CV_SIMD
+  const int lanes = cv::v_uint16::nlanes;
+  cv::v_uint16 four = cv::vx_setall_u16(4);
+  cv::v_uint16 six = cv::vx_setall_u16(6);
+
+  for (; c <= cols - lanes; c += lanes)
+  {
+    cv::v_uint16 sum = cv::vx_load_expand(p0 + c) + cv::vx_load_expand(p4 + c)
+                     + (cv::vx_load_expand(p1 + c) + cv::vx_load_expand(p3 + c)) * four
+                     + cv::vx_load_expand(p2 + c) * six;
+    cv::v_store(v + c, sum);
+  }
+#endif
+
+  for (; c < cols; c++)
+  {
+    v[c] = static_cast<unsigned short>(p0[c] + p4[c] + 4 * (p1[c] + p3[c]) + 6 * p2[c]);
+  }
+
+  for (int k = 1; k <= 2; k++)
+  {
+    v[-k] = v[cv::borderInterpolate(-k, cols, cv::BORDER_REFLECT_101)];
+    v[cols - 1 + k] = v[cv::borderInterpolate(cols - 1 + k, cols, cv::BORDER_REFLECT_101)];
+  }
+
+  c = 0;
+
+#if CV_SIMD
+  cv::v_uint16 half = cv::vx_setall_u16(128);
+
+  for (; c <= cols - lanes; c += lanes)
+  {
+    cv::v_uint16 sum = cv::vx_load(v + c - 2) + cv::vx_load(v + c + 2)
+                     + (cv::vx_load(v + c - 1) + cv::vx_load(v + c + 1)) * four
+                     + cv::vx_load(v + c) * six + half;
+    cv::v_pack_store(blurred + c, sum >> 8);
+  }
+#endif
+
+  for (; c < cols; c++)
+  {
+    blurred[c] = static_cast<unsigned char>((v[c - 2] + v[c + 2] + 4 * (v[c - 1] + v[c + 1]) + 6 * v[c] + 128) >> 8);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Thresholds one row, given the cumulative column sums of the row window sums.
+*
+* The window sum is bottom - top, plus the first and last rows' sums, repeated
+* for the parts of the window that are above or below the image. Then, with
+* no rounding ties possible for odd windows, pixel + offset > round(sum / area)
+* is the same as 2 * sum + area < 2 * area * (pixel + offset), in integers.
+*/
+void InternalThresholdRow(const unsigned char* image, const int cols,
+                          const int* bottom, const int* top,
+                          const int* firstRow, const int* lastRow, const int* beforeLastRow,
+                          const int numberAbove, const int numberBelow,
+                          const int area, const int offset, const unsigned char maxValue,
+                          unsigned char* thresholded)
+{
+  const int twiceArea = 2 * area;
+  int c = 0;
+
+#if CV_SIMD
+  const int lanes = cv::v_uint8::nlanes;
+  const int quarter = cv::v_int32::nlanes;
+  cv::v_int32 numberAboveV = cv::vx_setall_s32(numberAbove);
+  cv::v_int32 numberBelowV = cv::vx_setall_s32(numberBelow);
+  cv::v_int32 areaV = cv::vx_setall_s32(area);
+  cv::v_int32 twiceAreaV = cv::vx_setall_s32(twiceArea);
+  cv::v_int32 offsetV = cv::vx_setall_s32(offset);
+  cv::v_int32 maxValueV = cv::vx_setall_s32(maxValue);
+
+  for (; c <= cols - lanes; c += lanes)
+  {
+    cv::v_uint16 pixels16[2];
+    cv::v_uint32 pixels32[4];
+    cv::v_expand(cv::vx_load(image + c), pixels16[0], pixels16[1]);
+    cv::v_expand(pixels16[0], pixels32[0], pixels32[1]);
+    cv::v_expand(pixels16[1], pixels32[2], pixels32[3]);
+
+    cv::v_int32 result[4];
+    for (int j = 0; j < 4; j++)
+    {
+      int k = c + j * quarter;
+      cv::v_int32 sum = cv::vx_load(bottom + k) - cv::vx_load(top + k)
+                      + numberAboveV * cv::vx_load(firstRow + k)
+                      + numberBelowV * (cv::vx_load(lastRow + k) - cv::vx_load(beforeLastRow + k));
+      cv::v_int32 threshold = (cv::v_reinterpret_as_s32(pixels32[j]) + offsetV) * twiceAreaV;
+      result[j] = (sum + sum + areaV < threshold) & maxValueV;
+    }
+    cv::v_store(thresholded + c, cv::v_pack_u(cv::v_pack(result[0], result[1]),
+                                              cv::v_pack(result[2], result[3])));
+  }
+#endif
+
+  for (; c < cols; c++)
+  {
+    int sum = bottom[c] - top[c]
+            + numberAbove * firstRow[c]
+            + numberBelow * (lastRow[c] - beforeLastRow[c]);
+    thresholded[c] = 2 * sum + area < twiceArea * (image[c] + offset) ? maxValue : 0;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Given the row window sums in rows 1 to image.rows of workspace, thresholds image.
+*/
+void InternalThresholdFromRowSums(const cv::Mat& image,
+                                  const double maxValue,
+                                  const int windowSize,
+                                  const double offset,
+                                  cv::Mat& workspace,
+                                  cv::Mat& thresholdedImage)
+{
+  const int rows = image.rows;
+  const int cols = image.cols;
+  const int radius = windowSize / 2;
+  const int area = windowSize * windowSize;
+
+  // As cv::adaptiveThreshold, where beyond +/-256 every pixel is on, or off, anyway.
+  const int integerOffset = std::min(std::max(cvCeil(offset), -256), 256);
+  const unsigned char integerMaxValue = cv::saturate_cast<unsigned char>(maxValue);
+
+  // Cumulative sums down each column, in strips, so each thread has its own columns.
+  workspace.row(0).setTo(0);
+  const int stripWidth = 256;
+  const int numberOfStrips = (cols + stripWidth - 1) / stripWidth;
+
+  #pragma omp parallel for
+  for (int s = 0; s < numberOfStrips; s++)
+  {
+    int start = s * stripWidth;
+    int end = std::min(start + stripWidth, cols);
+
+    for (int r = 1; r <= rows; r++)
+    {
+      const int* previous = workspace.ptr<int>(r - 1);
+      int* current = workspace.ptr<int>(r);
+      int c = start;
+
+#if CV_SIMD
+      const int lanes = cv::v_int32::nlanes;
+      for (; c <= end - lanes; c += lanes)
+      {
+        cv::v_store(current + c, cv::vx_load(current + c) + cv::vx_load(previous + c));
+      }
+#endif
+
+      for (; c < end; c++)
+      {
+        current[c] += previous[c];
+      }
+    }
+  }
+
+  sks::PrepareOutputBuffer(rows, cols, CV_8UC1, thresholdedImage);
+
+  #pragma omp parallel for
+  for (int r = 0; r < rows; r++)
+  {
+    int top = std::max(r - radius, 0);
+    int bottom = std::min(r + radius + 1, rows);
+
+    sks::InternalThresholdRow(image.ptr<unsigned char>(r), cols,
+                              workspace.ptr<int>(bottom),
+                              workspace.ptr<int>(top),
+                              workspace.ptr<int>(1),
+                              workspace.ptr<int>(rows),
+                              workspace.ptr<int>(rows - 1),
+                              std::max(radius - r, 0),
+                              std::max(r + radius + 1 - rows, 0),
+                              area,
+                              integerOffset,
+                              integerMaxValue,
+                              thresholdedImage.ptr<unsigned char>(r));
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void AdaptiveMeanThreshold(const cv::Mat& image,
+                           const double maxValue,
+                           const int windowSize,
+                           const double offset,
+                           cv::Mat& thresholdedImage,
+                           cv::Mat& workspace)
+{
+  sks::InternalValidateThresholdInputs(image, windowSize);
+  sks::PrepareOutputBuffer(image.rows + 1, image.cols, CV_32SC1, workspace);
+
+  const int radius = windowSize / 2;
+
+  #pragma omp parallel for
+  for (int r = 0; r < image.rows; r++)
+  {
+    sks::InternalBoxSumRow(image.ptr<unsigned char>(r), image.cols, radius, workspace.ptr<int>(r + 1));
+  }
+
+  sks::InternalThresholdFromRowSums(image, maxValue, windowSize, offset, workspace, thresholdedImage);
+}
+
+
+//-----------------------------------------------------------------------------
+void BlurAndAdaptiveMeanThreshold(const cv::Mat& image,
+                                  const double maxValue,
+                                  const int windowSize,
+                                  const double offset,
+                                  cv::Mat& blurredImage,
+                                  cv::Mat& thresholdedImage,
+                                  cv::Mat& workspace)
+{
+  sks::InternalValidateThresholdInputs(image, windowSize);
+  if (&blurredImage == &image || (blurredImage.data != nullptr && blurredImage.data == image.data))
+  {
+    sksExceptionThrow() << "Blurred image should be distinct from the input image.";
+  }
+
+  sks::PrepareOutputBuffer(image.rows, image.cols, CV_8UC1, blurredImage);
+  sks::PrepareOutputBuffer(image.rows + 1, image.cols, CV_32SC1, workspace);
+
+  const int radius = windowSize / 2;
+
+  #pragma omp parallel
+  {
+    // Per thread, so nothing is allocated per row.
+    std::vector<unsigned short> columnSums(image.cols + 4);
+
+    #pragma omp for
+    for (int r = 0; r < image.rows; r++)
+    {
+      unsigned char* blurredRow = blurredImage.ptr<unsigned char>(r);
+      sks::InternalGaussianBlurRow(image, r, columnSums.data(), blurredRow);
+      sks::InternalBoxSumRow(blurredRow, image.cols, radius, workspace.ptr<int>(r + 1));
+    }
+  }
+
+  sks::InternalThresholdFromRowSums(blurredImage, maxValue, windowSize, offset, workspace, thresholdedImage);
+}
+
+} // end namespace
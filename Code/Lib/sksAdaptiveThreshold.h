@@ -0,0 +1,81 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksAdaptiveThreshold_h
+#define sksAdaptiveThreshold_h
+
+#include <opencv2/core.hpp>
+#include "sksWin32ExportHeader.h"
+
+/**
+* \file sksAdaptiveThreshold.h
+* \brief Thresholding against the local mean, whose cost does not depend on the window size.
+*
+* The window sums come from running sums along each row, then cumulative
+* sums down each column, so each pixel costs the same for a 3x3 window as
+* for a 301x301 one. Rows are done in parallel, and pixels within a row in
+* SIMD registers, where OpenCV was built with them.
+*
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+ * \brief Binary threshold against the mean of each pixel's window, like cv::adaptiveThreshold,
+ * with cv::ADAPTIVE_THRESH_MEAN_C and cv::THRESH_BINARY.
+ *
+ * Pixels brighter than the rounded window mean, minus offset, are set to
+ * maxValue, and the rest to 0. As in cv::adaptiveThreshold, the window is
+ * extended past the image edges by replicating the edge pixels. The window
+ * sums are exact integers, so results match cv::adaptiveThreshold, except
+ * possibly for windows of 15x15 or smaller, where OpenCV rounds the mean
+ * using fixed point arithmetic.
+ *
+ * \param image CV_8UC1 image
+ * \param maxValue value given to pixels above the threshold
+ * \param windowSize odd, and > 1, width and height of the window
+ * \param offset subtracted from the mean, to give the threshold
+ * \param thresholdedImage CV_8UC1 output, reusing its memory where possible. Can be image itself.
+ * \param workspace CV_32SC1 window sums, reusing its memory where possible, so pass the same one each frame.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void AdaptiveMeanThreshold(const cv::Mat& image,
+                                                                     const double maxValue,
+                                                                     const int windowSize,
+                                                                     const double offset,
+                                                                     cv::Mat& thresholdedImage,
+                                                                     cv::Mat& workspace);
+
+/**
+ * \brief As cv::GaussianBlur(image, blurredImage, cv::Size(5, 5), 0), then sks::AdaptiveMeanThreshold of blurredImage.
+ *
+ * Each row is blurred, and its window sums computed, while it is still in
+ * cache, so the blurred image is written once and read once. The blur uses
+ * the same fixed point arithmetic as OpenCV, so blurredImage matches
+ * cv::GaussianBlur.
+ *
+ * \param blurredImage CV_8UC1 output, reusing its memory where possible. Must not be image itself.
+ * \see sks::AdaptiveMeanThreshold for the other parameters
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void BlurAndAdaptiveMeanThreshold(const cv::Mat& image,
+                                                                            const double maxValue,
+                                                                            const int windowSize,
+                                                                            const double offset,
+                                                                            cv::Mat& blurredImage,
+                                                                            cv::Mat& thresholdedImage,
+                                                                            cv::Mat& workspace);
+
+} // end namespace
+
+#endif
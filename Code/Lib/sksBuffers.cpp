@@ -0,0 +1,49 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+
+#include "sksBuffers.h"
+
+namespace sks
+{
+
+//-----------------------------------------------------------------------------
+void PrepareOutputBuffer(const int& rows,
+                         const int& cols,
+                         const int& type,
+                         cv::Mat& buffer)
+{
+  if (buffer.rows == rows && buffer.cols == cols && buffer.type() == type)
+  {
+    return;
+  }
+
+  if (   buffer.data != nullptr
+      && buffer.dims == 2
+      && buffer.cols == cols
+      && buffer.type() == type
+      && (rows <= buffer.rows || !buffer.isSubmatrix())
+     )
+  {
+    // Only allocates if rows exceeds the capacity of the current buffer.
+    // Growing a view would copy it to new memory, so we only shrink views.
+    buffer.resize(rows);
+  }
+  else
+  {
+    buffer.create(rows, cols, type);
+  }
+}
+
+} // end namespace
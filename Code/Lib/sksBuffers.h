@@ -0,0 +1,54 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+
+#ifndef sksBuffers_h
+#define sksBuffers_h
+
+#include <opencv2/core.hpp>
+#include "sksWin32ExportHeader.h"
+
+/**
+* \file sksBuffers.h
+* \brief Functions to reuse caller owned output matrices, e.g. from one video frame to the next.
+* \ingroup utilities
+*/
+namespace sks
+{
+
+/**
+* \brief Makes buffer a [rows x cols] matrix of the given type, reusing its memory if possible.
+*
+* If buffer already has the right number of columns and type, and enough
+* capacity, it is resized in place, (see cv::Mat::resize), so a buffer that is
+* reused every frame stops allocating once it has reached its largest size.
+* Otherwise cv::Mat::create is called, which allocates.
+*
+* If buffer is a view, such as some columns of a bigger matrix, with the
+* right number of columns and type, and at least as many rows as required,
+* it still refers to the bigger matrix afterwards, so is written in place.
+*
+* \param rows number of rows required
+* \param cols number of columns required
+* \param type OpenCV type, e.g. CV_64FC1
+* \param buffer matrix to reuse
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void PrepareOutputBuffer(const int& rows,
+                                                                   const int& cols,
+                                                                   const int& type,
+                                                                   cv::Mat& buffer);
+
+} // end namespace
+
+#endif
@@ -13,8 +13,11 @@
 =============================================================================*/
 
 #include "sksDotDetection.h"
+#include "sksAdaptiveThreshold.h"
+#include "sksBuffers.h"
+#include "sksValidate.h"
+#include "sksExceptionMacro.h"
 #include <opencv2/imgproc/imgproc.hpp>
-#include <opencv2/features2d.hpp>
 #include <opencv2/calib3d.hpp>
 #include <opencv2/core/types.hpp>
 #include <iostream>
@@ -71,214 +74,406 @@ struct KeyPointSorter
 };
 
 //-----------------------------------------------------------------------------
-cv::Mat ExtractDots(
-  const cv::Mat& distortedImage,
-  const cv::Mat& intrinsicMatrix,
-  const cv::Mat& distortionCoefficients,
-  const cv::Mat& gridPoints,
-  const cv::Mat& indexesOfFourReferencePoints
-  )
+DotDetectorParameters::DotDetectorParameters()
+: windowSize(151)
+, offset(20)
+, minimumArea(50)
+, maximumArea(50000)
+, maximumRMSError(10)
+, isSinglePass(false)
+, useMomentCentroids(false)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+DotDetector::DotDetector(const cv::Mat& intrinsicMatrix,
+                         const cv::Mat& distortionCoefficients,
+                         const cv::Mat& gridPoints,
+                         const cv::Mat& indexesOfFourReferencePoints,
+                         const int imageWidth,
+                         const int imageHeight,
+                         const DotDetectorParameters& parameters)
+: m_ImageSize(imageWidth, imageHeight)
+, m_Parameters(parameters)
+{
+  if (intrinsicMatrix.rows != 3 || intrinsicMatrix.cols != 3)
+  {
+    sksExceptionThrow() << "Intrinsic matrix should be 3x3, not "
+                        << intrinsicMatrix.rows << "x" << intrinsicMatrix.cols;
+  }
+  sks::ValidateDistortionCoefficients(distortionCoefficients);
+  if (gridPoints.rows < 1 || gridPoints.cols != 6)
+  {
+    sksExceptionThrow() << "Grid points should be Nx6, not "
+                        << gridPoints.rows << "x" << gridPoints.cols;
+  }
+  if (indexesOfFourReferencePoints.total() != 4)
+  {
+    sksExceptionThrow() << "There should be exactly 4 reference point indexes, not "
+                        << indexesOfFourReferencePoints.total();
+  }
+  if (imageWidth < 1 || imageHeight < 1)
+  {
+    sksExceptionThrow() << "Image size should be positive, not " << m_ImageSize;
+  }
+  if (parameters.windowSize < 3 || parameters.windowSize % 2 == 0)
+  {
+    sksExceptionThrow() << "Window size should be odd and > 1, not " << parameters.windowSize;
+  }
+
+  intrinsicMatrix.convertTo(m_IntrinsicMatrix, CV_64FC1);
+  gridPoints.convertTo(m_GridPoints, CV_64FC1);
+  indexesOfFourReferencePoints.reshape(1, 4).convertTo(m_IndexesOfFourReferencePoints, CV_32SC1);
+
+  for (int i = 0; i < 4; i++)
+  {
+    int index = m_IndexesOfFourReferencePoints.at<int>(i, 0);
+    if (index < 0 || index >= m_GridPoints.rows)
+    {
+      sksExceptionThrow() << "Reference point index " << index << " is not a row of the grid points.";
+    }
+  }
+
+  // Padded to all 8 coefficients, so detect needn't check how many there are.
+  m_DistortionCoefficients = cv::Mat::zeros(1, 8, CV_64FC1);
+  if (!distortionCoefficients.empty())
+  {
+    cv::Mat coefficients;
+    distortionCoefficients.reshape(1, 1).convertTo(coefficients, CV_64FC1);
+    coefficients.copyTo(m_DistortionCoefficients.colRange(0, coefficients.cols));
+  }
+
+  // The same fixed point maps that cv::undistort builds internally, on every call.
+  cv::initUndistortRectifyMap(m_IntrinsicMatrix, m_DistortionCoefficients, cv::Mat(), m_IntrinsicMatrix,
+                              m_ImageSize, CV_16SC2, m_UndistortMap1, m_UndistortMap2);
+
+  cv::SimpleBlobDetector::Params blobParameters;
+  blobParameters.filterByConvexity = false;
+  blobParameters.filterByInertia = true;
+  blobParameters.filterByCircularity = true;
+  blobParameters.filterByArea = true;
+  blobParameters.minArea = parameters.minimumArea;
+  blobParameters.maxArea = parameters.maximumArea;
+  m_BlobDetector = cv::SimpleBlobDetector::create(blobParameters);
+
+  // Its circularity and inertia defaults are the cv::SimpleBlobDetector ones.
+  sks::DotExtractorParameters extractorParameters;
+  extractorParameters.minimumArea = parameters.minimumArea;
+  extractorParameters.maximumArea = parameters.maximumArea;
+  m_DotExtractor = sks::DotExtractor(extractorParameters);
+
+  m_GridIndex.setPoints(m_GridPoints.colRange(1, 3));
+}
+
+
+//-----------------------------------------------------------------------------
+DotDetector::~DotDetector()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Size DotDetector::getImageSize() const
+{
+  return m_ImageSize;
+}
+
+
+//-----------------------------------------------------------------------------
+DotDetectorParameters DotDetector::getParameters() const
+{
+  return m_Parameters;
+}
+
+
+//-----------------------------------------------------------------------------
+void DotDetector::DetectKeyPoints(const cv::Mat& thresholdedImage,
+                                  const cv::Mat& image,
+                                  std::vector<cv::KeyPoint>& keyPoints)
 {
-  cv::Mat result(0, 6, CV_64F);
+  if (m_Parameters.useMomentCentroids)
+  {
+    m_DotExtractor.extract(thresholdedImage, image, keyPoints);
+  }
+  else
+  {
+    m_BlobDetector->detect(thresholdedImage, keyPoints);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat DotDetector::detect(const cv::Mat& distortedImage)
+{
+  cv::Mat result;
+  this->detect(distortedImage, result);
+  return result;
+}
+
+
+//-----------------------------------------------------------------------------
+void DotDetector::detect(const cv::Mat& distortedImage, cv::Mat& outputPoints)
+{
+  if (distortedImage.size() != m_ImageSize)
+  {
+    sksExceptionThrow() << "Image size:" << distortedImage.size()
+                        << " should equal the size given at construction:" << m_ImageSize;
+  }
+
+  sks::PrepareOutputBuffer(0, 6, CV_64F, outputPoints);
 
   unsigned char thresholdMax = 255;
-  unsigned short windowSize = 151;
-  unsigned char cOffset = 20;
-
-
-  cv::Mat smoothed;
-  cv::GaussianBlur(distortedImage,
-                   smoothed,
-                   cv::Size(5, 5),
-                   0);
-
-  cv::Mat thresholded;
-  cv::adaptiveThreshold(smoothed,
-                        thresholded,
-                        thresholdMax,
-                        cv::ADAPTIVE_THRESH_MEAN_C,
-                        cv::THRESH_BINARY,
-                        windowSize,
-                        cOffset);
-
-  cv::SimpleBlobDetector::Params params;
-  params.filterByConvexity = false;
-  params.filterByInertia = true;
-  params.filterByCircularity = true;
-  params.filterByArea = true;
-  params.minArea = 50;
-  params.maxArea = 50000;
-
-  cv::Ptr<cv::SimpleBlobDetector> detector = cv::SimpleBlobDetector::create(params);
-  std::vector<cv::KeyPoint> keypoints;
-  detector->detect(thresholded, keypoints);
-
-  cv::Mat undistortedImage;
-  cv::undistort(smoothed,
-                undistortedImage,
-                intrinsicMatrix,
-                distortionCoefficients
-               );
-
-  cv::Mat undistortedThresholdedImage;
-  cv::adaptiveThreshold(undistortedImage,
-                        undistortedThresholdedImage,
-                        thresholdMax,
-                        cv::ADAPTIVE_THRESH_MEAN_C,
-                        cv::THRESH_BINARY,
-                        windowSize,
-                        cOffset);
-
-  std::vector<cv::KeyPoint> undistortedKeypoints;
-  detector->detect(undistortedThresholdedImage, undistortedKeypoints);
-
-  unsigned int numberOfKeyPoints = keypoints.size();
-  unsigned int numberOfUndistortedKeyPoints = undistortedKeypoints.size();
-
-  if (numberOfKeyPoints > 4 && numberOfUndistortedKeyPoints >4)
+
+  // Blurred, and thresholded, in one pass, giving the same images as cv::GaussianBlur then cv::adaptiveThreshold.
+  sks::BlurAndAdaptiveMeanThreshold(distortedImage,
+                                    thresholdMax,
+                                    m_Parameters.windowSize,
+                                    m_Parameters.offset,
+                                    m_SmoothedImage,
+                                    m_ThresholdedImage,
+                                    m_ThresholdWorkspace);
+  this->DetectKeyPoints(m_ThresholdedImage, m_SmoothedImage, m_KeyPoints);
+
+  if (m_Parameters.isSinglePass)
   {
-    result = cv::Mat(numberOfUndistortedKeyPoints, 6, CV_64F);
+    this->DetectSinglePass(outputPoints);
+  }
+  else
+  {
+    this->DetectTwoPass(outputPoints);
+  }
+}
 
-    std::sort(undistortedKeypoints.begin(),
-              undistortedKeypoints.end(),
-              KeyPointSorter());
 
-    std::vector<ReferencePoint> biggestFourPoints;
-    biggestFourPoints.push_back(ReferencePoint(undistortedKeypoints[0].pt.x, undistortedKeypoints[0].pt.y));
-    biggestFourPoints.push_back(ReferencePoint(undistortedKeypoints[1].pt.x, undistortedKeypoints[1].pt.y));
-    biggestFourPoints.push_back(ReferencePoint(undistortedKeypoints[2].pt.x, undistortedKeypoints[2].pt.y));
-    biggestFourPoints.push_back(ReferencePoint(undistortedKeypoints[3].pt.x, undistortedKeypoints[3].pt.y));
+//-----------------------------------------------------------------------------
+void DotDetector::DetectSinglePass(cv::Mat& outputPoints)
+{
+  if (m_KeyPoints.size() <= 4)
+  {
+    return;
+  }
+
+  // Sorted first, so the undistorted centres are also in decreasing order of size.
+  std::sort(m_KeyPoints.begin(),
+            m_KeyPoints.end(),
+            KeyPointSorter());
+
+  cv::KeyPoint::convert(m_KeyPoints, m_KeyPointsAsVector);
+
+  // Passing the intrinsic matrix as P gives undistorted pixels, as in the undistorted image.
+  cv::undistortPoints(m_KeyPointsAsVector,
+                      m_UndistortedKeyPointsAsVector,
+                      m_IntrinsicMatrix,
+                      m_DistortionCoefficients,
+                      cv::noArray(),
+                      m_IntrinsicMatrix,
+                      cv::TermCriteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.01));
+
+  if (!this->AssignToGrid(m_UndistortedKeyPointsAsVector, outputPoints))
+  {
+    return;
+  }
+
+  // Each row came from one distorted keypoint, so there is nothing to search for.
+  for (int i = 0; i < outputPoints.rows; i++)
+  {
+    outputPoints.at<double>(i, 1) = m_KeyPointsAsVector[i].x;
+    outputPoints.at<double>(i, 2) = m_KeyPointsAsVector[i].y;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void DotDetector::DetectTwoPass(cv::Mat& outputPoints)
+{
+  cv::remap(m_SmoothedImage,
+            m_UndistortedImage,
+            m_UndistortMap1,
+            m_UndistortMap2,
+            cv::INTER_LINEAR,
+            cv::BORDER_CONSTANT
+           );
+
+  unsigned char thresholdMax = 255;
+  sks::AdaptiveMeanThreshold(m_UndistortedImage,
+                             thresholdMax,
+                             m_Parameters.windowSize,
+                             m_Parameters.offset,
+                             m_UndistortedThresholdedImage,
+                             m_ThresholdWorkspace);
+  this->DetectKeyPoints(m_UndistortedThresholdedImage, m_UndistortedImage, m_UndistortedKeyPoints);
+
+  if (m_KeyPoints.size() <= 4 || m_UndistortedKeyPoints.size() <= 4)
+  {
+    return;
+  }
+
+  std::sort(m_UndistortedKeyPoints.begin(),
+            m_UndistortedKeyPoints.end(),
+            KeyPointSorter());
 
-    cv::Point2f centroid = computeCentroid(biggestFourPoints);
+  cv::KeyPoint::convert(m_UndistortedKeyPoints, m_UndistortedKeyPointsAsVector);
+
+  if (!this->AssignToGrid(m_UndistortedKeyPointsAsVector, outputPoints))
+  {
+    return;
+  }
+
+  cv::KeyPoint::convert(m_KeyPoints, m_KeyPointsAsVector);
+  m_KeyPointIndex.setPoints(cv::Mat(m_KeyPointsAsVector).reshape(1));
+
+  const double fx = m_IntrinsicMatrix.at<double>(0, 0);
+  const double fy = m_IntrinsicMatrix.at<double>(1, 1);
+  const double cx = m_IntrinsicMatrix.at<double>(0, 2);
+  const double cy = m_IntrinsicMatrix.at<double>(1, 2);
+  const double* d = m_DistortionCoefficients.ptr<double>(0);
+
+  for (int i = 0; i < outputPoints.rows; i++)
+  {
+    // First redistort (it was undistorted earlier).
+
+    double relativeX = (outputPoints.at<double>(i, 1) - cx) / fx;
+    double relativeY = (outputPoints.at<double>(i, 2) - cy) / fy;
+    double r2 = relativeX * relativeX + relativeY * relativeY;
+    double radial = (1 + d[0] * r2 + d[1] * r2 * r2 + d[4] * r2 * r2 * r2)
+                  / (1 + d[5] * r2 + d[6] * r2 * r2 + d[7] * r2 * r2 * r2);
+
+    double distortedX = relativeX * radial;
+    double distortedY = relativeY * radial;
+
+    distortedX = distortedX + (2 * d[2] * relativeX * relativeY
+                            + d[3] * (r2 + 2 * relativeX * relativeX));
+
+    distortedY = distortedY + (d[2] * (r2 + 2 * relativeY * relativeY)
+                            + 2 * d[3] * relativeX * relativeY);
+
+    distortedX = distortedX * fx + cx;
+    distortedY = distortedY * fy + cy;
+
+    // Now we find the closest point on the original set of keypoints, and return that instead.
+    // The reason is that even distorting/undistorting image affects the blob detector.
+    int bestIndexSoFar = m_KeyPointIndex.findNearest(distortedX, distortedY);
+    outputPoints.at<double>(i, 1) = m_KeyPoints[bestIndexSoFar].pt.x;
+    outputPoints.at<double>(i, 2) = m_KeyPoints[bestIndexSoFar].pt.y;
+
+  } // end for each point
+}
+
+
+//-----------------------------------------------------------------------------
+bool DotDetector::AssignToGrid(const std::vector<cv::Point2f>& undistortedPoints, cv::Mat& outputPoints)
+{
+  sks::PrepareOutputBuffer(static_cast<int>(undistortedPoints.size()), 6, CV_64F, outputPoints);
 
-    for (unsigned int i = 0; i < biggestFourPoints.size(); i++)
+  std::vector<ReferencePoint> biggestFourPoints;
+  biggestFourPoints.push_back(ReferencePoint(undistortedPoints[0].x, undistortedPoints[0].y));
+  biggestFourPoints.push_back(ReferencePoint(undistortedPoints[1].x, undistortedPoints[1].y));
+  biggestFourPoints.push_back(ReferencePoint(undistortedPoints[2].x, undistortedPoints[2].y));
+  biggestFourPoints.push_back(ReferencePoint(undistortedPoints[3].x, undistortedPoints[3].y));
+
+  cv::Point2f centroid = computeCentroid(biggestFourPoints);
+
+  for (unsigned int i = 0; i < biggestFourPoints.size(); i++)
+  {
+    if (biggestFourPoints[i].x > centroid.x)
     {
-      if (biggestFourPoints[i].x > centroid.x)
-      {
-        biggestFourPoints[i].rightOfCentroid = 1;
-      }
-      if (biggestFourPoints[i].y > centroid.y)
-      {
-        biggestFourPoints[i].belowCentroid = 1;
-      }
+      biggestFourPoints[i].rightOfCentroid = 1;
     }
-    for (unsigned int i = 0; i < biggestFourPoints.size(); i++)
+    if (biggestFourPoints[i].y > centroid.y)
     {
-      biggestFourPoints[i].score = biggestFourPoints[i].rightOfCentroid + (biggestFourPoints[i].belowCentroid * 2);
+      biggestFourPoints[i].belowCentroid = 1;
     }
+  }
+  for (unsigned int i = 0; i < biggestFourPoints.size(); i++)
+  {
+    biggestFourPoints[i].score = biggestFourPoints[i].rightOfCentroid + (biggestFourPoints[i].belowCentroid * 2);
+  }
 
-    // Given the score assigned above, this sorting should make the biggestFourPoints
-    // be ordered, top-left, top-right, bottom-left, bottom-right.
-    std::sort(biggestFourPoints.begin(),
-              biggestFourPoints.end());
-
-    // Extract fiducials, suitable for passing to findHomography.
-    cv::Mat sourceFiducials = cv::Mat::zeros(4, 2, CV_64F);
-    cv::Mat targetFiducials = cv::Mat::zeros(4, 2, CV_64F);
-    for (unsigned int i = 0; i < 4; i++)
-    {
-      sourceFiducials.at<double>(i, 0) = biggestFourPoints[i].x;
-      sourceFiducials.at<double>(i, 1) = biggestFourPoints[i].y;
-      int gridIndexForIthFiducial = indexesOfFourReferencePoints.at<int>(i, 0);
-      targetFiducials.at<double>(i, 0) = gridPoints.at<double>(gridIndexForIthFiducial, 1);
-      targetFiducials.at<double>(i, 1) = gridPoints.at<double>(gridIndexForIthFiducial, 2);
-    }
-    cv::Mat homography = cv::findHomography(sourceFiducials,
-                                            targetFiducials
-                                            );
+  // Given the score assigned above, this sorting should make the biggestFourPoints
+  // be ordered, top-left, top-right, bottom-left, bottom-right.
+  std::sort(biggestFourPoints.begin(),
+            biggestFourPoints.end());
 
-    std::vector<cv::Point2f> undistortedKeyPointsAsVector;
-    cv::KeyPoint::convert(undistortedKeypoints, undistortedKeyPointsAsVector);
+  // Extract fiducials, suitable for passing to findHomography.
+  cv::Mat sourceFiducials = cv::Mat::zeros(4, 2, CV_64F);
+  cv::Mat targetFiducials = cv::Mat::zeros(4, 2, CV_64F);
+  for (unsigned int i = 0; i < 4; i++)
+  {
+    sourceFiducials.at<double>(i, 0) = biggestFourPoints[i].x;
+    sourceFiducials.at<double>(i, 1) = biggestFourPoints[i].y;
+    int gridIndexForIthFiducial = m_IndexesOfFourReferencePoints.at<int>(i, 0);
+    targetFiducials.at<double>(i, 0) = m_GridPoints.at<double>(gridIndexForIthFiducial, 1);
+    targetFiducials.at<double>(i, 1) = m_GridPoints.at<double>(gridIndexForIthFiducial, 2);
+  }
+  cv::Mat homography = cv::findHomography(sourceFiducials,
+                                          targetFiducials
+                                          );
 
-    std::vector<cv::Point2f> transformedPoints;
-    cv::perspectiveTransform(undistortedKeyPointsAsVector, transformedPoints, homography);
+  cv::perspectiveTransform(undistortedPoints, m_TransformedPoints, homography);
 
-    // Now for each dot, find closest point in reference grid.
-    double rmsError = 0;
-    for (unsigned int i = 0; i < transformedPoints.size(); i++)
-    {
-      double bestDistanceSoFar = std::numeric_limits<double>::max();
-      int bestIndexSoFar = -1;
-      for (unsigned int j = 0; j < gridPoints.rows; j++)
-      {
-        double squaredDist = (transformedPoints[i].x - gridPoints.at<double>(j, 1))
-                           * (transformedPoints[i].x - gridPoints.at<double>(j, 1))
-                           + (transformedPoints[i].y - gridPoints.at<double>(j, 2))
-                           * (transformedPoints[i].y - gridPoints.at<double>(j, 2));
-        if (squaredDist < bestDistanceSoFar)
-        {
-          bestDistanceSoFar = squaredDist;
-          bestIndexSoFar = j;
-        }
-      }
-      result.at<double>(i, 0) = gridPoints.at<double>(bestIndexSoFar, 0);
-      result.at<double>(i, 1) = undistortedKeyPointsAsVector[i].x;
-      result.at<double>(i, 2) = undistortedKeyPointsAsVector[i].y;
-      result.at<double>(i, 3) = gridPoints.at<double>(bestIndexSoFar, 3);
-      result.at<double>(i, 4) = gridPoints.at<double>(bestIndexSoFar, 4);
-      result.at<double>(i, 5) = gridPoints.at<double>(bestIndexSoFar, 5);
-      rmsError += bestDistanceSoFar;
-    }
+  // Now for each dot, find closest point in reference grid.
+  double rmsError = 0;
+  for (unsigned int i = 0; i < m_TransformedPoints.size(); i++)
+  {
+    double bestDistanceSoFar = 0;
+    int bestIndexSoFar = m_GridIndex.findNearest(m_TransformedPoints[i].x, m_TransformedPoints[i].y, bestDistanceSoFar);
+    const double* gridPoint = m_GridPoints.ptr<double>(bestIndexSoFar);
+    double* outputPoint = outputPoints.ptr<double>(i);
+    outputPoint[0] = gridPoint[0];
+    outputPoint[1] = undistortedPoints[i].x;
+    outputPoint[2] = undistortedPoints[i].y;
+    outputPoint[3] = gridPoint[3];
+    outputPoint[4] = gridPoint[4];
+    outputPoint[5] = gridPoint[5];
+    rmsError += bestDistanceSoFar;
+  }
 
-    rmsError /= static_cast<double>(transformedPoints.size());
-    rmsError = sqrt(rmsError);
+  rmsError /= static_cast<double>(m_TransformedPoints.size());
+  rmsError = sqrt(rmsError);
 
-    if (rmsError > 10)
-    {
-      return result;
-    }
+  return rmsError <= m_Parameters.maximumRMSError;
+}
 
-    for (unsigned int i = 0; i < transformedPoints.size(); i++)
-    {
-      // First redistort (it was undistorted earlier).
-
-      double relativeX = (result.at<double>(i, 1) - intrinsicMatrix.at<double>(0,2)) / intrinsicMatrix.at<double>(0,0);
-      double relativeY = (result.at<double>(i, 2) - intrinsicMatrix.at<double>(1,2)) / intrinsicMatrix.at<double>(1,1);
-      double r2 = relativeX * relativeX + relativeY * relativeY;
-      double radial = (1
-        + distortionCoefficients.at<double>(0, 0) * r2
-        + distortionCoefficients.at<double>(0, 1) * r2 * r2
-        + distortionCoefficients.at<double>(0, 4) * r2 * r2 * r2
-      );
-
-      double distortedX = relativeX * radial;
-      double distortedY = relativeY * radial;
-
-      distortedX = distortedX + (2 * distortionCoefficients.at<double>(0, 2)
-                                   * relativeX * relativeY
-                              + distortionCoefficients.at<double>(0, 3)
-                              * (r2 + 2 * relativeX * relativeX));
-
-      distortedY = distortedY + (distortionCoefficients.at<double>(0, 2)
-                              * (r2 + 2 * relativeY * relativeY)
-                              + 2 * distortionCoefficients.at<double>(0, 3)
-                              * relativeX * relativeY);
-
-      distortedX = distortedX * intrinsicMatrix.at<double>(0,0) + intrinsicMatrix.at<double>(0,2);
-      distortedY = distortedY * intrinsicMatrix.at<double>(1,1) + intrinsicMatrix.at<double>(1,2);
-
-      // Now we find the closest point on the original set of keypoints, and return that instead.
-      // The reason is that even distorting/undistorting image affects the blob detector.
-      double bestDistanceSoFar = std::numeric_limits<double>::max();
-      int bestIndexSoFar = -1;
-      for (unsigned int j = 0; j < numberOfKeyPoints; j++)
-      {
-        double squaredDist = (distortedX - keypoints[j].pt.x) * (distortedX - keypoints[j].pt.x)
-                           + (distortedY - keypoints[j].pt.y) * (distortedY - keypoints[j].pt.y);
-        if (squaredDist < bestDistanceSoFar)
-        {
-          bestDistanceSoFar = squaredDist;
-          bestIndexSoFar = j;
-        }
-      }
-      result.at<double>(i, 1) = keypoints[bestIndexSoFar].pt.x;
-      result.at<double>(i, 2) = keypoints[bestIndexSoFar].pt.y;
-
-    } // end for each point
-
-  } // end if we have enough points
 
+//-----------------------------------------------------------------------------
+cv::Mat ExtractDots(
+  const cv::Mat& distortedImage,
+  const cv::Mat& intrinsicMatrix,
+  const cv::Mat& distortionCoefficients,
+  const cv::Mat& gridPoints,
+  const cv::Mat& indexesOfFourReferencePoints
+  )
+{
+  cv::Mat result;
+  sks::ExtractDots(distortedImage,
+                   intrinsicMatrix,
+                   distortionCoefficients,
+                   gridPoints,
+                   indexesOfFourReferencePoints,
+                   result
+                  );
   return result;
 }
 
+
+//-----------------------------------------------------------------------------
+void ExtractDots(
+  const cv::Mat& distortedImage,
+  const cv::Mat& intrinsicMatrix,
+  const cv::Mat& distortionCoefficients,
+  const cv::Mat& gridPoints,
+  const cv::Mat& indexesOfFourReferencePoints,
+  cv::Mat& outputPoints
+  )
+{
+  sks::DotDetector detector(intrinsicMatrix,
+                            distortionCoefficients,
+                            gridPoints,
+                            indexesOfFourReferencePoints,
+                            distortedImage.cols,
+                            distortedImage.rows);
+  detector.detect(distortedImage, outputPoints);
+}
+
 } // end namespace
@@ -16,8 +16,13 @@
 #define sksDotDetection_h
 
 #include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+#include "sksDotExtractor.h"
+#include "sksSpatialIndex.h"
 #include "sksWin32ExportHeader.h"
 
+#include <vector>
+
 /**
 * \file sksDotDetection.h
 * \brief Functions to extract the locations of a pattern
@@ -44,6 +49,9 @@ namespace sks
 * are typically 3 times larger than all the other dots,
 * and so are easy to identify and use as fiducials for a homography.
 *
+* To process many images with the same calibration, such as live video,
+* construct a sks::DotDetector once, and call its detect method instead.
+*
 * \param distortedImage distorted image
 * \param intrinsicMatrix good guess of the intrinsic matrix
 * \param distortionCoefficients good guess of the distortion coefficients
@@ -59,6 +67,145 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat ExtractDots(
   const cv::Mat& indexesOfFourReferencePoints
 );
 
+/**
+* \brief As above, but writes into outputPoints, reusing its memory where possible.
+* \see sks::PrepareOutputBuffer
+* \param outputPoints [nx6] array of rows of id, x_pix, y_pix, x_mm, y_mm, z_mm of detected point locations
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void ExtractDots(
+  const cv::Mat& distortedImage,
+  const cv::Mat& intrinsicMatrix,
+  const cv::Mat& distortionCoefficients,
+  const cv::Mat& gridPoints,
+  const cv::Mat& indexesOfFourReferencePoints,
+  cv::Mat& outputPoints
+);
+
+
+/**
+* \brief Settings for sks::DotDetector, where the defaults match sks::ExtractDots.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT DotDetectorParameters
+{
+  DotDetectorParameters();
+
+  /// Size of the adaptive threshold window, in pixels, which must be odd and > 1. Detection takes the same time whatever the size. Default 151.
+  int windowSize;
+
+  /// Pixels darker than the local mean, minus this, are part of a dot. Default 20.
+  double offset;
+
+  /// Blobs with fewer pixels than this are ignored. Default 50.
+  float minimumArea;
+
+  /// Blobs with more pixels than this are ignored. Default 50000.
+  float maximumArea;
+
+  /// If the RMS distance, in grid pixels, from dots to their nearest grid point exceeds this, the match is rejected. Default 10.
+  double maximumRMSError;
+
+  /// If true, blobs are only detected in the distorted image, and their centres undistorted with
+  /// cv::undistortPoints, which is roughly twice as fast. If false, blobs are also detected in the
+  /// undistorted image, as sks::ExtractDots, which is more robust to strong distortion. Default false.
+  bool isSinglePass;
+
+  /// If true, dots are found by sks::DotExtractor, with intensity weighted centroids, which is faster,
+  /// and more accurate, than cv::SimpleBlobDetector. If false, as sks::ExtractDots. Default false.
+  bool useMomentCentroids;
+};
+
+
+/**
+* \class DotDetector
+* \brief Extracts calibration points from images of dots, as sks::ExtractDots,
+* but keeping everything that only depends on the calibration between calls.
+*
+* The undistortion maps are computed once, at construction, rather than by
+* cv::undistort for every image, and the blob detector, the index of grid
+* points, and all intermediate images are kept, so once the first image has
+* been processed, each detect call mostly reuses memory.
+*
+* By default, results are identical to sks::ExtractDots, but see
+* DotDetectorParameters::isSinglePass for a faster mode. As detect reuses member
+* buffers, a single instance should not be used from several threads at once.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT DotDetector {
+
+public:
+
+  /**
+  * \param intrinsicMatrix good guess of the [3x3] intrinsic matrix
+  * \param distortionCoefficients good guess of the distortion coefficients, 4, 5 or 8 values, or empty
+  * \param gridPoints [nx6] array of rows of id, x_pix, y_pix, x_mm, y_mm, z_mm reference point locations
+  * \param indexesOfFourReferencePoints [4x1] list of exactly 4 point indexes, see sks::ExtractDots
+  * \param imageWidth width of the images that will be passed to detect
+  * \param imageHeight height of the images that will be passed to detect
+  * \param parameters detection settings
+  */
+  DotDetector(const cv::Mat& intrinsicMatrix,
+              const cv::Mat& distortionCoefficients,
+              const cv::Mat& gridPoints,
+              const cv::Mat& indexesOfFourReferencePoints,
+              const int imageWidth,
+              const int imageHeight,
+              const DotDetectorParameters& parameters = DotDetectorParameters());
+
+  ~DotDetector();
+
+  /**
+  * \brief Detects dots in a distorted, greyscale, image of the size given at construction.
+  * \param outputPoints [nx6] array of rows of id, x_pix, y_pix, x_mm, y_mm, z_mm, reusing its memory where possible
+  */
+  void detect(const cv::Mat& distortedImage, cv::Mat& outputPoints);
+
+  /**
+  * \brief As above, returning a new matrix.
+  */
+  cv::Mat detect(const cv::Mat& distortedImage);
+
+  cv::Size getImageSize() const;
+  DotDetectorParameters getParameters() const;
+
+private:
+
+  void DetectKeyPoints(const cv::Mat& thresholdedImage, const cv::Mat& image, std::vector<cv::KeyPoint>& keyPoints);
+  void DetectSinglePass(cv::Mat& outputPoints);
+  void DetectTwoPass(cv::Mat& outputPoints);
+
+  /**
+  * \brief Labels undistorted points, sorted by decreasing blob size, with their nearest grid point.
+  * \return false if the RMS distance to the grid is more than maximumRMSError
+  */
+  bool AssignToGrid(const std::vector<cv::Point2f>& undistortedPoints, cv::Mat& outputPoints);
+
+  cv::Mat                         m_IntrinsicMatrix;
+  cv::Mat                         m_DistortionCoefficients;
+  cv::Mat                         m_GridPoints;
+  cv::Mat                         m_IndexesOfFourReferencePoints;
+  cv::Size                        m_ImageSize;
+  DotDetectorParameters           m_Parameters;
+
+  cv::Mat                         m_UndistortMap1;
+  cv::Mat                         m_UndistortMap2;
+  cv::Ptr<cv::SimpleBlobDetector> m_BlobDetector;
+  sks::DotExtractor               m_DotExtractor;
+  sks::SpatialIndex               m_GridIndex;
+
+  // Scratch, kept between calls to detect, to avoid reallocation.
+  cv::Mat                         m_SmoothedImage;
+  cv::Mat                         m_ThresholdedImage;
+  cv::Mat                         m_UndistortedImage;
+  cv::Mat                         m_UndistortedThresholdedImage;
+  cv::Mat                         m_ThresholdWorkspace;
+  std::vector<cv::KeyPoint>       m_KeyPoints;
+  std::vector<cv::KeyPoint>       m_UndistortedKeyPoints;
+  std::vector<cv::Point2f>        m_KeyPointsAsVector;
+  std::vector<cv::Point2f>        m_UndistortedKeyPointsAsVector;
+  std::vector<cv::Point2f>        m_TransformedPoints;
+  sks::SpatialIndex               m_KeyPointIndex;
+
+}; // end class
+
 } // end namespace
 
 #endif
\ No newline at end of file
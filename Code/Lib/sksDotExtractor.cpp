@@ -0,0 +1,227 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksDotExtractor.h"
+#include "sksExceptionMacro.h"
+#include <opencv2/imgproc.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <cmath>
+#include <vector>
+
+namespace sks
+{
+
+//-----------------------------------------------------------------------------
+DotExtractorParameters::DotExtractorParameters()
+: minimumArea(50)
+, maximumArea(50000)
+, minimumCircularity(0.8f)
+, minimumInertiaRatio(0.1f)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+DotExtractor::DotExtractor(const DotExtractorParameters& parameters)
+: m_Parameters(parameters)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+DotExtractor::~DotExtractor()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+DotExtractorParameters DotExtractor::getParameters() const
+{
+  return m_Parameters;
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Measures one labelled dot, within its bounding box, returning false if it fails the shape filters.
+*/
+bool InternalMeasureDot(const cv::Mat& labels,
+                        const cv::Mat& image,
+                        const int label,
+                        const int* statistics,
+                        const DotExtractorParameters& parameters,
+                        cv::KeyPoint& keyPoint)
+{
+  const int left = statistics[cv::CC_STAT_LEFT];
+  const int top = statistics[cv::CC_STAT_TOP];
+  const int width = statistics[cv::CC_STAT_WIDTH];
+  const int height = statistics[cv::CC_STAT_HEIGHT];
+  const int right = left + width;
+  const int bottom = top + height;
+  const double area = statistics[cv::CC_STAT_AREA];
+
+  // As cv::SimpleBlobDetector, from the outer contour, found within the bounding
+  // box, with a 1 pixel border, so dots touching the box edge are closed.
+  cv::Mat dotMask = cv::Mat::zeros(height + 2, width + 2, CV_8UC1);
+  cv::Mat dotMaskInterior = dotMask(cv::Rect(1, 1, width, height));
+  cv::compare(labels(cv::Rect(left, top, width, height)), label, dotMaskInterior, cv::CMP_EQ);
+
+  std::vector<std::vector<cv::Point> > contours;
+  cv::findContours(dotMask, contours, cv::RETR_EXTERNAL, cv::CHAIN_APPROX_NONE);
+  if (contours.empty())
+  {
+    return false;
+  }
+
+  // A single 8 connected component has a single outer contour.
+  double contourArea = cv::contourArea(contours[0]);
+  double perimeter = cv::arcLength(contours[0], true);
+  if (perimeter <= 0)
+  {
+    return false;
+  }
+  double circularity = 4 * CV_PI * contourArea / (perimeter * perimeter);
+  if (circularity < parameters.minimumCircularity)
+  {
+    return false;
+  }
+
+  double sumX = 0;
+  double sumY = 0;
+  double sumXX = 0;
+  double sumYY = 0;
+  double sumXY = 0;
+  double sumWeights = 0;
+  double sumWeightedX = 0;
+  double sumWeightedY = 0;
+
+  for (int r = top; r < bottom; r++)
+  {
+    const int* labelRow = labels.ptr<int>(r);
+    const unsigned char* imageRow = image.ptr<unsigned char>(r);
+
+    // Relative to the bounding box, so the sums stay small.
+    double y = r - top;
+
+    for (int c = left; c < right; c++)
+    {
+      if (labelRow[c] != label)
+      {
+        continue;
+      }
+
+      double x = c - left;
+      sumX += x;
+      sumY += y;
+      sumXX += x * x;
+      sumYY += y * y;
+      sumXY += x * y;
+
+      // Dots are dark, so darker pixels are more certainly part of the dot.
+      double weight = 255 - imageRow[c];
+      sumWeights += weight;
+      sumWeightedX += weight * x;
+      sumWeightedY += weight * y;
+    }
+  }
+
+  // As cv::SimpleBlobDetector, the ratio of the smallest to largest eigenvalue of the central moments.
+  double meanX = sumX / area;
+  double meanY = sumY / area;
+  double mu20 = sumXX / area - meanX * meanX;
+  double mu02 = sumYY / area - meanY * meanY;
+  double mu11 = sumXY / area - meanX * meanY;
+  double denominator = std::sqrt((mu20 - mu02) * (mu20 - mu02) + 4 * mu11 * mu11);
+  double inertiaRatio = 1;
+  if (denominator > 1e-2)
+  {
+    inertiaRatio = (mu20 + mu02 - denominator) / (mu20 + mu02 + denominator);
+  }
+  if (inertiaRatio < parameters.minimumInertiaRatio)
+  {
+    return false;
+  }
+
+  if (sumWeights > 0)
+  {
+    keyPoint.pt.x = static_cast<float>(left + sumWeightedX / sumWeights);
+    keyPoint.pt.y = static_cast<float>(top + sumWeightedY / sumWeights);
+  }
+  else
+  {
+    keyPoint.pt.x = static_cast<float>(left + meanX);
+    keyPoint.pt.y = static_cast<float>(top + meanY);
+  }
+  keyPoint.size = static_cast<float>(2 * std::sqrt(area / CV_PI));
+  keyPoint.response = static_cast<float>(circularity);
+  return true;
+}
+
+
+//-----------------------------------------------------------------------------
+void DotExtractor::extract(const cv::Mat& thresholdedImage, const cv::Mat& image, std::vector<cv::KeyPoint>& keyPoints)
+{
+  if (thresholdedImage.empty() || thresholdedImage.type() != CV_8UC1)
+  {
+    sksExceptionThrow() << "Thresholded image should be a non-empty CV_8UC1 image.";
+  }
+  if (image.size() != thresholdedImage.size() || image.type() != CV_8UC1)
+  {
+    sksExceptionThrow() << "Image should be CV_8UC1, and the same size as the thresholded image, "
+                        << thresholdedImage.size() << ", not " << image.size();
+  }
+
+  keyPoints.clear();
+
+  cv::compare(thresholdedImage, 0, m_DotMask, cv::CMP_EQ);
+  int numberOfLabels = cv::connectedComponentsWithStats(m_DotMask, m_Labels, m_Statistics, m_Centroids, 8, CV_32S);
+
+  // Label 0 is the background. The area filter only needs the statistics, so is done first.
+  m_Candidates.clear();
+  for (int label = 1; label < numberOfLabels; label++)
+  {
+    int area = m_Statistics.at<int>(label, cv::CC_STAT_AREA);
+    if (area >= m_Parameters.minimumArea && area < m_Parameters.maximumArea)
+    {
+      m_Candidates.push_back(label);
+    }
+  }
+
+  int numberOfCandidates = static_cast<int>(m_Candidates.size());
+  m_CandidateKeyPoints.resize(numberOfCandidates);
+  m_IsAccepted.assign(numberOfCandidates, 0);
+
+  // Dots vary in size, so are shared out dynamically.
+  #pragma omp parallel for schedule(dynamic, 8)
+  for (int i = 0; i < numberOfCandidates; i++)
+  {
+    int label = m_Candidates[i];
+    m_IsAccepted[i] = sks::InternalMeasureDot(m_Labels, image, label, m_Statistics.ptr<int>(label),
+                                              m_Parameters, m_CandidateKeyPoints[i]) ? 1 : 0;
+  }
+
+  for (int i = 0; i < numberOfCandidates; i++)
+  {
+    if (m_IsAccepted[i])
+    {
+      keyPoints.push_back(m_CandidateKeyPoints[i]);
+    }
+  }
+}
+
+} // end namespace
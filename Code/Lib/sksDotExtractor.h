@@ -0,0 +1,109 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksDotExtractor_h
+#define sksDotExtractor_h
+
+#include <opencv2/core.hpp>
+#include "sksWin32ExportHeader.h"
+
+#include <vector>
+
+/**
+* \file sksDotExtractor.h
+* \brief Finds dark dots, with sub-pixel centres, in thresholded images.
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+* \brief Filters for sks::DotExtractor, where the defaults match those sks::DotDetector gives cv::SimpleBlobDetector.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT DotExtractorParameters
+{
+  DotExtractorParameters();
+
+  /// Dots with fewer pixels than this are ignored. Default 50.
+  float minimumArea;
+
+  /// Dots with this many pixels, or more, are ignored. Default 50000.
+  float maximumArea;
+
+  /// Dots whose outer contour has 4 pi area / perimeter^2 below this are ignored. Default 0.8.
+  float minimumCircularity;
+
+  /// Dots whose minor, over major, second moment is below this are ignored. Default 0.1.
+  float minimumInertiaRatio;
+};
+
+
+/**
+* \class DotExtractor
+* \brief Replaces cv::SimpleBlobDetector for images that are already thresholded,
+* with intensity weighted centroids.
+*
+* cv::SimpleBlobDetector thresholds its input at many levels, and finds
+* contours at each, which for a binary image repeats the same work many times,
+* and its centres are those of the pixel boundary. Instead, the dark pixels
+* are labelled once, with cv::connectedComponentsWithStats, which OpenCV runs
+* in parallel over horizontal stripes. Then each dot that passes the area
+* filter is visited once, in parallel, accumulating its moments, and its
+* centroid weighted by darkness, (255 - intensity), in the grey image, which
+* is sub-pixel accurate even for small dots.
+*
+* Circularity and inertia ratio are as cv::SimpleBlobDetector. Circularity uses
+* the area and length of the dot's outer contour, from cv::findContours within
+* its bounding box, so squares and rectangles are rejected, as they are there.
+*
+* Key points have pt at the weighted centroid, and size the diameter of a
+* disc of the same area, so can be sorted by size, as sks::DotDetector does.
+* As extract reuses member buffers, a single instance should not be used
+* from several threads at once.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT DotExtractor {
+
+public:
+
+  explicit DotExtractor(const DotExtractorParameters& parameters = DotExtractorParameters());
+  ~DotExtractor();
+
+  /**
+  * \brief Finds dots, which are connected, (8 way), regions of 0 in thresholdedImage.
+  * \param thresholdedImage CV_8UC1, where dots are 0, as from cv::THRESH_BINARY of dark dots
+  * \param image CV_8UC1 grey image, the same size, whose intensities weight the centroids
+  * \param keyPoints output, one per dot, in raster order of each dot's first pixel
+  */
+  void extract(const cv::Mat& thresholdedImage, const cv::Mat& image, std::vector<cv::KeyPoint>& keyPoints);
+
+  DotExtractorParameters getParameters() const;
+
+private:
+
+  DotExtractorParameters     m_Parameters;
+
+  // Scratch, kept between calls to extract, to avoid reallocation.
+  cv::Mat                    m_DotMask;
+  cv::Mat                    m_Labels;
+  cv::Mat                    m_Statistics;
+  cv::Mat                    m_Centroids;
+  std::vector<int>           m_Candidates;
+  std::vector<cv::KeyPoint>  m_CandidateKeyPoints;
+  std::vector<unsigned char> m_IsAccepted;
+
+}; // end class
+
+} // end namespace
+
+#endif
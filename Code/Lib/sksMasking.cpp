@@ -14,45 +14,65 @@
 
 #include "sksMasking.h"
 #include "sksValidate.h"
+#include "sksBuffers.h"
 #include "sksExceptionMacro.h"
 
 #include <opencv2/calib3d.hpp>
+#include <algorithm>
 #include <iostream>
 #include <vector>
 
 namespace sks
 {
 
+//-----------------------------------------------------------------------------
+inline bool InternalIsInMask(const double& x, const double& y, const cv::Mat& mask)
+{
+  return    x >= 0
+         && y >= 0
+         && static_cast<int>(x) < mask.cols
+         && static_cast<int>(y) < mask.rows
+         && mask.at<unsigned char>(static_cast<int>(y), static_cast<int>(x)) > 0;
+}
+
+
 //-----------------------------------------------------------------------------
 cv::Mat MaskPoints(const cv::Mat& points,
                    const cv::Mat& mask)
 {
+  cv::Mat outputPoints;
+  sks::MaskPoints(points, mask, outputPoints);
+  return outputPoints;
+}
 
-  std::vector<unsigned long int> indexes;
 
-  for (unsigned long int i = 0; i < points.rows; i++)
+//-----------------------------------------------------------------------------
+void MaskPoints(const cv::Mat& points,
+                const cv::Mat& mask,
+                cv::Mat& outputPoints)
+{
+  if (&outputPoints == &points)
   {
-    if (   points.at<double>(i, 0) >= 0
-        && points.at<double>(i, 1) >= 0
-        && static_cast<int>(points.at<double>(i, 0)) < mask.cols
-        && static_cast<int>(points.at<double>(i, 1)) < mask.rows
-        && mask.at<unsigned char>(static_cast<int>(points.at<double>(i, 1)),
-                                  static_cast<int>(points.at<double>(i, 0)) > 0)
-                                 )
-    {
-      indexes.push_back(i);
-    }
+    sksExceptionThrow() << "Masked points cannot be written into the input points.";
   }
 
-  cv::Mat outputPoints = cv::Mat(indexes.size(), 2, CV_64FC1);
+  // Sized for the worst case, (all points kept), then shrunk, which does not reallocate.
+  sks::PrepareOutputBuffer(points.rows, 2, CV_64FC1, outputPoints);
 
-  for (unsigned long int i = 0; i < indexes.size(); i++)
+  int numberOfMaskedPoints = 0;
+  for (int i = 0; i < points.rows; i++)
   {
-    outputPoints.at<double>(i, 0) = points.at<double>(indexes[i], 0);
-    outputPoints.at<double>(i, 1) = points.at<double>(indexes[i], 1);
+    const double* point = points.ptr<double>(i);
+    if (InternalIsInMask(point[0], point[1], mask))
+    {
+      double* output = outputPoints.ptr<double>(numberOfMaskedPoints);
+      output[0] = point[0];
+      output[1] = point[1];
+      numberOfMaskedPoints++;
+    }
   }
 
-  return outputPoints;
+  sks::PrepareOutputBuffer(numberOfMaskedPoints, 2, CV_64FC1, outputPoints);
 }
 
 
@@ -61,39 +81,80 @@ cv::Mat MaskStereoPoints(const cv::Mat& points,
                          const cv::Mat& leftMask,
                          const cv::Mat& rightMask)
 {
-  std::vector<unsigned long int> indexes;
+  cv::Mat outputPoints;
+  sks::MaskStereoPoints(points, leftMask, rightMask, outputPoints);
+  return outputPoints;
+}
+
 
-  for (unsigned long int i = 0; i < points.rows; i++)
+//-----------------------------------------------------------------------------
+void MaskStereoPoints(const cv::Mat& points,
+                      const cv::Mat& leftMask,
+                      const cv::Mat& rightMask,
+                      cv::Mat& outputPoints)
+{
+  if (&outputPoints == &points)
   {
-    if (   points.at<double>(i, 0) >= 0
-        && points.at<double>(i, 1) >= 0
-        && points.at<double>(i, 2) >= 0
-        && points.at<double>(i, 3) >= 0
-        && static_cast<int>(points.at<double>(i, 0)) < leftMask.cols
-        && static_cast<int>(points.at<double>(i, 1)) < leftMask.rows
-        && static_cast<int>(points.at<double>(i, 2)) < rightMask.cols
-        && static_cast<int>(points.at<double>(i, 3)) < rightMask.rows
-        && leftMask.at<unsigned char>(static_cast<int>(points.at<double>(i, 1)),
-                                      static_cast<int>(points.at<double>(i, 0)) > 0)
-        && rightMask.at<unsigned char>(static_cast<int>(points.at<double>(i, 1)),
-                                       static_cast<int>(points.at<double>(i, 0)) > 0)
+    sksExceptionThrow() << "Masked points cannot be written into the input points.";
+  }
+
+  // Sized for the worst case, (all points kept), then shrunk, which does not reallocate.
+  sks::PrepareOutputBuffer(points.rows, 4, CV_64FC1, outputPoints);
+
+  int numberOfMaskedPoints = 0;
+  for (int i = 0; i < points.rows; i++)
+  {
+    const double* point = points.ptr<double>(i);
+    if (   InternalIsInMask(point[0], point[1], leftMask)
+        && InternalIsInMask(point[2], point[3], rightMask)
        )
     {
-      indexes.push_back(i);
+      double* output = outputPoints.ptr<double>(numberOfMaskedPoints);
+      output[0] = point[0];
+      output[1] = point[1];
+      output[2] = point[2];
+      output[3] = point[3];
+      numberOfMaskedPoints++;
     }
   }
 
-  cv::Mat outputPoints = cv::Mat(indexes.size(), 4, CV_64FC1);
+  sks::PrepareOutputBuffer(numberOfMaskedPoints, 4, CV_64FC1, outputPoints);
+}
+
+
+//-----------------------------------------------------------------------------
+void MaskReconstructedPoints(const cv::Mat& points,
+                             const cv::Mat& leftMask,
+                             const cv::Mat& rightMask,
+                             cv::Mat& outputPoints)
+{
+  if (&outputPoints == &points)
+  {
+    sksExceptionThrow() << "Masked points cannot be written into the input points.";
+  }
+  if (points.cols < 7 || points.type() != CV_64FC1)
+  {
+    sksExceptionThrow() << "Reconstructed points should be CV_64FC1 with at least 7 columns, not "
+                        << points.cols << " columns of type " << points.type();
+  }
+
+  // Sized for the worst case, (all points kept), then shrunk, which does not reallocate.
+  sks::PrepareOutputBuffer(points.rows, points.cols, CV_64FC1, outputPoints);
 
-  for (unsigned long int i = 0; i < indexes.size(); i++)
+  int numberOfMaskedPoints = 0;
+  for (int i = 0; i < points.rows; i++)
   {
-    outputPoints.at<double>(i, 0) = points.at<double>(indexes[i], 0);
-    outputPoints.at<double>(i, 1) = points.at<double>(indexes[i], 1);
-    outputPoints.at<double>(i, 2) = points.at<double>(indexes[i], 2);
-    outputPoints.at<double>(i, 3) = points.at<double>(indexes[i], 3);
+    const double* point = points.ptr<double>(i);
+    if (   InternalIsInMask(point[3], point[4], leftMask)
+        && InternalIsInMask(point[5], point[6], rightMask)
+       )
+    {
+      std::copy(point, point + points.cols, outputPoints.ptr<double>(numberOfMaskedPoints));
+      numberOfMaskedPoints++;
+    }
   }
 
-  return outputPoints;
+  sks::PrepareOutputBuffer(numberOfMaskedPoints, points.cols, CV_64FC1, outputPoints);
 }
 
-} // end namespace
\ No newline at end of file
+} // end namespace
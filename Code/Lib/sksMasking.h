@@ -37,6 +37,18 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat MaskPoints(const cv::Mat& poin
                                                              const cv::Mat& mask);
 
 
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ * \param points [Nx2] matrix of 2D points, x, y, as doubles.
+ * \param mask image
+ * \param outputPoints [Mx2] matrix of masked points, x, y, as doubles.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void MaskPoints(const cv::Mat& points,
+                                                          const cv::Mat& mask,
+                                                          cv::Mat& outputPoints);
+
+
 
 /**
  * \brief Returns points that occur at locations with non-zero pixels in both leftImage and rightImage.
@@ -50,6 +62,36 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat MaskStereoPoints(const cv::Mat
                                                                    const cv::Mat& leftMask,
                                                                    const cv::Mat& rightMask);
 
+
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ * \param points [Nx4] matrix of 2D points, where each row is left_x, left_y, right_x, right_y, as doubles.
+ * \param leftMask image
+ * \param rightMask image
+ * \param outputPoints [Mx4] matrix of masked points as doubles.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void MaskStereoPoints(const cv::Mat& points,
+                                                                const cv::Mat& leftMask,
+                                                                const cv::Mat& rightMask,
+                                                                cv::Mat& outputPoints);
+
+
+/**
+ * \brief Returns reconstructed points whose left and right image locations are non-zero pixels in leftMask and rightMask.
+ *
+ * All columns are kept, so this can be applied after triangulation, e.g. to the output of sks::ReconstructPointsUsingStoyanov.
+ *
+ * \param points [NxM] matrix, M >= 7, where each row is x, y, z, left_x, left_y, right_x, right_y, ..., as doubles.
+ * \param leftMask image
+ * \param rightMask image
+ * \param outputPoints [KxM] matrix of masked points as doubles.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void MaskReconstructedPoints(const cv::Mat& points,
+                                                                       const cv::Mat& leftMask,
+                                                                       const cv::Mat& rightMask,
+                                                                       cv::Mat& outputPoints);
+
 } // end namespace
 
 #endif
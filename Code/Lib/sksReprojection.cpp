@@ -0,0 +1,402 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksReprojection.h"
+#include "sksBuffers.h"
+#include "sksExceptionMacro.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <opencv2/core/hal/intrin.hpp>
+#include <limits>
+#include <vector>
+
+namespace sks
+{
+
+//-----------------------------------------------------------------------------
+void InternalValidateReprojectionInputs(const cv::Mat& disparity,
+                                        const cv::Mat& disparityToDepthMatrix,
+                                        float* Q)
+{
+  if (disparity.empty())
+  {
+    sksExceptionThrow() << "Disparity image is empty.";
+  }
+  if (disparity.type() != CV_16SC1 && disparity.type() != CV_32FC1)
+  {
+    sksExceptionThrow() << "Disparity image should be CV_16SC1 or CV_32FC1, not type " << disparity.type();
+  }
+  if (disparityToDepthMatrix.rows != 4 || disparityToDepthMatrix.cols != 4
+      || (disparityToDepthMatrix.type() != CV_32FC1 && disparityToDepthMatrix.type() != CV_64FC1))
+  {
+    sksExceptionThrow() << "disparityToDepthMatrix should be a 4x4 CV_32FC1 or CV_64FC1 matrix.";
+  }
+
+  // Row-major, so Q[4 * r + c].
+  cv::Mat floatMatrix(4, 4, CV_32FC1, Q);
+  disparityToDepthMatrix.convertTo(floatMatrix, CV_32FC1);
+}
+
+
+//-----------------------------------------------------------------------------
+inline float InternalLoadDisparity(const short* disparity, const float&)
+{
+  return *disparity * (1.0f / 16.0f);
+}
+
+
+//-----------------------------------------------------------------------------
+inline float InternalLoadDisparity(const float* disparity, const float&)
+{
+  return *disparity;
+}
+
+
+#if CV_SIMD
+//-----------------------------------------------------------------------------
+inline cv::v_float32 InternalLoadDisparity(const short* disparity, const cv::v_float32&)
+{
+  return cv::v_cvt_f32(cv::vx_load_expand(disparity)) * cv::vx_setall_f32(1.0f / 16.0f);
+}
+
+
+//-----------------------------------------------------------------------------
+inline cv::v_float32 InternalLoadDisparity(const float* disparity, const cv::v_float32&)
+{
+  return cv::vx_load(disparity);
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief W = Q [x y d 1], the last row only, which decides if a pixel is valid.
+*/
+template <typename V>
+inline V InternalReprojectW(const V* Q, const V& x, const V& y, const V& d)
+{
+  return Q[12] * x + Q[13] * y + Q[14] * d + Q[15];
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief [X Y Z W] = Q [x y d 1], then divides by W.
+*
+* Written once for plain floats and SIMD registers (V), so the two paths
+* cannot drift apart. Q is row-major, and already broadcast to type V.
+*/
+template <typename V>
+inline void InternalReprojectPixel(const V* Q, const V& x, const V& y, const V& d,
+                                   V& X, V& Y, V& Z, V& W)
+{
+  W = InternalReprojectW(Q, x, y, d);
+  X = (Q[0] * x + Q[1] * y + Q[2] * d + Q[3]) / W;
+  Y = (Q[4] * x + Q[5] * y + Q[6] * d + Q[7]) / W;
+  Z = (Q[8] * x + Q[9] * y + Q[10] * d + Q[11]) / W;
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Reprojects one row of disparity, D being short or float, into xyz, (3 floats per pixel), and mask.
+*/
+template <typename D>
+void InternalReprojectRow(const D* disparity, const int& cols, const int& row,
+                          const float* Q, float* xyz, unsigned char* mask)
+{
+  const float nan = std::numeric_limits<float>::quiet_NaN();
+  int c = 0;
+
+#if CV_SIMD
+  const int lanes = cv::v_float32::nlanes;
+
+  cv::v_float32 QV[16];
+  for (int j = 0; j < 16; j++)
+  {
+    QV[j] = cv::vx_setall_f32(Q[j]);
+  }
+
+  float firstColumns[cv::v_float32::nlanes];
+  for (int j = 0; j < lanes; j++)
+  {
+    firstColumns[j] = static_cast<float>(j);
+  }
+
+  cv::v_float32 x = cv::vx_load(firstColumns);
+  cv::v_float32 y = cv::vx_setall_f32(static_cast<float>(row));
+  cv::v_float32 step = cv::vx_setall_f32(static_cast<float>(lanes));
+  cv::v_float32 zero = cv::vx_setzero_f32();
+  cv::v_float32 nanV = cv::vx_setall_f32(nan);
+  cv::v_float32 X, Y, Z, W;
+  float w[cv::v_float32::nlanes];
+
+  for (; c <= cols - lanes; c += lanes)
+  {
+    InternalReprojectPixel(QV, x, y, InternalLoadDisparity(disparity + c, cv::v_float32()), X, Y, Z, W);
+
+    // Comparisons involving NaN are false, so NaN W is invalid too.
+    cv::v_float32 isValid = W > zero;
+    X = cv::v_select(isValid, X, nanV);
+    Y = cv::v_select(isValid, Y, nanV);
+    Z = cv::v_select(isValid, Z, nanV);
+    cv::v_store_interleave(xyz + 3 * c, X, Y, Z);
+
+    cv::v_store(w, W);
+    for (int j = 0; j < lanes; j++)
+    {
+      mask[c + j] = w[j] > 0 ? 255 : 0;
+    }
+
+    x = x + step;
+  }
+#endif
+
+  // Remaining pixels, or all of them, if SIMD is not available.
+  float y1 = static_cast<float>(row);
+  float X1, Y1, Z1, W1;
+  for (; c < cols; c++)
+  {
+    float x1 = static_cast<float>(c);
+    InternalReprojectPixel(Q, x1, y1, InternalLoadDisparity(disparity + c, float()), X1, Y1, Z1, W1);
+
+    float* output = xyz + 3 * c;
+    if (W1 > 0)
+    {
+      output[0] = X1;
+      output[1] = Y1;
+      output[2] = Z1;
+      mask[c] = 255;
+    }
+    else
+    {
+      output[0] = nan;
+      output[1] = nan;
+      output[2] = nan;
+      mask[c] = 0;
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief As InternalReprojectRow, but only computes W, to fill mask, and returns the number of valid pixels.
+*/
+template <typename D>
+int InternalMaskValidRow(const D* disparity, const int& cols, const int& row,
+                         const float* Q, unsigned char* mask)
+{
+  int c = 0;
+
+#if CV_SIMD
+  const int lanes = cv::v_float32::nlanes;
+
+  cv::v_float32 QV[16];
+  for (int j = 0; j < 16; j++)
+  {
+    QV[j] = cv::vx_setall_f32(Q[j]);
+  }
+
+  float firstColumns[cv::v_float32::nlanes];
+  for (int j = 0; j < lanes; j++)
+  {
+    firstColumns[j] = static_cast<float>(j);
+  }
+
+  cv::v_float32 x = cv::vx_load(firstColumns);
+  cv::v_float32 y = cv::vx_setall_f32(static_cast<float>(row));
+  cv::v_float32 step = cv::vx_setall_f32(static_cast<float>(lanes));
+  float w[cv::v_float32::nlanes];
+
+  for (; c <= cols - lanes; c += lanes)
+  {
+    // Comparisons involving NaN are false, so NaN W is invalid too.
+    cv::v_store(w, InternalReprojectW(QV, x, y, InternalLoadDisparity(disparity + c, cv::v_float32())));
+    for (int j = 0; j < lanes; j++)
+    {
+      mask[c + j] = w[j] > 0 ? 255 : 0;
+    }
+    x = x + step;
+  }
+#endif
+
+  float y1 = static_cast<float>(row);
+  for (; c < cols; c++)
+  {
+    float x1 = static_cast<float>(c);
+    mask[c] = InternalReprojectW(Q, x1, y1, InternalLoadDisparity(disparity + c, float())) > 0 ? 255 : 0;
+  }
+
+  int numberOfValidPixels = 0;
+  for (c = 0; c < cols; c++)
+  {
+    numberOfValidPixels += mask[c] > 0 ? 1 : 0;
+  }
+  return numberOfValidPixels;
+}
+
+
+//-----------------------------------------------------------------------------
+template <typename D>
+void InternalReprojectToOrganizedPoints(const cv::Mat& disparity, const float* Q,
+                                        cv::Mat& organizedPoints, cv::Mat& validityMask)
+{
+  #pragma omp parallel for
+  for (int r = 0; r < disparity.rows; r++)
+  {
+    sks::InternalReprojectRow(disparity.ptr<D>(r), disparity.cols, r, Q,
+                              organizedPoints.ptr<float>(r), validityMask.ptr<unsigned char>(r));
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Two passes over the rows, the first only computing W, to count valid pixels, so each row knows where to write.
+*
+* The second pass writes the pixels the first pass found valid, so the counts
+* always agree, and only that pass computes X, Y and Z.
+*/
+template <typename D, typename T>
+void InternalReprojectToPoints(const cv::Mat& disparity, const float* Q, cv::Mat& outputPoints)
+{
+  std::vector<int> rowOffsets(disparity.rows + 1, 0);
+  std::vector<unsigned char> validPixels(disparity.total());
+
+  #pragma omp parallel for
+  for (int r = 0; r < disparity.rows; r++)
+  {
+    rowOffsets[r + 1] = sks::InternalMaskValidRow(disparity.ptr<D>(r), disparity.cols, r, Q,
+                                                  validPixels.data() + r * disparity.cols);
+  }
+
+  for (int r = 0; r < disparity.rows; r++)
+  {
+    rowOffsets[r + 1] += rowOffsets[r];
+  }
+
+  sks::PrepareOutputBuffer(rowOffsets[disparity.rows], 7, cv::DataType<T>::type, outputPoints);
+
+  #pragma omp parallel
+  {
+    // Per thread, so nothing is allocated per row.
+    std::vector<float> xyz(disparity.cols * 3);
+    std::vector<unsigned char> mask(disparity.cols);
+
+    #pragma omp for
+    for (int r = 0; r < disparity.rows; r++)
+    {
+      const D* disparityRow = disparity.ptr<D>(r);
+      const unsigned char* validRow = validPixels.data() + r * disparity.cols;
+      sks::InternalReprojectRow(disparityRow, disparity.cols, r, Q, xyz.data(), mask.data());
+
+      int i = rowOffsets[r];
+      for (int c = 0; c < disparity.cols; c++)
+      {
+        if (validRow[c] > 0)
+        {
+          T* output = outputPoints.ptr<T>(i);
+          output[0] = static_cast<T>(xyz[3 * c]);
+          output[1] = static_cast<T>(xyz[3 * c + 1]);
+          output[2] = static_cast<T>(xyz[3 * c + 2]);
+          output[3] = static_cast<T>(c);
+          output[4] = static_cast<T>(r);
+          output[5] = static_cast<T>(c - sks::InternalLoadDisparity(disparityRow + c, float()));
+          output[6] = static_cast<T>(r);
+          i++;
+        }
+      }
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void ReprojectDisparityToOrganizedPoints(const cv::Mat& disparity,
+                                         const cv::Mat& disparityToDepthMatrix,
+                                         cv::Mat& organizedPoints,
+                                         cv::Mat& validityMask)
+{
+  float Q[16];
+  sks::InternalValidateReprojectionInputs(disparity, disparityToDepthMatrix, Q);
+
+  // Does not allocate if already the right size and type.
+  organizedPoints.create(disparity.size(), CV_32FC3);
+  validityMask.create(disparity.size(), CV_8UC1);
+
+  if (disparity.type() == CV_16SC1)
+  {
+    sks::InternalReprojectToOrganizedPoints<short>(disparity, Q, organizedPoints, validityMask);
+  }
+  else
+  {
+    sks::InternalReprojectToOrganizedPoints<float>(disparity, Q, organizedPoints, validityMask);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat ReprojectDisparityToPoints(const cv::Mat& disparity,
+                                   const cv::Mat& disparityToDepthMatrix,
+                                   const int type)
+{
+  cv::Mat outputPoints;
+  sks::ReprojectDisparityToPoints(disparity, disparityToDepthMatrix, type, outputPoints);
+  return outputPoints;
+}
+
+
+//-----------------------------------------------------------------------------
+void ReprojectDisparityToPoints(const cv::Mat& disparity,
+                                const cv::Mat& disparityToDepthMatrix,
+                                const int type,
+                                cv::Mat& outputPoints)
+{
+  if (type != CV_32FC1 && type != CV_64FC1)
+  {
+    sksExceptionThrow() << "type should be CV_32FC1 or CV_64FC1, not " << type;
+  }
+
+  float Q[16];
+  sks::InternalValidateReprojectionInputs(disparity, disparityToDepthMatrix, Q);
+
+  if (disparity.type() == CV_16SC1)
+  {
+    if (type == CV_32FC1)
+    {
+      sks::InternalReprojectToPoints<short, float>(disparity, Q, outputPoints);
+    }
+    else
+    {
+      sks::InternalReprojectToPoints<short, double>(disparity, Q, outputPoints);
+    }
+  }
+  else
+  {
+    if (type == CV_32FC1)
+    {
+      sks::InternalReprojectToPoints<float, float>(disparity, Q, outputPoints);
+    }
+    else
+    {
+      sks::InternalReprojectToPoints<float, double>(disparity, Q, outputPoints);
+    }
+  }
+}
+
+} // end namespace
@@ -0,0 +1,75 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksReprojection_h
+#define sksReprojection_h
+
+#include <opencv2/core.hpp>
+#include "sksWin32ExportHeader.h"
+
+/**
+* \file sksReprojection.h
+* \brief Functions to convert disparity images, from rectified stereo, straight to 3D points.
+*
+* For rectified images, triangulation reduces to [X Y Z W]^T = Q [x y d 1]^T,
+* then dividing by W, so these are much faster than the general ray based
+* methods in sksTriangulate.h, on dense disparity. Rows are done in parallel,
+* and pixels within a row in SIMD registers, where OpenCV was built with them.
+*
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+ * \brief Reprojects every pixel of a disparity image, giving an image of 3D points, like cv::reprojectImageTo3D.
+ *
+ * Pixels where W <= 0 are invalid, which includes zero disparity, (infinitely
+ * far away), and the negative values cv::StereoBM and cv::StereoSGBM use for
+ * unmatched pixels, when their minimum disparity is 0.
+ *
+ * \param disparity CV_16SC1 disparity with 4 fractional bits, as from cv::StereoBM and cv::StereoSGBM, or CV_32FC1 disparity in pixels.
+ * \param disparityToDepthMatrix [4x4] Q matrix, e.g. from cv::stereoRectify.
+ * \param organizedPoints CV_32FC3 image of X, Y, Z, same size as disparity, NaN where invalid, reusing its memory where possible.
+ * \param validityMask CV_8UC1 image, same size as disparity, 255 where valid, 0 elsewhere, reusing its memory where possible.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void ReprojectDisparityToOrganizedPoints(const cv::Mat& disparity,
+                                                                                   const cv::Mat& disparityToDepthMatrix,
+                                                                                   cv::Mat& organizedPoints,
+                                                                                   cv::Mat& validityMask);
+
+/**
+ * \brief As above, but returns only the valid pixels, as a point cloud.
+ *
+ * \param disparity CV_16SC1 disparity with 4 fractional bits, or CV_32FC1 disparity in pixels.
+ * \param disparityToDepthMatrix [4x4] Q matrix, e.g. from cv::stereoRectify.
+ * \param type CV_32FC1 or CV_64FC1
+ * \return [Nx7] matrix, where the columns are X,Y,Z, x_left, y_left, x_right, y_right, the 2D matches being in rectified image coordinates, so y_right = y_left.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat ReprojectDisparityToPoints(const cv::Mat& disparity,
+                                                                            const cv::Mat& disparityToDepthMatrix,
+                                                                            const int type);
+
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void ReprojectDisparityToPoints(const cv::Mat& disparity,
+                                                                         const cv::Mat& disparityToDepthMatrix,
+                                                                         const int type,
+                                                                         cv::Mat& outputPoints);
+
+} // end namespace
+
+#endif
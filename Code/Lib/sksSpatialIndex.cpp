@@ -0,0 +1,243 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksSpatialIndex.h"
+#include "sksExceptionMacro.h"
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace sks
+{
+
+//-----------------------------------------------------------------------------
+SpatialIndex::SpatialIndex()
+: m_MinimumX(0)
+, m_MinimumY(0)
+, m_CellSize(1)
+, m_NumberOfColumns(0)
+, m_NumberOfRows(0)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+SpatialIndex::SpatialIndex(const cv::Mat& points)
+: SpatialIndex()
+{
+  this->setPoints(points);
+}
+
+
+//-----------------------------------------------------------------------------
+SpatialIndex::~SpatialIndex()
+{
+}
+
+
+//-----------------------------------------------------------------------------
+int SpatialIndex::getNumberOfPoints() const
+{
+  return static_cast<int>(m_Points.size());
+}
+
+
+//-----------------------------------------------------------------------------
+int InternalClampCell(const double position, const int numberOfCells)
+{
+  // Clamped as double, so queries far outside the bounding box cannot overflow an int.
+  if (!(position > 0))
+  {
+    return 0;
+  }
+  if (position >= numberOfCells - 1)
+  {
+    return numberOfCells - 1;
+  }
+  return static_cast<int>(position);
+}
+
+
+//-----------------------------------------------------------------------------
+int SpatialIndex::GetCellColumn(const double x) const
+{
+  // Clamped, so queries outside the bounding box start from the nearest edge cell.
+  return sks::InternalClampCell(std::floor((x - m_MinimumX) / m_CellSize), m_NumberOfColumns);
+}
+
+
+//-----------------------------------------------------------------------------
+int SpatialIndex::GetCellRow(const double y) const
+{
+  return sks::InternalClampCell(std::floor((y - m_MinimumY) / m_CellSize), m_NumberOfRows);
+}
+
+
+//-----------------------------------------------------------------------------
+void SpatialIndex::setPoints(const cv::Mat& points)
+{
+  if (!points.empty() && points.cols != 2)
+  {
+    sksExceptionThrow() << "Points should have 2 columns, not " << points.cols;
+  }
+  if (!points.empty() && points.type() != CV_32FC1 && points.type() != CV_64FC1)
+  {
+    sksExceptionThrow() << "Points should be CV_32FC1 or CV_64FC1, not type " << points.type();
+  }
+
+  m_Points.resize(points.rows);
+  for (int i = 0; i < points.rows; i++)
+  {
+    if (points.type() == CV_32FC1)
+    {
+      m_Points[i] = cv::Point2d(points.at<float>(i, 0), points.at<float>(i, 1));
+    }
+    else
+    {
+      m_Points[i] = cv::Point2d(points.at<double>(i, 0), points.at<double>(i, 1));
+    }
+  }
+
+  int numberOfPoints = static_cast<int>(m_Points.size());
+  if (numberOfPoints == 0)
+  {
+    m_NumberOfColumns = 0;
+    m_NumberOfRows = 0;
+    m_CellStart.clear();
+    m_CellPoints.clear();
+    return;
+  }
+
+  double maximumX = m_Points[0].x;
+  double maximumY = m_Points[0].y;
+  m_MinimumX = m_Points[0].x;
+  m_MinimumY = m_Points[0].y;
+  for (int i = 1; i < numberOfPoints; i++)
+  {
+    m_MinimumX = std::min(m_MinimumX, m_Points[i].x);
+    m_MinimumY = std::min(m_MinimumY, m_Points[i].y);
+    maximumX = std::max(maximumX, m_Points[i].x);
+    maximumY = std::max(maximumY, m_Points[i].y);
+  }
+
+  // Roughly one point per cell, but never more than N + 1 cells along either
+  // axis, so nearly collinear points do not give a huge, empty, grid.
+  double width = maximumX - m_MinimumX;
+  double height = maximumY - m_MinimumY;
+  m_CellSize = std::max(std::sqrt(width * height / numberOfPoints),
+                        std::max(width, height) / numberOfPoints);
+  if (!(m_CellSize > 0))
+  {
+    m_CellSize = 1;
+  }
+  m_NumberOfColumns = static_cast<int>(width / m_CellSize) + 1;
+  m_NumberOfRows = static_cast<int>(height / m_CellSize) + 1;
+
+  // Counting sort of point indexes by cell, which keeps them in index order within each cell.
+  int numberOfCells = m_NumberOfColumns * m_NumberOfRows;
+  m_CellStart.assign(numberOfCells + 1, 0);
+  m_CellPoints.resize(numberOfPoints);
+
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    int cell = this->GetCellRow(m_Points[i].y) * m_NumberOfColumns + this->GetCellColumn(m_Points[i].x);
+    m_CellStart[cell + 1]++;
+  }
+  for (int c = 0; c < numberOfCells; c++)
+  {
+    m_CellStart[c + 1] += m_CellStart[c];
+  }
+  std::vector<int> nextInCell(m_CellStart.begin(), m_CellStart.end() - 1);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    int cell = this->GetCellRow(m_Points[i].y) * m_NumberOfColumns + this->GetCellColumn(m_Points[i].x);
+    m_CellPoints[nextInCell[cell]++] = i;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+int SpatialIndex::findNearest(const double x, const double y) const
+{
+  double squaredDistance = 0;
+  return this->findNearest(x, y, squaredDistance);
+}
+
+
+//-----------------------------------------------------------------------------
+int SpatialIndex::findNearest(const double x, const double y, double& squaredDistance) const
+{
+  int bestIndex = -1;
+  squaredDistance = std::numeric_limits<double>::max();
+
+  if (m_Points.empty())
+  {
+    return bestIndex;
+  }
+
+  int column = this->GetCellColumn(x);
+  int row = this->GetCellRow(y);
+  int maximumRing = std::max(std::max(column, m_NumberOfColumns - 1 - column),
+                             std::max(row, m_NumberOfRows - 1 - row));
+
+  for (int ring = 0; ring <= maximumRing; ring++)
+  {
+    int firstRow = std::max(row - ring, 0);
+    int lastRow = std::min(row + ring, m_NumberOfRows - 1);
+    int firstColumn = std::max(column - ring, 0);
+    int lastColumn = std::min(column + ring, m_NumberOfColumns - 1);
+
+    for (int r = firstRow; r <= lastRow; r++)
+    {
+      // Only the cells on the ring itself, as those inside were done already.
+      bool isEdgeRow = (r == row - ring || r == row + ring);
+      int step = isEdgeRow ? 1 : 2 * ring;
+
+      for (int c = column - ring; c <= column + ring; c += step)
+      {
+        if (c < firstColumn || c > lastColumn)
+        {
+          continue;
+        }
+
+        int cell = r * m_NumberOfColumns + c;
+        for (int k = m_CellStart[cell]; k < m_CellStart[cell + 1]; k++)
+        {
+          int i = m_CellPoints[k];
+          double dx = m_Points[i].x - x;
+          double dy = m_Points[i].y - y;
+          double distance = dx * dx + dy * dy;
+          if (distance < squaredDistance || (distance == squaredDistance && i < bestIndex))
+          {
+            squaredDistance = distance;
+            bestIndex = i;
+          }
+        }
+      }
+    }
+
+    // The query lies in, (or beyond the edge of), the centre cell, so anything
+    // in ring + 1 or further out is at least ring * m_CellSize away.
+    double reach = ring * m_CellSize;
+    if (bestIndex >= 0 && squaredDistance < reach * reach)
+    {
+      break;
+    }
+  }
+
+  return bestIndex;
+}
+
+} // end namespace
@@ -0,0 +1,102 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksSpatialIndex_h
+#define sksSpatialIndex_h
+
+#include <opencv2/core.hpp>
+#include "sksWin32ExportHeader.h"
+
+#include <vector>
+
+/**
+* \file sksSpatialIndex.h
+* \brief Nearest neighbour search over a fixed set of 2D points.
+* \ingroup utilities
+*/
+namespace sks
+{
+
+/**
+* \class SpatialIndex
+* \brief Uniform grid over a set of 2D points, for exact nearest neighbour queries.
+*
+* The bounding box of the points is divided into cells, sized so there is
+* roughly one point per cell, and each point is bucketed into its cell once,
+* in O(N). A query then searches rings of cells outwards from its own cell,
+* stopping once no unsearched cell can be closer than the best point so far,
+* so for evenly spread points, such as calibration dots, each query is O(1),
+* rather than O(N) for a brute force search.
+*
+* Results are identical to a brute force search, including ties, which go to
+* the lowest index. The index is immutable once built, so can be queried
+* from many threads.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT SpatialIndex {
+
+public:
+
+  /**
+  * \brief Creates an empty index, see setPoints().
+  */
+  SpatialIndex();
+
+  /**
+  * \param points [Nx2] CV_32FC1 or CV_64FC1 matrix of x, y, which is copied.
+  */
+  explicit SpatialIndex(const cv::Mat& points);
+
+  ~SpatialIndex();
+
+  /**
+  * \brief Replaces the indexed points, reusing memory where possible.
+  * \param points [Nx2] CV_32FC1 or CV_64FC1 matrix of x, y, which is copied. Can be empty.
+  */
+  void setPoints(const cv::Mat& points);
+
+  int getNumberOfPoints() const;
+
+  /**
+  * \brief Returns the row index of the point nearest to (x, y), or -1 if there are no points.
+  * \param squaredDistance output, squared distance to that point.
+  */
+  int findNearest(const double x, const double y, double& squaredDistance) const;
+
+  /**
+  * \brief As above, when the distance is not needed.
+  */
+  int findNearest(const double x, const double y) const;
+
+private:
+
+  int GetCellColumn(const double x) const;
+  int GetCellRow(const double y) const;
+
+  std::vector<cv::Point2d> m_Points;
+  double                   m_MinimumX;
+  double                   m_MinimumY;
+  double                   m_CellSize;
+  int                      m_NumberOfColumns;
+  int                      m_NumberOfRows;
+
+  // Point indexes, sorted by cell, so those in cell c are
+  // m_CellPoints[m_CellStart[c]] to m_CellPoints[m_CellStart[c + 1] - 1].
+  std::vector<int>         m_CellStart;
+  std::vector<int>         m_CellPoints;
+
+}; // end class
+
+} // end namespace
+
+#endif
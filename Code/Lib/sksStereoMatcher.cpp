@@ -0,0 +1,365 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksStereoMatcher.h"
+#include "sksBuffers.h"
+#include "sksExceptionMacro.h"
+#include <opencv2/imgproc.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace sks
+{
+
+//------------------------------------------------------------------------------
+void ValidateStereoMatcherImages(const cv::Mat& leftImage, const cv::Mat& rightImage)
+{
+  if (leftImage.empty() || rightImage.empty())
+  {
+    sksExceptionThrow() << "Images should not be empty.";
+  }
+  if (leftImage.size() != rightImage.size())
+  {
+    sksExceptionThrow() << "Left size:" << leftImage.size()
+      << " is not equal to right size:" << rightImage.size();
+  }
+}
+
+
+//------------------------------------------------------------------------------
+StereoMatcher::StereoMatcher()
+{
+}
+
+
+//------------------------------------------------------------------------------
+StereoMatcher::~StereoMatcher()
+{
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StereoMatcher::matchPoints(const cv::Mat& leftImage,
+                                   const cv::Mat& rightImage)
+{
+  cv::Mat matchedPoints;
+  this->matchPoints(leftImage, rightImage, matchedPoints);
+  return matchedPoints;
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovStereoMatcher::StoyanovStereoMatcher()
+{
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovStereoMatcher::~StoyanovStereoMatcher()
+{
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovStereoMatcher::matchPoints(const cv::Mat& leftImage,
+                                        const cv::Mat& rightImage,
+                                        cv::Mat& matchedPoints)
+{
+  m_Reconstructor.matchPoints(leftImage, rightImage, matchedPoints);
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovReconstructor& StoyanovStereoMatcher::getReconstructor()
+{
+  return m_Reconstructor;
+}
+
+
+//------------------------------------------------------------------------------
+RectifiedStereoMatcher::RectifiedStereoMatcher(const sks::StereoRig& rig,
+                                               const int imageWidth,
+                                               const int imageHeight,
+                                               const bool useSemiGlobal)
+: m_ImageSize(imageWidth, imageHeight)
+, m_Step(1)
+, m_Rectifier(rig, imageWidth, imageHeight)
+{
+  // The rectifier has already checked the image size.
+  cv::Mat leftProjection = m_Rectifier.getLeftProjectionMatrix();
+  cv::Mat rightProjection = m_Rectifier.getRightProjectionMatrix();
+
+  m_LeftCameraMatrix = cv::Matx33d(rig.getLeftCameraMatrix());
+  m_RightCameraMatrix = cv::Matx33d(rig.getRightCameraMatrix());
+  m_LeftRectifiedCameraMatrixInverse = cv::Matx33d(cv::Mat(leftProjection.colRange(0, 3))).inv();
+  m_RightRectifiedCameraMatrixInverse = cv::Matx33d(cv::Mat(rightProjection.colRange(0, 3))).inv();
+  m_LeftRectificationInverse = cv::Matx33d(m_Rectifier.getLeftRectification()).t();
+  m_RightRectificationInverse = cv::Matx33d(m_Rectifier.getRightRectification()).t();
+
+  // The rig pads these to 8 values, (k1, k2, p1, p2, k3, k4, k5, k6), all zero if there are none.
+  m_LeftDistortion = cv::Vec<double, 8>(rig.getLeftDistortionCoefficients().ptr<double>(0));
+  m_RightDistortion = cv::Vec<double, 8>(rig.getRightDistortionCoefficients().ptr<double>(0));
+
+  int numberOfDisparities = 64;
+  if (useSemiGlobal)
+  {
+    int blockSize = 5;
+    m_DisparityMatcher = cv::StereoSGBM::create(0, numberOfDisparities, blockSize,
+                                                8 * blockSize * blockSize,
+                                                32 * blockSize * blockSize);
+  }
+  else
+  {
+    m_DisparityMatcher = cv::StereoBM::create(numberOfDisparities, 15);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+RectifiedStereoMatcher::~RectifiedStereoMatcher()
+{
+}
+
+
+//------------------------------------------------------------------------------
+void RectifiedStereoMatcher::setStep(const int step)
+{
+  if (step < 1)
+  {
+    sksExceptionThrow() << "step should be at least 1, not " << step;
+  }
+  m_Step = step;
+}
+
+
+//------------------------------------------------------------------------------
+int RectifiedStereoMatcher::getStep() const
+{
+  return m_Step;
+}
+
+
+//------------------------------------------------------------------------------
+cv::Ptr<cv::StereoMatcher> RectifiedStereoMatcher::getDisparityMatcher() const
+{
+  return m_DisparityMatcher;
+}
+
+
+//------------------------------------------------------------------------------
+void RectifiedStereoMatcher::MapToOriginalImage(const double& x, const double& y,
+                                                const cv::Matx33d& cameraMatrix,
+                                                const cv::Matx33d& inverseRectifiedCameraMatrix,
+                                                const cv::Matx33d& inverseRectification,
+                                                const cv::Vec<double, 8>& distortion,
+                                                double* output) const
+{
+  const double* d = distortion.val;
+
+  // Rectified pixel, to ray in rectified camera, to ray in original camera.
+  cv::Vec3d ray = inverseRectification * (inverseRectifiedCameraMatrix * cv::Vec3d(x, y, 1));
+  double relativeX = ray[0] / ray[2];
+  double relativeY = ray[1] / ray[2];
+
+  // Then distorted, as cv::projectPoints, to the original pixel.
+  double r2 = relativeX * relativeX + relativeY * relativeY;
+  double radial = (1 + d[0] * r2 + d[1] * r2 * r2 + d[4] * r2 * r2 * r2)
+                / (1 + d[5] * r2 + d[6] * r2 * r2 + d[7] * r2 * r2 * r2);
+
+  double distortedX = relativeX * radial + 2 * d[2] * relativeX * relativeY
+                    + d[3] * (r2 + 2 * relativeX * relativeX);
+  double distortedY = relativeY * radial + d[2] * (r2 + 2 * relativeY * relativeY)
+                    + 2 * d[3] * relativeX * relativeY;
+
+  cv::Vec3d pixel = cameraMatrix * cv::Vec3d(distortedX, distortedY, 1);
+  output[0] = pixel[0] / pixel[2];
+  output[1] = pixel[1] / pixel[2];
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat RectifiedStereoMatcher::getDisparityToDepthMatrix() const
+{
+  return m_Rectifier.getDisparityToDepthMatrix();
+}
+
+
+//------------------------------------------------------------------------------
+const sks::StereoRectifier& RectifiedStereoMatcher::getRectifier() const
+{
+  return m_Rectifier;
+}
+
+
+//------------------------------------------------------------------------------
+void RectifiedStereoMatcher::computeDisparity(const cv::Mat& leftImage,
+                                              const cv::Mat& rightImage,
+                                              cv::Mat& disparity)
+{
+  sks::ValidateStereoMatcherImages(leftImage, rightImage);
+
+  if (leftImage.size() != m_ImageSize)
+  {
+    sksExceptionThrow() << "Image size:" << leftImage.size()
+      << " is not equal to the size given at construction:" << m_ImageSize;
+  }
+
+  cv::Mat leftGreyImage = leftImage;
+  cv::Mat rightGreyImage = rightImage;
+  if (leftImage.channels() == 3)
+  {
+    cv::cvtColor(leftImage, m_LeftGreyImage, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(rightImage, m_RightGreyImage, cv::COLOR_BGR2GRAY);
+    leftGreyImage = m_LeftGreyImage;
+    rightGreyImage = m_RightGreyImage;
+  }
+
+  m_Rectifier.rectify(leftGreyImage, rightGreyImage, m_LeftRectifiedImage, m_RightRectifiedImage);
+
+  // CV_16SC1, fixed point, with 4 fractional bits.
+  m_DisparityMatcher->compute(m_LeftRectifiedImage, m_RightRectifiedImage, disparity);
+}
+
+
+//------------------------------------------------------------------------------
+void RectifiedStereoMatcher::matchPoints(const cv::Mat& leftImage,
+                                         const cv::Mat& rightImage,
+                                         cv::Mat& matchedPoints)
+{
+  this->computeDisparity(leftImage, rightImage, m_Disparity);
+
+  // Invalid pixels are (minimum - 1) * 16. Zero disparity would give parallel rays.
+  short invalidDisparity = static_cast<short>(std::max(0, (m_DisparityMatcher->getMinDisparity() - 1) * 16));
+
+  // Count per row, so each row knows where to write, and rows can be done in parallel.
+  int numberOfRows = (m_Disparity.rows + m_Step - 1) / m_Step;
+  m_RowOffsets.assign(numberOfRows + 1, 0);
+
+  #pragma omp parallel for
+  for (int r = 0; r < numberOfRows; r++)
+  {
+    const short* disparity = m_Disparity.ptr<short>(r * m_Step);
+    int numberOfMatches = 0;
+    for (int c = 0; c < m_Disparity.cols; c += m_Step)
+    {
+      if (disparity[c] > invalidDisparity)
+      {
+        numberOfMatches++;
+      }
+    }
+    m_RowOffsets[r + 1] = numberOfMatches;
+  }
+
+  for (int r = 0; r < numberOfRows; r++)
+  {
+    m_RowOffsets[r + 1] += m_RowOffsets[r];
+  }
+
+  sks::PrepareOutputBuffer(m_RowOffsets[numberOfRows], 4, CV_64FC1, matchedPoints);
+
+  #pragma omp parallel for
+  for (int r = 0; r < numberOfRows; r++)
+  {
+    int y = r * m_Step;
+    const short* disparity = m_Disparity.ptr<short>(y);
+    int i = m_RowOffsets[r];
+    for (int c = 0; c < m_Disparity.cols; c += m_Step)
+    {
+      if (disparity[c] > invalidDisparity)
+      {
+        double* output = matchedPoints.ptr<double>(i);
+        this->MapToOriginalImage(c, y,
+                                 m_LeftCameraMatrix,
+                                 m_LeftRectifiedCameraMatrixInverse,
+                                 m_LeftRectificationInverse,
+                                 m_LeftDistortion,
+                                 output);
+        this->MapToOriginalImage(c - disparity[c] / 16.0, y,
+                                 m_RightCameraMatrix,
+                                 m_RightRectifiedCameraMatrixInverse,
+                                 m_RightRectificationInverse,
+                                 m_RightDistortion,
+                                 output + 2);
+        i++;
+      }
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+FeatureStereoMatcher::FeatureStereoMatcher(const int maximumNumberOfFeatures,
+                                           const double maximumVerticalDistance)
+: m_MaximumVerticalDistance(maximumVerticalDistance)
+, m_Matcher(cv::NORM_HAMMING, true)
+{
+  if (maximumNumberOfFeatures < 1)
+  {
+    sksExceptionThrow() << "maximumNumberOfFeatures should be at least 1, not " << maximumNumberOfFeatures;
+  }
+  m_Detector = cv::ORB::create(maximumNumberOfFeatures);
+}
+
+
+//------------------------------------------------------------------------------
+FeatureStereoMatcher::~FeatureStereoMatcher()
+{
+}
+
+
+//------------------------------------------------------------------------------
+void FeatureStereoMatcher::matchPoints(const cv::Mat& leftImage,
+                                       const cv::Mat& rightImage,
+                                       cv::Mat& matchedPoints)
+{
+  sks::ValidateStereoMatcherImages(leftImage, rightImage);
+
+  m_Detector->detectAndCompute(leftImage, cv::noArray(), m_LeftKeyPoints, m_LeftDescriptors);
+  m_Detector->detectAndCompute(rightImage, cv::noArray(), m_RightKeyPoints, m_RightDescriptors);
+
+  m_Matches.clear();
+  if (!m_LeftDescriptors.empty() && !m_RightDescriptors.empty())
+  {
+    m_Matcher.match(m_LeftDescriptors, m_RightDescriptors, m_Matches);
+  }
+
+  // In place, keeping the order of the left key points.
+  std::vector<cv::DMatch>::size_type numberOfMatches = 0;
+  for (std::vector<cv::DMatch>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    const cv::Point2f& left = m_LeftKeyPoints[m_Matches[i].queryIdx].pt;
+    const cv::Point2f& right = m_RightKeyPoints[m_Matches[i].trainIdx].pt;
+    if (m_MaximumVerticalDistance < 0 || std::abs(left.y - right.y) <= m_MaximumVerticalDistance)
+    {
+      m_Matches[numberOfMatches] = m_Matches[i];
+      numberOfMatches++;
+    }
+  }
+  m_Matches.resize(numberOfMatches);
+
+  sks::PrepareOutputBuffer(static_cast<int>(m_Matches.size()), 4, CV_64FC1, matchedPoints);
+  for (std::vector<cv::DMatch>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    const cv::Point2f& left = m_LeftKeyPoints[m_Matches[i].queryIdx].pt;
+    const cv::Point2f& right = m_RightKeyPoints[m_Matches[i].trainIdx].pt;
+    double* output = matchedPoints.ptr<double>(static_cast<int>(i));
+    output[0] = left.x;
+    output[1] = left.y;
+    output[2] = right.x;
+    output[3] = right.y;
+  }
+}
+
+} // end namespace
@@ -0,0 +1,238 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksStereoMatcher_h
+#define sksStereoMatcher_h
+
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/features2d.hpp>
+#include "sksStereoRig.h"
+#include "sksStereoRectifier.h"
+#include "sksStoyanov2010.h"
+#include "sksWin32ExportHeader.h"
+
+/**
+* \file sksStereoMatcher.h
+* \brief Interchangeable stereo matching methods, all producing matches in the
+* Nx4 format used by the triangulation functions, (see sksTriangulate.h).
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+* \class StereoMatcher
+* \brief Interface for stereo matching, so that methods can be swapped without changing downstream code.
+*
+* Implementations return matches in the coordinates of the images passed in,
+* (i.e. not rectified). So, for undistorted images, the output can be passed
+* straight to sks::StereoRig::triangulatePointsUsingHartley, or
+* sks::TriangulatePointsUsingHartley etc. For distorted images, the matches are
+* distorted too, so must be triangulated with a sks::StereoRig built with the
+* distortion coefficients, using its triangulateDistortedPointsUsing* methods.
+* Implementations keep state between calls, so use one instance per thread.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StereoMatcher {
+
+public:
+
+  StereoMatcher();
+  virtual ~StereoMatcher();
+
+  /**
+  * \brief Gets the matching points in left and right images.
+  * \return Nx4 CV_64FC1 matrix, where the columns are x_left, y_left, x_right, y_right, i.e. 2D pixel locations.
+  */
+  cv::Mat matchPoints(const cv::Mat& leftImage,
+                      const cv::Mat& rightImage);
+
+  /**
+  * \brief As above, but writes into matchedPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  */
+  virtual void matchPoints(const cv::Mat& leftImage,
+                           const cv::Mat& rightImage,
+                           cv::Mat& matchedPoints) = 0;
+
+private:
+
+  StereoMatcher(const StereoMatcher&);
+  StereoMatcher& operator=(const StereoMatcher&);
+
+}; // end class
+
+
+/**
+* \class StoyanovStereoMatcher
+* \brief Quasi-dense matching, using sks::StoyanovReconstructor.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StoyanovStereoMatcher : public StereoMatcher {
+
+public:
+
+  StoyanovStereoMatcher();
+  virtual ~StoyanovStereoMatcher();
+
+  using StereoMatcher::matchPoints;
+  virtual void matchPoints(const cv::Mat& leftImage,
+                           const cv::Mat& rightImage,
+                           cv::Mat& matchedPoints);
+
+  /**
+  * \brief For configuring streaming, pyramid mode etc. The match format should be left as the default.
+  */
+  StoyanovReconstructor& getReconstructor();
+
+private:
+
+  StoyanovReconstructor m_Reconstructor;
+
+}; // end class
+
+
+/**
+* \class RectifiedStereoMatcher
+* \brief Dense matching, using cv::StereoBM or cv::StereoSGBM on rectified images.
+*
+* Images are rectified by sks::StereoRectifier, using maps computed once, from the calibration, and
+* every valid pixel of the disparity image, (or every step'th pixel, see setStep),
+* is mapped back to original image coordinates, re-applying the rig's distortion,
+* so, as for all sks::StereoMatcher, matches are in the coordinates of the images
+* passed in. Assumes a horizontal stereo rig.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT RectifiedStereoMatcher : public StereoMatcher {
+
+public:
+
+  /**
+  * \param rig calibration, which has already been validated, including any distortion coefficients
+  * \param imageWidth width of the images that will be matched
+  * \param imageHeight height of the images that will be matched
+  * \param useSemiGlobal if false, uses cv::StereoBM, if true, uses cv::StereoSGBM.
+  */
+  RectifiedStereoMatcher(const sks::StereoRig& rig,
+                         const int imageWidth,
+                         const int imageHeight,
+                         const bool useSemiGlobal);
+  virtual ~RectifiedStereoMatcher();
+
+  using StereoMatcher::matchPoints;
+  virtual void matchPoints(const cv::Mat& leftImage,
+                           const cv::Mat& rightImage,
+                           cv::Mat& matchedPoints);
+
+  /**
+  * \brief Only outputs every step'th pixel, in x and y, of the disparity image. Default 1.
+  */
+  void setStep(const int step);
+  int getStep() const;
+
+  /**
+  * \brief For tuning the number of disparities, block size etc.
+  */
+  cv::Ptr<cv::StereoMatcher> getDisparityMatcher() const;
+
+  /**
+  * \brief Rectifies both images, and computes disparity, aligned to the rectified left image.
+  * \param disparity CV_16SC1, with 4 fractional bits, reusing its memory where possible.
+  */
+  void computeDisparity(const cv::Mat& leftImage,
+                        const cv::Mat& rightImage,
+                        cv::Mat& disparity);
+
+  /**
+  * \brief Q matrix, for sks::ReprojectDisparityToPoints, to reproject the output of computeDisparity.
+  *
+  * \see sks::StereoRectifier::getDisparityToDepthMatrix
+  */
+  cv::Mat getDisparityToDepthMatrix() const;
+
+  const sks::StereoRectifier& getRectifier() const;
+
+private:
+
+  void MapToOriginalImage(const double& x, const double& y,
+                          const cv::Matx33d& cameraMatrix,
+                          const cv::Matx33d& inverseRectifiedCameraMatrix,
+                          const cv::Matx33d& inverseRectification,
+                          const cv::Vec<double, 8>& distortion,
+                          double* output) const;
+
+  cv::Size                    m_ImageSize;
+  int                         m_Step;
+  cv::Ptr<cv::StereoMatcher>  m_DisparityMatcher;
+
+  sks::StereoRectifier        m_Rectifier;
+
+  // For mapping rectified pixels back to the original images.
+  cv::Matx33d                 m_LeftCameraMatrix;
+  cv::Matx33d                 m_RightCameraMatrix;
+  cv::Matx33d                 m_LeftRectifiedCameraMatrixInverse;
+  cv::Matx33d                 m_RightRectifiedCameraMatrixInverse;
+  cv::Matx33d                 m_LeftRectificationInverse;
+  cv::Matx33d                 m_RightRectificationInverse;
+  cv::Vec<double, 8>          m_LeftDistortion;
+  cv::Vec<double, 8>          m_RightDistortion;
+
+  // Scratch images, reused from one frame to the next.
+  cv::Mat                     m_LeftGreyImage;
+  cv::Mat                     m_RightGreyImage;
+  cv::Mat                     m_LeftRectifiedImage;
+  cv::Mat                     m_RightRectifiedImage;
+  cv::Mat                     m_Disparity;
+  std::vector<int>            m_RowOffsets;
+
+}; // end class
+
+
+/**
+* \class FeatureStereoMatcher
+* \brief Sparse matching of ORB features, using brute force Hamming distance, with a cross check.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT FeatureStereoMatcher : public StereoMatcher {
+
+public:
+
+  /**
+  * \param maximumNumberOfFeatures maximum number of ORB features detected in each image.
+  * \param maximumVerticalDistance if >= 0, matches whose y coordinates differ by more are rejected, which suits roughly rectified images.
+  */
+  FeatureStereoMatcher(const int maximumNumberOfFeatures = 5000,
+                       const double maximumVerticalDistance = -1);
+  virtual ~FeatureStereoMatcher();
+
+  using StereoMatcher::matchPoints;
+  virtual void matchPoints(const cv::Mat& leftImage,
+                           const cv::Mat& rightImage,
+                           cv::Mat& matchedPoints);
+
+private:
+
+  double                      m_MaximumVerticalDistance;
+  cv::Ptr<cv::ORB>            m_Detector;
+  cv::BFMatcher               m_Matcher;
+
+  // Reused from one frame to the next.
+  std::vector<cv::KeyPoint>   m_LeftKeyPoints;
+  std::vector<cv::KeyPoint>   m_RightKeyPoints;
+  cv::Mat                     m_LeftDescriptors;
+  cv::Mat                     m_RightDescriptors;
+  std::vector<cv::DMatch>     m_Matches;
+
+}; // end class
+
+} // end namespace
+
+#endif
@@ -0,0 +1,385 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksStereoPipeline.h"
+#include "sksBuffers.h"
+#include "sksMasking.h"
+#include "sksExceptionMacro.h"
+#include <opencv2/videoio.hpp>
+
+#include <chrono>
+#include <memory>
+
+namespace sks
+{
+
+//------------------------------------------------------------------------------
+StereoPipelineStatistics::StereoPipelineStatistics()
+: numberOfFrames(0)
+, lastSeconds(0)
+, meanSeconds(0)
+, queueDepth(0)
+, numberDropped(0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StereoPipeline::FrameSource CreateVideoFrameSource(const std::string& leftFileName,
+                                                   const std::string& rightFileName)
+{
+  // Shared, as std::function must be copyable, and cv::VideoCapture is not.
+  std::shared_ptr<cv::VideoCapture> leftVideo(new cv::VideoCapture(leftFileName));
+  std::shared_ptr<cv::VideoCapture> rightVideo(new cv::VideoCapture(rightFileName));
+
+  if (!leftVideo->isOpened())
+  {
+    sksExceptionThrow() << "Failed to open:" << leftFileName;
+  }
+  if (!rightVideo->isOpened())
+  {
+    sksExceptionThrow() << "Failed to open:" << rightFileName;
+  }
+
+  return [leftVideo, rightVideo](cv::Mat& leftImage, cv::Mat& rightImage)
+  {
+    return leftVideo->read(leftImage) && rightVideo->read(rightImage);
+  };
+}
+
+
+//------------------------------------------------------------------------------
+StereoPipeline::StereoPipeline(const FrameSource& source,
+                               const sks::StereoRig& rig,
+                               const bool useHartley)
+: m_Source(source)
+, m_Rig(rig)
+, m_UseHartley(useHartley)
+, m_IsStarted(false)
+, m_IsStopping(false)
+, m_LastLatency(0)
+{
+  if (!source)
+  {
+    sksExceptionThrow() << "No frame source.";
+  }
+  for (int s = 0; s < NUMBER_OF_STAGES; s++)
+  {
+    m_IsFinished[s] = false;
+    m_TotalTicks[s] = 0;
+    m_LastTicks[s] = 0;
+    m_NumberOfFrames[s] = 0;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+StereoPipeline::StereoPipeline(const std::string& leftFileName,
+                               const std::string& rightFileName,
+                               const sks::StereoRig& rig,
+                               const bool useHartley)
+: StereoPipeline(sks::CreateVideoFrameSource(leftFileName, rightFileName), rig, useHartley)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StereoPipeline::~StereoPipeline()
+{
+  this->StopThreads();
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::setMasks(const cv::Mat& leftMask, const cv::Mat& rightMask)
+{
+  if (m_IsStarted)
+  {
+    sksExceptionThrow() << "Masks cannot be changed once started.";
+  }
+  if (leftMask.empty() != rightMask.empty())
+  {
+    sksExceptionThrow() << "Masks should both be empty, or both be non-empty.";
+  }
+  if (!leftMask.empty() && (leftMask.type() != CV_8UC1 || rightMask.type() != CV_8UC1))
+  {
+    sksExceptionThrow() << "Masks should be CV_8UC1.";
+  }
+  m_LeftMask = leftMask;
+  m_RightMask = rightMask;
+}
+
+
+//------------------------------------------------------------------------------
+sks::StoyanovReconstructor& StereoPipeline::getReconstructor()
+{
+  return m_Reconstructor;
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::start()
+{
+  if (m_IsStarted)
+  {
+    sksExceptionThrow() << "StereoPipeline can only be started once.";
+  }
+
+  StoyanovMatchFormat format = m_Reconstructor.getMatchFormat();
+  StoyanovMatchFormat defaultFormat;
+  if (   format.type != defaultFormat.type
+      || format.isStructureOfArrays != defaultFormat.isStructureOfArrays
+      || format.includeCorrelation != defaultFormat.includeCorrelation
+     )
+  {
+    sksExceptionThrow() << "StereoPipeline requires the default match format.";
+  }
+
+  m_IsStarted = true;
+  for (int s = 0; s < NUMBER_OF_STAGES; s++)
+  {
+    m_Threads.push_back(std::thread(&StereoPipeline::RunStage, this, s));
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::StopThreads()
+{
+  m_IsStopping = true;
+  for (std::vector<std::thread>::size_type t = 0; t < m_Threads.size(); t++)
+  {
+    if (m_Threads[t].joinable())
+    {
+      m_Threads[t].join();
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::ThrowIfFailed()
+{
+  std::lock_guard<std::mutex> lock(m_ErrorMutex);
+  if (!m_Error.empty())
+  {
+    sksExceptionThrow() << m_Error;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::stop()
+{
+  this->StopThreads();
+  this->ThrowIfFailed();
+}
+
+
+//------------------------------------------------------------------------------
+bool StereoPipeline::isRunning() const
+{
+  return m_IsStarted && !m_IsFinished[NUMBER_OF_STAGES - 1];
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::Process(const int stage, const Frame& input, Frame& output)
+{
+  switch (stage)
+  {
+    case MATCH:
+      m_Reconstructor.matchPoints(input.leftImage, input.rightImage, output.points);
+      break;
+
+    case TRIANGULATE:
+    {
+      // A covered lens, or blank frame, matches nothing, which should not stop the pipeline.
+      if (input.points.rows == 0)
+      {
+        output.points.create(0, 7, CV_64FC1);
+        break;
+      }
+
+      sks::PrepareOutputBuffer(input.points.rows, 7, CV_64FC1, output.points);
+      cv::Mat matchedPoints = output.points.colRange(3, 7);
+      cv::Mat triangulatedPoints = output.points.colRange(0, 3);
+      input.points.copyTo(matchedPoints);
+
+      if (m_UseHartley)
+      {
+        m_Rig.triangulatePointsUsingHartley(matchedPoints, triangulatedPoints);
+      }
+      else
+      {
+        m_Rig.triangulatePointsUsingMidpointOfShortestDistance(matchedPoints, triangulatedPoints);
+      }
+      break;
+    }
+
+    case MASK:
+      if (input.points.rows == 0)
+      {
+        // As copying an empty matrix would lose its 7 columns.
+        output.points.create(0, 7, CV_64FC1);
+      }
+      else if (m_LeftMask.empty())
+      {
+        // Copied, as the input buffer goes back to the previous stage.
+        input.points.copyTo(output.points);
+      }
+      else
+      {
+        sks::MaskReconstructedPoints(input.points, m_LeftMask, m_RightMask, output.points);
+      }
+      break;
+
+    default:
+      sksExceptionThrow() << "Invalid stage:" << stage;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StereoPipeline::RunStage(const int stage)
+{
+  try
+  {
+    long long frameNumber = 0;
+
+    while (!m_IsStopping)
+    {
+      Frame& output = m_Buffers[stage].back();
+      int64 startTicks = cv::getTickCount();
+
+      if (stage == CAPTURE)
+      {
+        if (!m_Source(output.leftImage, output.rightImage))
+        {
+          break;
+        }
+        output.frameNumber = frameNumber++;
+        output.captureTicks = startTicks;
+      }
+      else
+      {
+        // Checked before receive(), so the last frame upstream is never missed.
+        bool isUpstreamFinished = m_IsFinished[stage - 1];
+
+        if (!m_Buffers[stage - 1].receive())
+        {
+          if (isUpstreamFinished)
+          {
+            break;
+          }
+          std::this_thread::sleep_for(std::chrono::microseconds(100));
+          continue;
+        }
+
+        const Frame& input = m_Buffers[stage - 1].front();
+        startTicks = cv::getTickCount();
+        this->Process(stage, input, output);
+        output.frameNumber = input.frameNumber;
+        output.captureTicks = input.captureTicks;
+      }
+
+      long long ticks = cv::getTickCount() - startTicks;
+      m_LastTicks[stage] = ticks;
+      m_TotalTicks[stage] += ticks;
+      m_NumberOfFrames[stage]++;
+
+      m_Buffers[stage].publish();
+    }
+  }
+  catch (const sks::Exception& e)
+  {
+    std::lock_guard<std::mutex> lock(m_ErrorMutex);
+    if (m_Error.empty())
+    {
+      m_Error = e.GetDescription();
+    }
+    m_IsStopping = true;
+  }
+  catch (const std::exception& e)
+  {
+    std::lock_guard<std::mutex> lock(m_ErrorMutex);
+    if (m_Error.empty())
+    {
+      m_Error = e.what();
+    }
+    m_IsStopping = true;
+  }
+
+  m_IsFinished[stage] = true;
+}
+
+
+//------------------------------------------------------------------------------
+bool StereoPipeline::getLatestPoints(cv::Mat& points, long long& frameNumber)
+{
+  this->ThrowIfFailed();
+
+  TripleBuffer<Frame>& buffer = m_Buffers[NUMBER_OF_STAGES - 1];
+  if (!buffer.receive())
+  {
+    return false;
+  }
+
+  const Frame& frame = buffer.front();
+  frame.points.copyTo(points);
+  frameNumber = frame.frameNumber;
+  m_LastLatency = static_cast<double>(cv::getTickCount() - frame.captureTicks) / cv::getTickFrequency();
+  return true;
+}
+
+
+//------------------------------------------------------------------------------
+double StereoPipeline::getLastLatency() const
+{
+  return m_LastLatency;
+}
+
+
+//------------------------------------------------------------------------------
+StereoPipelineStatistics StereoPipeline::getStatistics(const int stage) const
+{
+  if (stage < 0 || stage >= NUMBER_OF_STAGES)
+  {
+    sksExceptionThrow() << "Invalid stage:" << stage;
+  }
+
+  StereoPipelineStatistics statistics;
+  statistics.numberOfFrames = m_NumberOfFrames[stage];
+  statistics.lastSeconds = static_cast<double>(m_LastTicks[stage]) / cv::getTickFrequency();
+  if (statistics.numberOfFrames > 0)
+  {
+    statistics.meanSeconds = static_cast<double>(m_TotalTicks[stage])
+                             / cv::getTickFrequency() / statistics.numberOfFrames;
+  }
+  if (stage > CAPTURE)
+  {
+    statistics.queueDepth = m_Buffers[stage - 1].getDepth();
+    statistics.numberDropped = m_Buffers[stage - 1].getNumberDropped();
+  }
+  return statistics;
+}
+
+
+//------------------------------------------------------------------------------
+long long StereoPipeline::getNumberOfDroppedResults() const
+{
+  return m_Buffers[NUMBER_OF_STAGES - 1].getNumberDropped();
+}
+
+} // end namespace
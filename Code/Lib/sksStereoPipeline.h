@@ -0,0 +1,223 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksStereoPipeline_h
+#define sksStereoPipeline_h
+
+#include <opencv2/core.hpp>
+#include "sksStereoRig.h"
+#include "sksStoyanov2010.h"
+#include "sksTripleBuffer.h"
+#include "sksWin32ExportHeader.h"
+
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+* \file sksStereoPipeline.h
+* \brief Live reconstruction, with capture, matching, triangulation and masking on separate threads.
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+* \brief Counters for one stage of a sks::StereoPipeline, and the queue in front of it.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StereoPipelineStatistics
+{
+  StereoPipelineStatistics();
+
+  /// Frames processed by this stage.
+  long long numberOfFrames;
+
+  /// Time taken by this stage for the last frame, in seconds.
+  double lastSeconds;
+
+  /// Mean time taken by this stage per frame, in seconds.
+  double meanSeconds;
+
+  /// Frames waiting for this stage, so 0 or 1. Always 0 for CAPTURE.
+  int queueDepth;
+
+  /// Frames replaced by a newer one before this stage took them. Always 0 for CAPTURE.
+  long long numberDropped;
+};
+
+
+/**
+* \class StereoPipeline
+* \brief Runs capture, matching, triangulation and masking as a pipeline, one thread per stage.
+*
+* Stages are connected by sks::TripleBuffer, so when a stage falls behind,
+* the frames it has not started are dropped in favour of the newest one, and
+* latency does not grow. While one frame is being triangulated, the next is
+* being matched and the one after that captured, so throughput approaches
+* that of the slowest stage, (usually matching), rather than the sum of all stages.
+*
+* The output is Nx7 points, as sks::ReconstructPointsUsingStoyanov, only
+* including points inside the masks, if set. Points are read with getLatestPoints(),
+* e.g. from a render loop, which is the single consumer of the last stage.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StereoPipeline {
+
+public:
+
+  /**
+  * \brief Fills the left and right images with the next frame, returning false at the end of the stream.
+  *
+  * Called on the capture thread, so must not be shared with other threads.
+  * The images are reused from frame to frame, so can be written in place.
+  */
+  typedef std::function<bool(cv::Mat&, cv::Mat&)> FrameSource;
+
+  enum Stages
+  {
+    CAPTURE = 0,
+    MATCH = 1,
+    TRIANGULATE = 2,
+    MASK = 3,
+    NUMBER_OF_STAGES = 4
+  };
+
+  /**
+  * \param source provides pairs of undistorted images
+  * \param rig calibration, which has already been validated
+  * \param useHartley if false, uses midpoint method, if true, uses hartley.
+  */
+  StereoPipeline(const FrameSource& source,
+                 const sks::StereoRig& rig,
+                 const bool useHartley);
+
+  /**
+  * \brief Reads from two videos, or image sequences, (see cv::VideoCapture), until either ends.
+  */
+  StereoPipeline(const std::string& leftFileName,
+                 const std::string& rightFileName,
+                 const sks::StereoRig& rig,
+                 const bool useHartley);
+
+  /**
+  * \brief Stops, but does not throw, so call stop() first to see any errors.
+  */
+  ~StereoPipeline();
+
+  /**
+  * \brief Sets masks applied in the last stage, both empty, (the default), or both non-empty.
+  * \see sks::MaskReconstructedPoints
+  */
+  void setMasks(const cv::Mat& leftMask, const cv::Mat& rightMask);
+
+  /**
+  * \brief The matcher used by the match stage, which can be configured, e.g. for streaming or bands, before start().
+  *
+  * The match format must be left as the default, CV_64FC1, without correlation.
+  */
+  sks::StoyanovReconstructor& getReconstructor();
+
+  /**
+  * \brief Starts all stages. A pipeline can only be started once.
+  */
+  void start();
+
+  /**
+  * \brief Stops all stages, and throws if any of them failed.
+  */
+  void stop();
+
+  /**
+  * \brief Returns true until all stages have finished, e.g. at the end of the stream, or after an error.
+  */
+  bool isRunning() const;
+
+  /**
+  * \brief Copies the latest points into points, if there are any not already returned.
+  *
+  * Throws if any stage failed.
+  *
+  * \param points [Nx7] points, as sks::ReconstructPointsUsingStoyanov, reusing its memory where possible.
+  * \param frameNumber index of the frame, from the start of the stream, so gaps show dropped frames.
+  * \return true if there were new points.
+  */
+  bool getLatestPoints(cv::Mat& points, long long& frameNumber);
+
+  /**
+  * \brief Time from capture to the end of the last stage, in seconds, for the last frame returned by getLatestPoints().
+  */
+  double getLastLatency() const;
+
+  /**
+  * \brief Counters for one of sks::StereoPipeline::Stages, which can be read while running.
+  */
+  StereoPipelineStatistics getStatistics(const int stage) const;
+
+  /**
+  * \brief Number of results replaced by a newer one before getLatestPoints() was called.
+  */
+  long long getNumberOfDroppedResults() const;
+
+private:
+
+  StereoPipeline(const StereoPipeline&);
+  StereoPipeline& operator=(const StereoPipeline&);
+
+  /**
+  * \brief What passes from one stage to the next. Each stage only fills what the next one needs.
+  */
+  struct Frame
+  {
+    Frame() : frameNumber(0), captureTicks(0) {}
+
+    long long frameNumber;
+    int64     captureTicks;
+    cv::Mat   leftImage;
+    cv::Mat   rightImage;
+    cv::Mat   points;
+  };
+
+  void RunStage(const int stage);
+  void Process(const int stage, const Frame& input, Frame& output);
+  void StopThreads();
+  void ThrowIfFailed();
+
+  FrameSource                           m_Source;
+  sks::StereoRig                        m_Rig;
+  bool                                  m_UseHartley;
+  cv::Mat                               m_LeftMask;
+  cv::Mat                               m_RightMask;
+  sks::StoyanovReconstructor            m_Reconstructor;
+
+  // m_Buffers[s] is the output of stage s, and the input of stage s + 1.
+  sks::TripleBuffer<Frame>              m_Buffers[NUMBER_OF_STAGES];
+  std::vector<std::thread>              m_Threads;
+  bool                                  m_IsStarted;
+  std::atomic<bool>                     m_IsStopping;
+  std::atomic<bool>                     m_IsFinished[NUMBER_OF_STAGES];
+  std::atomic<long long>                m_TotalTicks[NUMBER_OF_STAGES];
+  std::atomic<long long>                m_LastTicks[NUMBER_OF_STAGES];
+  std::atomic<long long>                m_NumberOfFrames[NUMBER_OF_STAGES];
+  double                                m_LastLatency;
+
+  std::mutex                            m_ErrorMutex;
+  std::string                           m_Error;
+
+}; // end class
+
+} // end namespace
+
+#endif
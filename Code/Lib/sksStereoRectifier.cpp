@@ -0,0 +1,186 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksStereoRectifier.h"
+#include "sksExceptionMacro.h"
+#include "sksValidate.h"
+#include <opencv2/calib3d.hpp>
+#include <opencv2/imgproc.hpp>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace sks
+{
+
+//------------------------------------------------------------------------------
+StereoRectifier::StereoRectifier(const sks::StereoRig& rig,
+                                 const cv::Mat& leftDistortion,
+                                 const cv::Mat& rightDistortion,
+                                 const int imageWidth,
+                                 const int imageHeight)
+: m_ImageSize(imageWidth, imageHeight)
+, m_IsParallel(false)
+{
+  if (imageWidth < 1 || imageHeight < 1)
+  {
+    sksExceptionThrow() << "Image size should be positive, not " << m_ImageSize;
+  }
+  sks::ValidateDistortionCoefficients(leftDistortion);
+  sks::ValidateDistortionCoefficients(rightDistortion);
+
+  cv::Mat leftCameraMatrix = rig.getLeftCameraMatrix();
+  cv::Mat rightCameraMatrix = rig.getRightCameraMatrix();
+  cv::Mat disparityToDepth;
+
+  cv::stereoRectify(leftCameraMatrix, leftDistortion,
+                    rightCameraMatrix, rightDistortion,
+                    m_ImageSize,
+                    rig.getLeftToRightRotationMatrix(),
+                    rig.getLeftToRightTranslationVector(),
+                    m_LeftRectification, m_RightRectification,
+                    m_LeftProjectionMatrix, m_RightProjectionMatrix,
+                    disparityToDepth,
+                    cv::CALIB_ZERO_DISPARITY, -1);
+
+  // Fixed point maps, which cv::remap reads faster than floating point ones.
+  cv::initUndistortRectifyMap(leftCameraMatrix, leftDistortion, m_LeftRectification, m_LeftProjectionMatrix,
+                              m_ImageSize, CV_16SC2, m_LeftMap1, m_LeftMap2);
+  cv::initUndistortRectifyMap(rightCameraMatrix, rightDistortion, m_RightRectification, m_RightProjectionMatrix,
+                              m_ImageSize, CV_16SC2, m_RightMap1, m_RightMap2);
+
+  // Rotates reprojected points from the rectified, back to the original, left camera.
+  cv::Mat inverseLeftRectification = cv::Mat::eye(4, 4, CV_64FC1);
+  cv::Mat(m_LeftRectification.t()).copyTo(inverseLeftRectification(cv::Rect(0, 0, 3, 3)));
+  m_DisparityToDepthMatrix = inverseLeftRectification * disparityToDepth;
+}
+
+
+//------------------------------------------------------------------------------
+StereoRectifier::StereoRectifier(const sks::StereoRig& rig,
+                                 const int imageWidth,
+                                 const int imageHeight)
+: StereoRectifier(rig,
+                  rig.getLeftDistortionCoefficients(),
+                  rig.getRightDistortionCoefficients(),
+                  imageWidth, imageHeight)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StereoRectifier::~StereoRectifier()
+{
+}
+
+
+//------------------------------------------------------------------------------
+void StereoRectifier::setParallel(const bool isParallel)
+{
+  m_IsParallel = isParallel;
+}
+
+
+//------------------------------------------------------------------------------
+bool StereoRectifier::getParallel() const
+{
+  return m_IsParallel;
+}
+
+
+//------------------------------------------------------------------------------
+cv::Size StereoRectifier::getImageSize() const
+{
+  return m_ImageSize;
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StereoRectifier::getLeftRectification() const
+{
+  return m_LeftRectification.clone();
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StereoRectifier::getRightRectification() const
+{
+  return m_RightRectification.clone();
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StereoRectifier::getLeftProjectionMatrix() const
+{
+  return m_LeftProjectionMatrix.clone();
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StereoRectifier::getRightProjectionMatrix() const
+{
+  return m_RightProjectionMatrix.clone();
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StereoRectifier::getDisparityToDepthMatrix() const
+{
+  return m_DisparityToDepthMatrix.clone();
+}
+
+
+//------------------------------------------------------------------------------
+void StereoRectifier::rectify(const cv::Mat& leftImage,
+                              const cv::Mat& rightImage,
+                              cv::Mat& leftRectifiedImage,
+                              cv::Mat& rightRectifiedImage) const
+{
+  if (leftImage.empty() || rightImage.empty())
+  {
+    sksExceptionThrow() << "Images should not be empty.";
+  }
+  if (leftImage.size() != m_ImageSize || rightImage.size() != m_ImageSize)
+  {
+    sksExceptionThrow() << "Image sizes:" << leftImage.size() << " and " << rightImage.size()
+      << " should equal the size given at construction:" << m_ImageSize;
+  }
+  if (leftImage.type() != rightImage.type())
+  {
+    sksExceptionThrow() << "Left type:" << leftImage.type()
+      << " is not equal to right type:" << rightImage.type();
+  }
+  if (&leftRectifiedImage == &rightRectifiedImage
+      || leftImage.data == leftRectifiedImage.data
+      || rightImage.data == rightRectifiedImage.data)
+  {
+    sksExceptionThrow() << "Rectified images should be distinct from each other, and from the inputs.";
+  }
+
+  // Allocated here, as nothing must throw inside the parallel region.
+  leftRectifiedImage.create(m_ImageSize, leftImage.type());
+  rightRectifiedImage.create(m_ImageSize, rightImage.type());
+
+  #pragma omp parallel sections if (m_IsParallel)
+  {
+    #pragma omp section
+    cv::remap(leftImage, leftRectifiedImage, m_LeftMap1, m_LeftMap2, cv::INTER_LINEAR);
+
+    #pragma omp section
+    cv::remap(rightImage, rightRectifiedImage, m_RightMap1, m_RightMap2, cv::INTER_LINEAR);
+  }
+}
+
+} // end namespace
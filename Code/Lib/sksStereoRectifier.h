@@ -0,0 +1,139 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksStereoRectifier_h
+#define sksStereoRectifier_h
+
+#include <opencv2/core.hpp>
+#include "sksStereoRig.h"
+#include "sksWin32ExportHeader.h"
+
+/**
+* \file sksStereoRectifier.h
+* \brief Undistorts and rectifies stereo pairs, using maps computed once per calibration.
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+* \class StereoRectifier
+* \brief Undistorts and rectifies pairs of images, so matching points lie on the same row.
+*
+* The maps from cv::initUndistortRectifyMap are built once, at construction,
+* in the fixed point CV_16SC2 form, which cv::remap reads faster, and with
+* less memory traffic, than floating point maps. So each frame only costs
+* two calls to cv::remap.
+*
+* The rectified projection matrices, and Q, describe the rectified images,
+* so can be passed to sks::ReprojectDisparityToPoints, or used to triangulate
+* points matched in the rectified images.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StereoRectifier {
+
+public:
+
+  /**
+  * \param rig calibration, which has already been validated
+  * \param leftDistortion left distortion coefficients, or empty if already undistorted
+  * \param rightDistortion right distortion coefficients, or empty if already undistorted
+  * \param imageWidth width of the images that will be rectified
+  * \param imageHeight height of the images that will be rectified
+  */
+  StereoRectifier(const sks::StereoRig& rig,
+                  const cv::Mat& leftDistortion,
+                  const cv::Mat& rightDistortion,
+                  const int imageWidth,
+                  const int imageHeight);
+
+  /**
+  * \brief Using the distortion coefficients of the rig, which are all zero if it was built without any.
+  */
+  StereoRectifier(const sks::StereoRig& rig,
+                  const int imageWidth,
+                  const int imageHeight);
+
+  ~StereoRectifier();
+
+  /**
+  * \brief Undistorts and rectifies both images, with bilinear interpolation.
+  * \param leftRectifiedImage output, reusing its memory where possible
+  * \param rightRectifiedImage output, reusing its memory where possible
+  */
+  void rectify(const cv::Mat& leftImage,
+               const cv::Mat& rightImage,
+               cv::Mat& leftRectifiedImage,
+               cv::Mat& rightRectifiedImage) const;
+
+  /**
+  * \brief If true, left and right are remapped at the same time, on separate threads. Default false.
+  *
+  * cv::remap is already multi-threaded, so this mainly helps small images,
+  * where each call has too little work to keep all cores busy.
+  */
+  void setParallel(const bool isParallel);
+  bool getParallel() const;
+
+  cv::Size getImageSize() const;
+
+  /**
+  * \brief [3x3] rotation from the original, to the rectified, left camera, (R1 from cv::stereoRectify).
+  */
+  cv::Mat getLeftRectification() const;
+
+  /**
+  * \brief [3x3] rotation from the original, to the rectified, right camera, (R2 from cv::stereoRectify).
+  */
+  cv::Mat getRightRectification() const;
+
+  /**
+  * \brief [3x4] projection matrix of the rectified left camera, (P1 from cv::stereoRectify).
+  */
+  cv::Mat getLeftProjectionMatrix() const;
+
+  /**
+  * \brief [3x4] projection matrix of the rectified right camera, (P2 from cv::stereoRectify).
+  */
+  cv::Mat getRightProjectionMatrix() const;
+
+  /**
+  * \brief Q matrix, for sks::ReprojectDisparityToPoints, to reproject disparity computed from the rectified images.
+  *
+  * Unlike the Q from cv::stereoRectify, this includes the inverse of the left
+  * rectification, so points are in the original left camera coordinates,
+  * like those from sks::StereoRig.
+  */
+  cv::Mat getDisparityToDepthMatrix() const;
+
+private:
+
+  cv::Size  m_ImageSize;
+  bool      m_IsParallel;
+
+  cv::Mat   m_LeftMap1;
+  cv::Mat   m_LeftMap2;
+  cv::Mat   m_RightMap1;
+  cv::Mat   m_RightMap2;
+
+  cv::Mat   m_LeftRectification;
+  cv::Mat   m_RightRectification;
+  cv::Mat   m_LeftProjectionMatrix;
+  cv::Mat   m_RightProjectionMatrix;
+  cv::Mat   m_DisparityToDepthMatrix;
+
+}; // end class
+
+} // end namespace
+
+#endif
@@ -0,0 +1,1039 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksStereoRig.h"
+#include "sksValidate.h"
+#include "sksBuffers.h"
+#include "sksExceptionMacro.h"
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include <opencv2/calib3d.hpp>
+#include <opencv2/core/hal/intrin.hpp>
+#include <boost/math/special_functions/fpclassify.hpp>
+#include <limits>
+#include <cmath>
+
+namespace sks
+{
+
+//-----------------------------------------------------------------------------
+StereoRig::StereoRig(const cv::Mat& leftCameraMatrix,
+                     const cv::Mat& rightCameraMatrix,
+                     const cv::Mat& leftToRightRotationMatrix,
+                     const cv::Mat& leftToRightTranslationVector
+                    )
+: StereoRig(leftCameraMatrix, cv::Mat(),
+            rightCameraMatrix, cv::Mat(),
+            leftToRightRotationMatrix,
+            leftToRightTranslationVector)
+{
+}
+
+
+//-----------------------------------------------------------------------------
+void InternalPadDistortionCoefficients(const cv::Mat& distortionCoefficients, cv::Mat& paddedCoefficients)
+{
+  paddedCoefficients = cv::Mat::zeros(1, 8, CV_64FC1);
+  if (!distortionCoefficients.empty())
+  {
+    cv::Mat coefficients;
+    distortionCoefficients.reshape(1, 1).convertTo(coefficients, CV_64FC1);
+    coefficients.copyTo(paddedCoefficients.colRange(0, coefficients.cols));
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+StereoRig::StereoRig(const cv::Mat& leftCameraMatrix,
+                     const cv::Mat& leftDistortionCoefficients,
+                     const cv::Mat& rightCameraMatrix,
+                     const cv::Mat& rightDistortionCoefficients,
+                     const cv::Mat& leftToRightRotationMatrix,
+                     const cv::Mat& leftToRightTranslationVector
+                    )
+{
+  sks::ValidateStereoParameters(
+    leftCameraMatrix,
+    rightCameraMatrix,
+    leftToRightRotationMatrix,
+    leftToRightTranslationVector
+  );
+  sks::ValidateDistortionCoefficients(leftDistortionCoefficients);
+  sks::ValidateDistortionCoefficients(rightDistortionCoefficients);
+
+  // Padded to k1, k2, p1, p2, k3, k4, k5, k6, so the undistortion loop has no special cases.
+  InternalPadDistortionCoefficients(leftDistortionCoefficients, m_LeftDistortionCoefficients);
+  InternalPadDistortionCoefficients(rightDistortionCoefficients, m_RightDistortionCoefficients);
+
+  // Camera calibration routines are often 32 bit, as some drawing functions require 32 bit data.
+  // These triangulation routines need 64 bit data, so we convert once, here.
+  leftCameraMatrix.convertTo(m_LeftCameraMatrix, CV_64FC1);
+  rightCameraMatrix.convertTo(m_RightCameraMatrix, CV_64FC1);
+  leftToRightRotationMatrix.convertTo(m_LeftToRightRotationMatrix, CV_64FC1);
+  leftToRightTranslationVector.convertTo(m_LeftToRightTranslationVector, CV_64FC1);
+
+  // We invert the intrinsic params, so we can convert from pixels to normalised image coordinates.
+  m_LeftCameraMatrixInverse = m_LeftCameraMatrix.inv();
+  m_RightCameraMatrixInverse = m_RightCameraMatrix.inv();
+
+  // Setup R2L from L2R.
+  cv::Mat L2R64 = cv::Mat::eye(4, 4, CV_64FC1);
+  m_LeftToRightRotationMatrix.copyTo(L2R64(cv::Rect(0, 0, 3, 3)));
+  m_LeftToRightTranslationVector.copyTo(L2R64(cv::Rect(3, 0, 1, 3)));
+
+  cv::Mat R2L64 = L2R64.inv();
+  m_RightToLeftRotationMatrix = R2L64(cv::Rect(0, 0, 3, 3)).clone();
+  m_RightToLeftTranslationVector = R2L64(cv::Rect(3, 0, 1, 3)).clone();
+
+  // Reading Prince 2012 Computer Vision, the projection matrix, is just the extrinsic parameters,
+  // as our coordinates will be in a normalised camera space. P1 should be identity, so that
+  // reconstructed coordinates are in Left Camera Space, to P2 should reflect a right to left transform.
+  m_LeftProjectionMatrix = cv::Matx34d::eye();
+  for (int i = 0; i < 3; i++)
+  {
+    for (int j = 0; j < 4; j++)
+    {
+      m_RightProjectionMatrix(i, j) = L2R64.at<double>(i, j);
+    }
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void StereoRig::ValidatePoints(const cv::Mat& inputUndistortedPoints, const cv::Mat& outputPoints) const
+{
+  int numberOfPoints = inputUndistortedPoints.rows;
+
+  if (numberOfPoints < 1)
+  {
+    sksExceptionThrow() << "No points to triangulate!";
+  }
+
+  if (inputUndistortedPoints.cols != 4)
+  {
+    sksExceptionThrow() << "Points to triangulate should have 4 columns, not "
+                        << inputUndistortedPoints.cols;
+  }
+
+  if (inputUndistortedPoints.type() != CV_32FC1 && inputUndistortedPoints.type() != CV_64FC1)
+  {
+    sksExceptionThrow() << "Points to triangulate should be CV_32FC1 or CV_64FC1, not type "
+                        << inputUndistortedPoints.type();
+  }
+
+  if (&outputPoints == &inputUndistortedPoints)
+  {
+    sksExceptionThrow() << "Triangulated points cannot be written into the input points.";
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getLeftCameraMatrix() const
+{
+  return m_LeftCameraMatrix.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getRightCameraMatrix() const
+{
+  return m_RightCameraMatrix.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getLeftToRightRotationMatrix() const
+{
+  return m_LeftToRightRotationMatrix.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getLeftToRightTranslationVector() const
+{
+  return m_LeftToRightTranslationVector.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getRightToLeftRotationMatrix() const
+{
+  return m_RightToLeftRotationMatrix.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getRightToLeftTranslationVector() const
+{
+  return m_RightToLeftTranslationVector.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getLeftDistortionCoefficients() const
+{
+  return m_LeftDistortionCoefficients.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getRightDistortionCoefficients() const
+{
+  return m_RightDistortionCoefficients.clone();
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getLeftProjectionMatrix() const
+{
+  return cv::Mat(m_LeftProjectionMatrix, true);
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::getRightProjectionMatrix() const
+{
+  return cv::Mat(m_RightProjectionMatrix, true);
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Cached calibration, converted to the scalar type of the points, as row-major arrays.
+*/
+template <typename T>
+struct InternalStereoParameters
+{
+  T K1Inv[9];
+  T K2Inv[9];
+  T R2LRot[9];
+  T R2LTrn[3];
+  T P1[12];
+  T P2[12];
+  T D1[8];
+  T D2[8];
+  T Identity[9];
+};
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void InternalCopy(const double* input, const int& size, T* output)
+{
+  for (int i = 0; i < size; i++)
+  {
+    output[i] = static_cast<T>(input[i]);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Maps a scalar type to the widest SIMD register OpenCV was built with.
+*
+* Lane count follows the instruction set OpenCV was built for, e.g. for doubles,
+* 2 for SSE2/NEON, 4 for AVX2, 8 for AVX-512, and twice that for floats.
+* If there is no SIMD support for a type, lanes is 1, and only the scalar code is used.
+*/
+template <typename T>
+struct InternalVectorType
+{
+  typedef T type;
+  enum { lanes = 1 };
+};
+
+#if CV_SIMD
+template <>
+struct InternalVectorType<float>
+{
+  typedef cv::v_float32 type;
+  enum { lanes = cv::v_float32::nlanes };
+};
+#endif
+
+#if CV_SIMD_64F
+template <>
+struct InternalVectorType<double>
+{
+  typedef cv::v_float64 type;
+  enum { lanes = cv::v_float64::nlanes };
+};
+#endif
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+inline T InternalSetAll(const double& value, const T&)
+{
+  return static_cast<T>(value);
+}
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+inline T InternalLoad(const T* values, const T&)
+{
+  return *values;
+}
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+inline void InternalStore(T* values, const T& value)
+{
+  *values = value;
+}
+
+
+//-----------------------------------------------------------------------------
+inline float InternalSqrt(const float& value)
+{
+  return std::sqrt(value);
+}
+
+
+//-----------------------------------------------------------------------------
+inline double InternalSqrt(const double& value)
+{
+  return std::sqrt(value);
+}
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+inline void InternalSetNaNIfParallel(const T& sc, const T& tc,
+                                     T& x, T& y, T& z)
+{
+  if (!boost::math::isfinite(sc) || !boost::math::isfinite(tc))
+  {
+    x = std::numeric_limits<T>::quiet_NaN();
+    y = std::numeric_limits<T>::quiet_NaN();
+    z = std::numeric_limits<T>::quiet_NaN();
+  }
+}
+
+
+#if CV_SIMD
+//-----------------------------------------------------------------------------
+inline cv::v_float32 InternalSetAll(const double& value, const cv::v_float32&)
+{
+  return cv::vx_setall_f32(static_cast<float>(value));
+}
+
+
+//-----------------------------------------------------------------------------
+inline cv::v_float32 InternalLoad(const float* values, const cv::v_float32&)
+{
+  return cv::vx_load(values);
+}
+
+
+//-----------------------------------------------------------------------------
+inline void InternalStore(float* values, const cv::v_float32& value)
+{
+  cv::v_store(values, value);
+}
+
+
+//-----------------------------------------------------------------------------
+inline cv::v_float32 InternalSqrt(const cv::v_float32& value)
+{
+  return cv::v_sqrt(value);
+}
+
+
+//-----------------------------------------------------------------------------
+inline void InternalSetNaNIfParallel(const cv::v_float32& sc, const cv::v_float32& tc,
+                                     cv::v_float32& x, cv::v_float32& y, cv::v_float32& z)
+{
+  cv::v_float32 infinity = cv::vx_setall_f32(std::numeric_limits<float>::infinity());
+  cv::v_float32 nan = cv::vx_setall_f32(std::numeric_limits<float>::quiet_NaN());
+
+  // Comparisons involving NaN are false, so this catches NaN and +/- infinity.
+  cv::v_float32 isFinite = (cv::v_abs(sc) < infinity) & (cv::v_abs(tc) < infinity);
+  x = cv::v_select(isFinite, x, nan);
+  y = cv::v_select(isFinite, y, nan);
+  z = cv::v_select(isFinite, z, nan);
+}
+#endif
+
+
+#if CV_SIMD_64F
+//-----------------------------------------------------------------------------
+inline cv::v_float64 InternalSetAll(const double& value, const cv::v_float64&)
+{
+  return cv::vx_setall_f64(value);
+}
+
+
+//-----------------------------------------------------------------------------
+inline cv::v_float64 InternalLoad(const double* values, const cv::v_float64&)
+{
+  return cv::vx_load(values);
+}
+
+
+//-----------------------------------------------------------------------------
+inline void InternalStore(double* values, const cv::v_float64& value)
+{
+  cv::v_store(values, value);
+}
+
+
+//-----------------------------------------------------------------------------
+inline cv::v_float64 InternalSqrt(const cv::v_float64& value)
+{
+  return cv::v_sqrt(value);
+}
+
+
+//-----------------------------------------------------------------------------
+inline void InternalSetNaNIfParallel(const cv::v_float64& sc, const cv::v_float64& tc,
+                                     cv::v_float64& x, cv::v_float64& y, cv::v_float64& z)
+{
+  cv::v_float64 infinity = cv::vx_setall_f64(std::numeric_limits<double>::infinity());
+  cv::v_float64 nan = cv::vx_setall_f64(std::numeric_limits<double>::quiet_NaN());
+
+  // Comparisons involving NaN are false, so this catches NaN and +/- infinity.
+  cv::v_float64 isFinite = (cv::v_abs(sc) < infinity) & (cv::v_abs(tc) < infinity);
+  x = cv::v_select(isFinite, x, nan);
+  y = cv::v_select(isFinite, y, nan);
+  z = cv::v_select(isFinite, z, nan);
+}
+#endif
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Converts a distorted pixel to undistorted normalised image coordinates, in place.
+*
+* Same fixed point iteration as cv::undistortPoints, with its default of 5
+* iterations, written for plain floats and doubles, and for SIMD registers (V).
+* D is k1, k2, p1, p2, k3, k4, k5, k6. Both are already broadcast to type V.
+*/
+template <typename V>
+inline void InternalUndistortPoint(const V* KInv, const V* D, V& x, V& y)
+{
+  V one = InternalSetAll(1.0, x);
+  V two = InternalSetAll(2.0, x);
+  V x0 = KInv[0] * x + KInv[1] * y + KInv[2];
+  V y0 = KInv[3] * x + KInv[4] * y + KInv[5];
+  x = x0;
+  y = y0;
+
+  for (int i = 0; i < 5; i++)
+  {
+    V r2 = x * x + y * y;
+    V icdist = (one + ((D[7] * r2 + D[6]) * r2 + D[5]) * r2)
+             / (one + ((D[4] * r2 + D[1]) * r2 + D[0]) * r2);
+    V deltaX = two * D[2] * x * y + D[3] * (r2 + two * x * x);
+    V deltaY = D[2] * (r2 + two * y * y) + two * D[3] * x * y;
+    x = (x0 - deltaX) * icdist;
+    y = (y0 - deltaY) * icdist;
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Midpoint of the shortest line between the left and right rays.
+*
+* Same maths as sks::DistanceBetweenLines, with P0 = (0, 0, 0) and Q0 = R2L translation,
+* written once for plain floats and doubles, and for SIMD registers (V), so the vectorised
+* and the scalar paths cannot drift apart. Matrices are row-major, and are
+* already broadcast to type V. Nothing is allocated.
+*/
+template <typename V>
+inline void InternalTriangulatePointUsingMidpoint(
+  const V* K1Inv, const V* K2Inv, const V* R2LRot, const V* R2LTrn,
+  const V& leftX, const V& leftY, const V& rightX, const V& rightY,
+  V& x, V& y, V& z)
+{
+  // Converting to normalised image points, then unit vector along left hand camera line.
+  V ux = K1Inv[0] * leftX + K1Inv[1] * leftY + K1Inv[2];
+  V uy = K1Inv[3] * leftX + K1Inv[4] * leftY + K1Inv[5];
+  V uz = K1Inv[6] * leftX + K1Inv[7] * leftY + K1Inv[8];
+  V uNorm = InternalSqrt(ux * ux + uy * uy + uz * uz);
+  ux = ux / uNorm;
+  uy = uy / uNorm;
+  uz = uz / uNorm;
+
+  // Unit vector in right hand coordinate system.
+  V rx = K2Inv[0] * rightX + K2Inv[1] * rightY + K2Inv[2];
+  V ry = K2Inv[3] * rightX + K2Inv[4] * rightY + K2Inv[5];
+  V rz = K2Inv[6] * rightX + K2Inv[7] * rightY + K2Inv[8];
+  V rNorm = InternalSqrt(rx * rx + ry * ry + rz * rz);
+  rx = rx / rNorm;
+  ry = ry / rNorm;
+  rz = rz / rNorm;
+
+  // Rotate into the left hand coordinate frame.
+  V vx = R2LRot[0] * rx + R2LRot[1] * ry + R2LRot[2] * rz;
+  V vy = R2LRot[3] * rx + R2LRot[4] * ry + R2LRot[5] * rz;
+  V vz = R2LRot[6] * rx + R2LRot[7] * ry + R2LRot[8] * rz;
+
+  // With W0 = P0 - Q0 = -R2LTrn, as P0 is the left origin, and Q0 the right origin
+  // in left coordinates, d = u.W0 = -(u.R2LTrn) and e = v.W0 = -(v.R2LTrn).
+  V a = ux * ux + uy * uy + uz * uz;
+  V b = ux * vx + uy * vy + uz * vz;
+  V c = vx * vx + vy * vy + vz * vz;
+  V uDotT = ux * R2LTrn[0] + uy * R2LTrn[1] + uz * R2LTrn[2];
+  V vDotT = vx * R2LTrn[0] + vy * R2LTrn[1] + vz * R2LTrn[2];
+  // a*c - b*b is |u x v|^2, but computing it from the cross product avoids the
+  // cancellation in a*c - b*b for near parallel rays, which matters in float.
+  V crossX = uy * vz - uz * vy;
+  V crossY = uz * vx - ux * vz;
+  V crossZ = ux * vy - uy * vx;
+  V denominator = crossX * crossX + crossY * crossY + crossZ * crossZ;
+  V sc = (c * uDotT - b * vDotT) / denominator;
+  V tc = (b * uDotT - a * vDotT) / denominator;
+
+  // Midpoint of Psc = P0 + sc u, and Qtc = Q0 + tc v.
+  V half = InternalSetAll(0.5, leftX);
+  x = (sc * ux + R2LTrn[0] + tc * vx) * half;
+  y = (sc * uy + R2LTrn[1] + tc * vy) * half;
+  z = (sc * uz + R2LTrn[2] + tc * vz) * half;
+
+  InternalSetNaNIfParallel(sc, tc, x, y, z);
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Runs the midpoint method over all rows, in the scalar type T of the input.
+*
+* If isDistorted, each point is first undistorted to normalised coordinates,
+* so the identity replaces the inverse camera matrices.
+*/
+template <typename T>
+void InternalTriangulatePointsUsingMidpoint(
+  const InternalStereoParameters<T>& parameters,
+  const cv::Mat& inputPoints,
+  const bool isDistorted,
+  cv::Mat& outputPoints)
+{
+  typedef typename InternalVectorType<T>::type V;
+  const int lanes = InternalVectorType<T>::lanes;
+
+  int numberOfPoints = inputPoints.rows;
+  int numberOfBlocks = lanes > 1 ? numberOfPoints / lanes : 0;
+  int numberOfVectorisedPoints = numberOfBlocks * lanes;
+
+  const T* K1Inv = isDistorted ? parameters.Identity : parameters.K1Inv;
+  const T* K2Inv = isDistorted ? parameters.Identity : parameters.K2Inv;
+
+  if (numberOfBlocks > 0)
+  {
+    #pragma omp parallel
+    {
+      // Per thread, broadcast camera parameters, and a small structure-of-arrays
+      // buffer, so rows can have any stride, and nothing is allocated per point.
+      V K1InvV[9], K2InvV[9], R2LRotV[9], R2LTrnV[3];
+      V UndistortK1InvV[9], UndistortK2InvV[9], D1V[8], D2V[8];
+      for (int j = 0; j < 9; j++)
+      {
+        K1InvV[j] = InternalSetAll(K1Inv[j], V());
+        K2InvV[j] = InternalSetAll(K2Inv[j], V());
+        R2LRotV[j] = InternalSetAll(parameters.R2LRot[j], V());
+        UndistortK1InvV[j] = InternalSetAll(parameters.K1Inv[j], V());
+        UndistortK2InvV[j] = InternalSetAll(parameters.K2Inv[j], V());
+      }
+      for (int j = 0; j < 3; j++)
+      {
+        R2LTrnV[j] = InternalSetAll(parameters.R2LTrn[j], V());
+      }
+      for (int j = 0; j < 8; j++)
+      {
+        D1V[j] = InternalSetAll(parameters.D1[j], V());
+        D2V[j] = InternalSetAll(parameters.D2[j], V());
+      }
+
+      T leftX[InternalVectorType<T>::lanes];
+      T leftY[InternalVectorType<T>::lanes];
+      T rightX[InternalVectorType<T>::lanes];
+      T rightY[InternalVectorType<T>::lanes];
+      T outputX[InternalVectorType<T>::lanes];
+      T outputY[InternalVectorType<T>::lanes];
+      T outputZ[InternalVectorType<T>::lanes];
+
+      V x, y, z;
+
+      #pragma omp for
+      for (int b = 0; b < numberOfBlocks; b++)
+      {
+        int firstRow = b * lanes;
+
+        for (int j = 0; j < lanes; j++)
+        {
+          const T* input = inputPoints.ptr<T>(firstRow + j);
+          leftX[j] = input[0];
+          leftY[j] = input[1];
+          rightX[j] = input[2];
+          rightY[j] = input[3];
+        }
+
+        V lx = InternalLoad(leftX, V());
+        V ly = InternalLoad(leftY, V());
+        V rx = InternalLoad(rightX, V());
+        V ry = InternalLoad(rightY, V());
+
+        if (isDistorted)
+        {
+          InternalUndistortPoint(UndistortK1InvV, D1V, lx, ly);
+          InternalUndistortPoint(UndistortK2InvV, D2V, rx, ry);
+        }
+
+        InternalTriangulatePointUsingMidpoint(K1InvV, K2InvV, R2LRotV, R2LTrnV,
+                                              lx, ly, rx, ry,
+                                              x, y, z);
+
+        InternalStore(outputX, x);
+        InternalStore(outputY, y);
+        InternalStore(outputZ, z);
+
+        for (int j = 0; j < lanes; j++)
+        {
+          T* output = outputPoints.ptr<T>(firstRow + j);
+          output[0] = outputX[j];
+          output[1] = outputY[j];
+          output[2] = outputZ[j];
+        }
+      }
+    } // end parallel block
+  }
+
+  // Remaining points, or all of them, if SIMD is not available.
+  #pragma omp parallel for
+  for (int i = numberOfVectorisedPoints; i < numberOfPoints; i++)
+  {
+    const T* input = inputPoints.ptr<T>(i);
+    T* output = outputPoints.ptr<T>(i);
+
+    T lx = input[0];
+    T ly = input[1];
+    T rx = input[2];
+    T ry = input[3];
+
+    if (isDistorted)
+    {
+      InternalUndistortPoint(parameters.K1Inv, parameters.D1, lx, ly);
+      InternalUndistortPoint(parameters.K2Inv, parameters.D2, rx, ry);
+    }
+
+    InternalTriangulatePointUsingMidpoint(K1Inv, K2Inv,
+                                          parameters.R2LRot, parameters.R2LTrn,
+                                          lx, ly, rx, ry,
+                                          output[0], output[1], output[2]);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Solves the over-determined [4x3] system A X = B, in the least squares sense.
+*
+* Householder QR on fixed size arrays. This is better conditioned than forming
+* the normal equations, and unlike cv::solve, allocates nothing. A and B are overwritten.
+* \return false if A is rank deficient, e.g. for parallel rays.
+*/
+template <typename T>
+inline bool InternalSolveLeastSquares(T A[4][3], T B[4], T X[3])
+{
+  for (int k = 0; k < 3; k++)
+  {
+    T norm = 0;
+    for (int i = k; i < 4; i++)
+    {
+      norm += A[i][k] * A[i][k];
+    }
+    norm = std::sqrt(norm);
+
+    if (!(norm > 0))
+    {
+      return false;
+    }
+
+    // Reflect column k onto alpha * e_k, choosing the sign to avoid cancellation.
+    T alpha = A[k][k] > 0 ? -norm : norm;
+    T v[4] = {0, 0, 0, 0};
+    v[k] = A[k][k] - alpha;
+    for (int i = k + 1; i < 4; i++)
+    {
+      v[i] = A[i][k];
+    }
+    T vDotV = 0;
+    for (int i = k; i < 4; i++)
+    {
+      vDotV += v[i] * v[i];
+    }
+
+    if (vDotV > 0)
+    {
+      for (int j = k + 1; j < 3; j++)
+      {
+        T vDotA = 0;
+        for (int i = k; i < 4; i++)
+        {
+          vDotA += v[i] * A[i][j];
+        }
+        T f = 2 * vDotA / vDotV;
+        for (int i = k; i < 4; i++)
+        {
+          A[i][j] -= f * v[i];
+        }
+      }
+      T vDotB = 0;
+      for (int i = k; i < 4; i++)
+      {
+        vDotB += v[i] * B[i];
+      }
+      T f = 2 * vDotB / vDotV;
+      for (int i = k; i < 4; i++)
+      {
+        B[i] -= f * v[i];
+      }
+    }
+    A[k][k] = alpha;
+  }
+
+  // Back substitution with the upper triangular R.
+  X[2] = B[2] / A[2][2];
+  X[1] = (B[1] - A[1][2] * X[2]) / A[1][1];
+  X[0] = (B[0] - A[0][1] * X[1] - A[0][2] * X[2]) / A[0][0];
+
+  return true;
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Solves the linear least squares triangulation, for given weights w1, w2.
+*
+* Assume X = (x,y,z,1), for Linear-LS method, which turns Ax = 0
+* into a AX = B system, where A is 4x3, X is 3x1 and B is 4x1.
+* P1 and P2 are [3x4], row-major.
+*/
+template <typename T>
+inline bool InternalTriangulatePointUsingLinearLeastSquares(
+    const T* P1,
+    const T* P2,
+    const T& u1x, const T& u1y,
+    const T& u2x, const T& u2y,
+    const T& w1,
+    const T& w2,
+    T X[3]
+    )
+{
+  T A[4][3];
+  T B[4];
+
+  for (int c = 0; c < 3; c++)
+  {
+    A[0][c] = (u1x*P1[8+c]-P1[c])/w1;
+    A[1][c] = (u1y*P1[8+c]-P1[4+c])/w1;
+    A[2][c] = (u2x*P2[8+c]-P2[c])/w2;
+    A[3][c] = (u2y*P2[8+c]-P2[4+c])/w2;
+  }
+
+  B[0] = -(u1x*P1[11] -P1[3])/w1;
+  B[1] = -(u1y*P1[11] -P1[7])/w1;
+  B[2] = -(u2x*P2[11] -P2[3])/w2;
+  B[3] = -(u2y*P2[11] -P2[7])/w2;
+
+  return InternalSolveLeastSquares(A, B, X);
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Relative convergence tolerance on the Hartley weights, per scalar type.
+*/
+template <typename T>
+inline T InternalHartleyTolerance();
+
+template <>
+inline double InternalHartleyTolerance<double>()
+{
+  return 0.000000001;
+}
+
+template <>
+inline float InternalHartleyTolerance<float>()
+{
+  return 0.00001f;
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Hartley's iteratively re-weighted linear least squares, for one point.
+*
+* The weights are the depths of the current estimate in each camera. Rather than
+* starting from w1 = w2 = 1, we start from the depths of initialEstimate, normally
+* the midpoint solution, which is already close, so most points pass the convergence
+* test on the second solve. The test is relative (1e-9 of the depth for double, 1e-5
+* for float), which does not noticeably change the result, but avoids iterating
+* on rounding noise.
+*/
+template <typename T>
+inline void InternalIterativeTriangulatePointUsingHartley(
+    const T* P1,
+    const T* P2,
+    const T& u1x, const T& u1y,
+    const T& u2x, const T& u2y,
+    const T initialEstimate[3],
+    T& x, T& y, T& z
+    )
+{
+  T epsilon = InternalHartleyTolerance<T>();
+  T w1 = 1, w2 = 1;
+  T X[3];
+
+  T initialW1 = P1[8]*initialEstimate[0] + P1[9]*initialEstimate[1] + P1[10]*initialEstimate[2] + P1[11];
+  T initialW2 = P2[8]*initialEstimate[0] + P2[9]*initialEstimate[1] + P2[10]*initialEstimate[2] + P2[11];
+  if (boost::math::isfinite(initialW1) && boost::math::isfinite(initialW2) && initialW1 != 0 && initialW2 != 0)
+  {
+    w1 = initialW1;
+    w2 = initialW2;
+  }
+
+  for (int i=0; i<10; i++) // Hartley suggests 10 iterations at most
+  {
+    if (!InternalTriangulatePointUsingLinearLeastSquares(P1, P2, u1x, u1y, u2x, u2y, w1, w2, X))
+    {
+      X[0] = std::numeric_limits<T>::quiet_NaN();
+      X[1] = std::numeric_limits<T>::quiet_NaN();
+      X[2] = std::numeric_limits<T>::quiet_NaN();
+      break;
+    }
+
+    T p2x1 = P1[8]*X[0] + P1[9]*X[1] + P1[10]*X[2] + P1[11];
+    T p2x2 = P2[8]*X[0] + P2[9]*X[1] + P2[10]*X[2] + P2[11];
+
+    if(std::fabs(w1 - p2x1) <= epsilon * std::fabs(w1) && std::fabs(w2 - p2x2) <= epsilon * std::fabs(w2))
+      break;
+
+    w1 = p2x1;
+    w2 = p2x2;
+  }
+
+  x = X[0];
+  y = X[1];
+  z = X[2];
+}
+
+
+//-----------------------------------------------------------------------------
+/**
+* \brief Runs the Hartley method over all rows, in the scalar type T of the input.
+*
+* If isDistorted, each point is first undistorted, as InternalTriangulatePointsUsingMidpoint.
+*/
+template <typename T>
+void InternalTriangulatePointsUsingHartley(
+  const InternalStereoParameters<T>& parameters,
+  const cv::Mat& inputPoints,
+  const bool isDistorted,
+  cv::Mat& outputPoints)
+{
+  int numberOfPoints = inputPoints.rows;
+
+  const T* K1Inv = isDistorted ? parameters.Identity : parameters.K1Inv;
+  const T* K2Inv = isDistorted ? parameters.Identity : parameters.K2Inv;
+
+  #pragma omp parallel for
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    const T* input = inputPoints.ptr<T>(i);
+    T* output = outputPoints.ptr<T>(i);
+
+    T lx = input[0];
+    T ly = input[1];
+    T rx = input[2];
+    T ry = input[3];
+
+    if (isDistorted)
+    {
+      InternalUndistortPoint(parameters.K1Inv, parameters.D1, lx, ly);
+      InternalUndistortPoint(parameters.K2Inv, parameters.D2, rx, ry);
+    }
+
+    // Converting to normalised image coordinates, (i.e. relative to a principal point of zero, and in millimetres not pixels).
+    T u1x = K1Inv[0] * lx + K1Inv[1] * ly + K1Inv[2];
+    T u1y = K1Inv[3] * lx + K1Inv[4] * ly + K1Inv[5];
+    T u2x = K2Inv[0] * rx + K2Inv[1] * ry + K2Inv[2];
+    T u2y = K2Inv[3] * rx + K2Inv[4] * ry + K2Inv[5];
+
+    T midpoint[3];
+    InternalTriangulatePointUsingMidpoint(K1Inv, K2Inv,
+                                          parameters.R2LRot, parameters.R2LTrn,
+                                          lx, ly, rx, ry,
+                                          midpoint[0], midpoint[1], midpoint[2]);
+
+    // The output 3D point, in reference frame of left camera.
+    InternalIterativeTriangulatePointUsingHartley(parameters.P1, parameters.P2,
+                                                  u1x, u1y, u2x, u2y, midpoint,
+                                                  output[0], output[1], output[2]);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void InternalSetParameters(const cv::Mat& leftCameraMatrixInverse,
+                           const cv::Mat& rightCameraMatrixInverse,
+                           const cv::Mat& rightToLeftRotationMatrix,
+                           const cv::Mat& rightToLeftTranslationVector,
+                           const cv::Matx34d& leftProjectionMatrix,
+                           const cv::Matx34d& rightProjectionMatrix,
+                           const cv::Mat& leftDistortionCoefficients,
+                           const cv::Mat& rightDistortionCoefficients,
+                           InternalStereoParameters<T>& parameters)
+{
+  // All cached as continuous CV_64FC1, so can be read as row-major arrays.
+  InternalCopy(leftCameraMatrixInverse.ptr<double>(0), 9, parameters.K1Inv);
+  InternalCopy(rightCameraMatrixInverse.ptr<double>(0), 9, parameters.K2Inv);
+  InternalCopy(rightToLeftRotationMatrix.ptr<double>(0), 9, parameters.R2LRot);
+  InternalCopy(rightToLeftTranslationVector.ptr<double>(0), 3, parameters.R2LTrn);
+  InternalCopy(leftProjectionMatrix.val, 12, parameters.P1);
+  InternalCopy(rightProjectionMatrix.val, 12, parameters.P2);
+  InternalCopy(leftDistortionCoefficients.ptr<double>(0), 8, parameters.D1);
+  InternalCopy(rightDistortionCoefficients.ptr<double>(0), 8, parameters.D2);
+  InternalCopy(cv::Matx33d::eye().val, 9, parameters.Identity);
+}
+
+
+//-----------------------------------------------------------------------------
+template <typename T>
+void InternalTriangulate(const InternalStereoParameters<T>& parameters,
+                         const cv::Mat& inputPoints,
+                         const bool isDistorted,
+                         const bool useHartley,
+                         cv::Mat& outputPoints)
+{
+  if (useHartley)
+  {
+    InternalTriangulatePointsUsingHartley(parameters, inputPoints, isDistorted, outputPoints);
+  }
+  else
+  {
+    InternalTriangulatePointsUsingMidpoint(parameters, inputPoints, isDistorted, outputPoints);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+void StereoRig::Triangulate(const cv::Mat& inputPoints,
+                            const bool isDistorted,
+                            const bool useHartley,
+                            cv::Mat& outputPoints) const
+{
+  this->ValidatePoints(inputPoints, outputPoints);
+
+  // Output has the same scalar type as the input, so float in gives float out.
+  sks::PrepareOutputBuffer(inputPoints.rows, 3, inputPoints.type(), outputPoints);
+
+  if (inputPoints.depth() == CV_32F)
+  {
+    InternalStereoParameters<float> parameters;
+    InternalSetParameters(m_LeftCameraMatrixInverse, m_RightCameraMatrixInverse,
+                          m_RightToLeftRotationMatrix, m_RightToLeftTranslationVector,
+                          m_LeftProjectionMatrix, m_RightProjectionMatrix,
+                          m_LeftDistortionCoefficients, m_RightDistortionCoefficients, parameters);
+    InternalTriangulate(parameters, inputPoints, isDistorted, useHartley, outputPoints);
+  }
+  else
+  {
+    InternalStereoParameters<double> parameters;
+    InternalSetParameters(m_LeftCameraMatrixInverse, m_RightCameraMatrixInverse,
+                          m_RightToLeftRotationMatrix, m_RightToLeftTranslationVector,
+                          m_LeftProjectionMatrix, m_RightProjectionMatrix,
+                          m_LeftDistortionCoefficients, m_RightDistortionCoefficients, parameters);
+    InternalTriangulate(parameters, inputPoints, isDistorted, useHartley, outputPoints);
+  }
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::triangulatePointsUsingMidpointOfShortestDistance(const cv::Mat& inputUndistortedPoints) const
+{
+  cv::Mat outputPoints;
+  this->triangulatePointsUsingMidpointOfShortestDistance(inputUndistortedPoints, outputPoints);
+  return outputPoints;
+}
+
+
+//-----------------------------------------------------------------------------
+void StereoRig::triangulatePointsUsingMidpointOfShortestDistance(const cv::Mat& inputUndistortedPoints,
+                                                                 cv::Mat& outputPoints) const
+{
+  this->Triangulate(inputUndistortedPoints, false, false, outputPoints);
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::triangulatePointsUsingHartley(const cv::Mat& inputUndistortedPoints) const
+{
+  cv::Mat outputPoints;
+  this->triangulatePointsUsingHartley(inputUndistortedPoints, outputPoints);
+  return outputPoints;
+}
+
+
+//-----------------------------------------------------------------------------
+void StereoRig::triangulatePointsUsingHartley(const cv::Mat& inputUndistortedPoints,
+                                              cv::Mat& outputPoints) const
+{
+  this->Triangulate(inputUndistortedPoints, false, true, outputPoints);
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::triangulateDistortedPointsUsingMidpointOfShortestDistance(const cv::Mat& inputDistortedPoints) const
+{
+  cv::Mat outputPoints;
+  this->triangulateDistortedPointsUsingMidpointOfShortestDistance(inputDistortedPoints, outputPoints);
+  return outputPoints;
+}
+
+
+//-----------------------------------------------------------------------------
+void StereoRig::triangulateDistortedPointsUsingMidpointOfShortestDistance(const cv::Mat& inputDistortedPoints,
+                                                                          cv::Mat& outputPoints) const
+{
+  this->Triangulate(inputDistortedPoints, true, false, outputPoints);
+}
+
+
+//-----------------------------------------------------------------------------
+cv::Mat StereoRig::triangulateDistortedPointsUsingHartley(const cv::Mat& inputDistortedPoints) const
+{
+  cv::Mat outputPoints;
+  this->triangulateDistortedPointsUsingHartley(inputDistortedPoints, outputPoints);
+  return outputPoints;
+}
+
+
+//-----------------------------------------------------------------------------
+void StereoRig::triangulateDistortedPointsUsingHartley(const cv::Mat& inputDistortedPoints,
+                                                       cv::Mat& outputPoints) const
+{
+  this->Triangulate(inputDistortedPoints, true, true, outputPoints);
+}
+
+} // end namespace
@@ -0,0 +1,190 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksStereoRig_h
+#define sksStereoRig_h
+
+#include <opencv2/core.hpp>
+#include "sksWin32ExportHeader.h"
+
+/**
+* \file sksStereoRig.h
+* \brief Holds a fixed stereo calibration, so that repeated triangulation
+* calls (e.g. once per video frame) do not redo the same setup work.
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+* \class StereoRig
+* \brief Validates a stereo calibration once, and caches the derived matrices.
+*
+* Construction validates the parameters (see sks::ValidateStereoParameters),
+* converts them to 64 bit, and precomputes the inverse camera matrices,
+* the right-to-left transformation and the projection matrices used by
+* the triangulation methods. The object is then immutable, so a single
+* instance can be shared across threads.
+*
+* The triangulation methods work in the scalar type of the points. CV_32FC1
+* points are triangulated entirely in float, giving CV_32FC1 output and twice
+* the SIMD width, at the cost of precision, (roughly 1 micron at 100mm depth,
+* for a 5mm baseline). CV_64FC1 points are triangulated in double.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StereoRig {
+
+public:
+
+  /**
+  * \param leftCameraMatrix [3x3] left camera matrix
+  * \param rightCameraMatrix [3x3] right camera matrix
+  * \param leftToRightRotationMatrix [3x3] matrix representing the rotation between camera axes
+  * \param leftToRightTranslationVector [3x1] translation between camera origins
+  */
+  StereoRig(const cv::Mat& leftCameraMatrix,
+            const cv::Mat& rightCameraMatrix,
+            const cv::Mat& leftToRightRotationMatrix,
+            const cv::Mat& leftToRightTranslationVector
+           );
+
+  /**
+  * \brief As above, with distortion coefficients, for the triangulateDistortedPoints methods.
+  * \param leftDistortionCoefficients empty, or 4, 5 or 8 values, (k1, k2, p1, p2[, k3[, k4, k5, k6]]), as OpenCV.
+  * \param rightDistortionCoefficients empty, or 4, 5 or 8 values, (k1, k2, p1, p2[, k3[, k4, k5, k6]]), as OpenCV.
+  */
+  StereoRig(const cv::Mat& leftCameraMatrix,
+            const cv::Mat& leftDistortionCoefficients,
+            const cv::Mat& rightCameraMatrix,
+            const cv::Mat& rightDistortionCoefficients,
+            const cv::Mat& leftToRightRotationMatrix,
+            const cv::Mat& leftToRightTranslationVector
+           );
+
+  /**
+  * \brief Triangulates using the midpoint of the shortest distance between rays.
+  * \see sks::TriangulatePointsUsingMidpointOfShortestDistance
+  * \param inputUndistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+  * \return [Nx3] matrix of triangulated points, of the same type as inputUndistortedPoints.
+  */
+  cv::Mat triangulatePointsUsingMidpointOfShortestDistance(const cv::Mat& inputUndistortedPoints) const;
+
+  /**
+  * \brief As above, but writes into outputPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  * \param inputUndistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+  * \param outputPoints [Nx3] matrix of triangulated points, of the same type as inputUndistortedPoints.
+  */
+  void triangulatePointsUsingMidpointOfShortestDistance(const cv::Mat& inputUndistortedPoints,
+                                                        cv::Mat& outputPoints) const;
+
+  /**
+  * \brief Triangulates using Hartley's iterative linear least squares method.
+  * \see sks::TriangulatePointsUsingHartley
+  * \param inputUndistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+  * \return [Nx3] matrix of triangulated points, of the same type as inputUndistortedPoints.
+  */
+  cv::Mat triangulatePointsUsingHartley(const cv::Mat& inputUndistortedPoints) const;
+
+  /**
+  * \brief As above, but writes into outputPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  * \param inputUndistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+  * \param outputPoints [Nx3] matrix of triangulated points, of the same type as inputUndistortedPoints.
+  */
+  void triangulatePointsUsingHartley(const cv::Mat& inputUndistortedPoints,
+                                     cv::Mat& outputPoints) const;
+
+  /**
+  * \brief As triangulatePointsUsingMidpointOfShortestDistance, but for points straight from the distorted images.
+  *
+  * Each point is undistorted inside the triangulation loop, using the same
+  * fixed point iteration as cv::undistortPoints, so there is no separate pass,
+  * and no intermediate [Nx4] buffer. Useful for sparse points, e.g. tracked markers,
+  * where undistorting the whole image would be wasteful.
+  *
+  * \param inputDistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+  * \return [Nx3] matrix of triangulated points, of the same type as inputDistortedPoints.
+  */
+  cv::Mat triangulateDistortedPointsUsingMidpointOfShortestDistance(const cv::Mat& inputDistortedPoints) const;
+
+  /**
+  * \brief As above, but writes into outputPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  */
+  void triangulateDistortedPointsUsingMidpointOfShortestDistance(const cv::Mat& inputDistortedPoints,
+                                                                 cv::Mat& outputPoints) const;
+
+  /**
+  * \brief As triangulatePointsUsingHartley, but for points straight from the distorted images.
+  * \see triangulateDistortedPointsUsingMidpointOfShortestDistance
+  * \param inputDistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+  * \return [Nx3] matrix of triangulated points, of the same type as inputDistortedPoints.
+  */
+  cv::Mat triangulateDistortedPointsUsingHartley(const cv::Mat& inputDistortedPoints) const;
+
+  /**
+  * \brief As above, but writes into outputPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  */
+  void triangulateDistortedPointsUsingHartley(const cv::Mat& inputDistortedPoints,
+                                              cv::Mat& outputPoints) const;
+
+  cv::Mat getLeftCameraMatrix() const;
+  cv::Mat getRightCameraMatrix() const;
+  cv::Mat getLeftToRightRotationMatrix() const;
+  cv::Mat getLeftToRightTranslationVector() const;
+  cv::Mat getRightToLeftRotationMatrix() const;
+  cv::Mat getRightToLeftTranslationVector() const;
+
+  /**
+  * \brief Returns [1x8] distortion coefficients, padded with zeros, and all zero if none were given.
+  */
+  cv::Mat getLeftDistortionCoefficients() const;
+  cv::Mat getRightDistortionCoefficients() const;
+
+  /**
+  * \brief Returns [3x4] projection matrix in normalised coordinates, i.e. [I|0].
+  */
+  cv::Mat getLeftProjectionMatrix() const;
+
+  /**
+  * \brief Returns [3x4] projection matrix in normalised coordinates, i.e. [R|t] left to right.
+  */
+  cv::Mat getRightProjectionMatrix() const;
+
+private:
+
+  void ValidatePoints(const cv::Mat& inputUndistortedPoints, const cv::Mat& outputPoints) const;
+  void Triangulate(const cv::Mat& inputPoints, const bool isDistorted,
+                   const bool useHartley, cv::Mat& outputPoints) const;
+
+  // All stored as CV_64FC1.
+  cv::Mat m_LeftCameraMatrix;
+  cv::Mat m_RightCameraMatrix;
+  cv::Mat m_LeftCameraMatrixInverse;
+  cv::Mat m_RightCameraMatrixInverse;
+  cv::Mat m_LeftToRightRotationMatrix;
+  cv::Mat m_LeftToRightTranslationVector;
+  cv::Mat m_RightToLeftRotationMatrix;
+  cv::Mat m_RightToLeftTranslationVector;
+  cv::Mat m_LeftDistortionCoefficients;
+  cv::Mat m_RightDistortionCoefficients;
+  cv::Matx34d m_LeftProjectionMatrix;
+  cv::Matx34d m_RightProjectionMatrix;
+
+}; // end class
+
+} // end namespace
+
+#endif
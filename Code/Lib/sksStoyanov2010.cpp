@@ -13,41 +13,1152 @@
 =============================================================================*/
 
 #include "sksStoyanov2010.h"
-#include "sksTriangulate.h"
+#include "sksBuffers.h"
 #include "sksExceptionMacro.h"
-#include "sksValidate.h"
-#include <opencv2/stereo.hpp>
+#include <opencv2/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <limits>
+#include <string>
 
 namespace sks
 {
 
 //------------------------------------------------------------------------------
-void ValidateImages(const cv::Mat& leftImage, const cv::Mat& rightImage)
+void ValidateImages(const cv::Mat& leftImage, const cv::Mat& rightImage)
+{
+  cv::Size leftSize = leftImage.size();
+  cv::Size rightSize = rightImage.size();
+
+  if (leftSize != rightSize)
+  {
+    sksExceptionThrow() << "Left size:" << leftSize
+      << " is not equal to right size:" << rightSize;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+template <typename T>
+void InternalCopyMatchesToPoints(const std::vector<cv::stereo::Match>& matches,
+                                 const std::vector<cv::Point2f>& refinedRightPoints,
+                                 const bool isStructureOfArrays,
+                                 const bool includeCorrelation,
+                                 cv::Mat& matchedPoints)
+{
+  int numberOfMatches = static_cast<int>(matches.size());
+  bool isRefined = !refinedRightPoints.empty();
+
+  // Threads only pay off for dense matching, which gives hundreds of thousands of matches.
+  if (isStructureOfArrays)
+  {
+    T* leftX = matchedPoints.ptr<T>(0);
+    T* leftY = matchedPoints.ptr<T>(1);
+    T* rightX = matchedPoints.ptr<T>(2);
+    T* rightY = matchedPoints.ptr<T>(3);
+    T* correlation = includeCorrelation ? matchedPoints.ptr<T>(4) : nullptr;
+
+    #pragma omp parallel for schedule(static) if (numberOfMatches > 10000)
+    for (int i = 0; i < numberOfMatches; i++)
+    {
+      leftX[i] = static_cast<T>(matches[i].p0.x);
+      leftY[i] = static_cast<T>(matches[i].p0.y);
+      rightX[i] = static_cast<T>(isRefined ? refinedRightPoints[i].x : matches[i].p1.x);
+      rightY[i] = static_cast<T>(isRefined ? refinedRightPoints[i].y : matches[i].p1.y);
+      if (includeCorrelation)
+      {
+        correlation[i] = static_cast<T>(matches[i].corr);
+      }
+    }
+  }
+  else
+  {
+    #pragma omp parallel for schedule(static) if (numberOfMatches > 10000)
+    for (int i = 0; i < numberOfMatches; i++)
+    {
+      T* output = matchedPoints.ptr<T>(i);
+      output[0] = static_cast<T>(matches[i].p0.x);
+      output[1] = static_cast<T>(matches[i].p0.y);
+      output[2] = static_cast<T>(isRefined ? refinedRightPoints[i].x : matches[i].p1.x);
+      output[3] = static_cast<T>(isRefined ? refinedRightPoints[i].y : matches[i].p1.y);
+      if (includeCorrelation)
+      {
+        output[4] = static_cast<T>(matches[i].corr);
+      }
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void ValidateMatchType(const int type)
+{
+  if (type != CV_32FC1 && type != CV_64FC1)
+  {
+    sksExceptionThrow() << "Matches should be CV_32FC1 or CV_64FC1, not type " << type;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void CopyMatchesToPoints(const std::vector<cv::stereo::Match>& matches,
+                         const std::vector<cv::Point2f>& refinedRightPoints,
+                         const int type,
+                         const bool isStructureOfArrays,
+                         const bool includeCorrelation,
+                         cv::Mat& matchedPoints)
+{
+  sks::ValidateMatchType(type);
+
+  int numberOfMatches = static_cast<int>(matches.size());
+  int numberOfValues = includeCorrelation ? 5 : 4;
+
+  if (isStructureOfArrays)
+  {
+    sks::PrepareOutputBuffer(numberOfValues, numberOfMatches, type, matchedPoints);
+  }
+  else
+  {
+    sks::PrepareOutputBuffer(numberOfMatches, numberOfValues, type, matchedPoints);
+  }
+
+  if (numberOfMatches == 0)
+  {
+    return;
+  }
+
+  if (type == CV_32FC1)
+  {
+    sks::InternalCopyMatchesToPoints<float>(matches, refinedRightPoints,
+                                            isStructureOfArrays, includeCorrelation, matchedPoints);
+  }
+  else
+  {
+    sks::InternalCopyMatchesToPoints<double>(matches, refinedRightPoints,
+                                             isStructureOfArrays, includeCorrelation, matchedPoints);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void ConvertMatchesToPoints(const std::vector<cv::stereo::Match>& matches,
+                            const int type,
+                            const bool isStructureOfArrays,
+                            const bool includeCorrelation,
+                            cv::Mat& matchedPoints)
+{
+  sks::CopyMatchesToPoints(matches, std::vector<cv::Point2f>(),
+                           type, isStructureOfArrays, includeCorrelation, matchedPoints);
+}
+
+
+//------------------------------------------------------------------------------
+double GetElapsedSeconds(const int64& startTicks)
+{
+  return static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovStreamingParameters::StoyanovStreamingParameters()
+: seedFraction(0.25f)
+, minimumMatchRatio(0.9f)
+, keyFrameInterval(30)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovPyramidParameters::StoyanovPyramidParameters()
+: level(0)
+, maximumLevel(3)
+, targetLatency(0)
+, refine(false)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovMatchFormat::StoyanovMatchFormat()
+: type(CV_64FC1)
+, isStructureOfArrays(false)
+, includeCorrelation(false)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovConfidenceParameters::StoyanovConfidenceParameters()
+: minimumCorrelation(-1)
+, maximumNumberOfMatches(0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovBandParameters::StoyanovBandParameters()
+: numberOfBands(1)
+, overlap(32)
+{
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovReconstructor::StoyanovReconstructor()
+: m_ImageSize(0, 0)
+, m_IsStreaming(false)
+, m_NextFrameIsKeyFrame(true)
+, m_LastFrameWasKeyFrame(true)
+, m_FramesSinceKeyFrame(0)
+, m_KeyFrameNumberOfMatches(0)
+, m_MaximumDisparity(0)
+, m_PyramidLevel(0)
+, m_MatchedPyramidLevel(0)
+, m_LastLatency(0)
+{
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setMasks(const cv::Mat& leftMask, const cv::Mat& rightMask)
+{
+  if (leftMask.empty() && rightMask.empty())
+  {
+    m_LeftMask.release();
+    m_RightMask.release();
+    m_MaskBoundingBox = cv::Rect();
+    return;
+  }
+
+  if (leftMask.type() != CV_8UC1 || rightMask.type() != CV_8UC1)
+  {
+    sksExceptionThrow() << "Masks should be CV_8UC1.";
+  }
+
+  if (leftMask.size() != rightMask.size())
+  {
+    sksExceptionThrow() << "Left mask size:" << leftMask.size()
+      << " is not equal to right mask size:" << rightMask.size();
+  }
+
+  // Same crop for both, so that rows, and hence disparities, are unchanged.
+  cv::Rect boundingBox = cv::boundingRect(leftMask) | cv::boundingRect(rightMask);
+  if (boundingBox.area() == 0)
+  {
+    sksExceptionThrow() << "Masks have no non-zero pixels.";
+  }
+
+  m_LeftMask = leftMask.clone();
+  m_RightMask = rightMask.clone();
+  m_MaskBoundingBox = boundingBox;
+  m_NextFrameIsKeyFrame = true;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setStreaming(const bool& isStreaming)
+{
+  m_IsStreaming = isStreaming;
+  m_NextFrameIsKeyFrame = true;
+}
+
+
+//------------------------------------------------------------------------------
+bool StoyanovReconstructor::getStreaming() const
+{
+  return m_IsStreaming;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setStreamingParameters(const StoyanovStreamingParameters& parameters)
+{
+  if (!(parameters.seedFraction > 0 && parameters.seedFraction <= 1))
+  {
+    sksExceptionThrow() << "seedFraction should be in (0, 1], not " << parameters.seedFraction;
+  }
+  if (!(parameters.minimumMatchRatio >= 0 && parameters.minimumMatchRatio <= 1))
+  {
+    sksExceptionThrow() << "minimumMatchRatio should be in [0, 1], not " << parameters.minimumMatchRatio;
+  }
+  if (parameters.keyFrameInterval < 1)
+  {
+    sksExceptionThrow() << "keyFrameInterval should be at least 1, not " << parameters.keyFrameInterval;
+  }
+  m_StreamingParameters = parameters;
+  m_NextFrameIsKeyFrame = true;
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovStreamingParameters StoyanovReconstructor::getStreamingParameters() const
+{
+  return m_StreamingParameters;
+}
+
+
+//------------------------------------------------------------------------------
+bool StoyanovReconstructor::getLastFrameWasKeyFrame() const
+{
+  return m_LastFrameWasKeyFrame;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setPyramidParameters(const StoyanovPyramidParameters& parameters)
+{
+  if (parameters.maximumLevel < 0 || parameters.maximumLevel > 8)
+  {
+    sksExceptionThrow() << "maximumLevel should be in [0, 8], not " << parameters.maximumLevel;
+  }
+  if (parameters.level < 0 || parameters.level > parameters.maximumLevel)
+  {
+    sksExceptionThrow() << "level should be in [0, " << parameters.maximumLevel
+      << "], not " << parameters.level;
+  }
+  if (!(parameters.targetLatency >= 0))
+  {
+    sksExceptionThrow() << "targetLatency should be >= 0, not " << parameters.targetLatency;
+  }
+  m_PyramidParameters = parameters;
+  m_PyramidLevel = parameters.level;
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovPyramidParameters StoyanovReconstructor::getPyramidParameters() const
+{
+  return m_PyramidParameters;
+}
+
+
+//------------------------------------------------------------------------------
+int StoyanovReconstructor::getPyramidLevel() const
+{
+  return m_PyramidLevel;
+}
+
+
+//------------------------------------------------------------------------------
+double StoyanovReconstructor::getLastLatency() const
+{
+  return m_LastLatency;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setBandParameters(const StoyanovBandParameters& parameters)
+{
+  if (parameters.numberOfBands < 1)
+  {
+    sksExceptionThrow() << "numberOfBands should be at least 1, not " << parameters.numberOfBands;
+  }
+  if (parameters.overlap < 0)
+  {
+    sksExceptionThrow() << "overlap should be >= 0, not " << parameters.overlap;
+  }
+  m_BandParameters = parameters;
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovBandParameters StoyanovReconstructor::getBandParameters() const
+{
+  return m_BandParameters;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setMatchFormat(const StoyanovMatchFormat& format)
+{
+  sks::ValidateMatchType(format.type);
+  m_MatchFormat = format;
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovMatchFormat StoyanovReconstructor::getMatchFormat() const
+{
+  return m_MatchFormat;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::setConfidenceParameters(const StoyanovConfidenceParameters& parameters)
+{
+  if (parameters.maximumNumberOfMatches < 0)
+  {
+    sksExceptionThrow() << "maximumNumberOfMatches should be >= 0, not " << parameters.maximumNumberOfMatches;
+  }
+  m_ConfidenceParameters = parameters;
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovConfidenceParameters StoyanovReconstructor::getConfidenceParameters() const
+{
+  return m_ConfidenceParameters;
+}
+
+
+//------------------------------------------------------------------------------
+cv::Ptr<cv::stereo::QuasiDenseStereo> StoyanovReconstructor::GetMatcher(const cv::Size& size, const int band)
+{
+  for (std::vector<cv::Size>::size_type i=0; i < m_MatcherSizes.size(); i++)
+  {
+    if (m_MatcherSizes[i] == size && m_MatcherBands[i] == band)
+    {
+      return m_Matchers[i];
+    }
+  }
+
+  // The matcher allocates its buffers for a given size, so we keep one per
+  // pyramid level and band, dropping the least recently created. Bands of
+  // the same size still need their own, as they are matched concurrently.
+  cv::Ptr<cv::stereo::QuasiDenseStereo> matcher = cv::stereo::QuasiDenseStereo::create(size);
+  m_DefaultParameters = matcher->Param;
+
+  std::vector<cv::Size>::size_type maximumNumberOfMatchers =
+    (m_PyramidParameters.maximumLevel + 1) * m_BandParameters.numberOfBands;
+  while (m_MatcherSizes.size() >= maximumNumberOfMatchers)
+  {
+    m_Matchers.erase(m_Matchers.begin());
+    m_MatcherSizes.erase(m_MatcherSizes.begin());
+    m_MatcherBands.erase(m_MatcherBands.begin());
+  }
+  m_Matchers.push_back(matcher);
+  m_MatcherSizes.push_back(size);
+  m_MatcherBands.push_back(band);
+
+  return matcher;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::SelectMatchers(const cv::Size& size)
+{
+  // Equal bands of core rows, each extended by the overlap, within the image.
+  int numberOfBands = std::max(1, std::min(m_BandParameters.numberOfBands, size.height));
+  int rowsPerBand = (size.height + numberOfBands - 1) / numberOfBands;
+
+  m_BandRegions.clear();
+  m_BandRows.clear();
+  for (int b = 0; b < numberOfBands; b++)
+  {
+    int startRow = b * rowsPerBand;
+    int endRow = std::min(size.height, startRow + rowsPerBand);
+    if (startRow >= endRow)
+    {
+      break;
+    }
+    int regionStartRow = std::max(0, startRow - m_BandParameters.overlap);
+    int regionEndRow = std::min(size.height, endRow + m_BandParameters.overlap);
+
+    m_BandRows.push_back(cv::Range(startRow, endRow));
+    m_BandRegions.push_back(cv::Rect(0, regionStartRow, size.width, regionEndRow - regionStartRow));
+  }
+
+  m_BandMatchers.resize(m_BandRegions.size());
+  for (std::vector<cv::Rect>::size_type b = 0; b < m_BandRegions.size(); b++)
+  {
+    m_BandMatchers[b] = this->GetMatcher(m_BandRegions[b].size(), static_cast<int>(b));
+  }
+
+  // Statistics from another resolution, or band layout, do not apply.
+  if (m_BandMatchers[0] != m_Matcher)
+  {
+    m_Matcher = m_BandMatchers[0];
+    m_NextFrameIsKeyFrame = true;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::MatchBands(const cv::Mat& leftImage, const cv::Mat& rightImage)
+{
+  // m_Matches keeps its capacity from one frame to the next.
+  m_Matches.clear();
+
+  if (m_BandMatchers.size() == 1)
+  {
+    m_Matcher->process(leftImage, rightImage);
+    m_Matcher->getDenseMatches(m_Matches);
+    return;
+  }
+
+  int numberOfBands = static_cast<int>(m_BandMatchers.size());
+  m_BandMatches.resize(numberOfBands);
+  std::vector<std::string> errors(numberOfBands);
+
+  // Streaming mode only updates the first band's parameters.
+  for (int b = 1; b < numberOfBands; b++)
+  {
+    m_BandMatchers[b]->Param = m_Matcher->Param;
+  }
+
+  // Exceptions must not leave an OpenMP block, so are collected, and rethrown below.
+  #pragma omp parallel for schedule(dynamic)
+  for (int b = 0; b < numberOfBands; b++)
+  {
+    try
+    {
+      cv::Ptr<cv::stereo::QuasiDenseStereo> matcher = m_BandMatchers[b];
+      matcher->process(leftImage(m_BandRegions[b]), rightImage(m_BandRegions[b]));
+
+      std::vector<cv::stereo::Match>& matches = m_BandMatches[b];
+      matches.clear();
+      matcher->getDenseMatches(matches);
+
+      // Back to image rows, keeping matches in this band's own rows, in order.
+      int offset = m_BandRegions[b].y;
+      std::vector<cv::stereo::Match>::size_type numberOfMatches = 0;
+      for (std::vector<cv::stereo::Match>::size_type i=0; i < matches.size(); i++)
+      {
+        cv::stereo::Match match = matches[i];
+        match.p0.y += offset;
+        match.p1.y += offset;
+        if (match.p0.y >= m_BandRows[b].start && match.p0.y < m_BandRows[b].end)
+        {
+          matches[numberOfMatches] = match;
+          numberOfMatches++;
+        }
+      }
+      matches.resize(numberOfMatches);
+    }
+    catch (const std::exception& e)
+    {
+      errors[b] = e.what();
+    }
+  }
+
+  for (int b = 0; b < numberOfBands; b++)
+  {
+    if (!errors[b].empty())
+    {
+      sksExceptionThrow() << "Matching band " << b << " failed:" << errors[b];
+    }
+  }
+
+  // Merged in band order, so the output does not depend on thread timing.
+  for (int b = 0; b < numberOfBands; b++)
+  {
+    m_Matches.insert(m_Matches.end(), m_BandMatches[b].begin(), m_BandMatches[b].end());
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::UpdateParameters()
+{
+  m_LastFrameWasKeyFrame = !m_IsStreaming
+                           || m_NextFrameIsKeyFrame
+                           || m_FramesSinceKeyFrame + 1 >= m_StreamingParameters.keyFrameInterval;
+
+  if (m_LastFrameWasKeyFrame)
+  {
+    m_Matcher->Param = m_DefaultParameters;
+    return;
+  }
+
+  cv::stereo::PropagationParameters parameters = m_DefaultParameters;
+
+  parameters.gftMaxNumFeatures = std::max(1, static_cast<int>(m_DefaultParameters.gftMaxNumFeatures
+                                                              * m_StreamingParameters.seedFraction));
+
+  // Pyramidal Lucas-Kanade copes with displacements of about half the window,
+  // doubling with each level, so we use the fewest levels that cover the previous
+  // frame's largest disparity, plus 50%, but never more than the default.
+  // m_MaximumDisparity is in full resolution pixels, so scale to the matched resolution.
+  int maximumDisparity = m_MaximumDisparity >> m_MatchedPyramidLevel;
+  int pyramidLevel = 0;
+  int range = std::max(1, m_DefaultParameters.lkTemplateSize / 2);
+  while (pyramidLevel < m_DefaultParameters.lkPyrLvl && range < maximumDisparity + maximumDisparity / 2)
+  {
+    pyramidLevel++;
+    range *= 2;
+  }
+  parameters.lkPyrLvl = pyramidLevel;
+
+  m_Matcher->Param = parameters;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::UpdateStatistics()
+{
+  int maximumDisparity = 0;
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    maximumDisparity = std::max(maximumDisparity, std::abs(m_Matches[i].p0.x - m_Matches[i].p1.x));
+    maximumDisparity = std::max(maximumDisparity, std::abs(m_Matches[i].p0.y - m_Matches[i].p1.y));
+  }
+  m_MaximumDisparity = maximumDisparity;
+
+  int numberOfMatches = static_cast<int>(m_Matches.size());
+
+  if (m_LastFrameWasKeyFrame)
+  {
+    m_KeyFrameNumberOfMatches = numberOfMatches;
+    m_FramesSinceKeyFrame = 0;
+  }
+  else
+  {
+    m_FramesSinceKeyFrame++;
+  }
+
+  // If density drops, go back to full seed detection.
+  m_NextFrameIsKeyFrame = numberOfMatches < m_StreamingParameters.minimumMatchRatio * m_KeyFrameNumberOfMatches;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::UpdatePyramidLevel()
+{
+  double targetLatency = m_PyramidParameters.targetLatency;
+  if (targetLatency <= 0)
+  {
+    return;
+  }
+
+  // Each level quarters the number of pixels, so only go back down
+  // if roughly 4 times the latency would still be within budget.
+  if (m_LastLatency > targetLatency && m_PyramidLevel < m_PyramidParameters.maximumLevel)
+  {
+    m_PyramidLevel++;
+  }
+  else if (m_LastLatency * 4 < 0.8 * targetLatency && m_PyramidLevel > 0)
+  {
+    m_PyramidLevel--;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::ApplyMasks(const cv::Mat& leftImage, const cv::Mat& rightImage)
+{
+  if (leftImage.size() != m_LeftMask.size())
+  {
+    sksExceptionThrow() << "Image size:" << leftImage.size()
+      << " is not equal to mask size:" << m_LeftMask.size();
+  }
+
+  // Scratch images are reused from one frame to the next.
+  m_LeftMaskedImage.create(m_MaskBoundingBox.size(), leftImage.type());
+  m_RightMaskedImage.create(m_MaskBoundingBox.size(), rightImage.type());
+  m_LeftMaskedImage.setTo(0);
+  m_RightMaskedImage.setTo(0);
+  leftImage(m_MaskBoundingBox).copyTo(m_LeftMaskedImage, m_LeftMask(m_MaskBoundingBox));
+  rightImage(m_MaskBoundingBox).copyTo(m_RightMaskedImage, m_RightMask(m_MaskBoundingBox));
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::MapMatchesToImageCoordinates()
+{
+  int scale = 1 << m_MatchedPyramidLevel;
+  cv::Point2i offset = m_MatchedRegion.tl();
+  cv::Rect imageRectangle(0, 0, m_ImageSize.width, m_ImageSize.height);
+  bool isMasked = !m_LeftMask.empty();
+
+  // Back to full resolution image coordinates, keeping matches inside both masks, in order.
+  std::vector<cv::stereo::Match>::size_type numberOfMatches = 0;
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    cv::stereo::Match match = m_Matches[i];
+    match.p0 = match.p0 * scale + offset;
+    match.p1 = match.p1 * scale + offset;
+
+    if (   match.p0.inside(imageRectangle)
+        && match.p1.inside(imageRectangle)
+        && (!isMasked || m_LeftMask.at<unsigned char>(match.p0) > 0)
+        && (!isMasked || m_RightMask.at<unsigned char>(match.p1) > 0)
+       )
+    {
+      m_Matches[numberOfMatches] = match;
+      numberOfMatches++;
+    }
+  }
+  m_Matches.resize(numberOfMatches);
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::RemoveUnconfidentMatches()
+{
+  float minimumCorrelation = m_ConfidenceParameters.minimumCorrelation;
+  int maximumNumberOfMatches = m_ConfidenceParameters.maximumNumberOfMatches;
+
+  // Only keep the best maximumNumberOfMatches, by raising the threshold to the
+  // correlation of the last one, and then counting how many ties to keep.
+  int numberOfTiesToKeep = std::numeric_limits<int>::max();
+  if (maximumNumberOfMatches > 0 && static_cast<int>(m_Matches.size()) > maximumNumberOfMatches)
+  {
+    m_Correlations.resize(m_Matches.size());
+    for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+    {
+      m_Correlations[i] = m_Matches[i].corr;
+    }
+    std::nth_element(m_Correlations.begin(),
+                     m_Correlations.begin() + (maximumNumberOfMatches - 1),
+                     m_Correlations.end(),
+                     std::greater<float>());
+
+    float lastCorrelation = m_Correlations[maximumNumberOfMatches - 1];
+    if (lastCorrelation >= minimumCorrelation)
+    {
+      minimumCorrelation = lastCorrelation;
+      numberOfTiesToKeep = maximumNumberOfMatches;
+      for (int i = 0; i < maximumNumberOfMatches; i++)
+      {
+        if (m_Correlations[i] > lastCorrelation)
+        {
+          numberOfTiesToKeep--;
+        }
+      }
+    }
+  }
+
+  // In place, keeping the original order, so nothing else is allocated.
+  std::vector<cv::stereo::Match>::size_type numberOfMatches = 0;
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    float correlation = m_Matches[i].corr;
+    bool isKept = correlation > minimumCorrelation;
+    if (!isKept && correlation == minimumCorrelation && numberOfTiesToKeep > 0)
+    {
+      isKept = true;
+      numberOfTiesToKeep--;
+    }
+    if (isKept)
+    {
+      m_Matches[numberOfMatches] = m_Matches[i];
+      numberOfMatches++;
+    }
+  }
+  m_Matches.resize(numberOfMatches);
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::RefineMatches(const cv::Mat& leftImage, const cv::Mat& rightImage)
+{
+  if (m_Matches.empty())
+  {
+    return;
+  }
+
+  // Lucas-Kanade needs 8 bit grey images.
+  cv::Mat leftGreyImage = leftImage;
+  cv::Mat rightGreyImage = rightImage;
+  if (leftImage.channels() == 3)
+  {
+    cv::cvtColor(leftImage, m_LeftGreyImage, cv::COLOR_BGR2GRAY);
+    cv::cvtColor(rightImage, m_RightGreyImage, cv::COLOR_BGR2GRAY);
+    leftGreyImage = m_LeftGreyImage;
+    rightGreyImage = m_RightGreyImage;
+  }
+
+  m_LeftPointsToRefine.resize(m_Matches.size());
+  m_RefinedRightPoints.resize(m_Matches.size());
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    m_LeftPointsToRefine[i] = m_Matches[i].p0;
+    m_RefinedRightPoints[i] = m_Matches[i].p1;
+  }
+
+  // Single level, starting from the upsampled match, as that is already within a
+  // coarse pixel, so each match is only refined within its own neighbourhood.
+  cv::calcOpticalFlowPyrLK(leftGreyImage, rightGreyImage,
+                           m_LeftPointsToRefine, m_RefinedRightPoints,
+                           m_RefinementStatus, m_RefinementError,
+                           cv::Size(11, 11), 0,
+                           cv::TermCriteria(cv::TermCriteria::COUNT + cv::TermCriteria::EPS, 10, 0.03),
+                           cv::OPTFLOW_USE_INITIAL_FLOW);
+
+  // Anything that failed, or moved further than one coarse pixel, keeps the coarse match.
+  float maximumMovement = static_cast<float>(1 << m_MatchedPyramidLevel);
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    cv::Point2f coarse = m_Matches[i].p1;
+    cv::Point2f movement = m_RefinedRightPoints[i] - coarse;
+    if (   m_RefinementStatus[i] == 0
+        || !(std::abs(movement.x) <= maximumMovement)
+        || !(std::abs(movement.y) <= maximumMovement)
+       )
+    {
+      m_RefinedRightPoints[i] = coarse;
+    }
+  }
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StoyanovReconstructor::GetBandDisparity() const
 {
-  cv::Size leftSize = leftImage.size();
-  cv::Size rightSize = rightImage.size();
+  // At the matched resolution, as the whole image matcher's disparity image.
+  cv::Mat disparity = cv::Mat::zeros(m_BandRows.back().end, m_BandRegions.front().width, CV_8UC1);
+  if (m_Matches.empty())
+  {
+    return disparity;
+  }
 
-  if (leftSize != rightSize)
+  // Each band's matcher scales to its own range, so one scale, over all matches, is used instead.
+  float minimumDisparity = std::numeric_limits<float>::max();
+  float maximumDisparity = 0;
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
   {
-    sksExceptionThrow() << "Left size:" << leftSize
-      << " is not equal to right size:" << rightSize;
+    float matchDisparity = static_cast<float>(cv::norm(m_Matches[i].p0 - m_Matches[i].p1));
+    minimumDisparity = std::min(minimumDisparity, matchDisparity);
+    maximumDisparity = std::max(maximumDisparity, matchDisparity);
+  }
+
+  const int numberOfLevels = 80;
+  float range = std::max(maximumDisparity - minimumDisparity, std::numeric_limits<float>::epsilon());
+  int scale = 1 << m_MatchedPyramidLevel;
+  cv::Point2i offset = m_MatchedRegion.tl();
+
+  for (std::vector<cv::stereo::Match>::size_type i=0; i < m_Matches.size(); i++)
+  {
+    // Matches are in full resolution image coordinates, (see MapMatchesToImageCoordinates).
+    cv::Point2i leftPoint = (m_Matches[i].p0 - offset) / scale;
+    float matchDisparity = static_cast<float>(cv::norm(m_Matches[i].p0 - m_Matches[i].p1));
+    int level = cvRound((numberOfLevels - 1) * (matchDisparity - minimumDisparity) / range);
+
+    // 0 is left for pixels without a match.
+    disparity.at<unsigned char>(leftPoint) = cv::saturate_cast<unsigned char>(1 + level * 254 / (numberOfLevels - 1));
   }
+  return disparity;
 }
 
 
 //------------------------------------------------------------------------------
-cv::Ptr<cv::stereo::QuasiDenseStereo> DoStereoMatching(
-  const cv::Mat& leftImage,
-  const cv::Mat& rightImage)
+cv::Mat StoyanovReconstructor::GetDisparity() const
+{
+  cv::Mat disparity;
+
+  if (m_BandMatchers.size() == 1)
+  {
+    disparity = m_Matcher->getDisparity(80);
+  }
+  else
+  {
+    disparity = this->GetBandDisparity();
+  }
+
+  if (m_MatchedPyramidLevel > 0)
+  {
+    cv::Mat upsampledDisparity;
+    cv::resize(disparity, upsampledDisparity, m_MatchedRegion.size(), 0, 0, cv::INTER_NEAREST);
+    disparity = upsampledDisparity;
+  }
+
+  if (m_MatchedRegion.size() == m_ImageSize)
+  {
+    return disparity;
+  }
+
+  cv::Mat fullSizeDisparity = cv::Mat::zeros(m_ImageSize, disparity.type());
+  disparity.copyTo(fullSizeDisparity(m_MatchedRegion));
+  return fullSizeDisparity;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::Process(const cv::Mat& inputLeftImage, const cv::Mat& inputRightImage)
+{
+  int64 startTicks = cv::getTickCount();
+
+  sks::ValidateImages(inputLeftImage, inputRightImage);
+
+  cv::Mat leftImage = inputLeftImage;
+  cv::Mat rightImage = inputRightImage;
+
+  m_ImageSize = inputLeftImage.size();
+  m_MatchedRegion = cv::Rect(0, 0, m_ImageSize.width, m_ImageSize.height);
+
+  if (!m_LeftMask.empty())
+  {
+    this->ApplyMasks(inputLeftImage, inputRightImage);
+    leftImage = m_LeftMaskedImage;
+    rightImage = m_RightMaskedImage;
+    m_MatchedRegion = m_MaskBoundingBox;
+  }
+
+  // Scratch images for each level are reused from one frame to the next.
+  int pyramidLevel = 0;
+  m_LeftPyramid.resize(m_PyramidLevel);
+  m_RightPyramid.resize(m_PyramidLevel);
+  while (pyramidLevel < m_PyramidLevel && leftImage.cols > 1 && leftImage.rows > 1)
+  {
+    cv::pyrDown(leftImage, m_LeftPyramid[pyramidLevel]);
+    cv::pyrDown(rightImage, m_RightPyramid[pyramidLevel]);
+    leftImage = m_LeftPyramid[pyramidLevel];
+    rightImage = m_RightPyramid[pyramidLevel];
+    pyramidLevel++;
+  }
+  m_MatchedPyramidLevel = pyramidLevel;
+
+  this->SelectMatchers(leftImage.size());
+  this->UpdateParameters();
+  this->MatchBands(leftImage, rightImage);
+
+  this->MapMatchesToImageCoordinates();
+
+  // Before filtering, so streaming mode tracks how well the matcher is doing.
+  this->UpdateStatistics();
+
+  this->RemoveUnconfidentMatches();
+
+  m_RefinedRightPoints.clear();
+  if (m_PyramidParameters.refine && m_MatchedPyramidLevel > 0)
+  {
+    this->RefineMatches(inputLeftImage, inputRightImage);
+  }
+
+  m_LastLatency = sks::GetElapsedSeconds(startTicks);
+  this->UpdatePyramidLevel();
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StoyanovReconstructor::computeDisparity(const cv::Mat& leftImage,
+                                                const cv::Mat& rightImage)
+{
+  this->Process(leftImage, rightImage);
+
+  cv::Mat outputImage = this->GetDisparity();
+  return outputImage;
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StoyanovReconstructor::matchPoints(const cv::Mat& leftImage,
+                                           const cv::Mat& rightImage)
+{
+  cv::Mat matchedPoints;
+  this->matchPoints(leftImage, rightImage, matchedPoints);
+  return matchedPoints;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::ExtractMatches(cv::Mat& matchedPoints)
+{
+  sks::CopyMatchesToPoints(m_Matches, m_RefinedRightPoints,
+                           m_MatchFormat.type,
+                           m_MatchFormat.isStructureOfArrays,
+                           m_MatchFormat.includeCorrelation,
+                           matchedPoints);
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::ExtractAndTriangulateMatches(const sks::StereoRig& rig,
+                                                         const bool useHartley,
+                                                         cv::Mat& outputPoints)
+{
+  int numberOfColumns = m_MatchFormat.includeCorrelation ? 8 : 7;
+  sks::PrepareOutputBuffer(static_cast<int>(m_Matches.size()), numberOfColumns, m_MatchFormat.type, outputPoints);
+
+  // Masks, or the confidence parameters, can leave nothing to triangulate.
+  if (m_Matches.empty())
+  {
+    return;
+  }
+
+  // These are views into outputPoints, so are written in place.
+  cv::Mat matchedPointsAndCorrelation = outputPoints.colRange(3, numberOfColumns);
+  cv::Mat matchedPoints = outputPoints.colRange(3, 7);
+  cv::Mat triangulatedPoints = outputPoints.colRange(0, 3);
+
+  sks::CopyMatchesToPoints(m_Matches, m_RefinedRightPoints, m_MatchFormat.type,
+                           false, m_MatchFormat.includeCorrelation, matchedPointsAndCorrelation);
+
+  if (useHartley)
+  {
+    rig.triangulatePointsUsingHartley(matchedPoints, triangulatedPoints);
+  }
+  else
+  {
+    rig.triangulatePointsUsingMidpointOfShortestDistance(matchedPoints, triangulatedPoints);
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::ExtractAndTriangulateOrganizedPoints(const sks::StereoRig& rig,
+                                                                 const bool useHartley,
+                                                                 cv::Mat& organizedPoints,
+                                                                 cv::Mat& validityMask)
+{
+  // Does not allocate if already the right size and type.
+  organizedPoints.create(m_ImageSize, CV_32FC3);
+  validityMask.create(m_ImageSize, CV_8UC1);
+  organizedPoints.setTo(cv::Scalar::all(std::numeric_limits<float>::quiet_NaN()));
+  validityMask.setTo(0);
+
+  // Masks, or the confidence parameters, can leave nothing to triangulate.
+  if (m_Matches.empty())
+  {
+    return;
+  }
+
+  // Float throughout, as the output is float, which is also faster to triangulate.
+  sks::CopyMatchesToPoints(m_Matches, m_RefinedRightPoints, CV_32FC1, false, false, m_OrganizedMatches);
+
+  if (useHartley)
+  {
+    rig.triangulatePointsUsingHartley(m_OrganizedMatches, m_OrganizedTriangulatedPoints);
+  }
+  else
+  {
+    rig.triangulatePointsUsingMidpointOfShortestDistance(m_OrganizedMatches, m_OrganizedTriangulatedPoints);
+  }
+
+  // Each left pixel is matched at most once, so threads never write to the same pixel.
+  int numberOfMatches = static_cast<int>(m_Matches.size());
+
+  #pragma omp parallel for schedule(static) if (numberOfMatches > 10000)
+  for (int i = 0; i < numberOfMatches; i++)
+  {
+    const cv::Point2i& leftPoint = m_Matches[i].p0;
+    const float* point = m_OrganizedTriangulatedPoints.ptr<float>(i);
+    organizedPoints.at<cv::Vec3f>(leftPoint.y, leftPoint.x) = cv::Vec3f(point[0], point[1], point[2]);
+    validityMask.at<unsigned char>(leftPoint.y, leftPoint.x) = 255;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::reconstructOrganizedPoints(const cv::Mat& leftImage,
+                                                       const cv::Mat& rightImage,
+                                                       const sks::StereoRig& rig,
+                                                       const bool useHartley,
+                                                       cv::Mat& organizedPoints,
+                                                       cv::Mat& validityMask)
+{
+  this->Process(leftImage, rightImage);
+  this->ExtractAndTriangulateOrganizedPoints(rig, useHartley, organizedPoints, validityMask);
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::matchPoints(const cv::Mat& leftImage,
+                                        const cv::Mat& rightImage,
+                                        cv::Mat& matchedPoints)
+{
+  this->Process(leftImage, rightImage);
+  this->ExtractMatches(matchedPoints);
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat StoyanovReconstructor::reconstructPoints(const cv::Mat& leftImage,
+                                                 const cv::Mat& rightImage,
+                                                 const sks::StereoRig& rig,
+                                                 const bool useHartley)
+{
+  cv::Mat outputPoints;
+  this->reconstructPoints(leftImage, rightImage, rig, useHartley, outputPoints);
+  return outputPoints;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::reconstructPoints(const cv::Mat& leftImage,
+                                              const cv::Mat& rightImage,
+                                              const sks::StereoRig& rig,
+                                              const bool useHartley,
+                                              cv::Mat& outputPoints)
+{
+  this->Process(leftImage, rightImage);
+  this->ExtractAndTriangulateMatches(rig, useHartley, outputPoints);
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovResult StoyanovReconstructor::reconstruct(const cv::Mat& leftImage,
+                                                  const cv::Mat& rightImage,
+                                                  const sks::StereoRig& rig,
+                                                  const bool useHartley,
+                                                  const int outputs)
+{
+  StoyanovResult result;
+  this->reconstruct(leftImage, rightImage, rig, useHartley, outputs, result);
+  return result;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovReconstructor::reconstruct(const cv::Mat& leftImage,
+                                        const cv::Mat& rightImage,
+                                        const sks::StereoRig& rig,
+                                        const bool useHartley,
+                                        const int outputs,
+                                        StoyanovResult& result)
 {
-  sks::ValidateImages(leftImage, rightImage);
+  if ((outputs & (ALL | ORGANIZED_POINTS)) == 0)
+  {
+    sksExceptionThrow() << "No outputs requested, outputs=" << outputs;
+  }
 
-  cv::Size frameSize = leftImage.size();
+  this->Process(leftImage, rightImage);
+
+  if (outputs & POINTS)
+  {
+    this->ExtractAndTriangulateMatches(rig, useHartley, result.reconstructedPoints);
+    if ((outputs & MATCHES) && !m_MatchFormat.isStructureOfArrays)
+    {
+      result.matchedPoints = result.reconstructedPoints.colRange(3, result.reconstructedPoints.cols);
+    }
+    else if (outputs & MATCHES)
+    {
+      // Must not be a view of reconstructedPoints, as it is a different layout.
+      if (result.matchedPoints.isSubmatrix())
+      {
+        result.matchedPoints.release();
+      }
+      this->ExtractMatches(result.matchedPoints);
+    }
+    else
+    {
+      result.matchedPoints.release();
+    }
+  }
+  else
+  {
+    result.reconstructedPoints.release();
+    if (outputs & MATCHES)
+    {
+      this->ExtractMatches(result.matchedPoints);
+    }
+    else
+    {
+      result.matchedPoints.release();
+    }
+  }
 
-  cv::Ptr<cv::stereo::QuasiDenseStereo> stereo = cv::stereo::QuasiDenseStereo::create(frameSize);
-  stereo->process(leftImage, rightImage);
+  if (outputs & DISPARITY)
+  {
+    result.disparity = this->GetDisparity();
+  }
+  else
+  {
+    result.disparity.release();
+  }
 
-  return stereo;
+  if (outputs & ORGANIZED_POINTS)
+  {
+    this->ExtractAndTriangulateOrganizedPoints(rig, useHartley, result.organizedPoints, result.validityMask);
+  }
+  else
+  {
+    result.organizedPoints.release();
+    result.validityMask.release();
+  }
 }
 
 
@@ -57,12 +1168,8 @@ cv::Mat ComputeDisparityUsingStoyanov(
   const cv::Mat& rightImage
   )
 {
-  sks::ValidateImages(leftImage, rightImage);
-
-  cv::Ptr<cv::stereo::QuasiDenseStereo> stereo = sks::DoStereoMatching(leftImage, rightImage);
-
-  cv::Mat outputImage = stereo->getDisparity(80);
-  return outputImage;
+  sks::StoyanovReconstructor reconstructor;
+  return reconstructor.computeDisparity(leftImage, rightImage);
 }
 
 
@@ -72,22 +1179,70 @@ cv::Mat MatchPointsUsingStoyanov(
   const cv::Mat& rightImage
   )
 {
-  sks::ValidateImages(leftImage, rightImage);
+  cv::Mat matchedPoints;
+  sks::MatchPointsUsingStoyanov(leftImage, rightImage, matchedPoints);
+  return matchedPoints;
+}
+
 
-  cv::Ptr<cv::stereo::QuasiDenseStereo> stereo = sks::DoStereoMatching(leftImage, rightImage);
+//------------------------------------------------------------------------------
+void MatchPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& rightImage,
+  cv::Mat& matchedPoints
+  )
+{
+  sks::StoyanovReconstructor reconstructor;
+  reconstructor.matchPoints(leftImage, rightImage, matchedPoints);
+}
 
-  std::vector<cv::stereo::Match> matches;
-  stereo->getDenseMatches(matches);
 
-  cv::Mat matchedPoints = cv::Mat(matches.size(), 4, CV_64FC1);
-  for (std::vector<cv::stereo::Match>::size_type i=0; i < matches.size(); i++)
-  {
-    matchedPoints.at<double>(i, 0) = matches[i].p0.x;
-    matchedPoints.at<double>(i, 1) = matches[i].p0.y;
-    matchedPoints.at<double>(i, 2) = matches[i].p1.x;
-    matchedPoints.at<double>(i, 3) = matches[i].p1.y;
-  }
-  return matchedPoints;
+//------------------------------------------------------------------------------
+cv::Mat ReconstructPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley
+  )
+{
+  cv::Mat outputPoints;
+  sks::ReconstructPointsUsingStoyanov(leftImage,
+                                      leftCameraMatrix,
+                                      rightImage,
+                                      rightCameraMatrix,
+                                      leftToRightRotationMatrix,
+                                      leftToRightTranslationVector,
+                                      useHartley,
+                                      outputPoints
+                                     );
+  return outputPoints;
+}
+
+
+//------------------------------------------------------------------------------
+void ReconstructPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  cv::Mat& outputPoints
+  )
+{
+  // Validates the calibration before we spend time matching.
+  sks::StereoRig rig(leftCameraMatrix,
+                     rightCameraMatrix,
+                     leftToRightRotationMatrix,
+                     leftToRightTranslationVector
+                    );
+
+  sks::StoyanovReconstructor reconstructor;
+  reconstructor.reconstructPoints(leftImage, rightImage, rig, useHartley, outputPoints);
 }
 
 
@@ -99,50 +1254,104 @@ cv::Mat ReconstructPointsUsingStoyanov(
   const cv::Mat& rightCameraMatrix,
   const cv::Mat& leftToRightRotationMatrix,
   const cv::Mat& leftToRightTranslationVector,
+  const cv::Mat& leftMask,
+  const cv::Mat& rightMask,
   const bool useHartley
   )
 {
-  sks::ValidateImages(leftImage, rightImage);
+  // Validates the calibration before we spend time matching.
+  sks::StereoRig rig(leftCameraMatrix,
+                     rightCameraMatrix,
+                     leftToRightRotationMatrix,
+                     leftToRightTranslationVector
+                    );
+
+  sks::StoyanovReconstructor reconstructor;
+  reconstructor.setMasks(leftMask, rightMask);
+  return reconstructor.reconstructPoints(leftImage, rightImage, rig, useHartley);
+}
+
+
+//------------------------------------------------------------------------------
+cv::Mat ReconstructPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  const float minimumCorrelation,
+  const int maximumNumberOfPoints
+  )
+{
+  // Validates the calibration before we spend time matching.
+  sks::StereoRig rig(leftCameraMatrix,
+                     rightCameraMatrix,
+                     leftToRightRotationMatrix,
+                     leftToRightTranslationVector
+                    );
 
-  sks::ValidateStereoParameters(
-    leftCameraMatrix,
-    rightCameraMatrix,
-    leftToRightRotationMatrix,
-    leftToRightTranslationVector
-  );
+  sks::StoyanovConfidenceParameters parameters;
+  parameters.minimumCorrelation = minimumCorrelation;
+  parameters.maximumNumberOfMatches = maximumNumberOfPoints;
 
-  cv::Mat matchedPoints = sks::MatchPointsUsingStoyanov(leftImage, rightImage);
+  sks::StoyanovMatchFormat format;
+  format.includeCorrelation = true;
 
-  cv::Mat triangulatedPoints;
+  sks::StoyanovReconstructor reconstructor;
+  reconstructor.setConfidenceParameters(parameters);
+  reconstructor.setMatchFormat(format);
+  return reconstructor.reconstructPoints(leftImage, rightImage, rig, useHartley);
+}
 
-  if (useHartley)
-  {
-    triangulatedPoints = sks::TriangulatePointsUsingHartley(matchedPoints,
-                                                            leftCameraMatrix,
-                                                            rightCameraMatrix,
-                                                            leftToRightRotationMatrix,
-                                                            leftToRightTranslationVector
-                                                           );
-  }
-  else
-  {
-    triangulatedPoints = sks::TriangulatePointsUsingMidpointOfShortestDistance(matchedPoints,
-                                                                               leftCameraMatrix,
-                                                                               rightCameraMatrix,
-                                                                               leftToRightRotationMatrix,
-                                                                               leftToRightTranslationVector
-                                                                              );
-  }
 
-  cv::Mat outputPoints = cv::Mat(triangulatedPoints.rows, 7, CV_64FC1);
+//------------------------------------------------------------------------------
+void ReconstructOrganizedPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  cv::Mat& organizedPoints,
+  cv::Mat& validityMask
+  )
+{
+  // Validates the calibration before we spend time matching.
+  sks::StereoRig rig(leftCameraMatrix,
+                     rightCameraMatrix,
+                     leftToRightRotationMatrix,
+                     leftToRightTranslationVector
+                    );
+
+  sks::StoyanovReconstructor reconstructor;
+  reconstructor.reconstructOrganizedPoints(leftImage, rightImage, rig, useHartley, organizedPoints, validityMask);
+}
 
-  cv::Mat output3D = outputPoints(cv::Rect(0, 0, triangulatedPoints.cols, triangulatedPoints.rows));
-  triangulatedPoints.copyTo(output3D);
 
-  cv::Mat output2D = outputPoints(cv::Rect(3, 0, matchedPoints.cols, matchedPoints.rows));
-  matchedPoints.copyTo(output2D);
+//------------------------------------------------------------------------------
+StoyanovResult ReconstructUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  const int outputs
+  )
+{
+  // Validates the calibration before we spend time matching.
+  sks::StereoRig rig(leftCameraMatrix,
+                     rightCameraMatrix,
+                     leftToRightRotationMatrix,
+                     leftToRightTranslationVector
+                    );
 
-  return outputPoints;
+  sks::StoyanovReconstructor reconstructor;
+  return reconstructor.reconstruct(leftImage, rightImage, rig, useHartley, outputs);
 }
 
 } // end namespace
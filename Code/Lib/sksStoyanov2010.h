@@ -16,6 +16,8 @@
 #define sksStoyanov2010_h
 
 #include <opencv2/core.hpp>
+#include <opencv2/stereo.hpp>
+#include "sksStereoRig.h"
 #include "sksWin32ExportHeader.h"
 
 /**
@@ -52,6 +54,36 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat MatchPointsUsingStoyanov(
   const cv::Mat& rightImage
   );
 
+/**
+* \brief As above, but writes into matchedPoints, reusing its memory where possible.
+* \see sks::PrepareOutputBuffer
+* \param[in] leftImage usually RGB image
+* \param[in] rightImage usually RGB image
+* \param[out] matchedPoints Nx4 matrix, where the columns are x_left, y_left, x_right, y_right.
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void MatchPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& rightImage,
+  cv::Mat& matchedPoints
+  );
+
+/**
+* \brief Converts matches to a matrix, in parallel, writing rows directly.
+* \see sks::PrepareOutputBuffer
+* \param[in] matches from cv::stereo::QuasiDenseStereo::getDenseMatches
+* \param[in] type CV_32FC1 or CV_64FC1
+* \param[in] isStructureOfArrays if false, output is Nx4, one match per row, if true, output is 4xN, one coordinate per row.
+* \param[in] includeCorrelation if true, adds each match's correlation score as a 5th column, (or row).
+* \param[out] matchedPoints x_left, y_left, x_right, y_right, [correlation], as columns or rows, as above.
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void ConvertMatchesToPoints(
+  const std::vector<cv::stereo::Match>& matches,
+  const int type,
+  const bool isStructureOfArrays,
+  const bool includeCorrelation,
+  cv::Mat& matchedPoints
+  );
+
 /**
 * \brief Does full triangulation of matched points, returning a point cloud.
 * \param[in] leftImage usually RGB image
@@ -73,6 +105,519 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat ReconstructPointsUsingStoyanov
   const bool useHartley
   );
 
+/**
+* \brief As above, but writes into outputPoints, reusing its memory where possible.
+*
+* The matches are written straight into columns 3-6 of outputPoints, and
+* triangulated straight into columns 0-2, so nothing is copied.
+* \see sks::PrepareOutputBuffer
+* \param[out] outputPoints Nx7 matrix, where the columns are X,Y,Z, x_left, y_left, x_right, y_right.
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void ReconstructPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  cv::Mat& outputPoints
+  );
+
+
+/**
+* \brief Does full triangulation of matched points, returning an image of 3D points, aligned to the left image.
+*
+* Unlike the Nx7 point cloud, this keeps the image grid, so neighbouring
+* points are found by looking at neighbouring pixels, and takes 13 bytes
+* per pixel, rather than 56 bytes per point.
+*
+* \param[out] organizedPoints CV_32FC3 image, same size as leftImage, of X, Y, Z, NaN where there is no match.
+* \param[out] validityMask CV_8UC1 image, same size as leftImage, 255 where there is a match, 0 elsewhere.
+* \see sks::StoyanovReconstructor::reconstructOrganizedPoints
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void ReconstructOrganizedPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  cv::Mat& organizedPoints,
+  cv::Mat& validityMask
+  );
+
+
+/**
+* \brief Everything a single run of Stoyanov 2010 matching can produce.
+*
+* Only the members that were asked for are filled in, the rest are empty.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StoyanovResult
+{
+  cv::Mat matchedPoints;       ///< Nx4 matrix of x_left, y_left, x_right, y_right.
+  cv::Mat disparity;           ///< Disparity image, same size as the input images.
+  cv::Mat reconstructedPoints; ///< Nx7 matrix of X, Y, Z, x_left, y_left, x_right, y_right.
+  cv::Mat organizedPoints;     ///< CV_32FC3 image of X, Y, Z, same size as the left image, NaN where not matched.
+  cv::Mat validityMask;        ///< CV_8UC1 image, same size as the left image, 255 where organizedPoints is valid.
+};
+
+
+/**
+* \brief As above, but only matching inside the masks.
+* \see sks::StoyanovReconstructor::setMasks
+* \param[in] leftMask CV_8UC1 image, same size as leftImage, non-zero where matching should happen.
+* \param[in] rightMask CV_8UC1 image, same size as rightImage, non-zero where matching should happen.
+* \return Nx7 matrix, where the columns are X,Y,Z (3D triangulated point), x_left, y_left, x_right, y_right (2D matches).
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat ReconstructPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const cv::Mat& leftMask,
+  const cv::Mat& rightMask,
+  const bool useHartley
+  );
+
+
+/**
+* \brief As above, but rejecting weak matches before triangulation, and returning their correlation.
+* \see sks::StoyanovReconstructor::setConfidenceParameters
+* \param[in] minimumCorrelation matches with a lower correlation score are not triangulated.
+* \param[in] maximumNumberOfPoints if > 0, only this many matches, with the highest correlation, are triangulated.
+* \return Nx8 matrix, where the columns are X,Y,Z (3D triangulated point), x_left, y_left, x_right, y_right (2D matches), correlation.
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat ReconstructPointsUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  const float minimumCorrelation,
+  const int maximumNumberOfPoints
+  );
+
+
+/**
+* \brief Matches once, and returns any of the matches, disparity image and point cloud.
+*
+* ComputeDisparityUsingStoyanov, MatchPointsUsingStoyanov and ReconstructPointsUsingStoyanov
+* each run the whole matching. Use this if you need more than one of their outputs.
+*
+* \param[in] outputs bitwise OR of sks::StoyanovReconstructor::Outputs, saying which members of the result to fill in.
+* \return sks::StoyanovResult
+*/
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT StoyanovResult ReconstructUsingStoyanov(
+  const cv::Mat& leftImage,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightImage,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  const bool useHartley,
+  const int outputs
+  );
+
+
+/**
+* \brief Settings for the streaming mode of sks::StoyanovReconstructor.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StoyanovStreamingParameters
+{
+  StoyanovStreamingParameters();
+
+  /// Fraction of the default number of seed features detected on non-key frames, (0, 1].
+  float seedFraction;
+
+  /// If a frame has fewer than this fraction of the matches of the last key frame, the next frame is a key frame.
+  float minimumMatchRatio;
+
+  /// Maximum number of frames between key frames. 1 means every frame is a key frame.
+  int keyFrameInterval;
+};
+
+
+/**
+* \brief Settings for the coarse-to-fine (pyramid) mode of sks::StoyanovReconstructor.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StoyanovPyramidParameters
+{
+  StoyanovPyramidParameters();
+
+  /// Number of times images are halved before matching. 0 means full resolution.
+  int level;
+
+  /// Highest level the latency controller may choose.
+  int maximumLevel;
+
+  /// If > 0, seconds per frame the controller aims for, by changing level. If 0, level is fixed.
+  double targetLatency;
+
+  /// If true, and level > 0, right hand points are refined at full resolution, using Lucas-Kanade.
+  bool refine;
+};
+
+
+/**
+* \brief Layout of the matches returned by sks::StoyanovReconstructor, (see sks::ConvertMatchesToPoints).
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StoyanovMatchFormat
+{
+  StoyanovMatchFormat();
+
+  /// CV_32FC1 or CV_64FC1, default CV_64FC1.
+  int type;
+
+  /// If true, matches are 4xN, one coordinate per row, rather than Nx4.
+  bool isStructureOfArrays;
+
+  /// If true, each match's correlation score is added as an extra column, (or row).
+  bool includeCorrelation;
+};
+
+
+/**
+* \brief Settings for rejecting weak matches in sks::StoyanovReconstructor, before triangulation.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StoyanovConfidenceParameters
+{
+  StoyanovConfidenceParameters();
+
+  /// Matches with a correlation score below this are rejected. Default -1 keeps all of them.
+  float minimumCorrelation;
+
+  /// If > 0, only this many matches, with the highest correlation, are kept, in their original order.
+  int maximumNumberOfMatches;
+};
+
+
+/**
+* \brief Settings for matching horizontal bands of the image in parallel, in sks::StoyanovReconstructor.
+*
+* Each band's matcher scales its own disparity image to the range of that band,
+* so with more than 1 band, the disparity output is instead drawn from the merged
+* matches, with one scale for the whole image.
+*/
+struct SKSURGERYOPENCVCPP_WINEXPORT StoyanovBandParameters
+{
+  StoyanovBandParameters();
+
+  /// Number of horizontal bands, each matched on its own thread. 1 means the whole image is matched at once.
+  int numberOfBands;
+
+  /// Number of rows, at the matched resolution, that each band extends into its neighbours.
+  int overlap;
+};
+
+
+/**
+* \class StoyanovReconstructor
+* \brief Runs Stoyanov 2010 matching repeatedly, e.g. once per video frame,
+* reusing one cv::stereo::QuasiDenseStereo matcher.
+*
+* Creating the matcher allocates all its internal buffers, for a given image
+* size. The functions above create one per call. This class keeps the matcher,
+* and only re-creates it when the image size changes.
+*
+* Each method processes the pair of images passed in. The class is not thread
+* safe, so use one instance per thread, or per video stream.
+*
+* In streaming mode, consecutive calls are assumed to be consecutive video frames.
+* Key frames use the matcher's default parameters. In between key frames, the
+* matcher detects fewer seed features, (see StoyanovStreamingParameters::seedFraction),
+* and uses as few Lucas-Kanade pyramid levels as the previous frame's largest
+* disparity allows. This relies on the quasi-dense propagation filling in from
+* fewer seeds. If the number of matches drops, the next frame is a key frame.
+*
+* In pyramid mode, images are downsampled before matching, (see StoyanovPyramidParameters),
+* and matches are scaled back up, so outputs are always in full resolution pixels,
+* and the camera matrices still apply. One matcher is kept per matched image size,
+* so changing level does not re-create matchers. Disparity images are upsampled
+* to full size, but their grey levels are those of the matched resolution.
+*
+* In band mode, (see StoyanovBandParameters), rectified images are split into
+* horizontal bands, which overlap, so that propagation can continue across the seams.
+* Each band has its own matcher, and bands are matched in parallel, using OpenMP.
+* Each band only keeps matches whose left point is in its own rows, (i.e. not in
+* the overlap), and bands are merged in order, so the output is deterministic.
+* Propagation is best-first over the whole image, so results are not identical
+* to matching the whole image, but are the same format and coordinates.
+* The disparity image is drawn from the merged matches, after the confidence
+* filters, with one scale for all bands, so grey levels are continuous across
+* seams: 0 where there is no match, and otherwise 1 to 255, linear in disparity,
+* over the range of disparities of all matches, in 80 levels.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StoyanovReconstructor {
+
+public:
+
+  /**
+  * \brief Flags for which outputs sks::StoyanovReconstructor::reconstruct computes.
+  */
+  enum Outputs
+  {
+    MATCHES = 1,
+    DISPARITY = 2,
+    POINTS = 4,
+    ALL = MATCHES | DISPARITY | POINTS,
+    ORGANIZED_POINTS = 8 ///< Not part of ALL, as it allocates whole images, so must be asked for.
+  };
+
+  StoyanovReconstructor();
+
+  /**
+  * \brief Restricts matching to the non-zero pixels of the masks.
+  *
+  * Images are cropped to the bounding box of both masks, and pixels outside each
+  * mask are set to zero, before matching, so seeds and propagation stay inside
+  * the masks, (e.g. the circular field of view of an endoscope). Matches are
+  * returned in full image coordinates, and only those with the left point in
+  * leftMask and the right point in rightMask are kept, so only those are triangulated.
+  * Disparity images are full size, and zero outside the bounding box.
+  *
+  * \param leftMask CV_8UC1 image, same size as the images, or empty to switch off masking.
+  * \param rightMask CV_8UC1 image, same size as leftMask, or empty to switch off masking.
+  */
+  void setMasks(const cv::Mat& leftMask, const cv::Mat& rightMask);
+
+  /**
+  * \brief Turns streaming mode on or off. Either way, the next frame is a key frame.
+  */
+  void setStreaming(const bool& isStreaming);
+  bool getStreaming() const;
+
+  void setStreamingParameters(const StoyanovStreamingParameters& parameters);
+  StoyanovStreamingParameters getStreamingParameters() const;
+
+  /**
+  * \brief Returns true if the most recent frame was processed with the default parameters.
+  */
+  bool getLastFrameWasKeyFrame() const;
+
+  /**
+  * \brief Sets the pyramid mode, (see StoyanovPyramidParameters), and the level of the next frame.
+  */
+  void setPyramidParameters(const StoyanovPyramidParameters& parameters);
+  StoyanovPyramidParameters getPyramidParameters() const;
+
+  /**
+  * \brief Returns the pyramid level the next frame will use, which the controller may have changed.
+  */
+  int getPyramidLevel() const;
+
+  /**
+  * \brief Returns how long the most recent matching took, in seconds.
+  */
+  double getLastLatency() const;
+
+  void setBandParameters(const StoyanovBandParameters& parameters);
+  StoyanovBandParameters getBandParameters() const;
+
+  /**
+  * \brief Sets the layout of matches from matchPoints and reconstruct.
+  *
+  * Triangulation is done in the same type, so reconstructPoints, and
+  * POINTS from reconstruct, are also of this type. If includeCorrelation
+  * is true, these have correlation as an 8th column. Unless the format is
+  * structure of arrays, MATCHES from reconstruct is a view into POINTS,
+  * otherwise it is converted separately.
+  */
+  void setMatchFormat(const StoyanovMatchFormat& format);
+  StoyanovMatchFormat getMatchFormat() const;
+
+  /**
+  * \brief Sets which matches are rejected, (see StoyanovConfidenceParameters).
+  *
+  * Matches are rejected straight after matching, so they are never refined,
+  * converted or triangulated. Streaming mode still counts all matches.
+  */
+  void setConfidenceParameters(const StoyanovConfidenceParameters& parameters);
+  StoyanovConfidenceParameters getConfidenceParameters() const;
+
+  /**
+  * \brief Matches once, then computes only the requested outputs.
+  *
+  * If both MATCHES and POINTS are requested, result.matchedPoints is a view
+  * of columns 3-6 of result.reconstructedPoints, so nothing is copied.
+  * Passing the same result each frame reuses its memory. ORGANIZED_POINTS
+  * fills result.organizedPoints and result.validityMask, as reconstructOrganizedPoints.
+  *
+  * \param rig calibration, only used if POINTS or ORGANIZED_POINTS is requested
+  * \param useHartley if false, uses midpoint method, if true, uses hartley.
+  * \param outputs bitwise OR of Outputs
+  * \param result members that were not requested are released
+  */
+  void reconstruct(const cv::Mat& leftImage,
+                   const cv::Mat& rightImage,
+                   const sks::StereoRig& rig,
+                   const bool useHartley,
+                   const int outputs,
+                   StoyanovResult& result);
+
+  /**
+  * \brief As above, returning a new result.
+  */
+  StoyanovResult reconstruct(const cv::Mat& leftImage,
+                             const cv::Mat& rightImage,
+                             const sks::StereoRig& rig,
+                             const bool useHartley,
+                             const int outputs);
+
+  /**
+  * \brief Gets a disparity map image.
+  * \see sks::ComputeDisparityUsingStoyanov
+  */
+  cv::Mat computeDisparity(const cv::Mat& leftImage,
+                           const cv::Mat& rightImage);
+
+  /**
+  * \brief Gets the matching points in left and right images.
+  * \see sks::MatchPointsUsingStoyanov
+  * \return Nx4 matrix, where the columns are x_left, y_left, x_right, y_right, i.e. 2D pixel locations.
+  */
+  cv::Mat matchPoints(const cv::Mat& leftImage,
+                      const cv::Mat& rightImage);
+
+  /**
+  * \brief As above, but writes into matchedPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  */
+  void matchPoints(const cv::Mat& leftImage,
+                   const cv::Mat& rightImage,
+                   cv::Mat& matchedPoints);
+
+  /**
+  * \brief Matches, then triangulates, returning a point cloud.
+  * \see sks::ReconstructPointsUsingStoyanov
+  * \param rig calibration, which has already been validated
+  * \param useHartley if false, uses midpoint method, if true, uses hartley.
+  * \return Nx7 matrix, where the columns are X,Y,Z (3D triangulated point), x_left, y_left, x_right, y_right (2D matches).
+  */
+  cv::Mat reconstructPoints(const cv::Mat& leftImage,
+                            const cv::Mat& rightImage,
+                            const sks::StereoRig& rig,
+                            const bool useHartley);
+
+  /**
+  * \brief As above, but writes into outputPoints, reusing its memory where possible.
+  * \see sks::PrepareOutputBuffer
+  */
+  void reconstructPoints(const cv::Mat& leftImage,
+                         const cv::Mat& rightImage,
+                         const sks::StereoRig& rig,
+                         const bool useHartley,
+                         cv::Mat& outputPoints);
+
+  /**
+  * \brief Matches, then triangulates, writing each point at its pixel in the left image.
+  *
+  * Matches are triangulated in float, (see sks::StereoRig), then written into
+  * organizedPoints at the pixel they were matched from. Both images are reused
+  * from one call to the next if they are already the right size and type.
+  * In pyramid mode, only every 2^level pixels can be matched.
+  *
+  * \see sks::ReconstructOrganizedPointsUsingStoyanov
+  * \param rig calibration, which has already been validated
+  * \param useHartley if false, uses midpoint method, if true, uses hartley.
+  * \param organizedPoints CV_32FC3 image of X, Y, Z, NaN where there is no match.
+  * \param validityMask CV_8UC1 image, 255 where there is a match, 0 elsewhere.
+  */
+  void reconstructOrganizedPoints(const cv::Mat& leftImage,
+                                  const cv::Mat& rightImage,
+                                  const sks::StereoRig& rig,
+                                  const bool useHartley,
+                                  cv::Mat& organizedPoints,
+                                  cv::Mat& validityMask);
+
+private:
+
+  StoyanovReconstructor(const StoyanovReconstructor&);
+  StoyanovReconstructor& operator=(const StoyanovReconstructor&);
+
+  void Process(const cv::Mat& leftImage, const cv::Mat& rightImage);
+  void ExtractMatches(cv::Mat& matchedPoints);
+  void ExtractAndTriangulateMatches(const sks::StereoRig& rig,
+                                    const bool useHartley,
+                                    cv::Mat& outputPoints);
+  void ExtractAndTriangulateOrganizedPoints(const sks::StereoRig& rig,
+                                            const bool useHartley,
+                                            cv::Mat& organizedPoints,
+                                            cv::Mat& validityMask);
+
+  cv::Ptr<cv::stereo::QuasiDenseStereo> GetMatcher(const cv::Size& size, const int band);
+  void SelectMatchers(const cv::Size& size);
+  void MatchBands(const cv::Mat& leftImage, const cv::Mat& rightImage);
+  void UpdateParameters();
+  void UpdateStatistics();
+  void UpdatePyramidLevel();
+  void ApplyMasks(const cv::Mat& leftImage, const cv::Mat& rightImage);
+  void MapMatchesToImageCoordinates();
+  void RemoveUnconfidentMatches();
+  void RefineMatches(const cv::Mat& leftImage, const cv::Mat& rightImage);
+  cv::Mat GetDisparity() const;
+  cv::Mat GetBandDisparity() const;
+
+  cv::Ptr<cv::stereo::QuasiDenseStereo>   m_Matcher;
+  std::vector<cv::Ptr<cv::stereo::QuasiDenseStereo> > m_Matchers;
+  std::vector<cv::Size>                   m_MatcherSizes;
+  std::vector<int>                        m_MatcherBands;
+  std::vector<cv::stereo::Match>          m_Matches;
+  std::vector<cv::Point2f>                m_RefinedRightPoints;
+  cv::Size                                m_ImageSize;
+  cv::Rect                                m_MatchedRegion;
+
+  // Streaming mode.
+  bool                                    m_IsStreaming;
+  StoyanovStreamingParameters             m_StreamingParameters;
+  cv::stereo::PropagationParameters       m_DefaultParameters;
+  bool                                    m_NextFrameIsKeyFrame;
+  bool                                    m_LastFrameWasKeyFrame;
+  int                                     m_FramesSinceKeyFrame;
+  int                                     m_KeyFrameNumberOfMatches;
+  int                                     m_MaximumDisparity;
+
+  // Masking.
+  cv::Mat                                 m_LeftMask;
+  cv::Mat                                 m_RightMask;
+  cv::Rect                                m_MaskBoundingBox;
+  cv::Mat                                 m_LeftMaskedImage;
+  cv::Mat                                 m_RightMaskedImage;
+
+  // Pyramid.
+  StoyanovPyramidParameters               m_PyramidParameters;
+  int                                     m_PyramidLevel;
+  int                                     m_MatchedPyramidLevel;
+  double                                  m_LastLatency;
+  std::vector<cv::Mat>                    m_LeftPyramid;
+  std::vector<cv::Mat>                    m_RightPyramid;
+  cv::Mat                                 m_LeftGreyImage;
+  cv::Mat                                 m_RightGreyImage;
+  std::vector<cv::Point2f>                m_LeftPointsToRefine;
+  std::vector<unsigned char>              m_RefinementStatus;
+  std::vector<float>                      m_RefinementError;
+
+  // Output.
+  StoyanovMatchFormat                     m_MatchFormat;
+  StoyanovConfidenceParameters            m_ConfidenceParameters;
+  std::vector<float>                      m_Correlations;
+  cv::Mat                                 m_OrganizedMatches;
+  cv::Mat                                 m_OrganizedTriangulatedPoints;
+
+  // Bands.
+  StoyanovBandParameters                  m_BandParameters;
+  std::vector<cv::Rect>                   m_BandRegions;
+  std::vector<cv::Range>                  m_BandRows;
+  std::vector<cv::Ptr<cv::stereo::QuasiDenseStereo> > m_BandMatchers;
+  std::vector<std::vector<cv::stereo::Match> > m_BandMatches;
+
+}; // end class
+
 } // end namespace
 
 #endif
\ No newline at end of file
@@ -0,0 +1,294 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "sksStoyanovBatch.h"
+#include "sksExceptionMacro.h"
+#include <opencv2/imgcodecs.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+namespace sks
+{
+
+//------------------------------------------------------------------------------
+cv::Mat LoadBatchImage(const std::string& fileName)
+{
+  cv::Mat image = cv::imread(fileName);
+  if (image.empty())
+  {
+    sksExceptionThrow() << "Failed to load image:" << fileName;
+  }
+  return image;
+}
+
+
+//------------------------------------------------------------------------------
+void ValidateBatchSizes(const size_t& numberOfLeft, const size_t& numberOfRight)
+{
+  if (numberOfLeft != numberOfRight)
+  {
+    sksExceptionThrow() << "Number of left images:" << numberOfLeft
+      << " is not equal to number of right images:" << numberOfRight;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+std::string GetBatchErrorMessage(const std::exception& e)
+{
+  const sks::Exception* exception = dynamic_cast<const sks::Exception*>(&e);
+  if (exception != nullptr)
+  {
+    return exception->GetDescription();
+  }
+  return e.what();
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovBatchReconstructor::StoyanovBatchReconstructor(const sks::StereoRig& rig,
+                                                       const bool useHartley,
+                                                       const int numberOfThreads,
+                                                       const int queueDepth)
+: m_Rig(rig)
+, m_UseHartley(useHartley)
+, m_NumberOfThreads(numberOfThreads)
+, m_QueueDepth(queueDepth)
+{
+  if (numberOfThreads < 1)
+  {
+    sksExceptionThrow() << "numberOfThreads should be at least 1, not " << numberOfThreads;
+  }
+  if (queueDepth < numberOfThreads)
+  {
+    sksExceptionThrow() << "queueDepth should be at least numberOfThreads:" << numberOfThreads
+      << ", not " << queueDepth;
+  }
+
+  for (int i = 0; i < numberOfThreads; i++)
+  {
+    m_Reconstructors.push_back(std::unique_ptr<StoyanovReconstructor>(new StoyanovReconstructor()));
+  }
+  m_Results.resize(queueDepth);
+}
+
+
+//------------------------------------------------------------------------------
+StoyanovBatchReconstructor::~StoyanovBatchReconstructor()
+{
+}
+
+
+//------------------------------------------------------------------------------
+int StoyanovBatchReconstructor::getNumberOfThreads() const
+{
+  return m_NumberOfThreads;
+}
+
+
+//------------------------------------------------------------------------------
+int StoyanovBatchReconstructor::getQueueDepth() const
+{
+  return m_QueueDepth;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovBatchReconstructor::Run(const int numberOfPairs,
+                                     const PairLoader& loader,
+                                     const ResultCallback& callback)
+{
+  // Pair i is written to m_Results[i % m_QueueDepth]. A worker only starts pair i
+  // once pair i - m_QueueDepth has been passed to the callback, so buffers are
+  // never overwritten while in use, and memory does not grow with the sequence.
+  std::mutex mutex;
+  std::condition_variable workerCondition;
+  std::condition_variable callbackCondition;
+  int nextPair = 0;
+  int nextResult = 0;
+  std::vector<bool> isReady(m_QueueDepth, false);
+  bool isStopping = false;
+  std::string error;
+
+  std::vector<std::thread> threads;
+  int numberOfThreads = std::min(m_NumberOfThreads, numberOfPairs);
+
+  for (int t = 0; t < numberOfThreads; t++)
+  {
+    StoyanovReconstructor* reconstructor = m_Reconstructors[t].get();
+
+    threads.push_back(std::thread([&, reconstructor]()
+    {
+      cv::Mat leftImage;
+      cv::Mat rightImage;
+
+      while (true)
+      {
+        int pair = 0;
+        {
+          std::unique_lock<std::mutex> lock(mutex);
+          workerCondition.wait(lock, [&]() {
+            return isStopping || nextPair >= numberOfPairs || nextPair < nextResult + m_QueueDepth;
+          });
+          if (isStopping || nextPair >= numberOfPairs)
+          {
+            return;
+          }
+          pair = nextPair;
+          nextPair++;
+        }
+
+        try
+        {
+          loader(pair, leftImage, rightImage);
+          reconstructor->reconstructPoints(leftImage, rightImage, m_Rig, m_UseHartley,
+                                           m_Results[pair % m_QueueDepth]);
+        }
+        catch (const std::exception& e)
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          if (error.empty())
+          {
+            std::ostringstream message;
+            message << "Pair " << pair << " failed:" << sks::GetBatchErrorMessage(e);
+            error = message.str();
+          }
+          isStopping = true;
+          workerCondition.notify_all();
+          callbackCondition.notify_all();
+          return;
+        }
+
+        {
+          std::lock_guard<std::mutex> lock(mutex);
+          isReady[pair % m_QueueDepth] = true;
+        }
+        callbackCondition.notify_all();
+      }
+    }));
+  }
+
+  // Results are passed on in order, on this thread.
+  try
+  {
+    for (int pair = 0; pair < numberOfPairs; pair++)
+    {
+      int slot = pair % m_QueueDepth;
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        callbackCondition.wait(lock, [&]() { return isReady[slot] || isStopping; });
+        if (isStopping)
+        {
+          break;
+        }
+      }
+
+      callback(pair, m_Results[slot]);
+
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        isReady[slot] = false;
+        nextResult++;
+      }
+      workerCondition.notify_all();
+    }
+  }
+  catch (const std::exception& e)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (error.empty())
+    {
+      error = "Callback failed:" + sks::GetBatchErrorMessage(e);
+    }
+    isStopping = true;
+    workerCondition.notify_all();
+  }
+
+  for (std::vector<std::thread>::size_type t = 0; t < threads.size(); t++)
+  {
+    threads[t].join();
+  }
+
+  if (!error.empty())
+  {
+    sksExceptionThrow() << error;
+  }
+}
+
+
+//------------------------------------------------------------------------------
+std::vector<cv::Mat> StoyanovBatchReconstructor::reconstruct(const std::vector<cv::Mat>& leftImages,
+                                                             const std::vector<cv::Mat>& rightImages)
+{
+  sks::ValidateBatchSizes(leftImages.size(), rightImages.size());
+
+  std::vector<cv::Mat> results(leftImages.size());
+
+  this->Run(static_cast<int>(leftImages.size()),
+            [&](const int pair, cv::Mat& leftImage, cv::Mat& rightImage)
+            {
+              leftImage = leftImages[pair];
+              rightImage = rightImages[pair];
+            },
+            [&](const int pair, const cv::Mat& points)
+            {
+              results[pair] = points.clone();
+            });
+
+  return results;
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovBatchReconstructor::reconstruct(const std::vector<std::string>& leftFileNames,
+                                             const std::vector<std::string>& rightFileNames,
+                                             const ResultCallback& callback)
+{
+  sks::ValidateBatchSizes(leftFileNames.size(), rightFileNames.size());
+
+  this->Run(static_cast<int>(leftFileNames.size()),
+            [&](const int pair, cv::Mat& leftImage, cv::Mat& rightImage)
+            {
+              leftImage = sks::LoadBatchImage(leftFileNames[pair]);
+              rightImage = sks::LoadBatchImage(rightFileNames[pair]);
+            },
+            callback);
+}
+
+
+//------------------------------------------------------------------------------
+void StoyanovBatchReconstructor::reconstruct(const std::string& leftPattern,
+                                             const std::string& rightPattern,
+                                             const ResultCallback& callback)
+{
+  std::vector<cv::String> leftFileNames;
+  std::vector<cv::String> rightFileNames;
+  cv::glob(leftPattern, leftFileNames, false);
+  cv::glob(rightPattern, rightFileNames, false);
+
+  if (leftFileNames.empty())
+  {
+    sksExceptionThrow() << "No images found for:" << leftPattern;
+  }
+
+  this->reconstruct(std::vector<std::string>(leftFileNames.begin(), leftFileNames.end()),
+                    std::vector<std::string>(rightFileNames.begin(), rightFileNames.end()),
+                    callback);
+}
+
+} // end namespace
@@ -0,0 +1,116 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksStoyanovBatch_h
+#define sksStoyanovBatch_h
+
+#include <opencv2/core.hpp>
+#include "sksStereoRig.h"
+#include "sksStoyanov2010.h"
+#include "sksWin32ExportHeader.h"
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+* \file sksStoyanovBatch.h
+* \brief Offline reconstruction of whole recorded sequences, using several threads.
+* \ingroup algorithms
+*/
+namespace sks
+{
+
+/**
+* \class StoyanovBatchReconstructor
+* \brief Reconstructs many stereo pairs concurrently, with one calibration.
+*
+* Each worker thread has its own sks::StoyanovReconstructor, which persists
+* from one call to the next. Results are passed to a callback, on the calling
+* thread, in the order of the input pairs. Workers never get more than
+* queueDepth pairs ahead of the callback, and each result is written into one
+* of queueDepth buffers, so for files, peak memory depends on queueDepth and
+* the number of threads, not the length of the sequence.
+*/
+class SKSURGERYOPENCVCPP_WINEXPORT StoyanovBatchReconstructor {
+
+public:
+
+  /**
+  * \brief Called with the index of the pair, and its Nx7 point cloud, (see sks::ReconstructPointsUsingStoyanov).
+  *
+  * The point cloud is only valid during the call, as its memory is reused, so clone it to keep it.
+  */
+  typedef std::function<void(const int, const cv::Mat&)> ResultCallback;
+
+  /**
+  * \param rig calibration, which has already been validated
+  * \param useHartley if false, uses midpoint method, if true, uses hartley.
+  * \param numberOfThreads number of worker threads, each with its own matcher.
+  * \param queueDepth maximum number of results computed, but not yet passed to the callback, at least numberOfThreads.
+  */
+  StoyanovBatchReconstructor(const sks::StereoRig& rig,
+                             const bool useHartley,
+                             const int numberOfThreads,
+                             const int queueDepth);
+  ~StoyanovBatchReconstructor();
+
+  /**
+  * \brief Reconstructs pairs of images already in memory.
+  * \return one Nx7 point cloud per pair, in order.
+  */
+  std::vector<cv::Mat> reconstruct(const std::vector<cv::Mat>& leftImages,
+                                   const std::vector<cv::Mat>& rightImages);
+
+  /**
+  * \brief Reconstructs pairs of image files, each loaded by the worker that reconstructs it.
+  */
+  void reconstruct(const std::vector<std::string>& leftFileNames,
+                   const std::vector<std::string>& rightFileNames,
+                   const ResultCallback& callback);
+
+  /**
+  * \brief Reconstructs two image sequences, each found using cv::glob, e.g. "left_frame_*.png", so in sorted order.
+  */
+  void reconstruct(const std::string& leftPattern,
+                   const std::string& rightPattern,
+                   const ResultCallback& callback);
+
+  int getNumberOfThreads() const;
+  int getQueueDepth() const;
+
+private:
+
+  StoyanovBatchReconstructor(const StoyanovBatchReconstructor&);
+  StoyanovBatchReconstructor& operator=(const StoyanovBatchReconstructor&);
+
+  typedef std::function<void(const int, cv::Mat&, cv::Mat&)> PairLoader;
+
+  void Run(const int numberOfPairs,
+           const PairLoader& loader,
+           const ResultCallback& callback);
+
+  sks::StereoRig                                        m_Rig;
+  bool                                                  m_UseHartley;
+  int                                                   m_NumberOfThreads;
+  int                                                   m_QueueDepth;
+  std::vector<std::unique_ptr<StoyanovReconstructor> >  m_Reconstructors;
+  std::vector<cv::Mat>                                  m_Results;
+
+}; // end class
+
+} // end namespace
+
+#endif
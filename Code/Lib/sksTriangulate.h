@@ -31,12 +31,15 @@ namespace sks
  *
  * Taken from: http://geomalgorithms.com/a07-_distance.html
  *
- * \param inputUndistortedPoints [Nx4] matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+ * \param inputUndistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
  * \param leftCameraMatrix [3x3] left camera matrix
  * \param rightCameraMatrix [3x3] right camera matrix
  * \param leftToRightRotationMatrix [3x3] matrix representing the rotation between camera axes
  * \param leftToRightTranslationVector [3x1] translation between camera origins
- * \return [Nx3] matrix of triangulated points.
+ * \return [Nx3] matrix of triangulated points, of the same type as inputUndistortedPoints.
+ *
+ * If you are triangulating repeatedly with the same calibration, e.g. once per
+ * video frame, construct a sks::StereoRig once and call its methods instead.
  */
 extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingMidpointOfShortestDistance(
   const cv::Mat& inputUndistortedPoints,
@@ -47,6 +50,20 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingMidpoint
   );
 
 
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void TriangulatePointsUsingMidpointOfShortestDistance(
+  const cv::Mat& inputUndistortedPoints,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  cv::Mat& outputPoints
+  );
+
+
 /**
  * \brief Triangulates a vector of un-distorted (i.e. already correction for distortion) 2D point pairs back into 3D.
  *
@@ -57,12 +74,20 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingMidpoint
  *  <li>Price 2012, Computer Vision: Models, Learning and Inference.</li>
  * </ul>
  *
- * \param inputUndistortedPoints [Nx4] matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+ * \param inputUndistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
  * \param leftCameraMatrix [3x3] left camera matrix
  * \param rightCameraMatrix [3x3] right camera matrix
  * \param leftToRightRotationMatrix [3x3] matrix representing the rotation between camera axes
  * \param leftToRightTranslationVector [3x1] translation between camera origins
- * \return [Nx3] matrix of triangulated points.
+ * \return [Nx3] matrix of triangulated points, of the same type as inputUndistortedPoints.
+ *
+ * The iteration is warm-started from the midpoint solution, and each
+ * linear least squares step is solved with a fixed size QR decomposition.
+ * Results agree with the original cv::solve(..., cv::DECOMP_SVD) implementation,
+ * which started from unit weights, to within 1e-6 (in the units of the translation vector)
+ * for non-degenerate rays. Parallel rays give NaN.
+ *
+ * As above, see sks::StereoRig for repeated calls with the same calibration.
  */
 extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingHartley(
   const cv::Mat& inputUndistortedPoints,
@@ -72,5 +97,93 @@ extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingHartley(
   const cv::Mat& leftToRightTranslationVector
   );
 
+
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void TriangulatePointsUsingHartley(
+  const cv::Mat& inputUndistortedPoints,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  cv::Mat& outputPoints
+  );
+
+
+/**
+ * \brief Triangulates 2D point pairs straight from the distorted images, undistorting each pair in the same pass.
+ *
+ * Saves undistorting the images, or calling cv::undistortPoints first, which
+ * would take a separate pass and a separate [Nx4] buffer.
+ *
+ * \param inputDistortedPoints [Nx4] CV_32FC1 or CV_64FC1 matrix of 2D points, where each row is left_x, left_y, right_x, right_y.
+ * \param leftCameraMatrix [3x3] left camera matrix
+ * \param leftDistortionCoefficients empty, or 4, 5 or 8 values, as OpenCV
+ * \param rightCameraMatrix [3x3] right camera matrix
+ * \param rightDistortionCoefficients empty, or 4, 5 or 8 values, as OpenCV
+ * \param leftToRightRotationMatrix [3x3] matrix representing the rotation between camera axes
+ * \param leftToRightTranslationVector [3x1] translation between camera origins
+ * \return [Nx3] matrix of triangulated points, of the same type as inputDistortedPoints.
+ * \see sks::StereoRig::triangulateDistortedPointsUsingMidpointOfShortestDistance
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingMidpointOfShortestDistance(
+  const cv::Mat& inputDistortedPoints,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& leftDistortionCoefficients,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& rightDistortionCoefficients,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector
+  );
+
+
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void TriangulatePointsUsingMidpointOfShortestDistance(
+  const cv::Mat& inputDistortedPoints,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& leftDistortionCoefficients,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& rightDistortionCoefficients,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  cv::Mat& outputPoints
+  );
+
+
+/**
+ * \brief As TriangulatePointsUsingHartley, for 2D point pairs straight from the distorted images.
+ * \see The distorted TriangulatePointsUsingMidpointOfShortestDistance above, for the parameters.
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT cv::Mat TriangulatePointsUsingHartley(
+  const cv::Mat& inputDistortedPoints,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& leftDistortionCoefficients,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& rightDistortionCoefficients,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector
+  );
+
+
+/**
+ * \brief As above, but writes into outputPoints, reusing its memory where possible.
+ * \see sks::PrepareOutputBuffer
+ */
+extern "C++" SKSURGERYOPENCVCPP_WINEXPORT void TriangulatePointsUsingHartley(
+  const cv::Mat& inputDistortedPoints,
+  const cv::Mat& leftCameraMatrix,
+  const cv::Mat& leftDistortionCoefficients,
+  const cv::Mat& rightCameraMatrix,
+  const cv::Mat& rightDistortionCoefficients,
+  const cv::Mat& leftToRightRotationMatrix,
+  const cv::Mat& leftToRightTranslationVector,
+  cv::Mat& outputPoints
+  );
+
 } // end namespace
 #endif
\ No newline at end of file
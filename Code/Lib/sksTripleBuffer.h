@@ -0,0 +1,135 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#ifndef sksTripleBuffer_h
+#define sksTripleBuffer_h
+
+#include <atomic>
+
+/**
+* \file sksTripleBuffer.h
+* \brief Lock-free hand over of the latest value from one thread to another.
+* \ingroup utilities
+*/
+namespace sks
+{
+
+/**
+* \class TripleBuffer
+* \brief Single producer, single consumer queue of length 1, where the latest value wins.
+*
+* The producer writes into back(), then calls publish(). The consumer calls
+* receive(), and if it returns true, reads front(). If the producer publishes
+* again before the consumer receives, the older value is dropped, so the
+* consumer always gets the most recent value, and never falls behind.
+*
+* There are three slots, one owned by each side, and one in the middle,
+* swapped with a single atomic exchange, so neither side ever blocks. As the
+* slots are reused, T should hold buffers, (e.g. cv::Mat), that are written in
+* place, so nothing is allocated once the first few values have been passed.
+*/
+template <typename T>
+class TripleBuffer {
+
+public:
+
+  TripleBuffer()
+  : m_Middle(1)
+  , m_Back(0)
+  , m_Front(2)
+  , m_NumberPublished(0)
+  , m_NumberReceived(0)
+  , m_NumberDropped(0)
+  {
+  }
+
+  /**
+  * \brief Slot the producer writes into, before calling publish().
+  */
+  T& back()
+  {
+    return m_Slots[m_Back];
+  }
+
+  /**
+  * \brief Makes back() available to the consumer, dropping any value it has not yet received.
+  */
+  void publish()
+  {
+    int previous = m_Middle.exchange(m_Back | IS_NEW, std::memory_order_acq_rel);
+    if (previous & IS_NEW)
+    {
+      m_NumberDropped++;
+    }
+    m_Back = previous & SLOT;
+    m_NumberPublished++;
+  }
+
+  /**
+  * \brief Takes the latest published value, if there is one, into front().
+  * \return true if there was a new value, and false if front() is unchanged.
+  */
+  bool receive()
+  {
+    if ((m_Middle.load(std::memory_order_acquire) & IS_NEW) == 0)
+    {
+      return false;
+    }
+    // Only the consumer clears IS_NEW, so this still gets a new value.
+    int previous = m_Middle.exchange(m_Front, std::memory_order_acq_rel);
+    m_Front = previous & SLOT;
+    m_NumberReceived++;
+    return true;
+  }
+
+  /**
+  * \brief Slot the consumer reads from, valid until the next successful receive().
+  */
+  const T& front() const
+  {
+    return m_Slots[m_Front];
+  }
+
+  /**
+  * \brief Number of values published, but not yet received, so 0 or 1.
+  */
+  int getDepth() const
+  {
+    return (m_Middle.load(std::memory_order_acquire) & IS_NEW) ? 1 : 0;
+  }
+
+  long long getNumberPublished() const { return m_NumberPublished.load(); }
+  long long getNumberReceived() const { return m_NumberReceived.load(); }
+  long long getNumberDropped() const { return m_NumberDropped.load(); }
+
+private:
+
+  TripleBuffer(const TripleBuffer&);
+  TripleBuffer& operator=(const TripleBuffer&);
+
+  enum { SLOT = 3, IS_NEW = 4 };
+
+  T                      m_Slots[3];
+  std::atomic<int>       m_Middle;
+  int                    m_Back;
+  int                    m_Front;
+  std::atomic<long long> m_NumberPublished;
+  std::atomic<long long> m_NumberReceived;
+  std::atomic<long long> m_NumberDropped;
+
+}; // end class
+
+} // end namespace
+
+#endif
@@ -67,4 +67,32 @@ void ValidateStereoParameters(
   }
 }
 
+
+//------------------------------------------------------------------------------
+void ValidateDistortionCoefficients(const cv::Mat& distortionCoefficients)
+{
+  if (distortionCoefficients.empty())
+  {
+    return;
+  }
+
+  if (distortionCoefficients.rows != 1 && distortionCoefficients.cols != 1)
+  {
+    sksExceptionThrow() << "Distortion coefficients should be a row or column vector!";
+  }
+
+  int numberOfCoefficients = static_cast<int>(distortionCoefficients.total());
+  if (numberOfCoefficients != 4 && numberOfCoefficients != 5 && numberOfCoefficients != 8)
+  {
+    sksExceptionThrow() << "Distortion coefficients should have 4, 5 or 8 values, not "
+                        << numberOfCoefficients;
+  }
+
+  if (distortionCoefficients.type() != CV_32FC1 && distortionCoefficients.type() != CV_64FC1)
+  {
+    sksExceptionThrow() << "Distortion coefficients should be CV_32FC1 or CV_64FC1, not type "
+                        << distortionCoefficients.type();
+  }
+}
+
 } // end namespace
@@ -33,6 +33,11 @@ void ValidateStereoParameters(
   const cv::Mat& leftToRightTranslationVector
   );
 
+/**
+* \brief Checks distortion coefficients are empty, or 4, 5 or 8 values, (k1, k2, p1, p2[, k3[, k4, k5, k6]]).
+*/
+void ValidateDistortionCoefficients(const cv::Mat& distortionCoefficients);
+
 }
 
 #endif
\ No newline at end of file
@@ -21,11 +21,18 @@
 #define PY_ARRAY_UNIQUE_SYMBOL pbcvt_ARRAY_API
 
 #include "sksTriangulate.h"
+#include "sksStereoRig.h"
 #include "sksStoyanov2010.h"
+#include "sksStereoMatcher.h"
+#include "sksStereoRectifier.h"
 #include "sksException.h"
+#include "sksExceptionMacro.h"
 #include "sksVideoCapture.h"
 #include "sksMasking.h"
 #include "sksDotDetection.h"
+#include "sksStoyanovBatch.h"
+#include "sksStereoPipeline.h"
+#include "sksReprojection.h"
 
 #include <boost/python.hpp>
 #include <boost/python/exception_translator.hpp>
@@ -57,6 +64,108 @@ void translate_exception(Exception const& e)
   PyErr_SetString(PyExc_RuntimeError, ss.str().c_str());
 }
 
+template<typename T>
+std::vector<T> ListToVector(const boost::python::list& list)
+{
+  std::vector<T> result;
+  for (boost::python::ssize_t i = 0; i < boost::python::len(list); i++)
+  {
+    result.push_back(boost::python::extract<T>(list[i]));
+  }
+  return result;
+}
+
+boost::python::list BatchReconstructPairs(StoyanovBatchReconstructor& reconstructor,
+                                          const boost::python::list& leftImages,
+                                          const boost::python::list& rightImages)
+{
+  std::vector<cv::Mat> results = reconstructor.reconstruct(ListToVector<cv::Mat>(leftImages),
+                                                           ListToVector<cv::Mat>(rightImages));
+  boost::python::list list;
+  for (std::vector<cv::Mat>::size_type i = 0; i < results.size(); i++)
+  {
+    list.append(results[i]);
+  }
+  return list;
+}
+
+// The callback runs on the calling thread, which holds the GIL, so can call Python.
+StoyanovBatchReconstructor::ResultCallback WrapBatchCallback(const boost::python::object& callback)
+{
+  return [callback](const int pair, const cv::Mat& points)
+  {
+    try
+    {
+      callback(pair, points.clone());
+    }
+    catch (const boost::python::error_already_set&)
+    {
+      PyErr_Clear();
+      sksExceptionThrow() << "Python callback failed for pair:" << pair;
+    }
+  };
+}
+
+void BatchReconstructFiles(StoyanovBatchReconstructor& reconstructor,
+                           const boost::python::list& leftFileNames,
+                           const boost::python::list& rightFileNames,
+                           const boost::python::object& callback)
+{
+  reconstructor.reconstruct(ListToVector<std::string>(leftFileNames),
+                            ListToVector<std::string>(rightFileNames),
+                            WrapBatchCallback(callback));
+}
+
+void BatchReconstructSequences(StoyanovBatchReconstructor& reconstructor,
+                               const std::string& leftPattern,
+                               const std::string& rightPattern,
+                               const boost::python::object& callback)
+{
+  reconstructor.reconstruct(leftPattern, rightPattern, WrapBatchCallback(callback));
+}
+
+// Returns (frame_number, points), or None if there are no new points.
+boost::python::object PipelineGetLatestPoints(StereoPipeline& pipeline)
+{
+  cv::Mat points;
+  long long frameNumber = 0;
+  if (!pipeline.getLatestPoints(points, frameNumber))
+  {
+    return boost::python::object();
+  }
+  return boost::python::make_tuple(frameNumber, points);
+}
+
+// Returns (organized_points, validity_mask).
+boost::python::tuple ReprojectDisparityToOrganizedPointsAsTuple(const cv::Mat& disparity,
+                                                                const cv::Mat& disparityToDepthMatrix)
+{
+  cv::Mat organizedPoints;
+  cv::Mat validityMask;
+  ReprojectDisparityToOrganizedPoints(disparity, disparityToDepthMatrix, organizedPoints, validityMask);
+  return boost::python::make_tuple(organizedPoints, validityMask);
+}
+
+// Returns (left_rectified_image, right_rectified_image).
+boost::python::tuple StereoRectifierRectify(const StereoRectifier& rectifier,
+                                            const cv::Mat& leftImage,
+                                            const cv::Mat& rightImage)
+{
+  cv::Mat leftRectifiedImage;
+  cv::Mat rightRectifiedImage;
+  rectifier.rectify(leftImage, rightImage, leftRectifiedImage, rightRectifiedImage);
+  return boost::python::make_tuple(leftRectifiedImage, rightRectifiedImage);
+}
+
+cv::Mat RectifiedStereoMatcherComputeDisparity(RectifiedStereoMatcher& matcher,
+                                               const cv::Mat& leftImage,
+                                               const cv::Mat& rightImage)
+{
+  cv::Mat disparity;
+  matcher.computeDisparity(leftImage, rightImage, disparity);
+  return disparity;
+}
+
 // The name of the module should match that in CMakeLists.txt
 BOOST_PYTHON_MODULE (sksurgeryopencvpython) {
   init_ar();
@@ -66,20 +175,230 @@ BOOST_PYTHON_MODULE (sksurgeryopencvpython) {
 
   boost::python::register_exception_translator<Exception>(&translate_exception);
 
-  boost::python::def("triangulate_points_using_hartley", TriangulatePointsUsingHartley);
-  boost::python::def("triangulate_points_using_midpoint", TriangulatePointsUsingMidpointOfShortestDistance);
+  // Most functions also have an overload writing to a cv::Mat&, which is
+  // no use from Python, so we pick the versions that return a cv::Mat.
+  cv::Mat (*triangulatePointsUsingHartley)(const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                           const cv::Mat&, const cv::Mat&) = TriangulatePointsUsingHartley;
+  cv::Mat (*triangulatePointsUsingMidpoint)(const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                            const cv::Mat&, const cv::Mat&) = TriangulatePointsUsingMidpointOfShortestDistance;
+  cv::Mat (*triangulateDistortedPointsUsingHartley)(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                                    const cv::Mat&, const cv::Mat&, const cv::Mat&) = TriangulatePointsUsingHartley;
+  cv::Mat (*triangulateDistortedPointsUsingMidpoint)(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                                     const cv::Mat&, const cv::Mat&, const cv::Mat&) = TriangulatePointsUsingMidpointOfShortestDistance;
+  cv::Mat (*matchPointsUsingStoyanov)(const cv::Mat&, const cv::Mat&) = MatchPointsUsingStoyanov;
+  cv::Mat (*reconstructPointsUsingStoyanov)(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                            const cv::Mat&, const cv::Mat&, const bool) = ReconstructPointsUsingStoyanov;
+  cv::Mat (*reconstructPointsUsingStoyanovWithMasks)(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                                     const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                                     const bool) = ReconstructPointsUsingStoyanov;
+  cv::Mat (*reconstructPointsUsingStoyanovWithConfidence)(const cv::Mat&, const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                                                          const cv::Mat&, const cv::Mat&, const bool,
+                                                          const float, const int) = ReconstructPointsUsingStoyanov;
+  cv::Mat (*maskPoints)(const cv::Mat&, const cv::Mat&) = MaskPoints;
+  cv::Mat (*maskStereoPoints)(const cv::Mat&, const cv::Mat&, const cv::Mat&) = MaskStereoPoints;
+  cv::Mat (*extractDots)(const cv::Mat&, const cv::Mat&, const cv::Mat&,
+                         const cv::Mat&, const cv::Mat&) = ExtractDots;
+  cv::Mat (DotDetector::*dotDetectorDetect)(const cv::Mat&) = &DotDetector::detect;
+  cv::Mat (*reprojectDisparityToPoints)(const cv::Mat&, const cv::Mat&, const int) = ReprojectDisparityToPoints;
+  cv::Mat (StereoRig::*rigTriangulatePointsUsingHartley)(const cv::Mat&) const = &StereoRig::triangulatePointsUsingHartley;
+  cv::Mat (StereoRig::*rigTriangulatePointsUsingMidpoint)(const cv::Mat&) const = &StereoRig::triangulatePointsUsingMidpointOfShortestDistance;
+  cv::Mat (StereoRig::*rigTriangulateDistortedPointsUsingHartley)(const cv::Mat&) const = &StereoRig::triangulateDistortedPointsUsingHartley;
+  cv::Mat (StereoRig::*rigTriangulateDistortedPointsUsingMidpoint)(const cv::Mat&) const = &StereoRig::triangulateDistortedPointsUsingMidpointOfShortestDistance;
+  cv::Mat (StoyanovReconstructor::*reconstructorMatchPoints)(const cv::Mat&, const cv::Mat&) = &StoyanovReconstructor::matchPoints;
+  cv::Mat (StoyanovReconstructor::*reconstructorReconstructPoints)(const cv::Mat&, const cv::Mat&,
+                                                                   const StereoRig&, const bool) = &StoyanovReconstructor::reconstructPoints;
+  StoyanovResult (StoyanovReconstructor::*reconstructorReconstruct)(const cv::Mat&, const cv::Mat&,
+                                                                    const StereoRig&, const bool, const int) = &StoyanovReconstructor::reconstruct;
+  cv::Mat (StereoMatcher::*stereoMatcherMatchPoints)(const cv::Mat&, const cv::Mat&) = &StereoMatcher::matchPoints;
+
+  boost::python::def("triangulate_points_using_hartley", triangulatePointsUsingHartley);
+  boost::python::def("triangulate_points_using_midpoint", triangulatePointsUsingMidpoint);
+  boost::python::def("triangulate_points_using_hartley", triangulateDistortedPointsUsingHartley);
+  boost::python::def("triangulate_points_using_midpoint", triangulateDistortedPointsUsingMidpoint);
   boost::python::def("compute_disparity_using_stoyanov", ComputeDisparityUsingStoyanov);
-  boost::python::def("match_points_using_stoyanov", MatchPointsUsingStoyanov);
-  boost::python::def("reconstruct_points_using_stoyanov", ReconstructPointsUsingStoyanov);
-  boost::python::def("mask_points", MaskPoints);
-  boost::python::def("mask_stereo_points", MaskStereoPoints);
-  boost::python::def("extract_dots", ExtractDots);
+  boost::python::def("match_points_using_stoyanov", matchPointsUsingStoyanov);
+  boost::python::def("reconstruct_points_using_stoyanov", reconstructPointsUsingStoyanov);
+  boost::python::def("reconstruct_points_using_stoyanov", reconstructPointsUsingStoyanovWithMasks);
+  boost::python::def("reconstruct_points_using_stoyanov", reconstructPointsUsingStoyanovWithConfidence);
+  boost::python::def("reconstruct_using_stoyanov", ReconstructUsingStoyanov);
+  boost::python::def("mask_points", maskPoints);
+  boost::python::def("mask_stereo_points", maskStereoPoints);
+  boost::python::def("extract_dots", extractDots);
+  boost::python::def("reproject_disparity_to_points", reprojectDisparityToPoints);
+  boost::python::def("reproject_disparity_to_organized_points", ReprojectDisparityToOrganizedPointsAsTuple);
 
   class_<VideoCapture>("VideoCapture", init<int, int, int>())
     .def(init<int>())
     .def("read", &VideoCapture::read)
     .def("isOpened", &VideoCapture::isOpened)
   ;
+
+  class_<StereoRig>("StereoRig", init<cv::Mat, cv::Mat, cv::Mat, cv::Mat>())
+    .def(init<cv::Mat, cv::Mat, cv::Mat, cv::Mat, cv::Mat, cv::Mat>())
+    .def("triangulate_points_using_hartley", rigTriangulatePointsUsingHartley)
+    .def("triangulate_points_using_midpoint", rigTriangulatePointsUsingMidpoint)
+    .def("triangulate_distorted_points_using_hartley", rigTriangulateDistortedPointsUsingHartley)
+    .def("triangulate_distorted_points_using_midpoint", rigTriangulateDistortedPointsUsingMidpoint)
+    .def("get_left_distortion_coefficients", &StereoRig::getLeftDistortionCoefficients)
+    .def("get_right_distortion_coefficients", &StereoRig::getRightDistortionCoefficients)
+    .def("get_left_camera_matrix", &StereoRig::getLeftCameraMatrix)
+    .def("get_right_camera_matrix", &StereoRig::getRightCameraMatrix)
+    .def("get_left_projection_matrix", &StereoRig::getLeftProjectionMatrix)
+    .def("get_right_projection_matrix", &StereoRig::getRightProjectionMatrix)
+  ;
+
+  enum_<StoyanovReconstructor::Outputs>("StoyanovOutputs")
+    .value("MATCHES", StoyanovReconstructor::MATCHES)
+    .value("DISPARITY", StoyanovReconstructor::DISPARITY)
+    .value("POINTS", StoyanovReconstructor::POINTS)
+    .value("ALL", StoyanovReconstructor::ALL)
+    .value("ORGANIZED_POINTS", StoyanovReconstructor::ORGANIZED_POINTS)
+  ;
+
+  class_<StoyanovResult>("StoyanovResult")
+    .add_property("matched_points", make_getter(&StoyanovResult::matchedPoints, return_value_policy<return_by_value>()))
+    .add_property("disparity", make_getter(&StoyanovResult::disparity, return_value_policy<return_by_value>()))
+    .add_property("reconstructed_points", make_getter(&StoyanovResult::reconstructedPoints, return_value_policy<return_by_value>()))
+    .add_property("organized_points", make_getter(&StoyanovResult::organizedPoints, return_value_policy<return_by_value>()))
+    .add_property("validity_mask", make_getter(&StoyanovResult::validityMask, return_value_policy<return_by_value>()))
+  ;
+
+  class_<StoyanovStreamingParameters>("StoyanovStreamingParameters")
+    .def_readwrite("seed_fraction", &StoyanovStreamingParameters::seedFraction)
+    .def_readwrite("minimum_match_ratio", &StoyanovStreamingParameters::minimumMatchRatio)
+    .def_readwrite("key_frame_interval", &StoyanovStreamingParameters::keyFrameInterval)
+  ;
+
+  class_<StoyanovPyramidParameters>("StoyanovPyramidParameters")
+    .def_readwrite("level", &StoyanovPyramidParameters::level)
+    .def_readwrite("maximum_level", &StoyanovPyramidParameters::maximumLevel)
+    .def_readwrite("target_latency", &StoyanovPyramidParameters::targetLatency)
+    .def_readwrite("refine", &StoyanovPyramidParameters::refine)
+  ;
+
+  class_<StoyanovMatchFormat>("StoyanovMatchFormat")
+    .def_readwrite("type", &StoyanovMatchFormat::type)
+    .def_readwrite("is_structure_of_arrays", &StoyanovMatchFormat::isStructureOfArrays)
+    .def_readwrite("include_correlation", &StoyanovMatchFormat::includeCorrelation)
+  ;
+
+  class_<StoyanovConfidenceParameters>("StoyanovConfidenceParameters")
+    .def_readwrite("minimum_correlation", &StoyanovConfidenceParameters::minimumCorrelation)
+    .def_readwrite("maximum_number_of_matches", &StoyanovConfidenceParameters::maximumNumberOfMatches)
+  ;
+
+  class_<StoyanovBandParameters>("StoyanovBandParameters")
+    .def_readwrite("number_of_bands", &StoyanovBandParameters::numberOfBands)
+    .def_readwrite("overlap", &StoyanovBandParameters::overlap)
+  ;
+
+  class_<StoyanovReconstructor, boost::noncopyable>("StoyanovReconstructor", init<>())
+    .def("set_masks", &StoyanovReconstructor::setMasks)
+    .def("set_streaming", &StoyanovReconstructor::setStreaming)
+    .def("get_streaming", &StoyanovReconstructor::getStreaming)
+    .def("set_streaming_parameters", &StoyanovReconstructor::setStreamingParameters)
+    .def("get_streaming_parameters", &StoyanovReconstructor::getStreamingParameters)
+    .def("get_last_frame_was_key_frame", &StoyanovReconstructor::getLastFrameWasKeyFrame)
+    .def("set_pyramid_parameters", &StoyanovReconstructor::setPyramidParameters)
+    .def("get_pyramid_parameters", &StoyanovReconstructor::getPyramidParameters)
+    .def("get_pyramid_level", &StoyanovReconstructor::getPyramidLevel)
+    .def("get_last_latency", &StoyanovReconstructor::getLastLatency)
+    .def("set_band_parameters", &StoyanovReconstructor::setBandParameters)
+    .def("get_band_parameters", &StoyanovReconstructor::getBandParameters)
+    .def("set_match_format", &StoyanovReconstructor::setMatchFormat)
+    .def("get_match_format", &StoyanovReconstructor::getMatchFormat)
+    .def("set_confidence_parameters", &StoyanovReconstructor::setConfidenceParameters)
+    .def("get_confidence_parameters", &StoyanovReconstructor::getConfidenceParameters)
+    .def("compute_disparity", &StoyanovReconstructor::computeDisparity)
+    .def("match_points", reconstructorMatchPoints)
+    .def("reconstruct_points", reconstructorReconstructPoints)
+    .def("reconstruct", reconstructorReconstruct)
+  ;
+
+  class_<DotDetectorParameters>("DotDetectorParameters")
+    .def_readwrite("window_size", &DotDetectorParameters::windowSize)
+    .def_readwrite("offset", &DotDetectorParameters::offset)
+    .def_readwrite("minimum_area", &DotDetectorParameters::minimumArea)
+    .def_readwrite("maximum_area", &DotDetectorParameters::maximumArea)
+    .def_readwrite("maximum_rms_error", &DotDetectorParameters::maximumRMSError)
+    .def_readwrite("is_single_pass", &DotDetectorParameters::isSinglePass)
+    .def_readwrite("use_moment_centroids", &DotDetectorParameters::useMomentCentroids)
+  ;
+
+  class_<DotDetector, boost::noncopyable>("DotDetector", init<cv::Mat, cv::Mat, cv::Mat, cv::Mat, int, int>())
+    .def(init<cv::Mat, cv::Mat, cv::Mat, cv::Mat, int, int, DotDetectorParameters>())
+    .def("detect", dotDetectorDetect)
+    .def("get_parameters", &DotDetector::getParameters)
+  ;
+
+  class_<StereoRectifier>("StereoRectifier", init<StereoRig, cv::Mat, cv::Mat, int, int>())
+    .def(init<StereoRig, int, int>())
+    .def("rectify", StereoRectifierRectify)
+    .def("set_parallel", &StereoRectifier::setParallel)
+    .def("get_parallel", &StereoRectifier::getParallel)
+    .def("get_left_rectification", &StereoRectifier::getLeftRectification)
+    .def("get_right_rectification", &StereoRectifier::getRightRectification)
+    .def("get_left_projection_matrix", &StereoRectifier::getLeftProjectionMatrix)
+    .def("get_right_projection_matrix", &StereoRectifier::getRightProjectionMatrix)
+    .def("get_disparity_to_depth_matrix", &StereoRectifier::getDisparityToDepthMatrix)
+  ;
+
+  class_<StereoMatcher, boost::noncopyable>("StereoMatcher", no_init)
+    .def("match_points", stereoMatcherMatchPoints)
+  ;
+
+  class_<StoyanovStereoMatcher, bases<StereoMatcher>, boost::noncopyable>("StoyanovStereoMatcher", init<>())
+  ;
+
+  class_<RectifiedStereoMatcher, bases<StereoMatcher>, boost::noncopyable>("RectifiedStereoMatcher",
+                                                                           init<StereoRig, int, int, bool>())
+    .def("set_step", &RectifiedStereoMatcher::setStep)
+    .def("get_step", &RectifiedStereoMatcher::getStep)
+    .def("compute_disparity", RectifiedStereoMatcherComputeDisparity)
+    .def("get_disparity_to_depth_matrix", &RectifiedStereoMatcher::getDisparityToDepthMatrix)
+  ;
+
+  class_<FeatureStereoMatcher, bases<StereoMatcher>, boost::noncopyable>("FeatureStereoMatcher", init<>())
+    .def(init<int, double>())
+  ;
+
+  class_<StoyanovBatchReconstructor, boost::noncopyable>("StoyanovBatchReconstructor",
+                                                         init<StereoRig, bool, int, int>())
+    .def("reconstruct_pairs", BatchReconstructPairs)
+    .def("reconstruct_files", BatchReconstructFiles)
+    .def("reconstruct_sequences", BatchReconstructSequences)
+    .def("get_number_of_threads", &StoyanovBatchReconstructor::getNumberOfThreads)
+    .def("get_queue_depth", &StoyanovBatchReconstructor::getQueueDepth)
+  ;
+
+  enum_<StereoPipeline::Stages>("StereoPipelineStages")
+    .value("CAPTURE", StereoPipeline::CAPTURE)
+    .value("MATCH", StereoPipeline::MATCH)
+    .value("TRIANGULATE", StereoPipeline::TRIANGULATE)
+    .value("MASK", StereoPipeline::MASK)
+    .value("NUMBER_OF_STAGES", StereoPipeline::NUMBER_OF_STAGES)
+  ;
+
+  class_<StereoPipelineStatistics>("StereoPipelineStatistics")
+    .def_readonly("number_of_frames", &StereoPipelineStatistics::numberOfFrames)
+    .def_readonly("last_seconds", &StereoPipelineStatistics::lastSeconds)
+    .def_readonly("mean_seconds", &StereoPipelineStatistics::meanSeconds)
+    .def_readonly("queue_depth", &StereoPipelineStatistics::queueDepth)
+    .def_readonly("number_dropped", &StereoPipelineStatistics::numberDropped)
+  ;
+
+  // Only from files, as a Python frame source would be called on the capture thread.
+  class_<StereoPipeline, boost::noncopyable>("StereoPipeline", init<std::string, std::string, StereoRig, bool>())
+    .def("set_masks", &StereoPipeline::setMasks)
+    .def("get_reconstructor", &StereoPipeline::getReconstructor, return_internal_reference<>())
+    .def("start", &StereoPipeline::start)
+    .def("stop", &StereoPipeline::stop)
+    .def("is_running", &StereoPipeline::isRunning)
+    .def("get_latest_points", PipelineGetLatestPoints)
+    .def("get_last_latency", &StereoPipeline::getLastLatency)
+    .def("get_statistics", &StereoPipeline::getStatistics)
+    .def("get_number_of_dropped_results", &StereoPipeline::getNumberOfDroppedResults)
+  ;
 }
 
 }  // end namespace sks
@@ -236,3 +236,41 @@ def test_dotty_uncalibrated_20():
                                           )
     assert(346 == number_of_points)
 
+
+
+def test_dot_detector_matches_extract_dots():
+    intrinsics = np.loadtxt('Testing/Data/calib-ucl-circles/calib.left.intrinsics.txt')
+    distortion = np.loadtxt('Testing/Data/calib-ucl-circles/calib.left.distortion.txt')
+    model = __setup_dotty_calibration_model()
+    fiducial_indexes = np.array([[133], [141], [308], [316]], dtype=int)
+
+    detector = None
+    for snapshot in ['08_54_13', '08_54_23', '08_54_29']:
+        image = cv2.imread('Testing/Data/calib-ucl-circles/snapshots-uncalibrated/'
+                           + snapshot + '/left_image.png')
+        greyscale = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
+        if detector is None:
+            detector = sks.DotDetector(intrinsics, distortion, model, fiducial_indexes,
+                                       greyscale.shape[1], greyscale.shape[0])
+        expected = sks.extract_dots(greyscale, intrinsics, distortion, model, fiducial_indexes)
+        actual = detector.detect(greyscale)
+        assert np.array_equal(expected, actual)
+
+
+def test_dot_detector_single_pass():
+    intrinsics = np.loadtxt('Testing/Data/calib-ucl-circles/calib.left.intrinsics.txt')
+    distortion = np.loadtxt('Testing/Data/calib-ucl-circles/calib.left.distortion.txt')
+    model = __setup_dotty_calibration_model()
+    fiducial_indexes = np.array([[133], [141], [308], [316]], dtype=int)
+    image = cv2.imread('Testing/Data/calib-ucl-circles/snapshots-uncalibrated/08_54_13/left_image.png')
+    greyscale = cv2.cvtColor(image, cv2.COLOR_BGR2GRAY)
+
+    parameters = sks.DotDetectorParameters()
+    parameters.is_single_pass = True
+    detector = sks.DotDetector(intrinsics, distortion, model, fiducial_indexes,
+                               greyscale.shape[1], greyscale.shape[0], parameters)
+    assert detector.get_parameters().is_single_pass
+
+    results = detector.detect(greyscale)
+    assert results.shape[1] == 6
+    assert results.shape[0] >= 0.9 * 373
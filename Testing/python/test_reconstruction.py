@@ -3,6 +3,8 @@
 import pytest
 import numpy as np
 import datetime
+import os
+import tempfile
 import six
 import sksurgeryopencvpython as cvpy
 import cv2
@@ -62,3 +64,460 @@ def test_reconstruction():
                + str((end_stoyanov_hartley - start_stoyanov_hartley).total_seconds()))
     assert points.shape[0] == number_of_points  # can only check for consistency.
     assert points.shape[1] == 7
+
+
+def test_stoyanov_reconstructor():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    rig = cvpy.StereoRig(left_intrinsics,
+                         right_intrinsics,
+                         l2r[0:3, 0:3],
+                         l2r[0:3, 3:4]
+                         )
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    reconstructor = cvpy.StoyanovReconstructor()
+
+    # The first call creates the matcher, subsequent calls reuse it.
+    for i in range(3):
+        start = datetime.datetime.now()
+        points = reconstructor.reconstruct_points(left_image, right_image, rig, False)
+        end = datetime.datetime.now()
+        six.print_('StoyanovReconstructor, call ' + str(i) + '=:'
+                   + str((end - start).total_seconds()))
+        assert points.shape[1] == 7
+
+    matches = reconstructor.match_points(left_image, right_image)
+    assert matches.shape[0] == points.shape[0]
+    assert np.allclose(matches, points[:, 3:7])
+
+
+def test_reconstruct_once():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    result = cvpy.reconstruct_using_stoyanov(left_image,
+                                             left_intrinsics,
+                                             right_image,
+                                             right_intrinsics,
+                                             l2r[0:3, 0:3],
+                                             l2r[0:3, 3:4],
+                                             False,
+                                             cvpy.StoyanovOutputs.ALL
+                                             )
+
+    points = result.reconstructed_points
+    assert points.shape[1] == 7
+    assert np.allclose(result.matched_points, points[:, 3:7])
+    assert result.disparity.shape[0:2] == left_image.shape[0:2]
+
+    disparity = cvpy.compute_disparity_using_stoyanov(left_image, right_image)
+    assert np.array_equal(disparity, result.disparity)
+
+
+def test_streaming():
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    reconstructor = cvpy.StoyanovReconstructor()
+    key_frame = reconstructor.match_points(left_image, right_image)
+
+    reconstructor.set_streaming(True)
+    for i in range(5):
+        start = datetime.datetime.now()
+        matches = reconstructor.match_points(left_image, right_image)
+        end = datetime.datetime.now()
+        six.print_('Streaming, key frame=' + str(reconstructor.get_last_frame_was_key_frame())
+                   + ', matches=' + str(matches.shape[0]) + ' of ' + str(key_frame.shape[0])
+                   + ', time=' + str((end - start).total_seconds()))
+        assert matches.shape[1] == 4
+
+
+def test_pyramid():
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+    rows, cols = left_image.shape[0:2]
+
+    reconstructor = cvpy.StoyanovReconstructor()
+    full_resolution = reconstructor.match_points(left_image, right_image)
+
+    parameters = cvpy.StoyanovPyramidParameters()
+    parameters.level = 1
+    parameters.refine = True
+    reconstructor.set_pyramid_parameters(parameters)
+    matches = reconstructor.match_points(left_image, right_image)
+    six.print_('Pyramid, matches=' + str(matches.shape[0]) + ' of ' + str(full_resolution.shape[0])
+               + ', time=' + str(reconstructor.get_last_latency()))
+
+    # Still in full resolution pixels.
+    assert matches.shape[0] > 0
+    assert np.max(matches[:, 0]) < cols
+    assert np.max(matches[:, 1]) < rows
+    assert np.max(matches[:, 0]) > cols / 2
+
+    # Controller changes level to meet the budget.
+    parameters.level = 0
+    parameters.target_latency = 1e-9
+    reconstructor.set_pyramid_parameters(parameters)
+    reconstructor.match_points(left_image, right_image)
+    assert reconstructor.get_pyramid_level() == 1
+
+
+def test_bands():
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    reconstructor = cvpy.StoyanovReconstructor()
+    parameters = cvpy.StoyanovBandParameters()
+    assert parameters.number_of_bands == 1
+
+    # Benchmark, on the Hamlyn pair. First call for each setting creates matchers, so is not timed.
+    for number_of_bands in [1, 2, 4, 8]:
+        parameters.number_of_bands = number_of_bands
+        reconstructor.set_band_parameters(parameters)
+        reconstructor.match_points(left_image, right_image)
+
+        start = datetime.datetime.now()
+        matches = reconstructor.match_points(left_image, right_image)
+        end = datetime.datetime.now()
+        six.print_('Bands=' + str(number_of_bands)
+                   + ', matches=' + str(matches.shape[0])
+                   + ', time=' + str((end - start).total_seconds()))
+        assert matches.shape[0] > 0
+        assert matches.shape[1] == 4
+
+        # Deterministic, regardless of thread timing.
+        assert np.array_equal(matches, reconstructor.match_points(left_image, right_image))
+
+
+def test_match_format():
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    reconstructor = cvpy.StoyanovReconstructor()
+    default_matches = reconstructor.match_points(left_image, right_image)
+
+    match_format = cvpy.StoyanovMatchFormat()
+    match_format.type = cv2.CV_32FC1
+    match_format.is_structure_of_arrays = True
+    match_format.include_correlation = True
+    reconstructor.set_match_format(match_format)
+
+    start = datetime.datetime.now()
+    matches = reconstructor.match_points(left_image, right_image)
+    end = datetime.datetime.now()
+    six.print_('Match format, time=' + str((end - start).total_seconds()))
+
+    assert matches.dtype == np.float32
+    assert matches.shape == (5, default_matches.shape[0])
+    assert np.array_equal(matches[0:4, :].T, default_matches)
+
+    # Filtering on correlation needs no second pass over the matches.
+    confident = matches[:, matches[4, :] > 0.9]
+    assert confident.shape[1] <= matches.shape[1]
+
+
+def test_reconstruction_with_masks():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    # A circular field of view, like an endoscope.
+    rows, cols = left_image.shape[0:2]
+    mask = np.zeros((rows, cols), dtype=np.uint8)
+    cv2.circle(mask, (cols // 2, rows // 2), int(rows * 0.45), 255, -1)
+
+    start = datetime.datetime.now()
+    points = cvpy.reconstruct_points_using_stoyanov(left_image,
+                                                    left_intrinsics,
+                                                    right_image,
+                                                    right_intrinsics,
+                                                    l2r[0:3, 0:3],
+                                                    l2r[0:3, 3:4],
+                                                    mask,
+                                                    mask,
+                                                    False
+                                                    )
+    end = datetime.datetime.now()
+    six.print_('Stoyanov 2010, with masks=:' + str((end - start).total_seconds()))
+
+    assert points.shape[0] > 0
+    assert points.shape[1] == 7
+    left = points[:, 3:5].astype(np.int32)
+    right = points[:, 5:7].astype(np.int32)
+    assert np.all(mask[left[:, 1], left[:, 0]] > 0)
+    assert np.all(mask[right[:, 1], right[:, 0]] > 0)
+
+
+def test_reconstruction_with_confidence():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    start = datetime.datetime.now()
+    points = cvpy.reconstruct_points_using_stoyanov(left_image,
+                                                    left_intrinsics,
+                                                    right_image,
+                                                    right_intrinsics,
+                                                    l2r[0:3, 0:3],
+                                                    l2r[0:3, 3:4],
+                                                    False,
+                                                    0.9,
+                                                    1000
+                                                    )
+    end = datetime.datetime.now()
+    six.print_('Stoyanov 2010, with confidence=:' + str((end - start).total_seconds())
+               + ', points=' + str(points.shape[0]))
+
+    assert points.shape[0] <= 1000
+    assert points.shape[1] == 8
+    assert np.all(points[:, 7] >= 0.9 - 1e-6)
+
+
+def test_stereo_matchers():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+    rows, cols = left_image.shape[0:2]
+
+    rig = cvpy.StereoRig(left_intrinsics, right_intrinsics, l2r[0:3, 0:3], l2r[0:3, 3:4])
+
+    matchers = [('Stoyanov', cvpy.StoyanovStereoMatcher()),
+                ('StereoBM', cvpy.RectifiedStereoMatcher(rig, cols, rows, False)),
+                ('StereoSGBM', cvpy.RectifiedStereoMatcher(rig, cols, rows, True)),
+                ('ORB', cvpy.FeatureStereoMatcher(5000, 2.0))]
+
+    for name, matcher in matchers:
+        start = datetime.datetime.now()
+        matches = matcher.match_points(left_image, right_image)
+        end = datetime.datetime.now()
+        six.print_(name + ', matches=' + str(matches.shape[0])
+                   + ', time=' + str((end - start).total_seconds()))
+
+        # Same format, so downstream code does not change.
+        assert matches.shape[0] > 0
+        assert matches.shape[1] == 4
+        points = rig.triangulate_points_using_midpoint(matches)
+        assert points.shape[0] == matches.shape[0]
+
+
+def test_batch_reconstruction():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+    rig = cvpy.StereoRig(left_intrinsics, right_intrinsics, l2r[0:3, 0:3], l2r[0:3, 3:4])
+
+    left_file = 'Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png'
+    right_file = 'Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png'
+    left_image = cv2.imread(left_file)
+    right_image = cv2.imread(right_file)
+
+    expected = cvpy.StoyanovReconstructor().reconstruct_points(left_image, right_image, rig, False)
+
+    number_of_pairs = 8
+    batch = cvpy.StoyanovBatchReconstructor(rig, False, 4, 4)
+
+    start = datetime.datetime.now()
+    results = batch.reconstruct_pairs([left_image] * number_of_pairs, [right_image] * number_of_pairs)
+    end = datetime.datetime.now()
+    six.print_('Stoyanov 2010, batch of ' + str(number_of_pairs) + ':'
+               + str((end - start).total_seconds()))
+
+    assert len(results) == number_of_pairs
+    for points in results:
+        assert np.array_equal(points, expected)
+
+    delivered = []
+
+    def callback(pair, points):
+        delivered.append(pair)
+        assert np.array_equal(points, expected)
+
+    batch.reconstruct_files([left_file] * number_of_pairs, [right_file] * number_of_pairs, callback)
+    assert delivered == list(range(number_of_pairs))
+
+    delivered = []
+    batch.reconstruct_sequences(left_file, right_file, callback)
+    assert delivered == [0]
+
+    with pytest.raises(RuntimeError):
+        batch.reconstruct_pairs([left_image], [])
+
+
+def test_stereo_pipeline():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+    rig = cvpy.StereoRig(left_intrinsics, right_intrinsics, l2r[0:3, 0:3], l2r[0:3, 3:4])
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+    expected = cvpy.StoyanovReconstructor().reconstruct_points(left_image, right_image, rig, False)
+
+    # Image sequences, read as videos.
+    number_of_frames = 5
+    directory = tempfile.mkdtemp()
+    for i in range(number_of_frames):
+        cv2.imwrite(os.path.join(directory, 'left_%02d.png' % i), left_image)
+        cv2.imwrite(os.path.join(directory, 'right_%02d.png' % i), right_image)
+
+    pipeline = cvpy.StereoPipeline(os.path.join(directory, 'left_%02d.png'),
+                                   os.path.join(directory, 'right_%02d.png'),
+                                   rig, False)
+    pipeline.start()
+
+    results = []
+    while True:
+        is_running = pipeline.is_running()
+        result = pipeline.get_latest_points()
+        if result is not None:
+            results.append(result)
+        elif not is_running:
+            break
+    pipeline.stop()
+
+    assert len(results) > 0
+    assert results[-1][0] == number_of_frames - 1
+    for frame_number, points in results:
+        assert np.array_equal(points, expected)
+
+    statistics = pipeline.get_statistics(cvpy.StereoPipelineStages.CAPTURE)
+    assert statistics.number_of_frames == number_of_frames
+    for stage in [cvpy.StereoPipelineStages.MATCH, cvpy.StereoPipelineStages.TRIANGULATE, cvpy.StereoPipelineStages.MASK]:
+        statistics = pipeline.get_statistics(stage)
+        six.print_('Stage ' + str(stage) + ', frames=' + str(statistics.number_of_frames)
+                   + ', mean=' + str(statistics.mean_seconds)
+                   + ', dropped=' + str(statistics.number_dropped))
+        assert statistics.number_of_frames > 0
+
+
+def test_organized_points():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+
+    result = cvpy.reconstruct_using_stoyanov(left_image,
+                                             left_intrinsics,
+                                             right_image,
+                                             right_intrinsics,
+                                             l2r[0:3, 0:3],
+                                             l2r[0:3, 3:4],
+                                             False,
+                                             cvpy.StoyanovOutputs.POINTS | cvpy.StoyanovOutputs.ORGANIZED_POINTS
+                                             )
+
+    points = result.reconstructed_points
+    organized_points = result.organized_points
+    validity_mask = result.validity_mask
+
+    assert organized_points.shape == (left_image.shape[0], left_image.shape[1], 3)
+    assert organized_points.dtype == np.float32
+    assert validity_mask.shape == left_image.shape[0:2]
+    assert np.count_nonzero(validity_mask) == points.shape[0]
+    assert np.all(np.isnan(organized_points[validity_mask == 0]))
+
+    # Same points, looked up by pixel, rather than searched for.
+    x = points[:, 3].astype(int)
+    y = points[:, 4].astype(int)
+    assert np.allclose(organized_points[y, x], points[:, 0:3], rtol=1e-3, atol=1e-3)
+
+
+def test_reproject_disparity():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+    rows, cols = left_image.shape[0:2]
+
+    rig = cvpy.StereoRig(left_intrinsics, right_intrinsics, l2r[0:3, 0:3], l2r[0:3, 3:4])
+    matcher = cvpy.RectifiedStereoMatcher(rig, cols, rows, True)
+
+    disparity = matcher.compute_disparity(left_image, right_image)
+    q = matcher.get_disparity_to_depth_matrix()
+    assert disparity.shape == (rows, cols)
+    assert q.shape == (4, 4)
+
+    start = datetime.datetime.now()
+    points = cvpy.reproject_disparity_to_points(disparity, q, cv2.CV_64FC1)
+    end = datetime.datetime.now()
+    six.print_('Reprojection, points=' + str(points.shape[0])
+               + ', time=' + str((end - start).total_seconds()))
+
+    organized_points, validity_mask = cvpy.reproject_disparity_to_organized_points(disparity, q)
+    assert organized_points.shape == (rows, cols, 3)
+    assert np.count_nonzero(validity_mask) == points.shape[0]
+
+    x = points[:, 3].astype(int)
+    y = points[:, 4].astype(int)
+    assert np.allclose(organized_points[y, x], points[:, 0:3], rtol=1e-3, atol=1e-3)
+    assert np.median(points[:, 2]) > 0
+
+
+def test_stereo_rectifier():
+
+    left_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.left.intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/reconstruction/calib.right.intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/reconstruction/calib.l2r.4x4')
+
+    left_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_L_0100.png')
+    right_image = cv2.imread('Testing/Data/reconstruction/f7_dynamic_deint_R_0100.png')
+    rows, cols = left_image.shape[0:2]
+
+    rig = cvpy.StereoRig(left_intrinsics, right_intrinsics, l2r[0:3, 0:3], l2r[0:3, 3:4])
+    distortion = np.array([[-0.1, 0.01, 0, 0, 0]])
+
+    # Maps are built once, here, rather than for every frame.
+    rectifier = cvpy.StereoRectifier(rig, distortion, distortion, cols, rows)
+    rectifier.set_parallel(True)
+    assert rectifier.get_parallel()
+
+    start = datetime.datetime.now()
+    left_rectified, right_rectified = rectifier.rectify(left_image, right_image)
+    end = datetime.datetime.now()
+    six.print_('Rectification, time=' + str((end - start).total_seconds()))
+
+    assert left_rectified.shape == left_image.shape
+    assert right_rectified.shape == right_image.shape
+    assert rectifier.get_left_projection_matrix().shape == (3, 4)
+    assert rectifier.get_right_projection_matrix().shape == (3, 4)
+
+    # Rectified images can go straight to the disparity fast path.
+    matcher = cvpy.RectifiedStereoMatcher(rig, cols, rows, False)
+    undistorted_rectifier = cvpy.StereoRectifier(rig, cols, rows)
+    assert np.allclose(matcher.get_disparity_to_depth_matrix(),
+                       undistorted_rectifier.get_disparity_to_depth_matrix())
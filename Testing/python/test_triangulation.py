@@ -5,6 +5,7 @@ import numpy as np
 import datetime
 import six
 import sksurgeryopencvpython as cvpy
+import cv2
 
 
 def test_triangulate_points():
@@ -50,3 +51,98 @@ def test_triangulate_points():
 
     six.print_('Hartley=:' + str((end_hartley - start_hartley).total_seconds()))
     six.print_('Midpoint=:' + str((end_midpoint - end_hartley).total_seconds()))
+
+
+def test_stereo_rig():
+
+    left_intrinsics = np.loadtxt('Testing/Data/triangulation/left_intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/triangulation/right_intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/triangulation/l2r.txt')
+    image_points = np.loadtxt('Testing/Data/triangulation/image_points.txt')
+
+    rotation_matrix = l2r[0:3, 0:3]
+    translation_vector = l2r[0:3, 3:4]
+
+    rig = cvpy.StereoRig(left_intrinsics,
+                         right_intrinsics,
+                         rotation_matrix,
+                         translation_vector
+                         )
+
+    start_rig = datetime.datetime.now()
+    midpoint_from_rig = rig.triangulate_points_using_midpoint(image_points)
+    end_rig = datetime.datetime.now()
+
+    midpoint = cvpy.triangulate_points_using_midpoint(image_points,
+                                                      left_intrinsics,
+                                                      right_intrinsics,
+                                                      rotation_matrix,
+                                                      translation_vector
+                                                      )
+
+    assert np.allclose(midpoint, midpoint_from_rig)
+    six.print_('Midpoint, using StereoRig=:' + str((end_rig - start_rig).total_seconds()))
+
+
+def test_stereo_rig_float32():
+
+    left_intrinsics = np.loadtxt('Testing/Data/triangulation/left_intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/triangulation/right_intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/triangulation/l2r.txt')
+    image_points = np.loadtxt('Testing/Data/triangulation/image_points.txt')
+
+    rig = cvpy.StereoRig(left_intrinsics,
+                         right_intrinsics,
+                         l2r[0:3, 0:3],
+                         l2r[0:3, 3:4]
+                         )
+
+    hartley = rig.triangulate_points_using_hartley(image_points)
+    hartley_float = rig.triangulate_points_using_hartley(image_points.astype(np.float32))
+
+    assert hartley_float.dtype == np.float32
+    assert np.allclose(hartley, hartley_float, atol=0.01)
+
+
+def test_triangulate_distorted_points():
+
+    left_intrinsics = np.loadtxt('Testing/Data/triangulation/left_intrinsic.txt')
+    right_intrinsics = np.loadtxt('Testing/Data/triangulation/right_intrinsic.txt')
+    l2r = np.loadtxt('Testing/Data/triangulation/l2r.txt')
+    image_points = np.loadtxt('Testing/Data/triangulation/image_points.txt')
+
+    rotation_matrix = l2r[0:3, 0:3]
+    translation_vector = l2r[0:3, 3:4]
+    left_distortion = np.array([[-0.1, 0.01, 0.001, -0.001, 0.0]])
+    right_distortion = np.array([[-0.08, 0.01, 0.0, 0.001]])
+
+    # Distorting the existing, undistorted, points, gives a known answer.
+    rig = cvpy.StereoRig(left_intrinsics, right_intrinsics, rotation_matrix, translation_vector)
+    expected = rig.triangulate_points_using_hartley(image_points)
+
+    def distort(points, intrinsics, distortion):
+        normalised = cv2.undistortPoints(points.reshape(-1, 1, 2), intrinsics, None)
+        homogeneous = cv2.convertPointsToHomogeneous(normalised)
+        distorted, _ = cv2.projectPoints(homogeneous, np.zeros(3), np.zeros(3), intrinsics, distortion)
+        return distorted.reshape(-1, 2)
+
+    distorted_points = np.hstack((distort(image_points[:, 0:2], left_intrinsics, left_distortion),
+                                  distort(image_points[:, 2:4], right_intrinsics, right_distortion)))
+
+    distorted_rig = cvpy.StereoRig(left_intrinsics, left_distortion,
+                                   right_intrinsics, right_distortion,
+                                   rotation_matrix, translation_vector)
+
+    start = datetime.datetime.now()
+    hartley = distorted_rig.triangulate_distorted_points_using_hartley(distorted_points)
+    end = datetime.datetime.now()
+    six.print_('Hartley, distorted=:' + str((end - start).total_seconds()))
+
+    midpoint = cvpy.triangulate_points_using_midpoint(distorted_points,
+                                                      left_intrinsics, left_distortion,
+                                                      right_intrinsics, right_distortion,
+                                                      rotation_matrix, translation_vector)
+
+    assert distorted_rig.get_left_distortion_coefficients().shape == (1, 8)
+    assert np.allclose(hartley, expected, atol=0.01)
+    assert np.allclose(midpoint, distorted_rig.triangulate_distorted_points_using_midpoint(distorted_points))
@@ -0,0 +1,137 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "catch.hpp"
+#include "sksCatchMain.h"
+#include "sksAdaptiveThreshold.h"
+#include <opencv2/core.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <iostream>
+
+// OpenCV may use IPP, or other optimised code, which could round a mean that is
+// within floating point error of a half differently, so allow a tiny fraction.
+double thresholdTolerance = 0.0001;
+
+int CountDifferences(const cv::Mat& a, const cv::Mat& b)
+{
+  REQUIRE(a.size() == b.size());
+  REQUIRE(a.type() == b.type());
+  return cv::countNonZero(a != b);
+}
+
+TEST_CASE( "Adaptive threshold matches OpenCV.", "[AdaptiveThreshold Tests]" ) {
+
+  // Odd width, so the scalar tail is tested, whatever the SIMD width.
+  cv::Mat image(61, 203, CV_8UC1);
+  cv::randu(image, cv::Scalar(0), cv::Scalar(256));
+  cv::GaussianBlur(image, image, cv::Size(7, 7), 0);
+
+  cv::Mat thresholded;
+  cv::Mat workspace;
+  cv::Mat expected;
+
+  // Including windows bigger than the image, and negative offsets.
+  int windowSizes[] = {17, 31, 151, 301};
+  double offsets[] = {-3.5, 0, 2, 20};
+
+  for (int w = 0; w < 4; w++)
+  {
+    for (int o = 0; o < 4; o++)
+    {
+      sks::AdaptiveMeanThreshold(image, 255, windowSizes[w], offsets[o], thresholded, workspace);
+      cv::adaptiveThreshold(image, expected, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY,
+                            windowSizes[w], offsets[o]);
+      REQUIRE(CountDifferences(thresholded, expected) <= thresholdTolerance * image.total());
+    }
+  }
+
+  // Small windows differ by at most OpenCV's fixed point rounding of the mean.
+  sks::AdaptiveMeanThreshold(image, 100, 3, 1, thresholded, workspace);
+  cv::adaptiveThreshold(image, expected, 100, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, 3, 1);
+  REQUIRE(CountDifferences(thresholded, expected) <= 0.01 * image.total());
+
+  // In place.
+  cv::Mat inPlace = image.clone();
+  sks::AdaptiveMeanThreshold(inPlace, 255, 31, 5, inPlace, workspace);
+  sks::AdaptiveMeanThreshold(image, 255, 31, 5, thresholded, workspace);
+  REQUIRE(CountDifferences(inPlace, thresholded) == 0);
+
+  // Blurring in the same pass gives the same images as blurring first.
+  cv::Mat blurred;
+  cv::Mat expectedBlurred;
+  sks::BlurAndAdaptiveMeanThreshold(image, 255, 151, 20, blurred, thresholded, workspace);
+  cv::GaussianBlur(image, expectedBlurred, cv::Size(5, 5), 0);
+  cv::adaptiveThreshold(expectedBlurred, expected, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY, 151, 20);
+  REQUIRE(cv::norm(blurred, expectedBlurred, cv::NORM_INF) <= 1);
+  REQUIRE(CountDifferences(blurred, expectedBlurred) <= thresholdTolerance * image.total());
+  REQUIRE(CountDifferences(thresholded, expected) <= thresholdTolerance * image.total());
+
+  REQUIRE_THROWS(sks::AdaptiveMeanThreshold(cv::Mat(), 255, 31, 5, thresholded, workspace));
+  REQUIRE_THROWS(sks::AdaptiveMeanThreshold(cv::Mat::zeros(5, 5, CV_16UC1), 255, 31, 5, thresholded, workspace));
+  REQUIRE_THROWS(sks::AdaptiveMeanThreshold(image, 255, 30, 5, thresholded, workspace));
+  REQUIRE_THROWS(sks::AdaptiveMeanThreshold(image, 255, 1, 5, thresholded, workspace));
+  REQUIRE_THROWS(sks::BlurAndAdaptiveMeanThreshold(image, 255, 31, 5, image, thresholded, workspace));
+}
+
+TEST_CASE( "Adaptive threshold timing.", "[AdaptiveThreshold Tests]" ) {
+
+  int expectedNumberOfArgs = 2;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksAdaptiveThresholdTest image.png" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat image = cv::imread(sks::argv[1]);
+  cv::Mat greyscaleImage;
+  cv::cvtColor(image, greyscaleImage, cv::COLOR_BGR2GRAY);
+
+  cv::Mat blurred;
+  cv::Mat thresholded;
+  cv::Mat workspace;
+  cv::Mat expectedBlurred;
+  cv::Mat expected;
+  int numberOfRepeats = 10;
+
+  int windowSizes[] = {31, 151, 301};
+  for (int w = 0; w < 3; w++)
+  {
+    int64 startTicks = cv::getTickCount();
+    for (int i = 0; i < numberOfRepeats; i++)
+    {
+      cv::GaussianBlur(greyscaleImage, expectedBlurred, cv::Size(5, 5), 0);
+      cv::adaptiveThreshold(expectedBlurred, expected, 255, cv::ADAPTIVE_THRESH_MEAN_C, cv::THRESH_BINARY,
+                            windowSizes[w], 20);
+    }
+    double openCVSeconds = static_cast<double>(cv::getTickCount() - startTicks)
+                           / cv::getTickFrequency() / numberOfRepeats;
+
+    startTicks = cv::getTickCount();
+    for (int i = 0; i < numberOfRepeats; i++)
+    {
+      sks::BlurAndAdaptiveMeanThreshold(greyscaleImage, 255, windowSizes[w], 20, blurred, thresholded, workspace);
+    }
+    double fusedSeconds = static_cast<double>(cv::getTickCount() - startTicks)
+                          / cv::getTickFrequency() / numberOfRepeats;
+
+    std::cout << "Window=" << windowSizes[w]
+              << ", OpenCV blur and threshold=" << openCVSeconds
+              << "s, fused=" << fusedSeconds
+              << "s, speed up=" << openCVSeconds / fusedSeconds << std::endl;
+
+    REQUIRE(CountDifferences(blurred, expectedBlurred) <= thresholdTolerance * greyscaleImage.total());
+    REQUIRE(CountDifferences(thresholded, expected) <= thresholdTolerance * greyscaleImage.total());
+  }
+}
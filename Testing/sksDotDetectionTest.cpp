@@ -93,4 +93,92 @@ TEST_CASE( "Check one file of dots.", "[Dot Detection Tests]" ) {
   REQUIRE(result.rows == expectedNumberOfDots);
   REQUIRE(result.cols == 6);
 
+  // Constructed once, and reused, as for live video, it gives the same points each time.
+  sks::DotDetector detector(leftCameraMatrix,
+                            leftDistortionMatrix,
+                            gridPoints,
+                            referencePoints,
+                            greyscaleImage.cols,
+                            greyscaleImage.rows);
+
+  cv::Mat detectorResult;
+  int numberOfRepeats = 5;
+
+  start = std::chrono::high_resolution_clock::now();
+  for (int i = 0; i < numberOfRepeats; i++)
+  {
+    detector.detect(greyscaleImage, detectorResult);
+    REQUIRE(cv::norm(detectorResult, result, cv::NORM_INF) == 0);
+  }
+  end = std::chrono::high_resolution_clock::now();
+  duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  std::cerr << "DotDetector average duration=" << duration.count() / numberOfRepeats << std::endl;
+
+  // Single pass finds nearly the same dots, at the same distorted keypoints.
+  sks::DotDetectorParameters singlePassParameters;
+  singlePassParameters.isSinglePass = true;
+  sks::DotDetector singlePassDetector(leftCameraMatrix,
+                                      leftDistortionMatrix,
+                                      gridPoints,
+                                      referencePoints,
+                                      greyscaleImage.cols,
+                                      greyscaleImage.rows,
+                                      singlePassParameters);
+
+  start = std::chrono::high_resolution_clock::now();
+  cv::Mat singlePassResult = singlePassDetector.detect(greyscaleImage);
+  end = std::chrono::high_resolution_clock::now();
+  duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  std::cerr << "Single pass duration=" << duration.count() << std::endl;
+
+  REQUIRE(singlePassResult.cols == 6);
+  REQUIRE(singlePassResult.rows >= 0.9 * expectedNumberOfDots);
+
+  int numberInCommon = 0;
+  int numberAtSamePosition = 0;
+  for (int i = 0; i < singlePassResult.rows; i++)
+  {
+    for (int j = 0; j < result.rows; j++)
+    {
+      if (result.at<double>(j, 0) == singlePassResult.at<double>(i, 0))
+      {
+        numberInCommon++;
+        if (result.at<double>(j, 1) == singlePassResult.at<double>(i, 1)
+            && result.at<double>(j, 2) == singlePassResult.at<double>(i, 2))
+        {
+          numberAtSamePosition++;
+        }
+        break;
+      }
+    }
+  }
+  REQUIRE(numberInCommon >= 0.9 * expectedNumberOfDots);
+  REQUIRE(numberAtSamePosition >= 0.9 * numberInCommon);
+
+  // Moment centroids find nearly the same dots, without cv::SimpleBlobDetector.
+  sks::DotDetectorParameters momentParameters;
+  momentParameters.useMomentCentroids = true;
+  sks::DotDetector momentDetector(leftCameraMatrix,
+                                  leftDistortionMatrix,
+                                  gridPoints,
+                                  referencePoints,
+                                  greyscaleImage.cols,
+                                  greyscaleImage.rows,
+                                  momentParameters);
+
+  start = std::chrono::high_resolution_clock::now();
+  cv::Mat momentResult = momentDetector.detect(greyscaleImage);
+  end = std::chrono::high_resolution_clock::now();
+  duration = std::chrono::duration_cast<std::chrono::milliseconds>(end - start);
+  std::cerr << "Moment centroids duration=" << duration.count() << std::endl;
+
+  REQUIRE(momentResult.cols == 6);
+  REQUIRE(momentResult.rows >= 0.9 * expectedNumberOfDots);
+
+  cv::Mat smallImage;
+  cv::resize(greyscaleImage, smallImage, cv::Size(), 0.5, 0.5);
+  REQUIRE_THROWS(detector.detect(smallImage));
+  REQUIRE_THROWS(sks::DotDetector(leftCameraMatrix, leftDistortionMatrix, gridPoints,
+                                  referencePoints.rowRange(0, 3), greyscaleImage.cols, greyscaleImage.rows));
+
 }
@@ -0,0 +1,224 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "catch.hpp"
+#include "sksCatchMain.h"
+#include "sksDotExtractor.h"
+#include "sksAdaptiveThreshold.h"
+#include <opencv2/core.hpp>
+#include <opencv2/features2d.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+cv::Ptr<cv::SimpleBlobDetector> CreateBlobDetector()
+{
+  // As sks::DotDetector.
+  cv::SimpleBlobDetector::Params params;
+  params.filterByConvexity = false;
+  params.filterByInertia = true;
+  params.filterByCircularity = true;
+  params.filterByArea = true;
+  params.minArea = 50;
+  params.maxArea = 50000;
+  return cv::SimpleBlobDetector::create(params);
+}
+
+void ComputeErrors(const std::vector<cv::Point2f>& truth,
+                   const std::vector<cv::KeyPoint>& keyPoints,
+                   double& meanError,
+                   double& maximumError)
+{
+  meanError = 0;
+  maximumError = 0;
+  for (unsigned int i = 0; i < truth.size(); i++)
+  {
+    double bestDistance = std::numeric_limits<double>::max();
+    for (unsigned int j = 0; j < keyPoints.size(); j++)
+    {
+      cv::Point2f difference = keyPoints[j].pt - truth[i];
+      bestDistance = std::min(bestDistance, std::sqrt(static_cast<double>(difference.dot(difference))));
+    }
+    meanError += bestDistance;
+    maximumError = std::max(maximumError, bestDistance);
+  }
+  meanError /= truth.size();
+}
+
+TEST_CASE( "Extract synthetic dots.", "[DotExtractor Tests]" ) {
+
+  // Drawn 8 times bigger, then averaged down, so dots have anti-aliased, sub-pixel, edges.
+  const int scale = 8;
+  const int shift = 4;
+  cv::Mat bigImage(480 * scale, 640 * scale, CV_8UC1, cv::Scalar(220));
+  cv::RNG rng(4321);
+
+  std::vector<cv::Point2f> truth;
+  for (int y = 0; y < 6; y++)
+  {
+    for (int x = 0; x < 8; x++)
+    {
+      cv::Point2f centre(60 + x * 70 + rng.uniform(-0.5f, 0.5f), 50 + y * 60 + rng.uniform(-0.5f, 0.5f));
+      truth.push_back(centre);
+
+      // Pixel u, of the small image, is centred on (u + 0.5) * scale - 0.5, of the big one.
+      cv::Point bigCentre(cvRound(((centre.x + 0.5) * scale - 0.5) * (1 << shift)),
+                          cvRound(((centre.y + 0.5) * scale - 0.5) * (1 << shift)));
+      cv::circle(bigImage, bigCentre, (6 + y % 3) * scale << shift, cv::Scalar(40), cv::FILLED, cv::LINE_8, shift);
+    }
+  }
+
+  // Shapes that should be rejected: too small, too elongated, and not round.
+  cv::circle(bigImage, cv::Point(620 * scale, 20 * scale), 2 * scale, cv::Scalar(40), cv::FILLED);
+  cv::ellipse(bigImage, cv::Point(320 * scale, 440 * scale), cv::Size(20 * scale, 4 * scale), 30, 0, 360, cv::Scalar(40), cv::FILLED);
+  cv::rectangle(bigImage, cv::Rect(520 * scale, 410 * scale, 40 * scale, 4 * scale), cv::Scalar(40), cv::FILLED);
+  cv::rectangle(bigImage, cv::Rect(538 * scale, 392 * scale, 4 * scale, 40 * scale), cv::Scalar(40), cv::FILLED);
+
+  cv::Mat image;
+  cv::resize(bigImage, image, cv::Size(640, 480), 0, 0, cv::INTER_AREA);
+
+  cv::Mat blurred;
+  cv::Mat thresholded;
+  cv::Mat workspace;
+  sks::BlurAndAdaptiveMeanThreshold(image, 255, 51, 20, blurred, thresholded, workspace);
+
+  sks::DotExtractor extractor;
+  std::vector<cv::KeyPoint> keyPoints;
+  extractor.extract(thresholded, blurred, keyPoints);
+  REQUIRE(keyPoints.size() == truth.size());
+
+  double meanError = 0;
+  double maximumError = 0;
+  ComputeErrors(truth, keyPoints, meanError, maximumError);
+
+  std::vector<cv::KeyPoint> blobKeyPoints;
+  CreateBlobDetector()->detect(thresholded, blobKeyPoints);
+  double blobMeanError = 0;
+  double blobMaximumError = 0;
+  ComputeErrors(truth, blobKeyPoints, blobMeanError, blobMaximumError);
+
+  std::cout << "Centroid error: moments mean=" << meanError << ", max=" << maximumError
+            << ", SimpleBlobDetector mean=" << blobMeanError << ", max=" << blobMaximumError << std::endl;
+
+  REQUIRE(meanError < 0.05);
+  REQUIRE(maximumError < 0.1);
+
+  // Sizes are diameters, so bigger dots sort first, as sks::DotDetector needs.
+  for (unsigned int i = 0; i < keyPoints.size(); i++)
+  {
+    REQUIRE(keyPoints[i].size > 10);
+    REQUIRE(keyPoints[i].size < 20);
+  }
+
+  // Reused, with nothing to find.
+  cv::Mat blank(480, 640, CV_8UC1, cv::Scalar(255));
+  extractor.extract(blank, blank, keyPoints);
+  REQUIRE(keyPoints.empty());
+
+  REQUIRE_THROWS(extractor.extract(cv::Mat(), blank, keyPoints));
+  REQUIRE_THROWS(extractor.extract(thresholded, cv::Mat::zeros(10, 10, CV_8UC1), keyPoints));
+  REQUIRE_THROWS(extractor.extract(cv::Mat::zeros(480, 640, CV_32FC1), blank, keyPoints));
+}
+
+TEST_CASE( "Circularity as cv::SimpleBlobDetector.", "[DotExtractor Tests]" ) {
+
+  // Already thresholded, so shapes are exactly as drawn.
+  cv::Mat thresholded(300, 400, CV_8UC1, cv::Scalar(255));
+
+  // Discs, which pass.
+  cv::circle(thresholded, cv::Point(50, 50), 8, cv::Scalar(0), cv::FILLED);
+  cv::circle(thresholded, cv::Point(150, 50), 12, cv::Scalar(0), cv::FILLED);
+  cv::circle(thresholded, cv::Point(250, 50), 20, cv::Scalar(0), cv::FILLED);
+
+  // Big enough, and not elongated enough, to pass the area and inertia filters, but not round.
+  cv::rectangle(thresholded, cv::Rect(40, 150, 20, 20), cv::Scalar(0), cv::FILLED);
+  cv::rectangle(thresholded, cv::Rect(140, 150, 28, 14), cv::Scalar(0), cv::FILLED);
+  cv::rectangle(thresholded, cv::Rect(240, 150, 14, 28), cv::Scalar(0), cv::FILLED);
+  cv::Point2f corners[4];
+  cv::RotatedRect(cv::Point2f(350, 160), cv::Size2f(20, 20), 45).points(corners);
+  std::vector<cv::Point> rotatedSquare;
+  for (int i = 0; i < 4; i++)
+  {
+    rotatedSquare.push_back(cv::Point(cvRound(corners[i].x), cvRound(corners[i].y)));
+  }
+  cv::fillConvexPoly(thresholded, rotatedSquare, cv::Scalar(0));
+
+  sks::DotExtractor extractor;
+  std::vector<cv::KeyPoint> keyPoints;
+  extractor.extract(thresholded, thresholded, keyPoints);
+
+  std::vector<cv::KeyPoint> blobKeyPoints;
+  CreateBlobDetector()->detect(thresholded, blobKeyPoints);
+
+  REQUIRE(keyPoints.size() == 3);
+  REQUIRE(blobKeyPoints.size() == keyPoints.size());
+  for (unsigned int i = 0; i < keyPoints.size(); i++)
+  {
+    REQUIRE(keyPoints[i].pt.y == Approx(50).margin(0.01));
+    REQUIRE(keyPoints[i].response >= 0.8);
+  }
+}
+
+TEST_CASE( "Extract dots timing.", "[DotExtractor Tests]" ) {
+
+  int expectedNumberOfArgs = 2;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksDotExtractorTest image.png" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat image = cv::imread(sks::argv[1]);
+  cv::Mat greyscaleImage;
+  cv::cvtColor(image, greyscaleImage, cv::COLOR_BGR2GRAY);
+
+  cv::Mat blurred;
+  cv::Mat thresholded;
+  cv::Mat workspace;
+  sks::BlurAndAdaptiveMeanThreshold(greyscaleImage, 255, 151, 20, blurred, thresholded, workspace);
+
+  cv::Ptr<cv::SimpleBlobDetector> detector = CreateBlobDetector();
+  sks::DotExtractor extractor;
+  std::vector<cv::KeyPoint> blobKeyPoints;
+  std::vector<cv::KeyPoint> keyPoints;
+  int numberOfRepeats = 10;
+
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfRepeats; i++)
+  {
+    detector->detect(thresholded, blobKeyPoints);
+  }
+  double blobSeconds = static_cast<double>(cv::getTickCount() - startTicks)
+                       / cv::getTickFrequency() / numberOfRepeats;
+
+  startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfRepeats; i++)
+  {
+    extractor.extract(thresholded, blurred, keyPoints);
+  }
+  double extractorSeconds = static_cast<double>(cv::getTickCount() - startTicks)
+                            / cv::getTickFrequency() / numberOfRepeats;
+
+  std::cout << "SimpleBlobDetector: dots=" << blobKeyPoints.size() << ", time=" << blobSeconds
+            << "s, DotExtractor: dots=" << keyPoints.size() << ", time=" << extractorSeconds
+            << "s, speed up=" << blobSeconds / extractorSeconds << std::endl;
+
+  // The filters are equivalent, so both find nearly the same dots.
+  double difference = static_cast<double>(keyPoints.size()) - static_cast<double>(blobKeyPoints.size());
+  REQUIRE(std::abs(difference) <= 0.1 * blobKeyPoints.size());
+}
@@ -62,3 +62,75 @@ TEST_CASE( "Stereo.", "[Masking Tests]" ) {
   REQUIRE(points.at<double>(0, 0) == 0);
   REQUIRE(points.at<double>(0, 1) == 1);
 }
+
+TEST_CASE( "Stereo uses right coordinates for right mask.", "[Masking Tests]" ) {
+
+  cv::Mat points = cv::Mat::zeros(2, 4, CV_64FC1);
+  points.at<double>(0, 0) = 0;
+  points.at<double>(0, 1) = 1;
+  points.at<double>(0, 2) = 1;
+  points.at<double>(0, 3) = 0;
+  points.at<double>(1, 0) = 0;
+  points.at<double>(1, 1) = 1;
+  points.at<double>(1, 2) = 0;
+  points.at<double>(1, 3) = 1;
+
+  cv::Mat leftImage = cv::Mat::zeros(2, 2, CV_8UC1);
+  leftImage.at<unsigned char>(1, 0) = 1;
+  cv::Mat rightImage = cv::Mat::zeros(2, 2, CV_8UC1);
+  rightImage.at<unsigned char>(0, 1) = 1;
+
+  cv::Mat maskedPoints = sks::MaskStereoPoints(points, leftImage, rightImage);
+  REQUIRE(maskedPoints.rows == 1);
+  REQUIRE(maskedPoints.at<double>(0, 2) == 1);
+  REQUIRE(maskedPoints.at<double>(0, 3) == 0);
+}
+
+TEST_CASE( "Output buffer is reused.", "[Masking Tests]" ) {
+
+  cv::Mat points = cv::Mat::zeros(100, 2, CV_64FC1);
+  cv::Mat image = cv::Mat::ones(2, 2, CV_8UC1);
+
+  cv::Mat maskedPoints;
+  sks::MaskPoints(points, image, maskedPoints);
+  REQUIRE(maskedPoints.rows == 100);
+  unsigned char* data = maskedPoints.data;
+
+  // Fewer points, so should fit in the same memory.
+  sks::MaskPoints(points.rowRange(0, 10), image, maskedPoints);
+  REQUIRE(maskedPoints.rows == 10);
+  REQUIRE(maskedPoints.data == data);
+
+  // Back up to the original size, still fits.
+  sks::MaskPoints(points, image, maskedPoints);
+  REQUIRE(maskedPoints.rows == 100);
+  REQUIRE(maskedPoints.data == data);
+}
+
+TEST_CASE( "Reconstructed points keep all columns.", "[Masking Tests]" ) {
+
+  cv::Mat points = cv::Mat::zeros(2, 8, CV_64FC1);
+  for (int c = 0; c < 8; c++)
+  {
+    points.at<double>(0, c) = c;
+  }
+  points.at<double>(0, 3) = 0; // left x
+  points.at<double>(0, 4) = 1; // left y
+  points.at<double>(0, 5) = 1; // right x
+  points.at<double>(0, 6) = 0; // right y
+  points.at<double>(1, 3) = 1; // not in left mask
+
+  cv::Mat leftImage = cv::Mat::zeros(2, 2, CV_8UC1);
+  leftImage.at<unsigned char>(1, 0) = 1;
+  cv::Mat rightImage = cv::Mat::zeros(2, 2, CV_8UC1);
+  rightImage.at<unsigned char>(0, 1) = 1;
+
+  cv::Mat maskedPoints;
+  sks::MaskReconstructedPoints(points, leftImage, rightImage, maskedPoints);
+  REQUIRE(maskedPoints.rows == 1);
+  REQUIRE(maskedPoints.cols == 8);
+  REQUIRE(cv::norm(maskedPoints, points.row(0), cv::NORM_INF) == 0);
+
+  REQUIRE_THROWS(sks::MaskReconstructedPoints(points.colRange(0, 4), leftImage, rightImage, maskedPoints));
+  REQUIRE_THROWS(sks::MaskReconstructedPoints(points, leftImage, rightImage, points));
+}
@@ -0,0 +1,164 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "catch.hpp"
+#include "sksCatchMain.h"
+#include "sksReprojection.h"
+#include "sksStereoMatcher.h"
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/highgui.hpp>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+
+cv::Mat LoadMatrix(const std::string& fileName, const int rows, const int cols)
+{
+  std::ifstream file(fileName.c_str());
+  cv::Mat matrix(rows, cols, CV_64FC1);
+  for (int r = 0; r < rows; r++)
+  {
+    for (int c = 0; c < cols; c++)
+    {
+      file >> matrix.at<double>(r, c);
+    }
+  }
+  REQUIRE(file);
+  return matrix;
+}
+
+TEST_CASE( "Reproject synthetic disparity.", "[Reprojection Tests]" ) {
+
+  // Odd width, so the scalar tail is tested, whatever the SIMD width.
+  cv::Mat disparity(7, 37, CV_32FC1);
+  cv::randu(disparity, cv::Scalar(-5), cv::Scalar(50));
+  disparity.at<float>(3, 3) = 0;
+
+  cv::Mat Q = (cv::Mat_<double>(4, 4) << 1, 0, 0, -18, 0, 1, 0, -3, 0, 0, 0, 500, 0, 0, 0.2, 0);
+
+  cv::Mat organizedPoints;
+  cv::Mat validityMask;
+  sks::ReprojectDisparityToOrganizedPoints(disparity, Q, organizedPoints, validityMask);
+  REQUIRE(organizedPoints.type() == CV_32FC3);
+  REQUIRE(organizedPoints.size() == disparity.size());
+  REQUIRE(validityMask.type() == CV_8UC1);
+  REQUIRE(cv::countNonZero(validityMask) == cv::countNonZero(disparity > 0));
+
+  cv::Mat expected;
+  cv::reprojectImageTo3D(disparity, expected, Q, false, CV_32F);
+  for (int r = 0; r < disparity.rows; r++)
+  {
+    for (int c = 0; c < disparity.cols; c++)
+    {
+      cv::Vec3f point = organizedPoints.at<cv::Vec3f>(r, c);
+      if (validityMask.at<unsigned char>(r, c) > 0)
+      {
+        REQUIRE(cv::norm(point - expected.at<cv::Vec3f>(r, c)) < 1e-3);
+      }
+      else
+      {
+        REQUIRE(std::isnan(point[0]));
+      }
+    }
+  }
+
+  // Fixed point, as from cv::StereoBM, gives the same answer.
+  cv::Mat fixedDisparity;
+  disparity.convertTo(fixedDisparity, CV_16SC1, 16);
+  cv::Mat floatDisparity;
+  fixedDisparity.convertTo(floatDisparity, CV_32FC1, 1.0 / 16.0);
+
+  cv::Mat fixedPoints = sks::ReprojectDisparityToPoints(fixedDisparity, Q, CV_64FC1);
+  cv::Mat floatPoints = sks::ReprojectDisparityToPoints(floatDisparity, Q, CV_64FC1);
+  REQUIRE(fixedPoints.type() == CV_64FC1);
+  REQUIRE(fixedPoints.cols == 7);
+  REQUIRE(fixedPoints.rows == cv::countNonZero(floatDisparity > 0));
+  REQUIRE(cv::norm(fixedPoints, floatPoints, cv::NORM_INF) < 1e-3);
+
+  // Each point keeps its match, in rectified coordinates.
+  for (int i = 0; i < floatPoints.rows; i++)
+  {
+    int c = static_cast<int>(floatPoints.at<double>(i, 3));
+    int r = static_cast<int>(floatPoints.at<double>(i, 4));
+    REQUIRE(floatPoints.at<double>(i, 5) == Approx(c - floatDisparity.at<float>(r, c)));
+    REQUIRE(floatPoints.at<double>(i, 6) == r);
+  }
+
+  REQUIRE_THROWS(sks::ReprojectDisparityToPoints(disparity, Q, CV_8UC1));
+  REQUIRE_THROWS(sks::ReprojectDisparityToPoints(cv::Mat(), Q, CV_32FC1));
+  REQUIRE_THROWS(sks::ReprojectDisparityToPoints(cv::Mat::zeros(7, 37, CV_8UC1), Q, CV_32FC1));
+  REQUIRE_THROWS(sks::ReprojectDisparityToPoints(disparity, cv::Mat::eye(3, 3, CV_64FC1), CV_32FC1));
+}
+
+TEST_CASE( "Reproject rectified stereo.", "[Reprojection Tests]" ) {
+
+  int expectedNumberOfArgs = 6;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksReprojectionTest left.png right.png left.intrinsic.txt right.intrinsic.txt l2r.4x4" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+  cv::Mat leftToRight = LoadMatrix(sks::argv[5], 4, 4);
+
+  sks::StereoRig rig(LoadMatrix(sks::argv[3], 3, 3),
+                     LoadMatrix(sks::argv[4], 3, 3),
+                     leftToRight(cv::Rect(0, 0, 3, 3)).clone(),
+                     leftToRight(cv::Rect(3, 0, 1, 3)).clone());
+
+  sks::RectifiedStereoMatcher matcher(rig, leftImage.cols, leftImage.rows, true);
+
+  cv::Mat disparity;
+  matcher.computeDisparity(leftImage, rightImage, disparity);
+  REQUIRE(disparity.type() == CV_16SC1);
+  REQUIRE(disparity.size() == leftImage.size());
+
+  cv::Mat Q = matcher.getDisparityToDepthMatrix();
+  cv::Mat points;
+  int numberOfRepeats = 10;
+
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfRepeats; i++)
+  {
+    sks::ReprojectDisparityToPoints(disparity, Q, CV_64FC1, points);
+  }
+  double reprojectionSeconds = static_cast<double>(cv::getTickCount() - startTicks)
+                               / cv::getTickFrequency() / numberOfRepeats;
+
+  REQUIRE(points.rows > 0);
+
+  // The same correspondences, in original image coordinates, triangulated by ray intersection.
+  cv::Mat matchedPoints = matcher.matchPoints(leftImage, rightImage);
+  cv::Mat triangulatedPoints;
+
+  startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfRepeats; i++)
+  {
+    rig.triangulatePointsUsingMidpointOfShortestDistance(matchedPoints, triangulatedPoints);
+  }
+  double triangulationSeconds = static_cast<double>(cv::getTickCount() - startTicks)
+                                / cv::getTickFrequency() / numberOfRepeats;
+
+  std::cout << "Reprojection: points=" << points.rows << ", time=" << reprojectionSeconds
+            << "s, triangulation: points=" << triangulatedPoints.rows << ", time=" << triangulationSeconds
+            << "s, speed up=" << triangulationSeconds / reprojectionSeconds << std::endl;
+
+  // Both are in left camera coordinates, so have similar depth.
+  double reprojectedDepth = cv::mean(points.col(2))[0];
+  double triangulatedDepth = cv::mean(triangulatedPoints.col(2))[0];
+  REQUIRE(reprojectedDepth > 0);
+  REQUIRE(std::abs(reprojectedDepth - triangulatedDepth) < 0.1 * triangulatedDepth);
+}
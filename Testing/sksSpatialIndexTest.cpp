@@ -0,0 +1,164 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "catch.hpp"
+#include "sksCatchMain.h"
+#include "sksSpatialIndex.h"
+#include <opencv2/core.hpp>
+#include <iostream>
+#include <limits>
+
+int BruteForceNearest(const cv::Mat& points, const double x, const double y, double& squaredDistance)
+{
+  int bestIndex = -1;
+  squaredDistance = std::numeric_limits<double>::max();
+  for (int i = 0; i < points.rows; i++)
+  {
+    double dx = points.at<double>(i, 0) - x;
+    double dy = points.at<double>(i, 1) - y;
+    double distance = dx * dx + dy * dy;
+    if (distance < squaredDistance)
+    {
+      squaredDistance = distance;
+      bestIndex = i;
+    }
+  }
+  return bestIndex;
+}
+
+void CheckAgainstBruteForce(const cv::Mat& points, const sks::SpatialIndex& index, const double x, const double y)
+{
+  double expectedDistance = 0;
+  double actualDistance = 0;
+  int expectedIndex = BruteForceNearest(points, x, y, expectedDistance);
+  int actualIndex = index.findNearest(x, y, actualDistance);
+  REQUIRE(actualIndex == expectedIndex);
+  REQUIRE(actualDistance == expectedDistance);
+}
+
+TEST_CASE( "Spatial index matches brute force.", "[SpatialIndex Tests]" ) {
+
+  cv::RNG rng(1234);
+
+  cv::Mat points(500, 2, CV_64FC1);
+  rng.fill(points, cv::RNG::UNIFORM, 0, 100);
+
+  // Duplicates, and points on integer positions, so there are ties.
+  points.row(10).copyTo(points.row(20));
+  for (int i = 100; i < 200; i++)
+  {
+    points.at<double>(i, 0) = i % 10;
+    points.at<double>(i, 1) = i % 7;
+  }
+
+  sks::SpatialIndex index(points);
+  REQUIRE(index.getNumberOfPoints() == points.rows);
+
+  for (int i = 0; i < 2000; i++)
+  {
+    // Includes queries well outside the bounding box.
+    CheckAgainstBruteForce(points, index, rng.uniform(-50.0, 150.0), rng.uniform(-50.0, 150.0));
+  }
+  for (int i = 0; i < 10; i++)
+  {
+    for (int j = 0; j < 7; j++)
+    {
+      CheckAgainstBruteForce(points, index, i + 0.5, j + 0.5);
+    }
+  }
+  CheckAgainstBruteForce(points, index, points.at<double>(20, 0), points.at<double>(20, 1));
+  CheckAgainstBruteForce(points, index, 1e30, -1e30);
+
+  // Float input gives the same answers.
+  cv::Mat floatPoints;
+  points.convertTo(floatPoints, CV_32FC1);
+  cv::Mat roundedPoints;
+  floatPoints.convertTo(roundedPoints, CV_64FC1);
+  sks::SpatialIndex floatIndex(floatPoints);
+  for (int i = 0; i < 100; i++)
+  {
+    CheckAgainstBruteForce(roundedPoints, floatIndex, rng.uniform(0.0, 100.0), rng.uniform(0.0, 100.0));
+  }
+}
+
+TEST_CASE( "Spatial index degenerate input.", "[SpatialIndex Tests]" ) {
+
+  sks::SpatialIndex index;
+  double squaredDistance = 0;
+  REQUIRE(index.getNumberOfPoints() == 0);
+  REQUIRE(index.findNearest(1, 2, squaredDistance) == -1);
+
+  cv::Mat single = (cv::Mat_<double>(1, 2) << 3, 4);
+  index.setPoints(single);
+  REQUIRE(index.findNearest(0, 0, squaredDistance) == 0);
+  REQUIRE(squaredDistance == 25);
+
+  // All on one line, so one axis of the grid is a single cell.
+  cv::Mat collinear(50, 2, CV_64FC1);
+  for (int i = 0; i < collinear.rows; i++)
+  {
+    collinear.at<double>(i, 0) = i * 2.0;
+    collinear.at<double>(i, 1) = 5;
+  }
+  index.setPoints(collinear);
+  for (int i = -10; i < 110; i++)
+  {
+    CheckAgainstBruteForce(collinear, index, i * 0.9, i % 3);
+  }
+
+  // All the same, so the bounding box is empty.
+  cv::Mat same(5, 2, CV_64FC1, cv::Scalar(7));
+  index.setPoints(same);
+  REQUIRE(index.findNearest(0, 0, squaredDistance) == 0);
+
+  index.setPoints(cv::Mat());
+  REQUIRE(index.findNearest(0, 0) == -1);
+
+  REQUIRE_THROWS(index.setPoints(cv::Mat::zeros(5, 3, CV_64FC1)));
+  REQUIRE_THROWS(index.setPoints(cv::Mat::zeros(5, 2, CV_32SC1)));
+}
+
+TEST_CASE( "Spatial index timing.", "[SpatialIndex Tests]" ) {
+
+  cv::RNG rng(5678);
+  cv::Mat points(2000, 2, CV_64FC1);
+  rng.fill(points, cv::RNG::UNIFORM, 0, 1000);
+
+  cv::Mat queries(2000, 2, CV_64FC1);
+  rng.fill(queries, cv::RNG::UNIFORM, 0, 1000);
+
+  double squaredDistance = 0;
+  int bruteForceChecksum = 0;
+  int indexChecksum = 0;
+
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < queries.rows; i++)
+  {
+    bruteForceChecksum += BruteForceNearest(points, queries.at<double>(i, 0), queries.at<double>(i, 1), squaredDistance);
+  }
+  double bruteForceSeconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+
+  startTicks = cv::getTickCount();
+  sks::SpatialIndex index(points);
+  for (int i = 0; i < queries.rows; i++)
+  {
+    indexChecksum += index.findNearest(queries.at<double>(i, 0), queries.at<double>(i, 1));
+  }
+  double indexSeconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+
+  std::cout << "Nearest neighbour: brute force=" << bruteForceSeconds << "s, index=" << indexSeconds
+            << "s, speed up=" << bruteForceSeconds / indexSeconds << std::endl;
+
+  REQUIRE(indexChecksum == bruteForceChecksum);
+}
@@ -0,0 +1,344 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "catch.hpp"
+#include "sksCatchMain.h"
+#include "sksStereoMatcher.h"
+#include <opencv2/core.hpp>
+#include <opencv2/calib3d.hpp>
+#include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+
+cv::Mat LoadMatrix(const std::string& fileName, const int rows, const int cols)
+{
+  std::ifstream file(fileName.c_str());
+  cv::Mat matrix(rows, cols, CV_64FC1);
+  for (int r = 0; r < rows; r++)
+  {
+    for (int c = 0; c < cols; c++)
+    {
+      file >> matrix.at<double>(r, c);
+    }
+  }
+  REQUIRE(file);
+  return matrix;
+}
+
+void CheckMatches(const std::string& name, sks::StereoMatcher& matcher,
+                  const cv::Mat& leftImage, const cv::Mat& rightImage,
+                  const sks::StereoRig& rig)
+{
+  cv::Mat matchedPoints = matcher.matchPoints(leftImage, rightImage);
+
+  REQUIRE(matchedPoints.type() == CV_64FC1);
+  REQUIRE(matchedPoints.cols == 4);
+  REQUIRE(matchedPoints.rows > 0);
+
+  // These images are nearly rectified, so matches should be on nearly the same row.
+  cv::Mat verticalDistance = cv::abs(matchedPoints.col(1) - matchedPoints.col(3));
+  int numberOfRowMatches = cv::countNonZero(verticalDistance < 3);
+
+  // And triangulate in front of the cameras.
+  cv::Mat points = rig.triangulatePointsUsingMidpointOfShortestDistance(matchedPoints);
+  int numberInFront = cv::countNonZero(points.col(2) > 0);
+
+  std::cout << name << ": matches=" << matchedPoints.rows
+            << ", on same row=" << numberOfRowMatches
+            << ", in front=" << numberInFront << std::endl;
+
+  REQUIRE(numberOfRowMatches > matchedPoints.rows * 0.8);
+  REQUIRE(numberInFront > matchedPoints.rows * 0.8);
+}
+
+TEST_CASE( "Stereo matchers.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 6;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksStereoMatcherTest left.png right.png left.intrinsic.txt right.intrinsic.txt l2r.4x4" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+  cv::Mat leftCameraMatrix = LoadMatrix(sks::argv[3], 3, 3);
+  cv::Mat rightCameraMatrix = LoadMatrix(sks::argv[4], 3, 3);
+  cv::Mat leftToRight = LoadMatrix(sks::argv[5], 4, 4);
+
+  sks::StereoRig rig(leftCameraMatrix,
+                     rightCameraMatrix,
+                     leftToRight(cv::Rect(0, 0, 3, 3)).clone(),
+                     leftToRight(cv::Rect(3, 0, 1, 3)).clone());
+
+  sks::StoyanovStereoMatcher stoyanov;
+  CheckMatches("Stoyanov", stoyanov, leftImage, rightImage, rig);
+  REQUIRE(cv::norm(stoyanov.matchPoints(leftImage, rightImage),
+                   sks::MatchPointsUsingStoyanov(leftImage, rightImage), cv::NORM_INF) == 0);
+
+  sks::RectifiedStereoMatcher blockMatching(rig, leftImage.cols, leftImage.rows, false);
+  CheckMatches("StereoBM", blockMatching, leftImage, rightImage, rig);
+
+  sks::RectifiedStereoMatcher semiGlobal(rig, leftImage.cols, leftImage.rows, true);
+  CheckMatches("StereoSGBM", semiGlobal, leftImage, rightImage, rig);
+
+  // Sub-sampling.
+  int numberOfMatches = semiGlobal.matchPoints(leftImage, rightImage).rows;
+  REQUIRE_THROWS(semiGlobal.setStep(0));
+  semiGlobal.setStep(2);
+  REQUIRE(semiGlobal.matchPoints(leftImage, rightImage).rows < numberOfMatches / 2);
+
+  // Size is fixed at construction, as rectification maps are precomputed.
+  cv::Mat smallImage = leftImage(cv::Rect(0, 0, 100, 100));
+  REQUIRE_THROWS(semiGlobal.matchPoints(smallImage, smallImage));
+
+  sks::FeatureStereoMatcher features(5000, 2);
+  CheckMatches("ORB", features, leftImage, rightImage, rig);
+
+  REQUIRE_THROWS(sks::FeatureStereoMatcher(0, 3));
+}
+
+TEST_CASE( "Stereo rectifier.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 6;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksStereoMatcherTest left.png right.png left.intrinsic.txt right.intrinsic.txt l2r.4x4" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+  cv::Mat leftCameraMatrix = LoadMatrix(sks::argv[3], 3, 3);
+  cv::Mat rightCameraMatrix = LoadMatrix(sks::argv[4], 3, 3);
+  cv::Mat leftToRight = LoadMatrix(sks::argv[5], 4, 4);
+  cv::Mat rotation = leftToRight(cv::Rect(0, 0, 3, 3)).clone();
+  cv::Mat translation = leftToRight(cv::Rect(3, 0, 1, 3)).clone();
+
+  sks::StereoRig rig(leftCameraMatrix, rightCameraMatrix, rotation, translation);
+  cv::Mat distortion = (cv::Mat_<double>(1, 5) << -0.1, 0.01, 0, 0, 0);
+
+  REQUIRE_THROWS(sks::StereoRectifier(rig, 0, leftImage.rows));
+
+  sks::StereoRectifier rectifier(rig, distortion, distortion, leftImage.cols, leftImage.rows);
+  REQUIRE(!rectifier.getParallel());
+  REQUIRE(rectifier.getImageSize() == leftImage.size());
+
+  cv::Mat leftRectifiedImage;
+  cv::Mat rightRectifiedImage;
+  int numberOfFrames = 10;
+
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfFrames; i++)
+  {
+    rectifier.rectify(leftImage, rightImage, leftRectifiedImage, rightRectifiedImage);
+  }
+  double cachedSeconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+
+  REQUIRE(leftRectifiedImage.size() == leftImage.size());
+  REQUIRE(leftRectifiedImage.type() == leftImage.type());
+  REQUIRE(rightRectifiedImage.size() == rightImage.size());
+
+  // As before caching, building floating point maps for every frame.
+  cv::Mat expectedLeft;
+  cv::Mat expectedRight;
+  startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfFrames; i++)
+  {
+    cv::Mat map1;
+    cv::Mat map2;
+    cv::initUndistortRectifyMap(leftCameraMatrix, distortion, rectifier.getLeftRectification(),
+                                rectifier.getLeftProjectionMatrix(), leftImage.size(), CV_32FC1, map1, map2);
+    cv::remap(leftImage, expectedLeft, map1, map2, cv::INTER_LINEAR);
+    cv::initUndistortRectifyMap(rightCameraMatrix, distortion, rectifier.getRightRectification(),
+                                rectifier.getRightProjectionMatrix(), rightImage.size(), CV_32FC1, map1, map2);
+    cv::remap(rightImage, expectedRight, map1, map2, cv::INTER_LINEAR);
+  }
+  double uncachedSeconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+
+  std::cout << "Rectification: cached=" << cachedSeconds / numberOfFrames
+            << "s, uncached=" << uncachedSeconds / numberOfFrames << "s" << std::endl;
+
+  // Fixed point maps are accurate to 1/32 pixel, so only differ slightly.
+  REQUIRE(cv::norm(leftRectifiedImage, expectedLeft, cv::NORM_L1) / leftImage.total() < 1);
+  REQUIRE(cv::norm(rightRectifiedImage, expectedRight, cv::NORM_L1) / rightImage.total() < 1);
+
+  // Left and right at the same time, gives the same answer.
+  cv::Mat leftParallelImage;
+  cv::Mat rightParallelImage;
+  rectifier.setParallel(true);
+  rectifier.rectify(leftImage, rightImage, leftParallelImage, rightParallelImage);
+  REQUIRE(cv::norm(leftParallelImage, leftRectifiedImage, cv::NORM_INF) == 0);
+  REQUIRE(cv::norm(rightParallelImage, rightRectifiedImage, cv::NORM_INF) == 0);
+
+  // A point in front of the left camera, is on the same row in both rectified images.
+  cv::Mat point = (cv::Mat_<double>(3, 1) << 10, -5, 100);
+  cv::Mat rectifiedPoint = cv::Mat::ones(4, 1, CV_64FC1);
+  cv::Mat(rectifier.getLeftRectification() * point).copyTo(rectifiedPoint.rowRange(0, 3));
+  cv::Mat leftPixel = rectifier.getLeftProjectionMatrix() * rectifiedPoint;
+  cv::Mat rightPixel = rectifier.getRightProjectionMatrix() * rectifiedPoint;
+  REQUIRE(leftPixel.at<double>(1) / leftPixel.at<double>(2)
+          == Approx(rightPixel.at<double>(1) / rightPixel.at<double>(2)));
+
+  // And Q takes its disparity back to the original point.
+  cv::Mat disparityPoint = (cv::Mat_<double>(4, 1) << leftPixel.at<double>(0) / leftPixel.at<double>(2),
+                                                      leftPixel.at<double>(1) / leftPixel.at<double>(2),
+                                                      leftPixel.at<double>(0) / leftPixel.at<double>(2)
+                                                      - rightPixel.at<double>(0) / rightPixel.at<double>(2),
+                                                      1);
+  cv::Mat reprojectedPoint = rectifier.getDisparityToDepthMatrix() * disparityPoint;
+  reprojectedPoint /= reprojectedPoint.at<double>(3);
+  REQUIRE(cv::norm(reprojectedPoint.rowRange(0, 3), point) < 1e-6);
+
+  // The matcher rectifies undistorted images, the same way.
+  sks::RectifiedStereoMatcher matcher(rig, leftImage.cols, leftImage.rows, false);
+  sks::StereoRectifier undistortedRectifier(rig, leftImage.cols, leftImage.rows);
+  REQUIRE(cv::norm(matcher.getDisparityToDepthMatrix(),
+                   undistortedRectifier.getDisparityToDepthMatrix(), cv::NORM_INF) == 0);
+  REQUIRE(cv::norm(matcher.getRectifier().getLeftProjectionMatrix(),
+                   undistortedRectifier.getLeftProjectionMatrix(), cv::NORM_INF) == 0);
+
+  REQUIRE_THROWS(rectifier.rectify(leftImage(cv::Rect(0, 0, 10, 10)), rightImage,
+                                   leftRectifiedImage, rightRectifiedImage));
+  REQUIRE_THROWS(rectifier.rectify(leftImage, cv::Mat(), leftRectifiedImage, rightRectifiedImage));
+  REQUIRE_THROWS(rectifier.rectify(leftImage, rightImage, leftRectifiedImage, leftRectifiedImage));
+
+  cv::Mat greyImage;
+  cv::cvtColor(rightImage, greyImage, cv::COLOR_BGR2GRAY);
+  REQUIRE_THROWS(rectifier.rectify(leftImage, greyImage, leftRectifiedImage, rightRectifiedImage));
+}
+
+TEST_CASE( "Stereo matcher with distortion.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 6;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksStereoMatcherTest left.png right.png left.intrinsic.txt right.intrinsic.txt l2r.4x4" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+  cv::Mat leftCameraMatrix = LoadMatrix(sks::argv[3], 3, 3);
+  cv::Mat rightCameraMatrix = LoadMatrix(sks::argv[4], 3, 3);
+  cv::Mat leftToRight = LoadMatrix(sks::argv[5], 4, 4);
+  cv::Mat rotation = leftToRight(cv::Rect(0, 0, 3, 3)).clone();
+  cv::Mat translation = leftToRight(cv::Rect(3, 0, 1, 3)).clone();
+
+  cv::Mat leftDistortion = (cv::Mat_<double>(1, 5) << -0.1, 0.01, 0.001, -0.001, 0);
+  cv::Mat rightDistortion = (cv::Mat_<double>(1, 4) << -0.08, 0.02, -0.001, 0.001);
+  sks::StereoRig rig(leftCameraMatrix, leftDistortion, rightCameraMatrix, rightDistortion, rotation, translation);
+
+  REQUIRE_THROWS(sks::StereoRectifier(rig, cv::Mat::zeros(1, 3, CV_64FC1), rightDistortion,
+                                      leftImage.cols, leftImage.rows));
+  REQUIRE_THROWS(sks::StereoRectifier(rig, leftDistortion, cv::Mat::zeros(2, 4, CV_64FC1),
+                                      leftImage.cols, leftImage.rows));
+
+  // Without explicit coefficients, the rectifier uses the rig's.
+  sks::StereoRectifier rigRectifier(rig, leftImage.cols, leftImage.rows);
+  sks::StereoRectifier explicitRectifier(rig, leftDistortion, rightDistortion, leftImage.cols, leftImage.rows);
+  REQUIRE(cv::norm(rigRectifier.getLeftProjectionMatrix(),
+                   explicitRectifier.getLeftProjectionMatrix(), cv::NORM_INF) == 0);
+  REQUIRE(cv::norm(rigRectifier.getRightRectification(),
+                   explicitRectifier.getRightRectification(), cv::NORM_INF) == 0);
+
+  cv::Mat leftRectifiedImage;
+  cv::Mat rightRectifiedImage;
+  cv::Mat expectedLeft;
+  cv::Mat expectedRight;
+  rigRectifier.rectify(leftImage, rightImage, leftRectifiedImage, rightRectifiedImage);
+  explicitRectifier.rectify(leftImage, rightImage, expectedLeft, expectedRight);
+  REQUIRE(cv::norm(leftRectifiedImage, expectedLeft, cv::NORM_INF) == 0);
+  REQUIRE(cv::norm(rightRectifiedImage, expectedRight, cv::NORM_INF) == 0);
+
+  sks::RectifiedStereoMatcher matcher(rig, leftImage.cols, leftImage.rows, true);
+  REQUIRE(cv::norm(matcher.getRectifier().getDisparityToDepthMatrix(),
+                   explicitRectifier.getDisparityToDepthMatrix(), cv::NORM_INF) == 0);
+
+  int step = 8;
+  matcher.setStep(step);
+  cv::Mat matchedPoints = matcher.matchPoints(leftImage, rightImage);
+  REQUIRE(matchedPoints.rows > 0);
+
+  // Undistorting and rectifying each match, takes it back to the grid of rectified pixels it came from.
+  cv::Mat leftRectifiedPoints;
+  cv::Mat rightRectifiedPoints;
+  cv::TermCriteria criteria(cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 100, 1e-12);
+  cv::undistortPoints(matchedPoints.colRange(0, 2).clone().reshape(2), leftRectifiedPoints,
+                      leftCameraMatrix, leftDistortion,
+                      rigRectifier.getLeftRectification(), rigRectifier.getLeftProjectionMatrix(), criteria);
+  cv::undistortPoints(matchedPoints.colRange(2, 4).clone().reshape(2), rightRectifiedPoints,
+                      rightCameraMatrix, rightDistortion,
+                      rigRectifier.getRightRectification(), rigRectifier.getRightProjectionMatrix(), criteria);
+
+  cv::Matx33d inverseRectifiedCameraMatrix
+    = cv::Matx33d(cv::Mat(rigRectifier.getLeftProjectionMatrix().colRange(0, 3))).inv();
+  cv::Matx33d inverseRectification = cv::Matx33d(rigRectifier.getLeftRectification()).t();
+
+  double maximumError = 0;
+  for (int i = 0; i < matchedPoints.rows; i++)
+  {
+    cv::Point2d left = leftRectifiedPoints.at<cv::Point2d>(i);
+    cv::Point2d right = rightRectifiedPoints.at<cv::Point2d>(i);
+    REQUIRE(left.x == Approx(cvRound(left.x)).margin(1e-3));
+    REQUIRE(left.y == Approx(cvRound(left.y)).margin(1e-3));
+    REQUIRE(cvRound(left.x) % step == 0);
+    REQUIRE(cvRound(left.y) % step == 0);
+    REQUIRE(right.y == Approx(left.y).margin(1e-3));
+
+    // And cv::projectPoints, of the ray through that rectified pixel, gives the same original pixel.
+    cv::Vec3d ray = inverseRectification * (inverseRectifiedCameraMatrix
+                                            * cv::Vec3d(cvRound(left.x), cvRound(left.y), 1));
+    std::vector<cv::Point3d> rays(1, cv::Point3d(ray[0], ray[1], ray[2]));
+    std::vector<cv::Point2d> projected;
+    cv::projectPoints(rays, cv::Vec3d(0, 0, 0), cv::Vec3d(0, 0, 0), leftCameraMatrix, leftDistortion, projected);
+    double error = cv::norm(projected[0] - cv::Point2d(matchedPoints.at<double>(i, 0),
+                                                       matchedPoints.at<double>(i, 1)));
+    maximumError = std::max(maximumError, error);
+  }
+  REQUIRE(maximumError < 1e-6);
+
+  // As the images were distorted, so are the matches, which triangulate, with the rig's
+  // distortion, to the point the rectified disparity reprojects to.
+  cv::Mat triangulatedPoints = rig.triangulateDistortedPointsUsingHartley(matchedPoints);
+  REQUIRE(triangulatedPoints.rows == matchedPoints.rows);
+
+  cv::Matx44d disparityToDepth(matcher.getDisparityToDepthMatrix());
+  int numberOfCompared = 0;
+  int numberOfAccurate = 0;
+  for (int i = 0; i < matchedPoints.rows; i++)
+  {
+    cv::Point2d left = leftRectifiedPoints.at<cv::Point2d>(i);
+    cv::Point2d right = rightRectifiedPoints.at<cv::Point2d>(i);
+    double disparity = left.x - right.x;
+
+    // Small disparities are far away, where depth is too sensitive to compare.
+    if (disparity < 4)
+    {
+      continue;
+    }
+    cv::Vec4d expected = disparityToDepth * cv::Vec4d(left.x, left.y, disparity, 1);
+    cv::Point3d expectedPoint(expected[0] / expected[3], expected[1] / expected[3], expected[2] / expected[3]);
+    cv::Point3d point(triangulatedPoints.at<double>(i, 0),
+                      triangulatedPoints.at<double>(i, 1),
+                      triangulatedPoints.at<double>(i, 2));
+
+    numberOfCompared++;
+    numberOfAccurate += cv::norm(point - expectedPoint) < 0.01 * std::abs(expectedPoint.z) ? 1 : 0;
+  }
+  REQUIRE(numberOfCompared > 0);
+  REQUIRE(numberOfAccurate > 0.99 * numberOfCompared);
+}
@@ -0,0 +1,235 @@
+/*=============================================================================
+
+  SKSURGERYOPENCVCPP: Image-guided surgery functions, in C++, using OpenCV.
+
+  Copyright (c) University College London (UCL). All rights reserved.
+
+  This software is distributed WITHOUT ANY WARRANTY; without even
+  the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR
+  PURPOSE.
+
+  See LICENSE.txt in the top level directory for details.
+
+=============================================================================*/
+
+#include "catch.hpp"
+#include "sksCatchMain.h"
+#include "sksStereoPipeline.h"
+#include "sksTripleBuffer.h"
+#include "sksMasking.h"
+#include <opencv2/core.hpp>
+#include <opencv2/highgui.hpp>
+#include <iostream>
+#include <stdexcept>
+
+TEST_CASE( "Triple buffer.", "[Pipeline Tests]" ) {
+
+  sks::TripleBuffer<int> buffer;
+  REQUIRE(buffer.getDepth() == 0);
+  REQUIRE(!buffer.receive());
+
+  buffer.back() = 1;
+  buffer.publish();
+  REQUIRE(buffer.getDepth() == 1);
+  REQUIRE(buffer.receive());
+  REQUIRE(buffer.front() == 1);
+  REQUIRE(buffer.getDepth() == 0);
+  REQUIRE(!buffer.receive());
+  REQUIRE(buffer.front() == 1);
+
+  // Latest wins.
+  for (int i = 2; i <= 4; i++)
+  {
+    buffer.back() = i;
+    buffer.publish();
+  }
+  REQUIRE(buffer.getDepth() == 1);
+  REQUIRE(buffer.receive());
+  REQUIRE(buffer.front() == 4);
+  REQUIRE(buffer.getNumberPublished() == 4);
+  REQUIRE(buffer.getNumberReceived() == 2);
+  REQUIRE(buffer.getNumberDropped() == 2);
+}
+
+TEST_CASE( "Stereo pipeline.", "[Pipeline Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: sksStereoPipelineTest left.png right.png" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2000, 0, 960, 0, 2000, 540, 0, 0, 1);
+  cv::Mat rotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat translation = (cv::Mat_<double>(3, 1) << -5, 0, 0);
+  sks::StereoRig rig(leftIntrinsic, leftIntrinsic, rotation, translation);
+
+  int numberOfFrames = 20;
+
+  // Serial, for comparison.
+  sks::StoyanovReconstructor reconstructor;
+  cv::Mat expected;
+  int64 startTicks = cv::getTickCount();
+  for (int i = 0; i < numberOfFrames; i++)
+  {
+    reconstructor.reconstructPoints(leftImage, rightImage, rig, false, expected);
+  }
+  double serialSeconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+
+  // The same pair, numberOfFrames times.
+  int numberOfFramesRead = 0;
+  sks::StereoPipeline::FrameSource source = [&](cv::Mat& left, cv::Mat& right)
+  {
+    if (numberOfFramesRead == numberOfFrames)
+    {
+      return false;
+    }
+    leftImage.copyTo(left);
+    rightImage.copyTo(right);
+    numberOfFramesRead++;
+    return true;
+  };
+
+  sks::StereoPipeline pipeline(source, rig, false);
+  REQUIRE(!pipeline.isRunning());
+  REQUIRE_THROWS(pipeline.setMasks(cv::Mat(), cv::Mat::ones(10, 10, CV_8UC1)));
+  REQUIRE_THROWS(pipeline.getStatistics(sks::StereoPipeline::NUMBER_OF_STAGES));
+
+  cv::Mat points;
+  long long frameNumber = -1;
+  long long lastFrameNumber = -1;
+  int numberOfResults = 0;
+
+  startTicks = cv::getTickCount();
+  pipeline.start();
+  REQUIRE_THROWS(pipeline.start());
+  while (true)
+  {
+    // Checked first, so the last result is not missed.
+    bool isRunning = pipeline.isRunning();
+    if (pipeline.getLatestPoints(points, frameNumber))
+    {
+      // Frames are only ever dropped, never reordered.
+      REQUIRE(frameNumber > lastFrameNumber);
+      REQUIRE(cv::norm(points, expected, cv::NORM_INF) == 0);
+      lastFrameNumber = frameNumber;
+      numberOfResults++;
+    }
+    else if (!isRunning)
+    {
+      break;
+    }
+  }
+  double pipelineSeconds = static_cast<double>(cv::getTickCount() - startTicks) / cv::getTickFrequency();
+  pipeline.stop();
+
+  std::cout << "Serial=" << serialSeconds << "s, pipeline=" << pipelineSeconds << "s, results="
+            << numberOfResults << ", latency=" << pipeline.getLastLatency() << "s" << std::endl;
+
+  // The last frame is never dropped, as nothing newer replaces it.
+  REQUIRE(lastFrameNumber == numberOfFrames - 1);
+  REQUIRE(numberOfResults > 0);
+  REQUIRE(pipeline.getLastLatency() > 0);
+
+  for (int s = 0; s < sks::StereoPipeline::NUMBER_OF_STAGES; s++)
+  {
+    sks::StereoPipelineStatistics statistics = pipeline.getStatistics(s);
+    std::cout << "Stage " << s << ": frames=" << statistics.numberOfFrames
+              << ", mean=" << statistics.meanSeconds << "s, dropped=" << statistics.numberDropped << std::endl;
+
+    REQUIRE(statistics.queueDepth == 0);
+    REQUIRE(statistics.meanSeconds >= 0);
+    if (s == sks::StereoPipeline::CAPTURE)
+    {
+      REQUIRE(statistics.numberOfFrames == numberOfFrames);
+    }
+    else
+    {
+      // Every frame is either processed or dropped.
+      REQUIRE(statistics.numberOfFrames + statistics.numberDropped
+              == pipeline.getStatistics(s - 1).numberOfFrames);
+    }
+  }
+  REQUIRE(numberOfResults + pipeline.getNumberOfDroppedResults()
+          == pipeline.getStatistics(sks::StereoPipeline::MASK).numberOfFrames);
+
+  // Masks are applied in the last stage.
+  cv::Mat leftMask = cv::Mat::zeros(leftImage.rows, leftImage.cols, CV_8UC1);
+  leftMask(cv::Rect(0, 0, leftImage.cols / 2, leftImage.rows)) = 255;
+  cv::Mat rightMask = cv::Mat::ones(rightImage.rows, rightImage.cols, CV_8UC1);
+  cv::Mat expectedMasked;
+  sks::MaskReconstructedPoints(expected, leftMask, rightMask, expectedMasked);
+  REQUIRE(expectedMasked.rows > 0);
+  REQUIRE(expectedMasked.rows < expected.rows);
+
+  numberOfFramesRead = numberOfFrames - 1;
+  sks::StereoPipeline maskedPipeline(source, rig, false);
+  maskedPipeline.setMasks(leftMask, rightMask);
+  maskedPipeline.start();
+  while (maskedPipeline.isRunning())
+  {
+  }
+  maskedPipeline.stop();
+  REQUIRE(maskedPipeline.getLatestPoints(points, frameNumber));
+  REQUIRE(frameNumber == 0);
+  REQUIRE(cv::norm(points, expectedMasked, cv::NORM_INF) == 0);
+
+  // Blank frames match nothing, giving no points, but the pipeline carries on.
+  cv::Mat blankImage = cv::Mat::zeros(leftImage.size(), leftImage.type());
+  int numberOfBlankFramesRead = 0;
+  sks::StereoPipeline::FrameSource blankSource = [&](cv::Mat& left, cv::Mat& right)
+  {
+    if (numberOfBlankFramesRead == 4)
+    {
+      return false;
+    }
+    bool isBlank = numberOfBlankFramesRead % 2 == 0;
+    (isBlank ? blankImage : leftImage).copyTo(left);
+    (isBlank ? blankImage : rightImage).copyTo(right);
+    numberOfBlankFramesRead++;
+    return true;
+  };
+
+  sks::StereoPipeline blankPipeline(blankSource, rig, false);
+  blankPipeline.setMasks(leftMask, rightMask);
+  blankPipeline.start();
+  lastFrameNumber = -1;
+  while (true)
+  {
+    bool isRunning = blankPipeline.isRunning();
+    if (blankPipeline.getLatestPoints(points, frameNumber))
+    {
+      REQUIRE(points.cols == 7);
+      REQUIRE(points.type() == CV_64FC1);
+      if (frameNumber % 2 == 0)
+      {
+        REQUIRE(points.rows == 0);
+      }
+      else
+      {
+        REQUIRE(cv::norm(points, expectedMasked, cv::NORM_INF) == 0);
+      }
+      lastFrameNumber = frameNumber;
+    }
+    else if (!isRunning)
+    {
+      break;
+    }
+  }
+  REQUIRE_NOTHROW(blankPipeline.stop());
+  REQUIRE(lastFrameNumber == 3);
+
+  // Errors in any stage stop the pipeline, and are re-thrown.
+  sks::StereoPipeline failingPipeline([](cv::Mat&, cv::Mat&) -> bool { throw std::runtime_error("No camera"); },
+                                      rig, false);
+  failingPipeline.start();
+  while (failingPipeline.isRunning())
+  {
+  }
+  REQUIRE_THROWS(failingPipeline.getLatestPoints(points, frameNumber));
+  REQUIRE_THROWS(failingPipeline.stop());
+}
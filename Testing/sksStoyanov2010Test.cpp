@@ -15,9 +15,18 @@
 #include "catch.hpp"
 #include "sksCatchMain.h"
 #include "sksStoyanov2010.h"
+#include "sksStoyanovBatch.h"
+#include "sksMasking.h"
 #include <opencv2/core.hpp>
 #include <opencv2/highgui.hpp>
+#include <opencv2/imgproc.hpp>
 #include <iostream>
+#include <map>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <stdexcept>
 
 TEST_CASE( "Reconstruct chessboard.", "[Reconstruction Tests]" ) {
 
@@ -75,3 +84,778 @@ TEST_CASE( "Reconstruct chessboard.", "[Reconstruction Tests]" ) {
   REQUIRE(pointsIn3D.cols == 7);
   // REQUIRE(numberOfPoints == 237864); Don't do this, number changes on each platform - rounding errors etc.
 }
+
+TEST_CASE( "Reconstructor reuses matcher.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  cv::Mat expected = sks::MatchPointsUsingStoyanov(leftImage, rightImage);
+
+  // Each frame should give the same result as a freshly created matcher.
+  sks::StoyanovReconstructor reconstructor;
+  cv::Mat matchedPoints;
+  for (int i = 0; i < 3; i++)
+  {
+    reconstructor.matchPoints(leftImage, rightImage, matchedPoints);
+    REQUIRE(matchedPoints.rows == expected.rows);
+    REQUIRE(cv::norm(matchedPoints, expected, cv::NORM_INF) == 0);
+  }
+
+  // Change of size, re-creates the matcher.
+  cv::Mat smallLeftImage;
+  cv::Mat smallRightImage;
+  cv::resize(leftImage, smallLeftImage, cv::Size(), 0.5, 0.5);
+  cv::resize(rightImage, smallRightImage, cv::Size(), 0.5, 0.5);
+  cv::Mat smallExpected = sks::MatchPointsUsingStoyanov(smallLeftImage, smallRightImage);
+  reconstructor.matchPoints(smallLeftImage, smallRightImage, matchedPoints);
+  REQUIRE(matchedPoints.rows == smallExpected.rows);
+
+  REQUIRE_THROWS(reconstructor.matchPoints(leftImage, smallRightImage));
+}
+
+TEST_CASE( "Reconstruct once, with all outputs.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  cv::Mat leftCameraMatrix = cv::Mat::eye(3, 3, CV_64FC1);
+  leftCameraMatrix.at<double>(0, 0) = 2012.186314;
+  leftCameraMatrix.at<double>(1, 1) = 2017.966019;
+  leftCameraMatrix.at<double>(0, 2) = 944.7173708;
+  leftCameraMatrix.at<double>(1, 2) = 617.1093984;
+
+  cv::Mat rightCameraMatrix = cv::Mat::eye(3, 3, CV_64FC1);
+  rightCameraMatrix.at<double>(0, 0) = 2037.233928;
+  rightCameraMatrix.at<double>(1, 1) = 2052.018948;
+  rightCameraMatrix.at<double>(0, 2) = 1051.112809;
+  rightCameraMatrix.at<double>(1, 2) = 548.0675962;
+
+  cv::Mat leftToRightRotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat leftToRightTranslation = cv::Mat::zeros(3, 1, CV_64FC1);
+  leftToRightTranslation.at<double>(0, 0) = -4.631472;
+
+  sks::StereoRig rig(leftCameraMatrix, rightCameraMatrix, leftToRightRotation, leftToRightTranslation);
+
+  sks::StoyanovReconstructor reconstructor;
+  sks::StoyanovResult result;
+
+  reconstructor.reconstruct(leftImage, rightImage, rig, false, sks::StoyanovReconstructor::ALL, result);
+  REQUIRE(result.reconstructedPoints.cols == 7);
+  REQUIRE(result.matchedPoints.rows == result.reconstructedPoints.rows);
+  REQUIRE(result.disparity.size() == leftImage.size());
+
+  cv::Mat expectedPoints = reconstructor.reconstructPoints(leftImage, rightImage, rig, false);
+  cv::Mat expectedDisparity = reconstructor.computeDisparity(leftImage, rightImage);
+  REQUIRE(cv::norm(result.reconstructedPoints, expectedPoints, cv::NORM_INF) == 0);
+  REQUIRE(cv::norm(result.disparity, expectedDisparity, cv::NORM_INF) == 0);
+
+  // Only what is asked for.
+  reconstructor.reconstruct(leftImage, rightImage, rig, false, sks::StoyanovReconstructor::MATCHES, result);
+  REQUIRE(result.matchedPoints.rows == expectedPoints.rows);
+  REQUIRE(result.reconstructedPoints.empty());
+  REQUIRE(result.disparity.empty());
+  REQUIRE(cv::norm(result.matchedPoints, expectedPoints.colRange(3, 7), cv::NORM_INF) == 0);
+
+  REQUIRE_THROWS(reconstructor.reconstruct(leftImage, rightImage, rig, false, 0, result));
+}
+
+TEST_CASE( "Streaming mode.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  sks::StoyanovReconstructor reconstructor;
+
+  sks::StoyanovStreamingParameters parameters;
+  parameters.seedFraction = 0;
+  REQUIRE_THROWS(reconstructor.setStreamingParameters(parameters));
+  parameters.seedFraction = 0.25;
+  parameters.keyFrameInterval = 0;
+  REQUIRE_THROWS(reconstructor.setStreamingParameters(parameters));
+  parameters.keyFrameInterval = 5;
+  reconstructor.setStreamingParameters(parameters);
+
+  cv::Mat matchedPoints;
+  reconstructor.matchPoints(leftImage, rightImage, matchedPoints);
+  REQUIRE(reconstructor.getLastFrameWasKeyFrame());
+  int keyFrameNumberOfMatches = matchedPoints.rows;
+
+  reconstructor.setStreaming(true);
+  REQUIRE(reconstructor.getStreaming());
+
+  int64 keyFrameTicks = 0;
+  int64 otherFrameTicks = 0;
+  int numberOfKeyFrames = 0;
+  int numberOfOtherFrames = 0;
+
+  for (int i = 0; i < 10; i++)
+  {
+    int64 start = cv::getTickCount();
+    reconstructor.matchPoints(leftImage, rightImage, matchedPoints);
+    int64 ticks = cv::getTickCount() - start;
+
+    if (reconstructor.getLastFrameWasKeyFrame())
+    {
+      // Key frames use the default parameters, so are identical to the first frame.
+      REQUIRE(matchedPoints.rows == keyFrameNumberOfMatches);
+      keyFrameTicks += ticks;
+      numberOfKeyFrames++;
+    }
+    else
+    {
+      REQUIRE(matchedPoints.rows > 0);
+      otherFrameTicks += ticks;
+      numberOfOtherFrames++;
+    }
+  }
+
+  // The first streaming frame is a key frame, and at least every 5th after that.
+  REQUIRE(numberOfKeyFrames >= 2);
+  std::cout << "Streaming: key frames=" << numberOfKeyFrames
+            << ", mean=" << keyFrameTicks / cv::getTickFrequency() / numberOfKeyFrames
+            << "s, other frames=" << numberOfOtherFrames;
+  if (numberOfOtherFrames > 0)
+  {
+    std::cout << ", mean=" << otherFrameTicks / cv::getTickFrequency() / numberOfOtherFrames << "s";
+  }
+  std::cout << std::endl;
+
+  // Switching off returns to default parameters.
+  reconstructor.setStreaming(false);
+  reconstructor.matchPoints(leftImage, rightImage, matchedPoints);
+  REQUIRE(reconstructor.getLastFrameWasKeyFrame());
+  REQUIRE(matchedPoints.rows == keyFrameNumberOfMatches);
+}
+
+TEST_CASE( "Matching inside masks.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  sks::StoyanovReconstructor reconstructor;
+  REQUIRE_THROWS(reconstructor.setMasks(cv::Mat::zeros(leftImage.size(), CV_8UC1),
+                                        cv::Mat::zeros(leftImage.size(), CV_8UC1)));
+  REQUIRE_THROWS(reconstructor.setMasks(cv::Mat::ones(leftImage.size(), CV_8UC1),
+                                        cv::Mat::ones(leftImage.size(), CV_32FC1)));
+  REQUIRE_THROWS(reconstructor.setMasks(cv::Mat::ones(leftImage.size(), CV_8UC1),
+                                        cv::Mat::ones(10, 10, CV_8UC1)));
+
+  cv::Mat mask = cv::Mat::zeros(leftImage.size(), CV_8UC1);
+  cv::circle(mask,
+             cv::Point(leftImage.cols / 2, leftImage.rows / 2),
+             static_cast<int>(leftImage.rows * 0.45),
+             cv::Scalar(255),
+             -1);
+
+  cv::Mat allPoints = reconstructor.matchPoints(leftImage, rightImage);
+
+  reconstructor.setMasks(mask, mask);
+  cv::Mat maskedPoints = reconstructor.matchPoints(leftImage, rightImage);
+
+  std::cout << "Matches without mask=" << allPoints.rows << ", with mask=" << maskedPoints.rows << std::endl;
+  REQUIRE(maskedPoints.rows > 0);
+  REQUIRE(maskedPoints.rows < allPoints.rows);
+
+  // Every match is inside both masks, in full image coordinates.
+  REQUIRE(sks::MaskStereoPoints(maskedPoints, mask, mask).rows == maskedPoints.rows);
+
+  cv::Mat disparity = reconstructor.computeDisparity(leftImage, rightImage);
+  REQUIRE(disparity.size() == leftImage.size());
+
+  // Masks must match the images.
+  cv::Mat smallLeftImage;
+  cv::Mat smallRightImage;
+  cv::resize(leftImage, smallLeftImage, cv::Size(), 0.5, 0.5);
+  cv::resize(rightImage, smallRightImage, cv::Size(), 0.5, 0.5);
+  REQUIRE_THROWS(reconstructor.matchPoints(smallLeftImage, smallRightImage));
+
+  // Empty masks switch masking off.
+  reconstructor.setMasks(cv::Mat(), cv::Mat());
+  REQUIRE(reconstructor.matchPoints(leftImage, rightImage).rows == allPoints.rows);
+}
+
+TEST_CASE( "Pyramid mode.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  sks::StoyanovReconstructor reconstructor;
+  sks::StoyanovPyramidParameters parameters;
+  REQUIRE(parameters.level == 0);
+
+  parameters.level = -1;
+  REQUIRE_THROWS(reconstructor.setPyramidParameters(parameters));
+  parameters.level = parameters.maximumLevel + 1;
+  REQUIRE_THROWS(reconstructor.setPyramidParameters(parameters));
+  parameters.level = 0;
+  parameters.targetLatency = -1;
+  REQUIRE_THROWS(reconstructor.setPyramidParameters(parameters));
+  parameters.targetLatency = 0;
+
+  cv::Mat fullResolutionPoints = reconstructor.matchPoints(leftImage, rightImage);
+  double fullResolutionLatency = reconstructor.getLastLatency();
+  REQUIRE(fullResolutionLatency > 0);
+
+  parameters.level = 1;
+  reconstructor.setPyramidParameters(parameters);
+  cv::Mat coarsePoints = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(coarsePoints.rows > 0);
+  REQUIRE(coarsePoints.rows < fullResolutionPoints.rows);
+
+  // Still in full resolution pixels.
+  double minimum = 0;
+  double maximum = 0;
+  cv::minMaxLoc(coarsePoints.col(0), &minimum, &maximum);
+  REQUIRE(minimum >= 0);
+  REQUIRE(maximum < leftImage.cols);
+  REQUIRE(maximum > leftImage.cols / 2);
+  cv::minMaxLoc(coarsePoints.col(1), &minimum, &maximum);
+  REQUIRE(minimum >= 0);
+  REQUIRE(maximum < leftImage.rows);
+  REQUIRE(maximum > leftImage.rows / 2);
+
+  std::cout << "Pyramid: level 0 matches=" << fullResolutionPoints.rows << " in " << fullResolutionLatency
+            << "s, level 1 matches=" << coarsePoints.rows << " in " << reconstructor.getLastLatency()
+            << "s" << std::endl;
+
+  // Refinement only moves right hand points, by at most one coarse pixel.
+  parameters.refine = true;
+  reconstructor.setPyramidParameters(parameters);
+  cv::Mat refinedPoints = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(refinedPoints.rows == coarsePoints.rows);
+  REQUIRE(cv::norm(refinedPoints.colRange(0, 2), coarsePoints.colRange(0, 2), cv::NORM_INF) == 0);
+  REQUIRE(cv::norm(refinedPoints.colRange(2, 4), coarsePoints.colRange(2, 4), cv::NORM_INF) <= 2);
+
+  cv::Mat disparity = reconstructor.computeDisparity(leftImage, rightImage);
+  REQUIRE(disparity.size() == leftImage.size());
+
+  // An impossible budget makes the controller go up to the maximum level, one frame at a time.
+  parameters.level = 0;
+  parameters.maximumLevel = 2;
+  parameters.targetLatency = 1e-9;
+  reconstructor.setPyramidParameters(parameters);
+  REQUIRE(reconstructor.getPyramidLevel() == 0);
+  reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(reconstructor.getPyramidLevel() == 1);
+  reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(reconstructor.getPyramidLevel() == 2);
+  reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(reconstructor.getPyramidLevel() == 2);
+
+  // A generous budget brings it back down.
+  parameters.level = 2;
+  parameters.targetLatency = 1000;
+  reconstructor.setPyramidParameters(parameters);
+  reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(reconstructor.getPyramidLevel() == 1);
+  reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(reconstructor.getPyramidLevel() == 0);
+  REQUIRE(reconstructor.matchPoints(leftImage, rightImage).rows == fullResolutionPoints.rows);
+}
+
+TEST_CASE( "Band mode.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  sks::StoyanovReconstructor reconstructor;
+  sks::StoyanovBandParameters parameters;
+  REQUIRE(parameters.numberOfBands == 1);
+
+  parameters.numberOfBands = 0;
+  REQUIRE_THROWS(reconstructor.setBandParameters(parameters));
+  parameters.numberOfBands = 4;
+  parameters.overlap = -1;
+  REQUIRE_THROWS(reconstructor.setBandParameters(parameters));
+  parameters.overlap = 32;
+
+  cv::Mat wholeImagePoints = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(cv::norm(wholeImagePoints, sks::MatchPointsUsingStoyanov(leftImage, rightImage), cv::NORM_INF) == 0);
+
+  reconstructor.setBandParameters(parameters);
+  cv::Mat bandPoints = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(bandPoints.rows > wholeImagePoints.rows / 2);
+
+  // Deterministic, and in order of band.
+  REQUIRE(cv::norm(bandPoints, reconstructor.matchPoints(leftImage, rightImage), cv::NORM_INF) == 0);
+
+  int rowsPerBand = (leftImage.rows + parameters.numberOfBands - 1) / parameters.numberOfBands;
+  int band = 0;
+  for (int i = 0; i < bandPoints.rows; i++)
+  {
+    int pointBand = static_cast<int>(bandPoints.at<double>(i, 1)) / rowsPerBand;
+    REQUIRE(pointBand >= band);
+    band = pointBand;
+  }
+
+  // Most matches agree with matching the whole image.
+  std::map<std::pair<int, int>, std::pair<int, int> > wholeImageMatches;
+  for (int i = 0; i < wholeImagePoints.rows; i++)
+  {
+    const double* row = wholeImagePoints.ptr<double>(i);
+    wholeImageMatches[std::make_pair(static_cast<int>(row[0]), static_cast<int>(row[1]))]
+      = std::make_pair(static_cast<int>(row[2]), static_cast<int>(row[3]));
+  }
+  int numberOfAgreeingMatches = 0;
+  for (int i = 0; i < bandPoints.rows; i++)
+  {
+    const double* row = bandPoints.ptr<double>(i);
+    std::map<std::pair<int, int>, std::pair<int, int> >::const_iterator iter
+      = wholeImageMatches.find(std::make_pair(static_cast<int>(row[0]), static_cast<int>(row[1])));
+    if (iter != wholeImageMatches.end()
+        && std::abs(iter->second.first - static_cast<int>(row[2])) <= 1
+        && std::abs(iter->second.second - static_cast<int>(row[3])) <= 1)
+    {
+      numberOfAgreeingMatches++;
+    }
+  }
+  std::cout << "Bands: whole image matches=" << wholeImagePoints.rows
+            << ", band matches=" << bandPoints.rows
+            << ", agreeing=" << numberOfAgreeingMatches << std::endl;
+  REQUIRE(numberOfAgreeingMatches > bandPoints.rows / 2);
+
+  cv::Mat disparity = reconstructor.computeDisparity(leftImage, rightImage);
+  REQUIRE(disparity.size() == leftImage.size());
+
+  // Disparity uses one scale for all bands, so grey levels increase with disparity over
+  // the whole image, and matches either side of a seam, with the same disparity, have the same grey level.
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2000, 0, 960, 0, 2000, 540, 0, 0, 1);
+  sks::StereoRig rig(leftIntrinsic, leftIntrinsic, cv::Mat::eye(3, 3, CV_64FC1),
+                     (cv::Mat_<double>(3, 1) << -5, 0, 0));
+  sks::StoyanovResult result = reconstructor.reconstruct(leftImage, rightImage, rig, false,
+                                                         sks::StoyanovReconstructor::MATCHES
+                                                         | sks::StoyanovReconstructor::DISPARITY);
+  REQUIRE(result.disparity.type() == CV_8UC1);
+
+  std::vector<std::pair<double, int> > disparityAndGrey;
+  std::map<double, int> seamGreyLevels;
+  int numberOfSeamMatches = 0;
+  for (int i = 0; i < result.matchedPoints.rows; i++)
+  {
+    const double* row = result.matchedPoints.ptr<double>(i);
+    int x = static_cast<int>(row[0]);
+    int y = static_cast<int>(row[1]);
+    double matchDisparity = std::sqrt((row[0] - row[2]) * (row[0] - row[2]) + (row[1] - row[3]) * (row[1] - row[3]));
+    int grey = result.disparity.at<unsigned char>(y, x);
+    REQUIRE(grey > 0);
+    disparityAndGrey.push_back(std::make_pair(matchDisparity, grey));
+
+    int distanceToSeam = std::min(y % rowsPerBand, rowsPerBand - y % rowsPerBand);
+    if (y >= rowsPerBand && distanceToSeam <= 4)
+    {
+      if (seamGreyLevels.count(matchDisparity) > 0)
+      {
+        REQUIRE(seamGreyLevels[matchDisparity] == grey);
+        numberOfSeamMatches++;
+      }
+      seamGreyLevels[matchDisparity] = grey;
+    }
+  }
+  REQUIRE(numberOfSeamMatches > 0);
+
+  std::sort(disparityAndGrey.begin(), disparityAndGrey.end());
+  for (std::vector<std::pair<double, int> >::size_type i = 1; i < disparityAndGrey.size(); i++)
+  {
+    REQUIRE(disparityAndGrey[i].second >= disparityAndGrey[i - 1].second);
+  }
+  REQUIRE(cv::countNonZero(result.disparity) == result.matchedPoints.rows);
+
+  // Bands combine with pyramid mode.
+  sks::StoyanovPyramidParameters pyramidParameters;
+  pyramidParameters.level = 1;
+  reconstructor.setPyramidParameters(pyramidParameters);
+  cv::Mat coarsePoints = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(coarsePoints.rows > 0);
+  REQUIRE(reconstructor.computeDisparity(leftImage, rightImage).size() == leftImage.size());
+}
+
+TEST_CASE( "Convert matches to points.", "[Reconstruction Tests]" ) {
+
+  std::vector<cv::stereo::Match> matches(20001);
+  for (int i = 0; i < static_cast<int>(matches.size()); i++)
+  {
+    matches[i].p0 = cv::Point2i(i, i + 1);
+    matches[i].p1 = cv::Point2i(i + 2, i + 3);
+    matches[i].corr = 1.0f / (i + 1);
+  }
+
+  cv::Mat points;
+  REQUIRE_THROWS(sks::ConvertMatchesToPoints(matches, CV_8UC1, false, false, points));
+
+  sks::ConvertMatchesToPoints(matches, CV_64FC1, false, false, points);
+  REQUIRE(points.rows == 20001);
+  REQUIRE(points.cols == 4);
+  REQUIRE(points.type() == CV_64FC1);
+  REQUIRE(points.at<double>(20000, 0) == 20000);
+  REQUIRE(points.at<double>(20000, 3) == 20003);
+
+  sks::ConvertMatchesToPoints(matches, CV_32FC1, false, true, points);
+  REQUIRE(points.rows == 20001);
+  REQUIRE(points.cols == 5);
+  REQUIRE(points.type() == CV_32FC1);
+  REQUIRE(points.at<float>(1, 2) == 3);
+  REQUIRE(points.at<float>(1, 4) == 0.5f);
+
+  sks::ConvertMatchesToPoints(matches, CV_32FC1, true, true, points);
+  REQUIRE(points.rows == 5);
+  REQUIRE(points.cols == 20001);
+  REQUIRE(points.at<float>(0, 7) == 7);
+  REQUIRE(points.at<float>(1, 7) == 8);
+  REQUIRE(points.at<float>(2, 7) == 9);
+  REQUIRE(points.at<float>(3, 7) == 10);
+  REQUIRE(points.at<float>(4, 7) == 0.125f);
+
+  matches.clear();
+  sks::ConvertMatchesToPoints(matches, CV_64FC1, false, false, points);
+  REQUIRE(points.rows == 0);
+}
+
+TEST_CASE( "Reconstructor match format.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  sks::StoyanovReconstructor reconstructor;
+  cv::Mat doublePoints = reconstructor.matchPoints(leftImage, rightImage);
+
+  sks::StoyanovMatchFormat format;
+  REQUIRE(format.type == CV_64FC1);
+  format.type = CV_16SC1;
+  REQUIRE_THROWS(reconstructor.setMatchFormat(format));
+
+  format.type = CV_32FC1;
+  format.isStructureOfArrays = true;
+  format.includeCorrelation = true;
+  reconstructor.setMatchFormat(format);
+  cv::Mat floatPoints = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(floatPoints.type() == CV_32FC1);
+  REQUIRE(floatPoints.rows == 5);
+  REQUIRE(floatPoints.cols == doublePoints.rows);
+
+  cv::Mat convertedPoints;
+  floatPoints.rowRange(0, 4).t().convertTo(convertedPoints, CV_64FC1);
+  REQUIRE(cv::norm(convertedPoints, doublePoints, cv::NORM_INF) == 0);
+
+  // Triangulation in float, and matches converted separately, as they are a different layout.
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2000, 0, 960, 0, 2000, 540, 0, 0, 1);
+  cv::Mat rightIntrinsic = leftIntrinsic.clone();
+  cv::Mat rotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat translation = (cv::Mat_<double>(3, 1) << -5, 0, 0);
+  sks::StereoRig rig(leftIntrinsic, rightIntrinsic, rotation, translation);
+
+  sks::StoyanovResult result = reconstructor.reconstruct(leftImage, rightImage, rig, false,
+                                                         sks::StoyanovReconstructor::ALL);
+  REQUIRE(result.reconstructedPoints.type() == CV_32FC1);
+  REQUIRE(result.reconstructedPoints.cols == 7);
+  REQUIRE(result.matchedPoints.rows == 5);
+  REQUIRE(result.matchedPoints.cols == result.reconstructedPoints.rows);
+}
+
+TEST_CASE( "Reject unconfident matches.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  sks::StoyanovReconstructor reconstructor;
+
+  sks::StoyanovMatchFormat format;
+  format.includeCorrelation = true;
+  reconstructor.setMatchFormat(format);
+
+  cv::Mat allMatches = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(allMatches.cols == 5);
+
+  sks::StoyanovConfidenceParameters parameters;
+  REQUIRE(parameters.minimumCorrelation == -1);
+  REQUIRE(parameters.maximumNumberOfMatches == 0);
+  parameters.maximumNumberOfMatches = -1;
+  REQUIRE_THROWS(reconstructor.setConfidenceParameters(parameters));
+
+  // Threshold.
+  double medianCorrelation = 0;
+  {
+    std::vector<double> correlations;
+    allMatches.col(4).copyTo(correlations);
+    std::nth_element(correlations.begin(), correlations.begin() + correlations.size() / 2, correlations.end());
+    medianCorrelation = correlations[correlations.size() / 2];
+  }
+  parameters.minimumCorrelation = static_cast<float>(medianCorrelation);
+  parameters.maximumNumberOfMatches = 0;
+  reconstructor.setConfidenceParameters(parameters);
+  cv::Mat confidentMatches = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(confidentMatches.rows > 0);
+  REQUIRE(confidentMatches.rows < allMatches.rows);
+  double minimum = 0;
+  cv::minMaxLoc(confidentMatches.col(4), &minimum);
+  REQUIRE(minimum >= parameters.minimumCorrelation);
+
+  // Top K, in original order, so a subsequence of all matches.
+  parameters.minimumCorrelation = -1;
+  parameters.maximumNumberOfMatches = 100;
+  reconstructor.setConfidenceParameters(parameters);
+  cv::Mat bestMatches = reconstructor.matchPoints(leftImage, rightImage);
+  REQUIRE(bestMatches.rows == 100);
+  int j = 0;
+  for (int i = 0; i < allMatches.rows && j < bestMatches.rows; i++)
+  {
+    if (cv::norm(allMatches.row(i), bestMatches.row(j), cv::NORM_INF) == 0)
+    {
+      j++;
+    }
+  }
+  REQUIRE(j == bestMatches.rows);
+  cv::minMaxLoc(bestMatches.col(4), &minimum);
+  REQUIRE(cv::countNonZero(allMatches.col(4) > minimum) <= 100);
+
+  // Only the confident matches are triangulated, with correlation as the last column.
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2000, 0, 960, 0, 2000, 540, 0, 0, 1);
+  cv::Mat rotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat translation = (cv::Mat_<double>(3, 1) << -5, 0, 0);
+  sks::StereoRig rig(leftIntrinsic, leftIntrinsic, rotation, translation);
+
+  cv::Mat points = reconstructor.reconstructPoints(leftImage, rightImage, rig, false);
+  REQUIRE(points.rows == 100);
+  REQUIRE(points.cols == 8);
+  REQUIRE(cv::norm(points.colRange(3, 8), bestMatches, cv::NORM_INF) == 0);
+
+  sks::StoyanovResult result = reconstructor.reconstruct(leftImage, rightImage, rig, false,
+                                                         sks::StoyanovReconstructor::ALL);
+  REQUIRE(result.matchedPoints.cols == 5);
+  REQUIRE(result.matchedPoints.rows == 100);
+
+  // Rejecting every match gives no points, rather than failing to triangulate.
+  parameters.minimumCorrelation = 1.0f;
+  parameters.maximumNumberOfMatches = 0;
+  reconstructor.setConfidenceParameters(parameters);
+  REQUIRE(reconstructor.matchPoints(leftImage, rightImage).rows == 0);
+
+  points = reconstructor.reconstructPoints(leftImage, rightImage, rig, true);
+  REQUIRE(points.rows == 0);
+  REQUIRE(points.cols == 8);
+
+  reconstructor.reconstruct(leftImage, rightImage, rig, false, sks::StoyanovReconstructor::ALL, result);
+  REQUIRE(result.reconstructedPoints.rows == 0);
+  REQUIRE(result.reconstructedPoints.cols == 8);
+}
+
+TEST_CASE( "Batch reconstruction.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2000, 0, 960, 0, 2000, 540, 0, 0, 1);
+  cv::Mat rotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat translation = (cv::Mat_<double>(3, 1) << -5, 0, 0);
+  sks::StereoRig rig(leftIntrinsic, leftIntrinsic, rotation, translation);
+
+  REQUIRE_THROWS(sks::StoyanovBatchReconstructor(rig, false, 0, 1));
+  REQUIRE_THROWS(sks::StoyanovBatchReconstructor(rig, false, 3, 2));
+
+  // Different sizes, so each pair has a different result, which checks the order.
+  int numberOfPairs = 6;
+  std::vector<cv::Mat> leftImages;
+  std::vector<cv::Mat> rightImages;
+  std::vector<cv::Mat> expected;
+  sks::StoyanovReconstructor reconstructor;
+  for (int i = 0; i < numberOfPairs; i++)
+  {
+    double scale = 0.25 + 0.05 * i;
+    cv::Mat left;
+    cv::Mat right;
+    cv::resize(leftImage, left, cv::Size(), scale, scale);
+    cv::resize(rightImage, right, cv::Size(), scale, scale);
+    leftImages.push_back(left);
+    rightImages.push_back(right);
+    expected.push_back(reconstructor.reconstructPoints(left, right, rig, false));
+  }
+
+  sks::StoyanovBatchReconstructor batch(rig, false, 3, 3);
+  REQUIRE(batch.getNumberOfThreads() == 3);
+  REQUIRE(batch.getQueueDepth() == 3);
+
+  std::vector<cv::Mat> results = batch.reconstruct(leftImages, rightImages);
+  REQUIRE(results.size() == expected.size());
+  for (int i = 0; i < numberOfPairs; i++)
+  {
+    REQUIRE(results[i].rows == expected[i].rows);
+    REQUIRE(cv::norm(results[i], expected[i], cv::NORM_INF) == 0);
+  }
+
+  // Files, delivered in order, on this thread.
+  std::vector<std::string> leftFileNames(numberOfPairs, sks::argv[1]);
+  std::vector<std::string> rightFileNames(numberOfPairs, sks::argv[2]);
+  cv::Mat expectedFromFile = reconstructor.reconstructPoints(leftImage, rightImage, rig, false);
+  std::vector<int> delivered;
+  batch.reconstruct(leftFileNames, rightFileNames,
+                    [&](const int pair, const cv::Mat& points)
+                    {
+                      delivered.push_back(pair);
+                      REQUIRE(cv::norm(points, expectedFromFile, cv::NORM_INF) == 0);
+                    });
+  REQUIRE(static_cast<int>(delivered.size()) == numberOfPairs);
+  for (int i = 0; i < numberOfPairs; i++)
+  {
+    REQUIRE(delivered[i] == i);
+  }
+
+  // Errors in workers, or the callback, stop the batch, and are re-thrown.
+  REQUIRE_THROWS(batch.reconstruct(leftImages, std::vector<cv::Mat>(1, rightImage)));
+  rightFileNames[4] = "nonsense.png";
+  REQUIRE_THROWS(batch.reconstruct(leftFileNames, rightFileNames,
+                                   [](const int, const cv::Mat&) {}));
+  std::reverse(rightImages.begin(), rightImages.end());
+  REQUIRE_THROWS(batch.reconstruct(leftImages, rightImages));
+  REQUIRE_THROWS(batch.reconstruct(std::vector<std::string>(2, sks::argv[1]),
+                                   std::vector<std::string>(2, sks::argv[2]),
+                                   [](const int, const cv::Mat&) { throw std::runtime_error("stop"); }));
+}
+
+TEST_CASE( "Organized points.", "[Reconstruction Tests]" ) {
+
+  int expectedNumberOfArgs = 3;
+  if (sks::argc != expectedNumberOfArgs)
+  {
+    std::cerr << "Usage: mpMyFirstCatchTest fileName.txt" << std::endl;
+    REQUIRE( sks::argc == expectedNumberOfArgs);
+  }
+
+  cv::Mat leftImage = cv::imread(sks::argv[1]);
+  cv::Mat rightImage = cv::imread(sks::argv[2]);
+
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2000, 0, 960, 0, 2000, 540, 0, 0, 1);
+  cv::Mat rotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat translation = (cv::Mat_<double>(3, 1) << -5, 0, 0);
+  sks::StereoRig rig(leftIntrinsic, leftIntrinsic, rotation, translation);
+
+  sks::StoyanovReconstructor reconstructor;
+  sks::StoyanovResult result;
+
+  // ALL does not include organized points.
+  reconstructor.reconstruct(leftImage, rightImage, rig, false, sks::StoyanovReconstructor::ALL, result);
+  REQUIRE(result.organizedPoints.empty());
+  REQUIRE(result.validityMask.empty());
+
+  reconstructor.reconstruct(leftImage, rightImage, rig, false,
+                            sks::StoyanovReconstructor::POINTS | sks::StoyanovReconstructor::ORGANIZED_POINTS,
+                            result);
+  REQUIRE(result.organizedPoints.type() == CV_32FC3);
+  REQUIRE(result.organizedPoints.size() == leftImage.size());
+  REQUIRE(result.validityMask.type() == CV_8UC1);
+  REQUIRE(result.validityMask.size() == leftImage.size());
+  REQUIRE(result.reconstructedPoints.rows > 0);
+  REQUIRE(cv::countNonZero(result.validityMask) == result.reconstructedPoints.rows);
+
+  std::cout << "Organized points: " << result.organizedPoints.total() * 13 << " bytes, "
+            << "point list: " << result.reconstructedPoints.total() * 8 << " bytes" << std::endl;
+
+  // Each point is at its left pixel, triangulated in float.
+  for (int i = 0; i < result.reconstructedPoints.rows; i++)
+  {
+    const double* point = result.reconstructedPoints.ptr<double>(i);
+    int x = static_cast<int>(point[3]);
+    int y = static_cast<int>(point[4]);
+    REQUIRE(result.validityMask.at<unsigned char>(y, x) == 255);
+    cv::Vec3f organizedPoint = result.organizedPoints.at<cv::Vec3f>(y, x);
+    for (int j = 0; j < 3; j++)
+    {
+      REQUIRE(std::abs(organizedPoint[j] - point[j]) <= 1e-3 * (std::abs(point[j]) + 1));
+    }
+  }
+
+  // Invalid pixels are NaN.
+  cv::Mat invalid = result.validityMask == 0;
+  cv::Point invalidPixel;
+  cv::minMaxLoc(result.validityMask, nullptr, nullptr, &invalidPixel, nullptr);
+  REQUIRE(cv::countNonZero(invalid) > 0);
+  REQUIRE(std::isnan(result.organizedPoints.at<cv::Vec3f>(invalidPixel)[0]));
+
+  // Memory is reused.
+  cv::Mat organizedPoints = result.organizedPoints;
+  cv::Mat validityMask = result.validityMask;
+  reconstructor.reconstructOrganizedPoints(leftImage, rightImage, rig, false, organizedPoints, validityMask);
+  REQUIRE(organizedPoints.data == result.organizedPoints.data);
+  REQUIRE(validityMask.data == result.validityMask.data);
+  REQUIRE(cv::countNonZero(validityMask) == result.reconstructedPoints.rows);
+
+  // Free function.
+  cv::Mat freeOrganizedPoints;
+  cv::Mat freeValidityMask;
+  sks::ReconstructOrganizedPointsUsingStoyanov(leftImage, leftIntrinsic, rightImage, leftIntrinsic,
+                                               rotation, translation, false,
+                                               freeOrganizedPoints, freeValidityMask);
+  REQUIRE(cv::norm(freeValidityMask, validityMask, cv::NORM_INF) == 0);
+
+  // With no matches, every pixel is invalid.
+  sks::StoyanovConfidenceParameters parameters;
+  parameters.minimumCorrelation = 1.0f;
+  reconstructor.setConfidenceParameters(parameters);
+  reconstructor.reconstructOrganizedPoints(leftImage, rightImage, rig, true, organizedPoints, validityMask);
+  REQUIRE(organizedPoints.size() == leftImage.size());
+  REQUIRE(validityMask.size() == leftImage.size());
+  REQUIRE(cv::countNonZero(validityMask) == 0);
+  REQUIRE(cv::countNonZero(organizedPoints.reshape(1) == organizedPoints.reshape(1)) == 0);
+}
@@ -15,9 +15,13 @@
 #include "catch.hpp"
 #include "sksCatchMain.h"
 #include "sksTriangulate.h"
+#include "sksStereoRig.h"
 #include "sksMaths.h"
+#include <opencv2/calib3d.hpp>
 #include <iostream>
 #include <vector>
+#include <algorithm>
+#include <cmath>
 
 TEST_CASE( "Empty points throws exception.", "[Triangulate Tests]" ) {
 
@@ -238,3 +242,507 @@ TEST_CASE( "Chessboard Test.", "[Triangulate Tests]" ) {
   REQUIRE(rmsHartley < 1.5);
   REQUIRE(rmsMidpoint < 1.5);
 }
+
+
+TEST_CASE( "StereoRig validates on construction.", "[Triangulate Tests]" ) {
+
+  REQUIRE_THROWS(sks::StereoRig(cv::Mat(2, 3, CV_64FC1),
+                                cv::Mat(3, 3, CV_64FC1),
+                                cv::Mat(3, 3, CV_64FC1),
+                                cv::Mat(3, 1, CV_64FC1)
+                                ));
+
+  REQUIRE_THROWS(sks::StereoRig(cv::Mat(3, 3, CV_64FC1),
+                                cv::Mat(3, 3, CV_64FC1),
+                                cv::Mat(3, 3, CV_64FC1),
+                                cv::Mat(1, 3, CV_64FC1)
+                                ));
+
+  sks::StereoRig rig(cv::Mat::eye(3, 3, CV_64FC1),
+                     cv::Mat::eye(3, 3, CV_64FC1),
+                     cv::Mat::eye(3, 3, CV_64FC1),
+                     cv::Mat::zeros(3, 1, CV_64FC1)
+                    );
+
+  REQUIRE_THROWS(rig.triangulatePointsUsingHartley(cv::Mat(0, 4, CV_64FC1)));
+  REQUIRE_THROWS(rig.triangulatePointsUsingMidpointOfShortestDistance(cv::Mat(0, 4, CV_64FC1)));
+}
+
+
+TEST_CASE( "StereoRig matches free functions.", "[Triangulate Tests]" ) {
+
+  cv::Mat leftIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  leftIntrinsic.at<double>(0, 0) = 2012.186314;
+  leftIntrinsic.at<double>(1, 1) = 2017.966019;
+  leftIntrinsic.at<double>(0, 2) = 944.7173708;
+  leftIntrinsic.at<double>(1, 2) = 617.1093984;
+
+  cv::Mat rightIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  rightIntrinsic.at<double>(0, 0) = 2037.233928;
+  rightIntrinsic.at<double>(1, 1) = 2052.018948;
+  rightIntrinsic.at<double>(0, 2) = 1051.112809;
+  rightIntrinsic.at<double>(1, 2) = 548.0675962;
+
+  cv::Mat leftToRightRotation = cv::Mat::eye(3, 3, CV_64FC1);
+  leftToRightRotation.at<double>(0, 0) = 0.999678;
+  leftToRightRotation.at<double>(0, 1) = 0.000151;
+  leftToRightRotation.at<double>(0, 2) = 0.025398;
+  leftToRightRotation.at<double>(1, 0) = -0.000720;
+  leftToRightRotation.at<double>(1, 1) = 0.999749;
+  leftToRightRotation.at<double>(1, 2) = 0.022394;
+  leftToRightRotation.at<double>(2, 0) = -0.025388;
+  leftToRightRotation.at<double>(2, 1) = -0.022405;
+  leftToRightRotation.at<double>(2, 2) = 0.999426;
+
+  cv::Mat leftToRightTranslation = cv::Mat::eye(3, 1, CV_64FC1);
+  leftToRightTranslation.at<double>(0, 0) = -4.631472;
+  leftToRightTranslation.at<double>(1, 0) = 0.268695;
+  leftToRightTranslation.at<double>(2, 0) = 1.300256;
+
+  cv::Mat pointsIn2D = cv::Mat::zeros(2, 4, CV_64FC1);
+  pointsIn2D.at<double>(0, 0) = 1100.16;
+  pointsIn2D.at<double>(0, 1) = 262.974;
+  pointsIn2D.at<double>(0, 2) = 1184.84;
+  pointsIn2D.at<double>(0, 3) = 241.915;
+  pointsIn2D.at<double>(1, 0) = 1757.74;
+  pointsIn2D.at<double>(1, 1) = 228.971;
+  pointsIn2D.at<double>(1, 2) = 1843.52;
+  pointsIn2D.at<double>(1, 3) = 204.083;
+
+  sks::StereoRig rig(leftIntrinsic, rightIntrinsic, leftToRightRotation, leftToRightTranslation);
+
+  // Calling more than once, should give the same answer, as nothing is modified.
+  for (int i = 0; i < 2; i++)
+  {
+    cv::Mat hartleyFromRig = rig.triangulatePointsUsingHartley(pointsIn2D);
+    cv::Mat midpointFromRig = rig.triangulatePointsUsingMidpointOfShortestDistance(pointsIn2D);
+
+    cv::Mat hartley = sks::TriangulatePointsUsingHartley(pointsIn2D,
+                                                         leftIntrinsic,
+                                                         rightIntrinsic,
+                                                         leftToRightRotation,
+                                                         leftToRightTranslation);
+
+    cv::Mat midpoint = sks::TriangulatePointsUsingMidpointOfShortestDistance(pointsIn2D,
+                                                                             leftIntrinsic,
+                                                                             rightIntrinsic,
+                                                                             leftToRightRotation,
+                                                                             leftToRightTranslation);
+
+    REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(hartley, hartleyFromRig) < 0.000001);
+    REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(midpoint, midpointFromRig) < 0.000001);
+  }
+
+  // 32 bit calibration should be converted once, on construction.
+  cv::Mat leftIntrinsic32, rightIntrinsic32, leftToRightRotation32, leftToRightTranslation32;
+  leftIntrinsic.convertTo(leftIntrinsic32, CV_32FC1);
+  rightIntrinsic.convertTo(rightIntrinsic32, CV_32FC1);
+  leftToRightRotation.convertTo(leftToRightRotation32, CV_32FC1);
+  leftToRightTranslation.convertTo(leftToRightTranslation32, CV_32FC1);
+
+  sks::StereoRig rig32(leftIntrinsic32, rightIntrinsic32, leftToRightRotation32, leftToRightTranslation32);
+
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(rig.triangulatePointsUsingHartley(pointsIn2D),
+                                                    rig32.triangulatePointsUsingHartley(pointsIn2D)) < 0.01);
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(rig.triangulatePointsUsingMidpointOfShortestDistance(pointsIn2D),
+                                                    rig32.triangulatePointsUsingMidpointOfShortestDistance(pointsIn2D)) < 0.01);
+}
+
+
+TEST_CASE( "Vectorised midpoint matches DistanceBetweenLines.", "[Triangulate Tests]" ) {
+
+  cv::Mat leftIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  leftIntrinsic.at<double>(0, 0) = 2012.186314;
+  leftIntrinsic.at<double>(1, 1) = 2017.966019;
+  leftIntrinsic.at<double>(0, 2) = 944.7173708;
+  leftIntrinsic.at<double>(1, 2) = 617.1093984;
+
+  cv::Mat rightIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  rightIntrinsic.at<double>(0, 0) = 2037.233928;
+  rightIntrinsic.at<double>(1, 1) = 2052.018948;
+  rightIntrinsic.at<double>(0, 2) = 1051.112809;
+  rightIntrinsic.at<double>(1, 2) = 548.0675962;
+
+  cv::Mat leftToRightRotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat leftToRightTranslation = cv::Mat::zeros(3, 1, CV_64FC1);
+  leftToRightTranslation.at<double>(0, 0) = -4.631472;
+
+  sks::StereoRig rig(leftIntrinsic, rightIntrinsic, leftToRightRotation, leftToRightTranslation);
+
+  // Deliberately not a multiple of any SIMD width, so the remainder loop is tested too.
+  int numberOfPoints = 1003;
+  cv::Mat pointsIn2D = cv::Mat(numberOfPoints, 4, CV_64FC1);
+  cv::RNG rng(1);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    pointsIn2D.at<double>(i, 0) = rng.uniform(0.0, 1920.0);
+    pointsIn2D.at<double>(i, 1) = rng.uniform(0.0, 1080.0);
+    pointsIn2D.at<double>(i, 2) = pointsIn2D.at<double>(i, 0) + rng.uniform(20.0, 150.0);
+    pointsIn2D.at<double>(i, 3) = pointsIn2D.at<double>(i, 1) + rng.uniform(-70.0, -60.0);
+  }
+
+  cv::Mat midpoint = rig.triangulatePointsUsingMidpointOfShortestDistance(pointsIn2D);
+  REQUIRE(midpoint.rows == numberOfPoints);
+  REQUIRE(midpoint.cols == 3);
+
+  cv::Mat K1Inv = rig.getLeftCameraMatrix().inv();
+  cv::Mat K2Inv = rig.getRightCameraMatrix().inv();
+  cv::Mat R2LRot = rig.getRightToLeftRotationMatrix();
+  cv::Mat R2LTrn = rig.getRightToLeftTranslationVector();
+
+  cv::Mat expected = cv::Mat(numberOfPoints, 3, CV_64FC1);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    cv::Mat p1 = (cv::Mat_<double>(3, 1) << pointsIn2D.at<double>(i, 0), pointsIn2D.at<double>(i, 1), 1);
+    cv::Mat p2 = (cv::Mat_<double>(3, 1) << pointsIn2D.at<double>(i, 2), pointsIn2D.at<double>(i, 3), 1);
+    cv::Mat u = K1Inv * p1;
+    cv::Mat r = K2Inv * p2;
+    u /= cv::norm(u);
+    r /= cv::norm(r);
+    cv::Mat v = R2LRot * r;
+
+    cv::Point3d midPoint;
+    sks::DistanceBetweenLines(cv::Point3d(0, 0, 0),
+                              cv::Point3d(u.at<double>(0, 0), u.at<double>(1, 0), u.at<double>(2, 0)),
+                              cv::Point3d(R2LTrn.at<double>(0, 0), R2LTrn.at<double>(1, 0), R2LTrn.at<double>(2, 0)),
+                              cv::Point3d(v.at<double>(0, 0), v.at<double>(1, 0), v.at<double>(2, 0)),
+                              midPoint);
+    expected.at<double>(i, 0) = midPoint.x;
+    expected.at<double>(i, 1) = midPoint.y;
+    expected.at<double>(i, 2) = midPoint.z;
+  }
+
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(expected, midpoint) < 0.000001);
+
+  // Strided input, e.g. a sub-matrix of a bigger array, must give the same answer.
+  cv::Mat wider = cv::Mat::zeros(numberOfPoints, 7, CV_64FC1);
+  pointsIn2D.copyTo(wider(cv::Rect(3, 0, 4, numberOfPoints)));
+  cv::Mat fromView = rig.triangulatePointsUsingMidpointOfShortestDistance(wider(cv::Rect(3, 0, 4, numberOfPoints)));
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(midpoint, fromView) == 0);
+}
+
+
+cv::Point3d ReferenceHartleyUsingSVD(const cv::Matx34d& P1,
+                                     const cv::Matx34d& P2,
+                                     const cv::Point2d& u1,
+                                     const cv::Point2d& u2)
+{
+  // The original implementation, using cv::solve, starting from unit weights.
+  double w1 = 1, w2 = 1;
+  cv::Mat_<double> X(4, 1);
+  for (int i = 0; i < 10; i++)
+  {
+    cv::Matx43d A((u1.x*P1(2,0)-P1(0,0))/w1, (u1.x*P1(2,1)-P1(0,1))/w1, (u1.x*P1(2,2)-P1(0,2))/w1,
+                  (u1.y*P1(2,0)-P1(1,0))/w1, (u1.y*P1(2,1)-P1(1,1))/w1, (u1.y*P1(2,2)-P1(1,2))/w1,
+                  (u2.x*P2(2,0)-P2(0,0))/w2, (u2.x*P2(2,1)-P2(0,1))/w2, (u2.x*P2(2,2)-P2(0,2))/w2,
+                  (u2.y*P2(2,0)-P2(1,0))/w2, (u2.y*P2(2,1)-P2(1,1))/w2, (u2.y*P2(2,2)-P2(1,2))/w2);
+    cv::Matx41d B(-(u1.x*P1(2,3)-P1(0,3))/w1,
+                  -(u1.y*P1(2,3)-P1(1,3))/w1,
+                  -(u2.x*P2(2,3)-P2(0,3))/w2,
+                  -(u2.y*P2(2,3)-P2(1,3))/w2);
+    cv::Mat_<double> X_;
+    cv::solve(A, B, X_, cv::DECOMP_SVD);
+    X(0) = X_(0);
+    X(1) = X_(1);
+    X(2) = X_(2);
+    X(3) = 1.0;
+
+    double p2x1 = cv::Mat_<double>(cv::Mat_<double>(P1).row(2)*X)(0);
+    double p2x2 = cv::Mat_<double>(cv::Mat_<double>(P2).row(2)*X)(0);
+    if (fabs(w1 - p2x1) <= 0.00000000001 && fabs(w2 - p2x2) <= 0.00000000001)
+    {
+      break;
+    }
+    w1 = p2x1;
+    w2 = p2x2;
+  }
+  return cv::Point3d(X(0), X(1), X(2));
+}
+
+
+TEST_CASE( "Closed form Hartley matches SVD based Hartley.", "[Triangulate Tests]" ) {
+
+  cv::Mat leftIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  leftIntrinsic.at<double>(0, 0) = 2012.186314;
+  leftIntrinsic.at<double>(1, 1) = 2017.966019;
+  leftIntrinsic.at<double>(0, 2) = 944.7173708;
+  leftIntrinsic.at<double>(1, 2) = 617.1093984;
+
+  cv::Mat rightIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  rightIntrinsic.at<double>(0, 0) = 2037.233928;
+  rightIntrinsic.at<double>(1, 1) = 2052.018948;
+  rightIntrinsic.at<double>(0, 2) = 1051.112809;
+  rightIntrinsic.at<double>(1, 2) = 548.0675962;
+
+  cv::Mat leftToRightRotation = cv::Mat::eye(3, 3, CV_64FC1);
+  leftToRightRotation.at<double>(0, 0) = 0.999678;
+  leftToRightRotation.at<double>(0, 1) = 0.000151;
+  leftToRightRotation.at<double>(0, 2) = 0.025398;
+  leftToRightRotation.at<double>(1, 0) = -0.000720;
+  leftToRightRotation.at<double>(1, 1) = 0.999749;
+  leftToRightRotation.at<double>(1, 2) = 0.022394;
+  leftToRightRotation.at<double>(2, 0) = -0.025388;
+  leftToRightRotation.at<double>(2, 1) = -0.022405;
+  leftToRightRotation.at<double>(2, 2) = 0.999426;
+
+  cv::Mat leftToRightTranslation = cv::Mat::eye(3, 1, CV_64FC1);
+  leftToRightTranslation.at<double>(0, 0) = -4.631472;
+  leftToRightTranslation.at<double>(1, 0) = 0.268695;
+  leftToRightTranslation.at<double>(2, 0) = 1.300256;
+
+  sks::StereoRig rig(leftIntrinsic, rightIntrinsic, leftToRightRotation, leftToRightTranslation);
+
+  // Project random points in front of the cameras, then add about a pixel of noise.
+  int numberOfPoints = 500;
+  cv::Mat pointsIn2D = cv::Mat(numberOfPoints, 4, CV_64FC1);
+  cv::RNG rng(2);
+  cv::Mat K2R = rightIntrinsic * leftToRightRotation;
+  cv::Mat K2T = rightIntrinsic * leftToRightTranslation;
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    cv::Mat X = (cv::Mat_<double>(3, 1) << rng.uniform(-30.0, 30.0), rng.uniform(-20.0, 20.0), rng.uniform(50.0, 200.0));
+    cv::Mat left = leftIntrinsic * X;
+    cv::Mat right = K2R * X + K2T;
+    pointsIn2D.at<double>(i, 0) = left.at<double>(0, 0) / left.at<double>(2, 0) + rng.uniform(-1.0, 1.0);
+    pointsIn2D.at<double>(i, 1) = left.at<double>(1, 0) / left.at<double>(2, 0) + rng.uniform(-1.0, 1.0);
+    pointsIn2D.at<double>(i, 2) = right.at<double>(0, 0) / right.at<double>(2, 0) + rng.uniform(-1.0, 1.0);
+    pointsIn2D.at<double>(i, 3) = right.at<double>(1, 0) / right.at<double>(2, 0) + rng.uniform(-1.0, 1.0);
+  }
+
+  cv::Mat hartley = rig.triangulatePointsUsingHartley(pointsIn2D);
+
+  cv::Matx34d P1 = rig.getLeftProjectionMatrix();
+  cv::Matx34d P2 = rig.getRightProjectionMatrix();
+  cv::Mat K1Inv = leftIntrinsic.inv();
+  cv::Mat K2Inv = rightIntrinsic.inv();
+
+  double maxDifference = 0;
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    cv::Mat u1 = K1Inv * (cv::Mat_<double>(3, 1) << pointsIn2D.at<double>(i, 0), pointsIn2D.at<double>(i, 1), 1);
+    cv::Mat u2 = K2Inv * (cv::Mat_<double>(3, 1) << pointsIn2D.at<double>(i, 2), pointsIn2D.at<double>(i, 3), 1);
+    cv::Point3d expected = ReferenceHartleyUsingSVD(P1, P2,
+                                                    cv::Point2d(u1.at<double>(0, 0), u1.at<double>(1, 0)),
+                                                    cv::Point2d(u2.at<double>(0, 0), u2.at<double>(1, 0)));
+    maxDifference = std::max(maxDifference, std::fabs(expected.x - hartley.at<double>(i, 0)));
+    maxDifference = std::max(maxDifference, std::fabs(expected.y - hartley.at<double>(i, 1)));
+    maxDifference = std::max(maxDifference, std::fabs(expected.z - hartley.at<double>(i, 2)));
+  }
+  std::cerr << "Hartley, max difference to SVD=" << maxDifference << std::endl;
+  REQUIRE(maxDifference < 0.000001);
+}
+
+
+TEST_CASE( "Float points triangulate in float.", "[Triangulate Tests]" ) {
+
+  cv::Mat leftIntrinsic = cv::Mat::eye(3, 3, CV_32FC1);
+  leftIntrinsic.at<float>(0, 0) = 2012.186314f;
+  leftIntrinsic.at<float>(1, 1) = 2017.966019f;
+  leftIntrinsic.at<float>(0, 2) = 944.7173708f;
+  leftIntrinsic.at<float>(1, 2) = 617.1093984f;
+
+  cv::Mat rightIntrinsic = cv::Mat::eye(3, 3, CV_32FC1);
+  rightIntrinsic.at<float>(0, 0) = 2037.233928f;
+  rightIntrinsic.at<float>(1, 1) = 2052.018948f;
+  rightIntrinsic.at<float>(0, 2) = 1051.112809f;
+  rightIntrinsic.at<float>(1, 2) = 548.0675962f;
+
+  cv::Mat leftToRightRotation = cv::Mat::eye(3, 3, CV_32FC1);
+  cv::Mat leftToRightTranslation = cv::Mat::zeros(3, 1, CV_32FC1);
+  leftToRightTranslation.at<float>(0, 0) = -4.631472f;
+
+  sks::StereoRig rig(leftIntrinsic, rightIntrinsic, leftToRightRotation, leftToRightTranslation);
+
+  // Deliberately not a multiple of any SIMD width, so the remainder loop is tested too.
+  int numberOfPoints = 1003;
+  cv::Mat pointsIn2D = cv::Mat(numberOfPoints, 4, CV_32FC1);
+  cv::RNG rng(3);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    pointsIn2D.at<float>(i, 0) = rng.uniform(0.0f, 1920.0f);
+    pointsIn2D.at<float>(i, 1) = rng.uniform(0.0f, 1080.0f);
+    pointsIn2D.at<float>(i, 2) = pointsIn2D.at<float>(i, 0) + rng.uniform(20.0f, 150.0f);
+    pointsIn2D.at<float>(i, 3) = pointsIn2D.at<float>(i, 1) + rng.uniform(-70.0f, -60.0f);
+  }
+  cv::Mat pointsIn2D64;
+  pointsIn2D.convertTo(pointsIn2D64, CV_64FC1);
+
+  cv::Mat midpoint = rig.triangulatePointsUsingMidpointOfShortestDistance(pointsIn2D);
+  cv::Mat hartley = rig.triangulatePointsUsingHartley(pointsIn2D);
+  REQUIRE(midpoint.type() == CV_32FC1);
+  REQUIRE(hartley.type() == CV_32FC1);
+  REQUIRE(midpoint.rows == numberOfPoints);
+  REQUIRE(hartley.rows == numberOfPoints);
+
+  cv::Mat midpoint64 = rig.triangulatePointsUsingMidpointOfShortestDistance(pointsIn2D64);
+  cv::Mat hartley64 = rig.triangulatePointsUsingHartley(pointsIn2D64);
+  REQUIRE(midpoint64.type() == CV_64FC1);
+  REQUIRE(hartley64.type() == CV_64FC1);
+
+  cv::Mat midpointAsDouble;
+  cv::Mat hartleyAsDouble;
+  midpoint.convertTo(midpointAsDouble, CV_64FC1);
+  hartley.convertTo(hartleyAsDouble, CV_64FC1);
+
+  double rmsMidpoint = sks::ComputeRMSBetweenCorrespondingPoints(midpoint64, midpointAsDouble);
+  double rmsHartley = sks::ComputeRMSBetweenCorrespondingPoints(hartley64, hartleyAsDouble);
+  std::cerr << "Float vs double, rmsMidpoint=" << rmsMidpoint << ", rmsHartley=" << rmsHartley << std::endl;
+  REQUIRE(rmsMidpoint < 0.001);
+  REQUIRE(rmsHartley < 0.001);
+
+  // Anything other than float or double is rejected.
+  REQUIRE_THROWS(rig.triangulatePointsUsingMidpointOfShortestDistance(cv::Mat::zeros(1, 4, CV_32SC1)));
+  REQUIRE_THROWS(rig.triangulatePointsUsingHartley(cv::Mat::zeros(1, 4, CV_32SC1)));
+}
+
+
+TEST_CASE( "Triangulate into caller owned buffers.", "[Triangulate Tests]" ) {
+
+  cv::Mat leftIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  leftIntrinsic.at<double>(0, 0) = 2012.186314;
+  leftIntrinsic.at<double>(1, 1) = 2017.966019;
+  leftIntrinsic.at<double>(0, 2) = 944.7173708;
+  leftIntrinsic.at<double>(1, 2) = 617.1093984;
+
+  cv::Mat rightIntrinsic = cv::Mat::eye(3, 3, CV_64FC1);
+  rightIntrinsic.at<double>(0, 0) = 2037.233928;
+  rightIntrinsic.at<double>(1, 1) = 2052.018948;
+  rightIntrinsic.at<double>(0, 2) = 1051.112809;
+  rightIntrinsic.at<double>(1, 2) = 548.0675962;
+
+  cv::Mat leftToRightRotation = cv::Mat::eye(3, 3, CV_64FC1);
+  cv::Mat leftToRightTranslation = cv::Mat::zeros(3, 1, CV_64FC1);
+  leftToRightTranslation.at<double>(0, 0) = -4.631472;
+
+  sks::StereoRig rig(leftIntrinsic, rightIntrinsic, leftToRightRotation, leftToRightTranslation);
+
+  int numberOfPoints = 100;
+  cv::Mat pointsIn2D = cv::Mat(numberOfPoints, 4, CV_64FC1);
+  cv::RNG rng(4);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    pointsIn2D.at<double>(i, 0) = rng.uniform(0.0, 1920.0);
+    pointsIn2D.at<double>(i, 1) = rng.uniform(0.0, 1080.0);
+    pointsIn2D.at<double>(i, 2) = pointsIn2D.at<double>(i, 0) + rng.uniform(20.0, 150.0);
+    pointsIn2D.at<double>(i, 3) = pointsIn2D.at<double>(i, 1) + rng.uniform(-70.0, -60.0);
+  }
+
+  cv::Mat expected = rig.triangulatePointsUsingHartley(pointsIn2D);
+
+  // Reused from one call to the next, while capacity allows.
+  cv::Mat buffer;
+  rig.triangulatePointsUsingHartley(pointsIn2D, buffer);
+  unsigned char* data = buffer.data;
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(expected, buffer) == 0);
+
+  rig.triangulatePointsUsingHartley(pointsIn2D.rowRange(0, 50), buffer);
+  REQUIRE(buffer.rows == 50);
+  REQUIRE(buffer.data == data);
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(expected.rowRange(0, 50), buffer) == 0);
+
+  // Written straight into columns of a bigger matrix, as ReconstructPointsUsingStoyanov does.
+  cv::Mat wider = cv::Mat::zeros(numberOfPoints, 7, CV_64FC1);
+  cv::Mat view = wider.colRange(0, 3);
+  rig.triangulatePointsUsingHartley(pointsIn2D, view);
+  REQUIRE(view.data == wider.data);
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(expected, wider.colRange(0, 3)) == 0);
+
+  REQUIRE_THROWS(rig.triangulatePointsUsingHartley(pointsIn2D, pointsIn2D));
+}
+
+
+TEST_CASE( "Distorted points triangulate in one pass.", "[Triangulate Tests]" ) {
+
+  cv::Mat leftIntrinsic = (cv::Mat_<double>(3, 3) << 2012.186314, 0, 944.7173708, 0, 2017.966019, 617.1093984, 0, 0, 1);
+  cv::Mat rightIntrinsic = (cv::Mat_<double>(3, 3) << 2037.233928, 0, 1051.112809, 0, 2052.018948, 548.0675962, 0, 0, 1);
+  cv::Mat leftDistortion = (cv::Mat_<double>(1, 5) << -0.32, 0.12, 0.001, -0.002, 0.01);
+  cv::Mat rightDistortion = (cv::Mat_<double>(1, 4) << -0.28, 0.09, -0.001, 0.0015);
+
+  cv::Mat leftToRightRotation;
+  cv::Rodrigues((cv::Mat_<double>(3, 1) << 0.01, -0.02, 0.005), leftToRightRotation);
+  cv::Mat leftToRightTranslation = (cv::Mat_<double>(3, 1) << -4.631472, 0.1, 0.2);
+
+  sks::StereoRig rig(leftIntrinsic, leftDistortion, rightIntrinsic, rightDistortion,
+                     leftToRightRotation, leftToRightTranslation);
+
+  // Known points, projected through the distortion, so the answer is known.
+  int numberOfPoints = 1003;
+  std::vector<cv::Point3d> expectedPoints;
+  cv::RNG rng(5);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    expectedPoints.push_back(cv::Point3d(rng.uniform(-20.0, 20.0), rng.uniform(-15.0, 15.0), rng.uniform(60.0, 120.0)));
+  }
+
+  std::vector<cv::Point2d> leftPoints;
+  std::vector<cv::Point2d> rightPoints;
+  cv::Mat leftToRightRotationVector;
+  cv::Rodrigues(leftToRightRotation, leftToRightRotationVector);
+  cv::projectPoints(expectedPoints, cv::Mat::zeros(3, 1, CV_64FC1), cv::Mat::zeros(3, 1, CV_64FC1),
+                    leftIntrinsic, leftDistortion, leftPoints);
+  cv::projectPoints(expectedPoints, leftToRightRotationVector, leftToRightTranslation,
+                    rightIntrinsic, rightDistortion, rightPoints);
+
+  cv::Mat distortedPoints(numberOfPoints, 4, CV_64FC1);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    distortedPoints.at<double>(i, 0) = leftPoints[i].x;
+    distortedPoints.at<double>(i, 1) = leftPoints[i].y;
+    distortedPoints.at<double>(i, 2) = rightPoints[i].x;
+    distortedPoints.at<double>(i, 3) = rightPoints[i].y;
+  }
+  cv::Mat expected = cv::Mat(expectedPoints).reshape(1, numberOfPoints);
+
+  cv::Mat midpoint = rig.triangulateDistortedPointsUsingMidpointOfShortestDistance(distortedPoints);
+  cv::Mat hartley = rig.triangulateDistortedPointsUsingHartley(distortedPoints);
+
+  double rmsMidpoint = sks::ComputeRMSBetweenCorrespondingPoints(expected, midpoint);
+  double rmsHartley = sks::ComputeRMSBetweenCorrespondingPoints(expected, hartley);
+  std::cerr << "Distorted, rmsMidpoint=" << rmsMidpoint << ", rmsHartley=" << rmsHartley << std::endl;
+  REQUIRE(rmsMidpoint < 0.01);
+  REQUIRE(rmsHartley < 0.01);
+
+  // Same answer as undistorting first, in a separate pass.
+  std::vector<cv::Point2d> leftUndistorted;
+  std::vector<cv::Point2d> rightUndistorted;
+  cv::undistortPoints(leftPoints, leftUndistorted, leftIntrinsic, leftDistortion, cv::noArray(), leftIntrinsic);
+  cv::undistortPoints(rightPoints, rightUndistorted, rightIntrinsic, rightDistortion, cv::noArray(), rightIntrinsic);
+  cv::Mat undistortedPoints(numberOfPoints, 4, CV_64FC1);
+  for (int i = 0; i < numberOfPoints; i++)
+  {
+    undistortedPoints.at<double>(i, 0) = leftUndistorted[i].x;
+    undistortedPoints.at<double>(i, 1) = leftUndistorted[i].y;
+    undistortedPoints.at<double>(i, 2) = rightUndistorted[i].x;
+    undistortedPoints.at<double>(i, 3) = rightUndistorted[i].y;
+  }
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(rig.triangulatePointsUsingHartley(undistortedPoints), hartley) < 1e-6);
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(
+    sks::TriangulatePointsUsingMidpointOfShortestDistance(distortedPoints,
+                                                          leftIntrinsic, leftDistortion,
+                                                          rightIntrinsic, rightDistortion,
+                                                          leftToRightRotation, leftToRightTranslation),
+    midpoint) == 0);
+
+  // Float is vectorised, like the undistorted version.
+  cv::Mat distortedPoints32;
+  distortedPoints.convertTo(distortedPoints32, CV_32FC1);
+  cv::Mat midpoint32 = rig.triangulateDistortedPointsUsingMidpointOfShortestDistance(distortedPoints32);
+  REQUIRE(midpoint32.type() == CV_32FC1);
+  cv::Mat midpoint32AsDouble;
+  midpoint32.convertTo(midpoint32AsDouble, CV_64FC1);
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(midpoint, midpoint32AsDouble) < 0.01);
+
+  // Without distortion, the two methods agree.
+  sks::StereoRig undistortedRig(leftIntrinsic, rightIntrinsic, leftToRightRotation, leftToRightTranslation);
+  REQUIRE(cv::countNonZero(undistortedRig.getLeftDistortionCoefficients()) == 0);
+  REQUIRE(sks::ComputeRMSBetweenCorrespondingPoints(
+    undistortedRig.triangulateDistortedPointsUsingHartley(undistortedPoints),
+    undistortedRig.triangulatePointsUsingHartley(undistortedPoints)) == 0);
+
+  REQUIRE(rig.getLeftDistortionCoefficients().cols == 8);
+  REQUIRE(rig.getRightDistortionCoefficients().at<double>(3) == 0.0015);
+  REQUIRE_THROWS(sks::StereoRig(leftIntrinsic, cv::Mat::zeros(1, 3, CV_64FC1), rightIntrinsic, rightDistortion,
+                                leftToRightRotation, leftToRightTranslation));
+  REQUIRE_THROWS(sks::StereoRig(leftIntrinsic, leftDistortion, rightIntrinsic, cv::Mat::zeros(2, 4, CV_64FC1),
+                                leftToRightRotation, leftToRightTranslation));
+}